@@ -416,6 +416,10 @@ int CABSCamera::Initialize()
   nRet = CreateProperty(MM::g_Keyword_CameraID, serialNumberStream.str().c_str(), MM::String, true);
   assert(nRet == DEVICE_OK);
 
+  // transpose properties are applied by the camera, not by the Core
+  nRet = CreateProperty(MM::g_Keyword_Transpose_InCamera, "1", MM::Integer, true);
+  assert(nRet == DEVICE_OK);
+
   // binning
   CPropertyAction *pAct = new CPropertyAction (this, &CABSCamera::OnBinning);
   nRet = CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct);
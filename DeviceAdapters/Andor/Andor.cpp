@@ -4357,40 +4357,52 @@ int AndorCamera::GetCameraAcquisitionProgress(at_32* series)
      if(validLast > sequenceLength_) 
             validLast = sequenceLength_; //don't push more images at the circular buffer than are in the sequence.  
 
-      int retCode;
-      short*  imagePtr = fullFrameBuffer_;
-      for(int i=validFirst; i<=validLast; i++)
-      {
-
-         // create metadata
-         char label[MM::MaxStrLength];
-         this->GetLabel(label);
+      if (validLast < validFirst)
+         return DEVICE_OK;
 
+      // Insert all retrieved images in one call, each with its own metadata
+      const unsigned numImages = validLast - validFirst + 1;
+      std::vector<std::string> serializedMetadata(numImages);
+      std::vector<const char*> frameMetadata(numImages);
+      for (unsigned i = 0; i < numImages; i++)
+      {
          Metadata md;
          AddMetadataInfo(md);
-
          imageCounter_++;
-
-         // This method inserts new image in the circular buffer (residing in MMCore)
-         retCode = GetCoreCallback()->InsertImage(this, (unsigned char*) imagePtr,
+         serializedMetadata[i] = md.Serialize();
+         frameMetadata[i] = serializedMetadata[i].c_str();
+      }
+
+      unsigned numInserted = 0;
+      int retCode = GetCoreCallback()->InsertImages(this,
+         (unsigned char*) fullFrameBuffer_, numImages,
+         width,
+         height,
+         bytesPerPixel,
+         1,
+         "",
+         &frameMetadata[0],
+         &numInserted);
+
+      if (!stopOnOverflow_ && DEVICE_BUFFER_OVERFLOW == retCode &&
+            numInserted < numImages)
+      {
+         // do not stop on overflow - just reset the buffer and insert the
+         // frames that were rejected
+         const unsigned long frameBytes =
+            (unsigned long)width * height * bytesPerPixel;
+         GetCoreCallback()->ClearImageBuffer(this);
+         GetCoreCallback()->InsertImages(this,
+            (unsigned char*) fullFrameBuffer_ + numInserted * frameBytes,
+            numImages - numInserted,
             width,
             height,
             bytesPerPixel,
-            md.Serialize().c_str());
-
-         if (!stopOnOverflow_ && DEVICE_BUFFER_OVERFLOW == retCode)
-         {
-            // do not stop on overflow - just reset the buffer
-            GetCoreCallback()->ClearImageBuffer(this);
-            GetCoreCallback()->InsertImage(this, (unsigned char*) imagePtr,
-               width,
-               height,
-               bytesPerPixel,
-               md.Serialize().c_str(),
-               false);
-         }
-
-         imagePtr += width*height;
+            1,
+            "",
+            &frameMetadata[numInserted],
+            0,
+            false);
       }
 
       return DEVICE_OK;
@@ -29,6 +29,7 @@
 #include "../../MMDevice/ModuleInterface.h"
 #include <sstream>
 #include <algorithm>
+#include <new>
 #include "WriteCompactTiffRGB.h"
 #include <iostream>
 
@@ -244,7 +245,11 @@ CDemoCamera::CDemoCamera() :
    nComponents_(1),
    mode_(MODE_ARTIFICIAL_WAVES),
    imgManpl_(0),
-   pcf_(1.0)
+   pcf_(1.0),
+   frameBankSize_(0),
+   frameBankMemoryMB_(512),
+   targetFrameRate_(0.0),
+   frameBankIndex_(0)
 {
    memset(testProperty_,0,sizeof(testProperty_));
 
@@ -505,6 +510,22 @@ int CDemoCamera::Initialize()
    CreateFloatProperty(propName.c_str(), pcf_, false, pAct);
    SetPropertyLimits(propName.c_str(), 0.4, 4.0);
 
+   // Number of precomputed frames to cycle through (0 to generate each frame)
+   pAct = new CPropertyAction(this, &CDemoCamera::OnFrameBankSize);
+   CreateIntegerProperty("FrameBankSize", 0, false, pAct);
+   SetPropertyLimits("FrameBankSize", 0, 256);
+
+   // Memory available to the frame bank; fewer frames are precomputed if
+   // FrameBankSize frames do not fit
+   pAct = new CPropertyAction(this, &CDemoCamera::OnFrameBankMemoryMB);
+   CreateIntegerProperty("FrameBankMemoryMB", frameBankMemoryMB_, false, pAct);
+   SetPropertyLimits("FrameBankMemoryMB", 1, 8192);
+
+   // Frame rate of sequence acquisitions (0 to follow the exposure time)
+   pAct = new CPropertyAction(this, &CDemoCamera::OnTargetFrameRate);
+   CreateFloatProperty("TargetFrameRate", 0.0, false, pAct);
+   SetPropertyLimits("TargetFrameRate", 0.0, 100000.0);
+
    // Simulate application crash
    pAct = new CPropertyAction(this, &CDemoCamera::OnCrash);
    CreateStringProperty("SimulateCrash", "", false, pAct);
@@ -575,7 +596,14 @@ int CDemoCamera::SnapImage()
       exp = GetSequenceExposure();
    }
 
-   if (!fastImage_)
+   if (frameBankSize_ > 0 && !IsFrameBankValid())
+      BuildFrameBank(exp);
+   if (!frameBank_.empty())
+   {
+      MMThreadGuard g(imgPixelsLock_);
+      img_.SetPixels(NextBankFrame());
+   }
+   else if (!fastImage_)
    {
       GenerateSyntheticImage(img_, exp);
    }
@@ -1050,6 +1078,8 @@ int CDemoCamera::StartSequenceAcquisition(long numImages, double interval_ms, bo
    int ret = GetCoreCallback()->PrepareForAcq(this);
    if (ret != DEVICE_OK)
       return ret;
+   if (frameBankSize_ > 0)
+      BuildFrameBank(GetExposure());
    sequenceStartTime_ = GetCurrentMMTime();
    imageCounter_ = 0;
    thd_->Start(numImages,interval_ms);
@@ -1061,6 +1091,15 @@ int CDemoCamera::StartSequenceAcquisition(long numImages, double interval_ms, bo
  * Inserts Image and MetaData into MMCore circular Buffer
  */
 int CDemoCamera::InsertImage()
+{
+   MMThreadGuard g(imgPixelsLock_);
+   return InsertFrame(GetImageBuffer());
+}
+
+/*
+ * Inserts the given pixels (of the current image size) with metadata
+ */
+int CDemoCamera::InsertFrame(const unsigned char* pI)
 {
    MM::MMTime timeStamp = this->GetCurrentMMTime();
    char label[MM::MaxStrLength];
@@ -1076,14 +1115,7 @@ int CDemoCamera::InsertImage()
 
    imageCounter_++;
 
-   char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_Binning, buf);
-   md.put(MM::g_Keyword_Binning, buf);
-
-   MMThreadGuard g(imgPixelsLock_);
-
-   const unsigned char* pI;
-   pI = GetImageBuffer();
+   md.put(MM::g_Keyword_Binning, CDeviceUtils::ConvertToString(binSize_));
 
    unsigned int w = GetImageWidth();
    unsigned int h = GetImageHeight();
@@ -1122,19 +1154,31 @@ int CDemoCamera::RunSequenceOnThread(MM::MMTime startTime)
 
    double exposure = GetSequenceExposure();
 
-   if (!fastImage_)
+   const unsigned char* bankFrame = 0;
+   if (!frameBank_.empty())
+   {
+      bankFrame = NextBankFrame();
+   }
+   else if (!fastImage_)
    {
       GenerateSyntheticImage(img_, exposure);
    }
 
-   // Simulate exposure duration
-   double finishTime = exposure * (imageCounter_ + 1);
-   while ((GetCurrentMMTime() - startTime).getMsec() < finishTime)
+   // Simulate exposure duration, or pace frames at the target rate
+   double frameIntervalMs = exposure;
+   if (targetFrameRate_ > 0.0)
+      frameIntervalMs = 1000.0 / targetFrameRate_;
+   double finishTime = frameIntervalMs * (imageCounter_ + 1);
+   double elapsedMs;
+   while ((elapsedMs = (GetCurrentMMTime() - startTime).getMsec()) < finishTime)
    {
-      CDeviceUtils::SleepMs(1);
+      // Sleeping has millisecond resolution at best, so spin on the last
+      // few milliseconds when pacing at a target rate
+      if (targetFrameRate_ <= 0.0 || finishTime - elapsedMs > 2.0)
+         CDeviceUtils::SleepMs(1);
    }
 
-   ret = InsertImage();
+   ret = bankFrame ? InsertFrame(bankFrame) : InsertImage();
 
    if (ret != DEVICE_OK)
    {
@@ -1873,6 +1917,52 @@ int CDemoCamera::OnPCF(MM::PropertyBase* pProp, MM::ActionType eAct)
 }
 
 
+int CDemoCamera::OnFrameBankSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(frameBankSize_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      pProp->Get(frameBankSize_);
+      frameBank_.clear();
+   }
+   return DEVICE_OK;
+}
+
+int CDemoCamera::OnFrameBankMemoryMB(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(frameBankMemoryMB_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      pProp->Get(frameBankMemoryMB_);
+      frameBank_.clear();
+   }
+   return DEVICE_OK;
+}
+
+int CDemoCamera::OnTargetFrameRate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(targetFrameRate_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(targetFrameRate_);
+   }
+   return DEVICE_OK;
+}
+
+
 int CDemoCamera::OnCrash(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    AddAllowedValue("SimulateCrash", "");
@@ -2358,6 +2448,83 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
 }
 
 
+/**
+* Returns the number of frames of the current image format to precompute:
+* FrameBankSize, or as many as fit in FrameBankMemoryMB. Zero means that
+* frames are generated as they are acquired.
+*/
+unsigned CDemoCamera::FrameBankFrameCount() const
+{
+   if (frameBankSize_ <= 0)
+      return 0;
+   const double frameBytes =
+      (double) img_.Width() * img_.Height() * img_.Depth();
+   if (frameBytes <= 0.0)
+      return 0;
+   const double fitting = floor(frameBankMemoryMB_ * 1048576.0 / frameBytes);
+   return (unsigned) std::min((double) frameBankSize_, fitting);
+}
+
+/**
+* Returns true if the frame bank matches the current image format.
+*/
+bool CDemoCamera::IsFrameBankValid() const
+{
+   if (frameBank_.empty())
+      return FrameBankFrameCount() == 0;
+   return frameBank_.size() == FrameBankFrameCount() &&
+      frameBank_[0].Compatible(img_);
+}
+
+/**
+* Precomputes the frames cycled through when FrameBankSize is nonzero.
+*
+* The frames are generated once in the current mode, so that sequence
+* acquisitions are not limited by the cost of generating images. Properties
+* that affect the image content take effect when the bank is rebuilt at the
+* start of the next sequence acquisition. The bank is kept within
+* FrameBankMemoryMB; if not even one frame fits, frames are generated as
+* they are acquired.
+*/
+void CDemoCamera::BuildFrameBank(double exp)
+{
+   frameBank_.clear();
+   frameBankIndex_ = 0;
+   const unsigned frameCount = FrameBankFrameCount();
+   if (frameBankSize_ > 0 && frameCount < (unsigned) frameBankSize_)
+   {
+      std::ostringstream os;
+      os << "Frame bank limited to " << frameCount << " of " <<
+         frameBankSize_ << " frames by FrameBankMemoryMB";
+      LogMessage(os.str().c_str(), true);
+   }
+   if (frameCount == 0)
+      return;
+
+   try
+   {
+      frameBank_.resize(frameCount);
+      for (std::vector<ImgBuffer>::iterator it = frameBank_.begin();
+            it != frameBank_.end(); ++it)
+      {
+         it->Resize(img_.Width(), img_.Height(), img_.Depth());
+         it->ResetPixels();
+         GenerateSyntheticImage(*it, exp);
+      }
+   }
+   catch (const std::bad_alloc&)
+   {
+      // Generate frames as they are acquired instead
+      frameBank_.clear();
+      LogMessage("Not enough memory for the frame bank", false);
+   }
+}
+
+const unsigned char* CDemoCamera::NextBankFrame()
+{
+   return frameBank_[frameBankIndex_++ % frameBank_.size()].GetPixels();
+}
+
 bool CDemoCamera::GenerateColorTestPattern(ImgBuffer& img)
 {
    unsigned width = img.Width(), height = img.Height();
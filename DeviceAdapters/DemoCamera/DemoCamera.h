@@ -197,6 +197,9 @@ public:
    int OnIsSequenceable(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnMode(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnPCF(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFrameBankSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFrameBankMemoryMB(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTargetFrameRate(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnCrash(MM::PropertyBase* pProp, MM::ActionType eAct);
 
    // Special public DemoCamera methods
@@ -214,6 +217,11 @@ private:
    void GenerateEmptyImage(ImgBuffer& img);
    void GenerateSyntheticImage(ImgBuffer& img, double exp);
    bool GenerateColorTestPattern(ImgBuffer& img);
+   unsigned FrameBankFrameCount() const;
+   bool IsFrameBankValid() const;
+   void BuildFrameBank(double exp);
+   const unsigned char* NextBankFrame();
+   int InsertFrame(const unsigned char* pI);
    int ResizeImageBuffer();
 
    static const double nominalPixelSizeUm_;
@@ -268,6 +276,11 @@ private:
    int mode_;
    ImgManipulator* imgManpl_;
    double pcf_;
+   long frameBankSize_;
+   long frameBankMemoryMB_;
+   double targetFrameRate_;
+   std::vector<ImgBuffer> frameBank_;
+   unsigned long frameBankIndex_;
 };
 
 class MySequenceThread : public MMDeviceThreadBase
@@ -169,7 +169,7 @@ BoolSetting::HandleEdgeTrigger()
 
    GetLogger()->SetBool(GetDevice()->GetDeviceName(), GetName(),
          static_cast<bool>(newValue));
-   FirePostSetSignal();
+   FirePostSetSignal(true);
 }
 
 
@@ -373,7 +373,7 @@ IntegerSetting::HandleEdgeTrigger()
       nextTriggerIndex_ = 0;
 
    GetLogger()->SetInteger(GetDevice()->GetDeviceName(), GetName(), newValue);
-   FirePostSetSignal();
+   FirePostSetSignal(true);
 }
 
 
@@ -539,7 +539,7 @@ FloatSetting::HandleEdgeTrigger()
       nextTriggerIndex_ = 0;
 
    GetLogger()->SetFloat(GetDevice()->GetDeviceName(), GetName(), newValue);
-   FirePostSetSignal();
+   FirePostSetSignal(true);
 }
 
 
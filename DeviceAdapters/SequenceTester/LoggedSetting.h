@@ -63,6 +63,7 @@ class LoggedSetting : public boost::enable_shared_from_this<LoggedSetting>
    boost::shared_ptr<CountDownSetting> busySetting_;
 
    boost::signals2::signal<void ()> postSetSignal_;
+   boost::signals2::signal<void ()> postUntriggeredSetSignal_;
 
    // Zero is interpreted as triggering disabled
    boost::shared_ptr<IntegerSetting> sequenceMaxLengthSetting_;
@@ -78,7 +79,12 @@ protected:
    const InterDevice* GetDevice() const { return device_; }
    std::string GetName() const { return name_; }
 
-   void FirePostSetSignal() { postSetSignal_(); }
+   void FirePostSetSignal(bool triggered = false)
+   {
+      postSetSignal_();
+      if (!triggered)
+         postUntriggeredSetSignal_();
+   }
 
 public:
    typedef boost::shared_ptr<Self> Ptr;
@@ -94,6 +100,9 @@ public:
 
    typedef boost::signals2::signal<void ()> PostSetSignal;
    PostSetSignal& GetPostSetSignal() { return postSetSignal_; }
+   // Only fired when the value is set directly, not by an edge trigger
+   PostSetSignal& GetPostUntriggeredSetSignal()
+   { return postUntriggeredSetSignal_; }
 
    void SetSequenceMaxLengthSetting(boost::shared_ptr<IntegerSetting> setting)
    { sequenceMaxLengthSetting_ = setting; }
@@ -106,6 +115,7 @@ public:
 
    virtual int StartTriggerSequence() { return DEVICE_UNSUPPORTED_COMMAND; }
    virtual int StopTriggerSequence() { return DEVICE_UNSUPPORTED_COMMAND; }
+   virtual bool IsTriggerSequenceRunning() const { return false; }
 
    // Called when the trigger is received _and_ triggering is enabled (sequence
    // max length setting is > 0), but regardless of whether a trigger sequence
@@ -140,6 +150,7 @@ public:
    int SetTriggerSequence(const std::vector<uint8_t>& sequence);
    virtual int StartTriggerSequence();
    virtual int StopTriggerSequence();
+   virtual bool IsTriggerSequenceRunning() const { return sequenceRunning_; }
    virtual void HandleEdgeTrigger();
 
    enum PropertyDisplay
@@ -191,6 +202,7 @@ public:
    int SetTriggerSequence(const std::vector<long>& sequence);
    virtual int StartTriggerSequence();
    virtual int StopTriggerSequence();
+   virtual bool IsTriggerSequenceRunning() const { return sequenceRunning_; }
    virtual void HandleEdgeTrigger();
 
    MM::ActionFunctor* NewPropertyAction();
@@ -237,6 +249,7 @@ public:
    int SetTriggerSequence(const std::vector<double>& sequence);
    virtual int StartTriggerSequence();
    virtual int StopTriggerSequence();
+   virtual bool IsTriggerSequenceRunning() const { return sequenceRunning_; }
    virtual void HandleEdgeTrigger();
 
    MM::ActionFunctor* NewPropertyAction();
@@ -23,6 +23,7 @@
 
 #include "SequenceTester.h"
 #include "SequenceTesterImpl.h"
+#include "SimulatedTiming.h"
 
 #include "ModuleInterface.h"
 
@@ -31,6 +32,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/unordered_map.hpp>
+#include <algorithm>
 #include <exception>
 #include <string>
 #include <utility>
@@ -143,7 +145,8 @@ DeleteDevice(MM::Device* pDevice)
 
 
 TesterHub::TesterHub(const std::string& name) :
-   Super(name)
+   Super(name),
+   triggerReadyTime_(boost::posix_time::neg_infin)
 {
 }
 
@@ -239,6 +242,16 @@ TesterHub::FindPeerDevice(const std::string& name)
 }
 
 
+void
+TesterHub::DelayTriggerReady(double ms)
+{
+   boost::system_time readyTime =
+      boost::get_system_time() + DurationFromMs(ms);
+   if (readyTime > triggerReadyTime_)
+      triggerReadyTime_ = readyTime;
+}
+
+
 TesterCamera::TesterCamera(const std::string& name) :
    Super(name),
    produceHumanReadableImages_(true),
@@ -299,6 +312,15 @@ TesterCamera::Initialize()
    CreateFloatProperty("Exposure", exposureSetting_);
    CreateIntegerProperty("Binning", binningSetting_);
 
+   // When simulating timing, each frame takes the exposure time plus the
+   // readout time, and does not start before triggered devices are ready
+   simulateTiming_ = BoolSetting::New(GetLogger(), this, "SimulateTiming",
+         false);
+   readoutTimeMs_ = FloatSetting::New(GetLogger(), this, "ReadoutTimeMs",
+         0.0, true, 0.0, 10000.0);
+   CreateYesNoProperty("SimulateTiming", simulateTiming_);
+   CreateFloatProperty("ReadoutTimeMs", readoutTimeMs_);
+
    RegisterEdgeTriggerSource("ExposureStartEdge", exposureStartEdgeTrigger_);
    RegisterEdgeTriggerSource("ExposureStopEdge", exposureStopEdgeTrigger_);
 
@@ -309,11 +331,18 @@ TesterCamera::Initialize()
 int
 TesterCamera::SnapImage()
 {
-   TesterHub::Guard g(GetHub()->LockGlobalMutex());
+   boost::system_time exposureStart;
+   double readoutMs = SimulateExposure(boost::get_system_time(),
+         exposureStart);
 
-   delete[] snapImage_;
-   snapImage_ = GenerateLogImage(false, nextSnapImageNr_++);
+   {
+      TesterHub::Guard g(GetHub()->LockGlobalMutex());
 
+      delete[] snapImage_;
+      snapImage_ = GenerateLogImage(false, nextSnapImageNr_++);
+   }
+
+   SleepUntil(boost::get_system_time() + DurationFromMs(readoutMs));
    return DEVICE_OK;
 }
 
@@ -408,22 +437,24 @@ TesterCamera::GetROI(unsigned& x, unsigned& y, unsigned& w, unsigned& h)
 
 
 int
-TesterCamera::StartSequenceAcquisition(long count, double, bool stopOnOverflow)
+TesterCamera::StartSequenceAcquisition(long count, double intervalMs,
+      bool stopOnOverflow)
 {
-   return StartSequenceAcquisitionImpl(true, count, stopOnOverflow);
+   return StartSequenceAcquisitionImpl(true, count, intervalMs,
+         stopOnOverflow);
 }
 
 
 int
-TesterCamera::StartSequenceAcquisition(double)
+TesterCamera::StartSequenceAcquisition(double intervalMs)
 {
-   return StartSequenceAcquisitionImpl(false, 0, false);
+   return StartSequenceAcquisitionImpl(false, 0, intervalMs, false);
 }
 
 
 int
 TesterCamera::StartSequenceAcquisitionImpl(bool finite, long count,
-      bool stopOnOverflow)
+      double intervalMs, bool stopOnOverflow)
 {
    // There is no need to acquire the hub-global mutex here; no data protected
    // by it is accessed in this function.
@@ -440,7 +471,7 @@ TesterCamera::StartSequenceAcquisitionImpl(bool finite, long count,
    // Note: boost::packaged_task<void ()> in more recent versions of Boost.
    boost::packaged_task<void> captureTask(
          boost::bind(&TesterCamera::SendSequence, this,
-            finite, count, stopOnOverflow));
+            finite, count, intervalMs, stopOnOverflow));
    sequenceFuture_ = captureTask.get_future();
 
    boost::thread captureThread(boost::move(captureTask));
@@ -493,6 +524,32 @@ TesterCamera::IsCapturing()
 }
 
 
+double
+TesterCamera::SimulateExposure(boost::system_time notBefore,
+      boost::system_time& exposureStart)
+{
+   double exposureMs;
+   double readoutMs;
+   {
+      TesterHub::Guard g(GetHub()->LockGlobalMutex());
+
+      exposureStart = std::max(notBefore, boost::get_system_time());
+      if (!simulateTiming_->Get())
+         return 0.0;
+
+      exposureMs = exposureSetting_->Get();
+      readoutMs = readoutTimeMs_->Get();
+      exposureStart = std::max(exposureStart,
+            GetHub()->GetTriggerReadyTime());
+   }
+
+   // The exposure edge triggers are sent (by GenerateLogImage()) at the end
+   // of the exposure, so that triggered devices switch during the readout.
+   SleepUntil(exposureStart + DurationFromMs(exposureMs));
+   return readoutMs;
+}
+
+
 const unsigned char*
 TesterCamera::GenerateLogImage(bool isSequenceImage, size_t cumulativeNr,
       size_t frameNr)
@@ -524,7 +581,8 @@ TesterCamera::GenerateLogImage(bool isSequenceImage, size_t cumulativeNr,
 
 
 void
-TesterCamera::SendSequence(bool finite, long count, bool stopOnOverflow)
+TesterCamera::SendSequence(bool finite, long count, double intervalMs,
+      bool stopOnOverflow)
 {
    MM::Core* core = GetCoreCallback();
 
@@ -541,6 +599,9 @@ TesterCamera::SendSequence(bool finite, long count, bool stopOnOverflow)
    unsigned height = GetImageHeight();
    unsigned bytesPerPixel = GetImageBytesPerPixel();
 
+   // Earliest start of the next frame's exposure, given the interval
+   boost::system_time nextFrameTime = boost::get_system_time();
+
    for (long frame = 0; !finite || frame < count; ++frame)
    {
       {
@@ -549,6 +610,10 @@ TesterCamera::SendSequence(bool finite, long count, bool stopOnOverflow)
             break;
       }
 
+      boost::system_time exposureStart;
+      double readoutMs = SimulateExposure(nextFrameTime, exposureStart);
+      nextFrameTime = exposureStart + DurationFromMs(intervalMs);
+
       delete[] bytes;
 
       {
@@ -556,6 +621,8 @@ TesterCamera::SendSequence(bool finite, long count, bool stopOnOverflow)
          bytes = GenerateLogImage(true, nextSequenceImageNr_++, frame);
       }
 
+      SleepUntil(boost::get_system_time() + DurationFromMs(readoutMs));
+
       try
       {
          int err;
@@ -665,15 +732,43 @@ TesterXYStage::Initialize()
    setYOrigin_ = OneShotSetting::New(GetLogger(), this, "SetYOrigin");
    setYOrigin_->SetBusySetting(GetBusySetting());
 
+   // Simulated timing of moves (both axes at the same speed); instantaneous by
+   // default
+   velocityUmPerSecond_ = FloatSetting::New(GetLogger(), this,
+         "VelocityUmPerSecond", 0.0, true, 0.0, 1e6);
+   accelerationUmPerSecondSquared_ = FloatSetting::New(GetLogger(), this,
+         "AccelerationUmPerSecondSquared", 0.0, true, 0.0, 1e9);
+   settleTimeMs_ = FloatSetting::New(GetLogger(), this, "SettleTimeMs",
+         0.0, true, 0.0, 10000.0);
+   CreateFloatProperty("VelocityUmPerSecond", velocityUmPerSecond_);
+   CreateFloatProperty("AccelerationUmPerSecondSquared",
+         accelerationUmPerSecondSquared_);
+   CreateFloatProperty("SettleTimeMs", settleTimeMs_);
+
    return DEVICE_OK;
 }
 
 
+void
+TesterXYStage::SimulateMove(long dxSteps, long dySteps)
+{
+   // The axes move independently and simultaneously
+   double velocity = velocityUmPerSecond_->Get();
+   double acceleration = accelerationUmPerSecondSquared_->Get();
+   double xMs = MoveTimeMs(static_cast<double>(dxSteps) / stepsPerUm,
+         velocity, acceleration);
+   double yMs = MoveTimeMs(static_cast<double>(dySteps) / stepsPerUm,
+         velocity, acceleration);
+   SetBusyForMs(std::max(xMs, yMs) + settleTimeMs_->Get());
+}
+
+
 int
 TesterXYStage::SetPositionSteps(long x, long y)
 {
    TesterHub::Guard g(GetHub()->LockGlobalMutex());
 
+   SimulateMove(x - xPositionSteps_->Get(), y - yPositionSteps_->Get());
    xPositionSteps_->MarkBusy();
    yPositionSteps_->MarkBusy();
    int err1 = xPositionSteps_->Set(x);
@@ -795,6 +890,8 @@ TesterZStage::Initialize()
          triggerInput_.GetSourcePortSetting());
    CreateIntegerProperty("TriggerSequenceMaxLength",
          triggerInput_.GetSequenceMaxLengthSetting());
+   CreateFloatProperty("TriggerLatencyMs",
+         triggerInput_.GetLatencySetting());
 
    return DEVICE_OK;
 }
@@ -1061,6 +1158,16 @@ TesterSwitcher::Initialize()
          triggerInput_.GetSourcePortSetting());
    CreateIntegerProperty("TriggerSequenceMaxLength",
          triggerInput_.GetSequenceMaxLengthSetting());
+   CreateFloatProperty("TriggerLatencyMs",
+         triggerInput_.GetLatencySetting());
+
+   // Simulated time to switch positions (when not triggered); instantaneous
+   // by default
+   switchTimeMs_ = FloatSetting::New(GetLogger(), this, "SwitchTimeMs",
+         0.0, true, 0.0, 10000.0);
+   CreateFloatProperty("SwitchTimeMs", switchTimeMs_);
+   position_->GetPostUntriggeredSetSignal().connect(
+         boost::bind(&Self::HandlePositionSet, this));
 
    return DEVICE_OK;
 }
@@ -1086,3 +1193,12 @@ TesterSwitcher::GetGateOpen(bool& open)
 {
    return gateOpen_->Get(open);
 }
+
+
+void
+TesterSwitcher::HandlePositionSet()
+{
+   TesterHub::Guard g(GetHub()->LockGlobalMutex());
+
+   SetBusyForMs(switchTimeMs_->Get());
+}
@@ -49,7 +49,10 @@ public:
    typedef TesterBase Self;
    typedef TDeviceBase<UConcreteDevice> Super;
 
-   TesterBase(const std::string& name) : InterDevice(name) {}
+   TesterBase(const std::string& name) :
+      InterDevice(name),
+      busyDeadline_(boost::posix_time::neg_infin)
+   {}
    virtual ~TesterBase() {}
 
    virtual void GetName(char* name) const;
@@ -78,8 +81,13 @@ protected:
    void CreateStringProperty(const std::string& name,
          StringSetting::Ptr setting);
 
+   // Report busy for (at least) the given time from now, in addition to the
+   // busy count. Must be called with hub global mutex held.
+   void SetBusyForMs(double ms);
+
 private:
    CountDownSetting::Ptr busySetting_;
+   boost::system_time busyDeadline_;
 };
 
 
@@ -103,6 +111,10 @@ class TesterHub : public TesterBase<HubBase, TesterHub>
 
    boost::unordered_map< std::string, boost::weak_ptr<InterDevice> > devices_;
 
+   // Earliest time at which all devices that have received an edge trigger
+   // are ready (see TriggerInput)
+   boost::system_time triggerReadyTime_;
+
 public:
    typedef TesterHub Self;
    typedef TesterBase< ::HubBase, TesterHub > Super;
@@ -124,6 +136,11 @@ public:
    int RegisterDevice(const std::string& name, InterDevice::Ptr device);
    void UnregisterDevice(const std::string& name);
    InterDevice::Ptr FindPeerDevice(const std::string& name);
+
+   // Must be called with hub global mutex held
+   void DelayTriggerReady(double ms);
+   boost::system_time GetTriggerReadyTime() const
+   { return triggerReadyTime_; }
 };
 
 
@@ -170,10 +187,18 @@ private:
    const unsigned char* GenerateLogImage(bool isSequenceImage,
          size_t cumulativeNr, size_t frameNr = 0);
 
+   // Sleep (without holding the hub global mutex) until the end of the
+   // simulated exposure of a frame starting now or at notBefore, whichever
+   // is later, if timing simulation is enabled. Returns the readout time
+   // (zero if disabled) and sets exposureStart.
+   double SimulateExposure(boost::system_time notBefore,
+         boost::system_time& exposureStart);
+
    int StartSequenceAcquisitionImpl(bool finite, long count,
-         bool stopOnOverflow);
+         double intervalMs, bool stopOnOverflow);
 
-   void SendSequence(bool finite, long count, bool stopOnOverflow);
+   void SendSequence(bool finite, long count, double intervalMs,
+         bool stopOnOverflow);
 
 private:
    bool produceHumanReadableImages_;
@@ -198,6 +223,8 @@ private:
 
    FloatSetting::Ptr exposureSetting_;
    IntegerSetting::Ptr binningSetting_;
+   BoolSetting::Ptr simulateTiming_;
+   FloatSetting::Ptr readoutTimeMs_;
 
    EdgeTriggerSignal exposureStartEdgeTrigger_;
    EdgeTriggerSignal exposureStopEdgeTrigger_;
@@ -250,8 +277,14 @@ public:
    { isSequenceable = false; return DEVICE_OK; }
 
 private:
+   // Must be called with hub global mutex held
+   void SimulateMove(long dxSteps, long dySteps);
+
    IntegerSetting::Ptr xPositionSteps_;
    IntegerSetting::Ptr yPositionSteps_;
+   FloatSetting::Ptr velocityUmPerSecond_;
+   FloatSetting::Ptr accelerationUmPerSecondSquared_;
+   FloatSetting::Ptr settleTimeMs_;
    OneShotSetting::Ptr home_;
    OneShotSetting::Ptr stop_;
    OneShotSetting::Ptr setOrigin_;
@@ -289,7 +322,13 @@ protected:
    { return zPositionUm_; }
 
 private:
+   // Must be called with hub global mutex held
+   void SimulateMove(double distanceUm);
+
    FloatSetting::Ptr zPositionUm_;
+   FloatSetting::Ptr velocityUmPerSecond_;
+   FloatSetting::Ptr accelerationUmPerSecondSquared_;
+   FloatSetting::Ptr settleTimeMs_;
    OneShotSetting::Ptr home_;
    OneShotSetting::Ptr stop_;
    OneShotSetting::Ptr originSet_;
@@ -392,4 +431,6 @@ private:
    TriggerInput triggerInput_;
    IntegerSetting::Ptr position_;
    BoolSetting::Ptr gateOpen_;
+   FloatSetting::Ptr switchTimeMs_;
+   void HandlePositionSet();
 };
@@ -26,6 +26,7 @@
 #include "SequenceTester.h"
 
 #include "LoggedSetting.h"
+#include "SimulatedTiming.h"
 
 #include "DeviceUtils.h"
 
@@ -107,7 +108,22 @@ bool
 TesterBase<TDeviceBase, UConcreteDevice>::Busy()
 {
    TesterHub::Guard g(GetHub()->LockGlobalMutex());
-   return GetBusySetting()->Get() > 0;
+   // Always query the busy count, which counts down on each query
+   bool counting = GetBusySetting()->Get() > 0;
+   return counting || boost::get_system_time() < busyDeadline_;
+}
+
+
+template <template <class> class TDeviceBase, class UConcreteDevice>
+void
+TesterBase<TDeviceBase, UConcreteDevice>::SetBusyForMs(double ms)
+{
+   if (ms <= 0.0)
+      return;
+   boost::system_time deadline =
+      boost::get_system_time() + DurationFromMs(ms);
+   if (deadline > busyDeadline_)
+      busyDeadline_ = deadline;
 }
 
 
@@ -213,15 +229,38 @@ Tester1DStageBase<TConcreteStage, UStepsPerMicrometer>::Initialize()
    originSet_ = OneShotSetting::New(Super::GetLogger(), This(), "OriginSet");
    originSet_->SetBusySetting(Super::GetBusySetting());
 
+   // Simulated timing of moves; instantaneous by default
+   velocityUmPerSecond_ = FloatSetting::New(Super::GetLogger(), This(),
+         "VelocityUmPerSecond", 0.0, true, 0.0, 1e6);
+   accelerationUmPerSecondSquared_ = FloatSetting::New(Super::GetLogger(),
+         This(), "AccelerationUmPerSecondSquared", 0.0, true, 0.0, 1e9);
+   settleTimeMs_ = FloatSetting::New(Super::GetLogger(), This(),
+         "SettleTimeMs", 0.0, true, 0.0, 10000.0);
+   Super::CreateFloatProperty("VelocityUmPerSecond", velocityUmPerSecond_);
+   Super::CreateFloatProperty("AccelerationUmPerSecondSquared",
+         accelerationUmPerSecondSquared_);
+   Super::CreateFloatProperty("SettleTimeMs", settleTimeMs_);
+
    return DEVICE_OK;
 }
 
 
+template <class TConcreteStage, long UStepsPerMicrometer>
+void
+Tester1DStageBase<TConcreteStage, UStepsPerMicrometer>::
+SimulateMove(double distanceUm)
+{
+   Super::SetBusyForMs(MoveTimeMs(distanceUm, velocityUmPerSecond_->Get(),
+            accelerationUmPerSecondSquared_->Get()) + settleTimeMs_->Get());
+}
+
+
 template <class TConcreteStage, long UStepsPerMicrometer>
 int
 Tester1DStageBase<TConcreteStage, UStepsPerMicrometer>::SetPositionUm(double pos)
 {
    TesterHub::Guard g(Super::GetHub()->LockGlobalMutex());
+   SimulateMove(pos - zPositionUm_->Get());
    zPositionUm_->MarkBusy();
    return zPositionUm_->Set(pos);
 }
@@ -241,6 +280,7 @@ int
 Tester1DStageBase<TConcreteStage, UStepsPerMicrometer>::SetPositionSteps(long steps)
 {
    TesterHub::Guard g(Super::GetHub()->LockGlobalMutex());
+   SimulateMove(0.1 * steps - zPositionUm_->Get());
    zPositionUm_->MarkBusy();
    return zPositionUm_->Set(0.1 * steps);
 }
@@ -0,0 +1,66 @@
+// Mock device adapter for testing of device sequencing
+//
+// Copyright (C) 2014 University of California, San Francisco.
+//
+// This library is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this library; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+//
+// Author: Mark Tsuchida
+
+#include "SimulatedTiming.h"
+
+#include <boost/thread.hpp>
+#include <cmath>
+
+
+boost::posix_time::time_duration
+DurationFromMs(double ms)
+{
+   if (ms <= 0.0)
+      return boost::posix_time::time_duration();
+   return boost::posix_time::microseconds(
+         static_cast<boost::int64_t>(1000.0 * ms + 0.5));
+}
+
+
+void
+SleepUntil(const boost::posix_time::ptime& time)
+{
+   if (time > boost::get_system_time())
+      boost::this_thread::sleep(time);
+}
+
+
+double
+MoveTimeMs(double distanceUm, double velocityUmPerSecond,
+      double accelerationUmPerSecondSquared)
+{
+   const double distance = std::fabs(distanceUm);
+   const double v = velocityUmPerSecond;
+   const double a = accelerationUmPerSecondSquared;
+   if (distance == 0.0 || v <= 0.0)
+      return 0.0;
+   if (a <= 0.0)
+      return 1000.0 * distance / v;
+
+   // Distance covered while accelerating to, and decelerating from, v
+   const double rampDistance = v * v / a;
+   if (distance >= rampDistance)
+      return 1000.0 * (distance / v + v / a);
+   // Triangular profile; v is never reached
+   return 1000.0 * 2.0 * std::sqrt(distance / a);
+}
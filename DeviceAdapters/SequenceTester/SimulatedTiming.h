@@ -0,0 +1,42 @@
+// Mock device adapter for testing of device sequencing
+//
+// Copyright (C) 2014 University of California, San Francisco.
+//
+// This library is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this library; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+//
+// Author: Mark Tsuchida
+
+#pragma once
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+
+// Helpers for the optional simulation of device timing. All durations are
+// in (fractional) milliseconds, as in the timing properties of the devices.
+
+boost::posix_time::time_duration DurationFromMs(double ms);
+
+// Sleep until the given time (no-op if it has passed)
+void SleepUntil(const boost::posix_time::ptime& time);
+
+// Time taken by a move of the given distance with a trapezoidal velocity
+// profile: constant acceleration up to the maximum velocity, then constant
+// deceleration to a stop. Zero velocity means the move is instantaneous; zero
+// acceleration means the maximum velocity is reached instantly.
+double MoveTimeMs(double distanceUm, double velocityUmPerSecond,
+      double accelerationUmPerSecondSquared);
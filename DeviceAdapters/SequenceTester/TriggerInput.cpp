@@ -49,6 +49,9 @@ TriggerInput::Initialize(InterDevice::Ptr device,
          device_.get(), settingNamePrefix_ + "TriggerSequenceMaxLength",
          0, false);
    sequencedSetting_->SetSequenceMaxLengthSetting(sequenceMaxLength_);
+
+   latencyMs_ = FloatSetting::New(device_->GetLogger(), device_.get(),
+         settingNamePrefix_ + "TriggerLatencyMs", 0.0, true, 0.0, 10000.0);
 }
 
 
@@ -56,6 +59,7 @@ void
 TriggerInput::UpdateTriggerConnection()
 {
    sequencedSetting_->DisconnectEdgeTriggerSource();
+   latencyConnection_.disconnect();
 
    const std::string sourceDevice = triggerSourceDevice_->Get();
    const std::string sourcePort = triggerSourcePort_->Get();
@@ -71,4 +75,17 @@ TriggerInput::UpdateTriggerConnection()
       return;
 
    sequencedSetting_->ConnectToEdgeTriggerSource(*signal);
+   latencyConnection_ = signal->connect(
+         EdgeTriggerSignal::slot_type(&TriggerInput::ReceiveEdgeTrigger, this).
+         track(device_));
+}
+
+
+void
+TriggerInput::ReceiveEdgeTrigger()
+{
+   // Called with hub global mutex held. Triggers only take effect (and cost
+   // time) while the trigger sequence is running.
+   if (sequencedSetting_->IsTriggerSequenceRunning())
+      device_->GetHub()->DelayTriggerReady(latencyMs_->Get());
 }
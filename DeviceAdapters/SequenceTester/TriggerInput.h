@@ -40,6 +40,9 @@ class TriggerInput
    StringSetting::Ptr triggerSourceDevice_;
    StringSetting::Ptr triggerSourcePort_;
    IntegerSetting::Ptr sequenceMaxLength_;
+   FloatSetting::Ptr latencyMs_;
+
+   boost::signals2::connection latencyConnection_;
 
 public:
    TriggerInput(const std::string& settingNamePrefix = "") :
@@ -57,7 +60,12 @@ public:
    { return triggerSourcePort_; }
    IntegerSetting::Ptr GetSequenceMaxLengthSetting()
    { return sequenceMaxLength_; }
+   // Simulated time taken to respond to a trigger, during which the camera
+   // does not start the next exposure (if simulating timing)
+   FloatSetting::Ptr GetLatencySetting()
+   { return latencyMs_; }
 
 private:
    void UpdateTriggerConnection();
+   void ReceiveEdgeTrigger();
 };
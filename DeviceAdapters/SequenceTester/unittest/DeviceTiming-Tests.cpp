@@ -0,0 +1,288 @@
+// Mock device adapter for testing of device sequencing
+//
+// Copyright (C) 2014 University of California, San Francisco.
+//
+// This library is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this library; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <gtest/gtest.h>
+
+#include "DeviceThreads.h"
+#include "MMDevice.h"
+#include "ModuleInterface.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+
+
+// These tests create the SequenceTester devices directly (the adapter's
+// objects are linked into the test) and check their simulated timing.
+
+namespace
+{
+
+// Minimal core callback: the hub is the parent of all devices, and inserted
+// images are only counted
+class HubCore : public MM::Core
+{
+public:
+   HubCore() : hub_(0), insertedCount_(0) {}
+
+   void SetHub(MM::Hub* hub) { hub_ = hub; }
+   long GetInsertedCount()
+   {
+      MMThreadGuard g(lock_);
+      return insertedCount_;
+   }
+
+   virtual MM::Hub* GetParentHub(const MM::Device*) const { return hub_; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*,
+         unsigned, unsigned, unsigned, const char*, const bool)
+   {
+      MMThreadGuard g(lock_);
+      ++insertedCount_;
+      return DEVICE_OK;
+   }
+
+   virtual int LogMessage(const MM::Device*, const char*, bool) const { return DEVICE_OK; }
+   virtual MM::Device* GetDevice(const MM::Device*, const char*) { return 0; }
+   virtual int GetDeviceProperty(const char*, const char*, char*) { return DEVICE_ERR; }
+   virtual int SetDeviceProperty(const char*, const char*, const char*) { return DEVICE_ERR; }
+   virtual void GetLoadedDeviceOfType(const MM::Device*, MM::DeviceType, char* name, const unsigned int) { name[0] = 0; }
+   virtual int SetSerialProperties(const char*, const char*, const char*, const char*, const char*, const char*, const char*) { return DEVICE_ERR; }
+   virtual int SetSerialCommand(const MM::Device*, const char*, const char*, const char*) { return DEVICE_ERR; }
+   virtual int GetSerialAnswer(const MM::Device*, const char*, unsigned long, char*, const char*) { return DEVICE_ERR; }
+   virtual int WriteToSerial(const MM::Device*, const char*, const unsigned char*, unsigned long) { return DEVICE_ERR; }
+   virtual int ReadFromSerial(const MM::Device*, const char*, unsigned char*, unsigned long, unsigned long&) { return DEVICE_ERR; }
+   virtual int PurgeSerial(const MM::Device*, const char*) { return DEVICE_ERR; }
+   virtual MM::PortType GetSerialPortType(const char*) const { return MM::InvalidPort; }
+   virtual int OnPropertiesChanged(const MM::Device*) { return DEVICE_OK; }
+   virtual int OnPropertyChanged(const MM::Device*, const char*, const char*) { return DEVICE_OK; }
+   virtual int OnStagePositionChanged(const MM::Device*, double) { return DEVICE_OK; }
+   virtual int OnXYStagePositionChanged(const MM::Device*, double, double) { return DEVICE_OK; }
+   virtual int OnExposureChanged(const MM::Device*, double) { return DEVICE_OK; }
+   virtual int OnSLMExposureChanged(const MM::Device*, double) { return DEVICE_OK; }
+   virtual int OnMagnifierChanged(const MM::Device*) { return DEVICE_OK; }
+   virtual unsigned long GetClockTicksUs(const MM::Device*) { return 0; }
+   virtual MM::MMTime GetCurrentMMTime() { return MM::MMTime(); }
+   virtual int AcqFinished(const MM::Device*, int) { return DEVICE_OK; }
+   virtual int PrepareForAcq(const MM::Device*) { return DEVICE_OK; }
+   virtual int InsertImage(const MM::Device*, const ImgBuffer&) { return DEVICE_ERR; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, unsigned, const char*, const bool) { return DEVICE_ERR; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, const Metadata*, const bool) { return DEVICE_ERR; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, MM::SourcePixelFormat, unsigned, unsigned, const char*, const bool) { return DEVICE_ERR; }
+   virtual int InsertImages(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, unsigned, unsigned, const char*, const char* const*, unsigned*, const bool) { return DEVICE_ERR; }
+   virtual void ClearImageBuffer(const MM::Device*) {}
+   virtual bool InitializeImageBuffer(unsigned, unsigned, unsigned int, unsigned int, unsigned int) { return true; }
+   virtual int InsertMultiChannel(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, unsigned, Metadata*) { return DEVICE_ERR; }
+   virtual const char* GetImage() { return 0; }
+   virtual int GetImageDimensions(int&, int&, int&) { return DEVICE_ERR; }
+   virtual int GetFocusPosition(double&) { return DEVICE_ERR; }
+   virtual int SetFocusPosition(double) { return DEVICE_ERR; }
+   virtual int MoveFocus(double) { return DEVICE_ERR; }
+   virtual int SetXYPosition(double, double) { return DEVICE_ERR; }
+   virtual int GetXYPosition(double&, double&) { return DEVICE_ERR; }
+   virtual int MoveXYStage(double, double) { return DEVICE_ERR; }
+   virtual int SetExposure(double) { return DEVICE_ERR; }
+   virtual int GetExposure(double&) { return DEVICE_ERR; }
+   virtual int SetConfig(const char*, const char*) { return DEVICE_ERR; }
+   virtual int GetCurrentConfig(const char*, int, char*) { return DEVICE_ERR; }
+   virtual int GetChannelConfig(char*, const unsigned int) { return DEVICE_ERR; }
+   virtual MM::ImageProcessor* GetImageProcessor(const MM::Device*) { return 0; }
+   virtual MM::AutoFocus* GetAutoFocus(const MM::Device*) { return 0; }
+   virtual MM::State* GetStateDevice(const MM::Device*, const char*) { return 0; }
+   virtual MM::SignalIO* GetSignalIODevice(const MM::Device*, const char*) { return 0; }
+   virtual void NextPostedError(int&, char*, int, int&) {}
+   virtual void PostError(const int, const char*) {}
+   virtual void ClearPostedErrors() {}
+private:
+   MM::Hub* hub_;
+   long insertedCount_;
+   MMThreadLock lock_;
+};
+
+
+class SequenceTesterTimingTests : public ::testing::Test
+{
+protected:
+   HubCore core_;
+   MM::Hub* hub_;
+   MM::Camera* camera_;
+   MM::Stage* zStage_;
+   MM::State* switcher_;
+   boost::posix_time::ptime start_;
+
+   virtual void SetUp()
+   {
+      hub_ = static_cast<MM::Hub*>(CreateDevice("THub"));
+      camera_ = static_cast<MM::Camera*>(CreateDevice("TCamera-0"));
+      zStage_ = static_cast<MM::Stage*>(CreateDevice("TZStage-0"));
+      switcher_ = static_cast<MM::State*>(CreateDevice("TSwitcher-0"));
+      core_.SetHub(hub_);
+      MM::Device* devices[] = { hub_, camera_, zStage_, switcher_ };
+      const char* labels[] = { "Hub", "Cam", "Z", "Switcher" };
+      for (int i = 0; i < 4; ++i)
+      {
+         devices[i]->SetCallback(&core_);
+         devices[i]->SetLabel(labels[i]);
+         ASSERT_EQ(DEVICE_OK, devices[i]->Initialize());
+      }
+   }
+
+   virtual void TearDown()
+   {
+      MM::Device* devices[] = { switcher_, zStage_, camera_, hub_ };
+      for (int i = 0; i < 4; ++i)
+      {
+         devices[i]->Shutdown();
+         DeleteDevice(devices[i]);
+      }
+   }
+
+   void StartTimer() { start_ = boost::posix_time::microsec_clock::universal_time(); }
+   double ElapsedMs() const
+   {
+      return (boost::posix_time::microsec_clock::universal_time() - start_).
+         total_microseconds() / 1000.0;
+   }
+
+   static void WaitForDevice(MM::Device* device)
+   {
+      while (device->Busy())
+         boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+   }
+
+   void TriggerFromCamera(MM::Device* device, const char* sequenceMaxLength)
+   {
+      ASSERT_EQ(DEVICE_OK, device->SetProperty("TriggerSourceDevice",
+               "TCamera-0"));
+      ASSERT_EQ(DEVICE_OK, device->SetProperty("TriggerSourcePort",
+               "ExposureStartEdge"));
+      ASSERT_EQ(DEVICE_OK, device->SetProperty("TriggerSequenceMaxLength",
+               sequenceMaxLength));
+   }
+
+   void AcquireSequence(long nFrames, double intervalMs)
+   {
+      const long before = core_.GetInsertedCount();
+      ASSERT_EQ(DEVICE_OK,
+            camera_->StartSequenceAcquisition(nFrames, intervalMs, true));
+      while (core_.GetInsertedCount() < before + nFrames)
+         boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      camera_->StopSequenceAcquisition();
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_F(SequenceTesterTimingTests, StageIsBusyForMoveAndSettleTime)
+{
+   ASSERT_EQ(DEVICE_OK, zStage_->SetPositionUm(0.0));
+   WaitForDevice(zStage_);
+
+   // 100 ms at constant velocity, plus 50 ms settling
+   zStage_->SetProperty("VelocityUmPerSecond", "1000");
+   zStage_->SetProperty("SettleTimeMs", "50");
+   StartTimer();
+   ASSERT_EQ(DEVICE_OK, zStage_->SetPositionUm(100.0));
+   EXPECT_TRUE(zStage_->Busy());
+   WaitForDevice(zStage_);
+   double elapsedMs = ElapsedMs();
+   EXPECT_GE(elapsedMs, 145.0);
+   EXPECT_LT(elapsedMs, 1000.0);
+}
+
+TEST_F(SequenceTesterTimingTests, SwitcherIsBusyOnlyAfterDirectSets)
+{
+   switcher_->SetProperty("SwitchTimeMs", "500");
+   StartTimer();
+   ASSERT_EQ(DEVICE_OK, switcher_->SetPosition(3L));
+   EXPECT_TRUE(switcher_->Busy());
+   WaitForDevice(switcher_);
+   EXPECT_GE(ElapsedMs(), 495.0);
+
+   TriggerFromCamera(switcher_, "4");
+   switcher_->ClearPropertySequence("State");
+   switcher_->AddToPropertySequence("State", "4");
+   switcher_->AddToPropertySequence("State", "5");
+   switcher_->AddToPropertySequence("State", "6");
+   ASSERT_EQ(DEVICE_OK, switcher_->SendPropertySequence("State"));
+   ASSERT_EQ(DEVICE_OK, switcher_->StartPropertySequence("State"));
+   AcquireSequence(3, 0.0);
+   switcher_->StopPropertySequence("State");
+
+   long position;
+   ASSERT_EQ(DEVICE_OK, switcher_->GetPosition(position));
+   EXPECT_EQ(6, position);
+   EXPECT_FALSE(switcher_->Busy());
+}
+
+TEST_F(SequenceTesterTimingTests, FramesTakeExposureAndReadoutTime)
+{
+   camera_->SetProperty("SimulateTiming", "Yes");
+   camera_->SetExposure(50.0);
+   camera_->SetProperty("ReadoutTimeMs", "20");
+
+   StartTimer();
+   ASSERT_EQ(DEVICE_OK, camera_->SnapImage());
+   double elapsedMs = ElapsedMs();
+   EXPECT_GE(elapsedMs, 69.0);
+   EXPECT_LT(elapsedMs, 500.0);
+
+   // Exposures start at the requested interval
+   StartTimer();
+   AcquireSequence(5, 100.0);
+   elapsedMs = ElapsedMs();
+   EXPECT_GE(elapsedMs, 465.0);
+   EXPECT_LT(elapsedMs, 1500.0);
+}
+
+TEST_F(SequenceTesterTimingTests, TriggerLatencyOnlyDelaysRunningSequences)
+{
+   camera_->SetProperty("SimulateTiming", "Yes");
+   camera_->SetExposure(10.0);
+   TriggerFromCamera(zStage_, "10");
+   zStage_->SetProperty("TriggerLatencyMs", "200");
+
+   // Triggering is enabled, but no stage sequence is running
+   StartTimer();
+   ASSERT_EQ(DEVICE_OK, camera_->SnapImage());
+   ASSERT_EQ(DEVICE_OK, camera_->SnapImage());
+   EXPECT_LT(ElapsedMs(), 200.0);
+
+   zStage_->ClearStageSequence();
+   zStage_->AddToStageSequence(1.0);
+   zStage_->AddToStageSequence(2.0);
+   zStage_->AddToStageSequence(3.0);
+   ASSERT_EQ(DEVICE_OK, zStage_->SendStageSequence());
+   ASSERT_EQ(DEVICE_OK, zStage_->StartStageSequence());
+   StartTimer();
+   AcquireSequence(3, 0.0);
+   double elapsedMs = ElapsedMs();
+   zStage_->StopStageSequence();
+   // The second and third exposures wait for the stage
+   EXPECT_GE(elapsedMs, 399.0);
+   EXPECT_LT(elapsedMs, 1500.0);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,66 @@
+// Mock device adapter for testing of device sequencing
+//
+// Copyright (C) 2014 University of California, San Francisco.
+//
+// This library is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by the
+// Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+// for more details.
+//
+// IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this library; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <gtest/gtest.h>
+
+#include "SimulatedTiming.h"
+
+
+TEST(MoveTimeTests, InstantaneousWithoutVelocityOrDistance)
+{
+   EXPECT_EQ(0.0, MoveTimeMs(100.0, 0.0, 1000.0));
+   EXPECT_EQ(0.0, MoveTimeMs(0.0, 1000.0, 1000.0));
+}
+
+TEST(MoveTimeTests, ConstantVelocityWithoutAcceleration)
+{
+   EXPECT_DOUBLE_EQ(100.0, MoveTimeMs(100.0, 1000.0, 0.0));
+   // Direction does not matter
+   EXPECT_DOUBLE_EQ(100.0, MoveTimeMs(-100.0, 1000.0, 0.0));
+}
+
+TEST(MoveTimeTests, TrapezoidalProfile)
+{
+   // 1000 um/s reached after 0.1 s and 50 um; 100 um at full speed in
+   // between
+   EXPECT_DOUBLE_EQ(300.0, MoveTimeMs(200.0, 1000.0, 10000.0));
+   // Exactly reaches full speed
+   EXPECT_DOUBLE_EQ(200.0, MoveTimeMs(100.0, 1000.0, 10000.0));
+}
+
+TEST(MoveTimeTests, TriangularProfileForShortMoves)
+{
+   // Accelerates over 12.5 um (0.05 s), then decelerates
+   EXPECT_DOUBLE_EQ(100.0, MoveTimeMs(25.0, 1000.0, 10000.0));
+   EXPECT_DOUBLE_EQ(100.0, MoveTimeMs(-25.0, 1000.0, 10000.0));
+}
+
+TEST(DurationTests, ConvertsFractionalMilliseconds)
+{
+   EXPECT_EQ(1500, DurationFromMs(1.5).total_microseconds());
+   EXPECT_EQ(0, DurationFromMs(0.0).total_microseconds());
+   EXPECT_EQ(0, DurationFromMs(-5.0).total_microseconds());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
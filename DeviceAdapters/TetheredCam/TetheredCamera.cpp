@@ -317,6 +317,10 @@ int CTetheredCamera::Initialize()
    nRet = CreateProperty(MM::g_Keyword_CameraID, "V1.0", MM::String, true);
    assert(nRet == DEVICE_OK);
 
+   // Transpose properties are applied here, not by the Core
+   nRet = CreateProperty(MM::g_Keyword_Transpose_InCamera, "1", MM::Integer, true);
+   assert(nRet == DEVICE_OK);
+
    // binning
    CPropertyAction *pAct = new CPropertyAction (this, &CTetheredCamera::OnBinning);
    nRet = CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct);
@@ -0,0 +1,632 @@
+// DESCRIPTION:   Runs multi-dimensional acquisitions on a Core thread
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AcquisitionEngine.h"
+
+#include "CircularBuffer.h"
+#include "Configuration.h"
+#include "CoreUtils.h"
+#include "DeviceManager.h"
+#include "Devices/CameraInstance.h"
+#include "MMCore.h"
+#include "MonotonicClock.h"
+#include "MultiROIPacker.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <map>
+
+
+namespace mm
+{
+
+Metadata
+AcquisitionEvent::GetTags() const
+{
+   Metadata md;
+   md.PutImageTag("Frame", frameIndex);
+   md.PutImageTag("FrameIndex", frameIndex);
+   md.PutImageTag("PositionIndex", positionIndex);
+   md.PutImageTag("Slice", sliceIndex);
+   md.PutImageTag("SliceIndex", sliceIndex);
+   md.PutImageTag("ChannelIndex", channelIndex);
+   md.PutImageTag("Channel",
+         channelPreset.empty() ? std::string("Default") : channelPreset);
+   if (hasXY)
+   {
+      md.PutImageTag("XPositionUm", x);
+      md.PutImageTag("YPositionUm", y);
+   }
+   if (hasZ)
+      md.PutImageTag("ZPositionUm", z);
+   if (exposureMs > 0.0)
+      md.PutImageTag("Exposure-ms", exposureMs);
+   return md;
+}
+
+
+AcquisitionEngine::AcquisitionEngine(CMMCore& core) :
+   core_(core),
+   zOrigin_(0.0),
+   lastExposureMs_(0.0),
+   hasLastZ_(false),
+   lastZ_(0.0),
+   running_(false),
+   stopRequested_(false),
+   failed_(false),
+   errorCode_(MMERR_OK)
+{
+}
+
+
+AcquisitionEngine::~AcquisitionEngine()
+{
+   Stop();
+   boost::mutex::scoped_lock threadLock(threadMutex_);
+   if (thread_.joinable())
+      thread_.join();
+}
+
+
+void
+AcquisitionEngine::Start(const AcquisitionPlan& plan) throw (CMMError)
+{
+   boost::mutex::scoped_lock threadLock(threadMutex_);
+   if (IsRunning())
+      throw CMMError("An acquisition plan is already running",
+            MMERR_NotAllowedDuringSequenceAcquisition);
+   if (thread_.joinable())
+      thread_.join();
+
+   camera_ = core_.getCameraDevice();
+   if (camera_.empty())
+      throw CMMError(core_.getCoreErrorText(MMERR_CameraNotAvailable),
+            MMERR_CameraNotAvailable);
+
+   xyStage_.clear();
+   if (plan.getNumberOfXYPositions() > 0)
+   {
+      xyStage_ = core_.getXYStageDevice();
+      if (xyStage_.empty())
+         throw CMMError("Acquisition plan has XY positions but there is no "
+               "current XY stage");
+   }
+
+   focus_.clear();
+   zOrigin_ = 0.0;
+   if (!plan.getZSlices().empty())
+   {
+      focus_ = core_.getFocusDevice();
+      if (focus_.empty())
+         throw CMMError("Acquisition plan has Z slices but there is no "
+               "current focus device");
+      if (plan.isZRelative())
+         zOrigin_ = core_.getPosition(focus_.c_str());
+   }
+
+   for (long i = 0; i < plan.getNumberOfChannels(); ++i)
+   {
+      const std::string preset = plan.getChannelPreset(i);
+      if (!core_.isConfigDefined(plan.getChannelGroup().c_str(),
+               preset.c_str()))
+         throw CMMError("Channel preset " + ToQuotedString(preset) +
+               " is not defined in group " +
+               ToQuotedString(plan.getChannelGroup()));
+   }
+
+   core_.initializeCircularBuffer();
+
+   plan_ = plan;
+   lastPreset_.clear();
+   lastExposureMs_ = 0.0;
+   hasLastZ_ = false;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      running_ = true;
+      stopRequested_ = false;
+      failed_ = false;
+      errorText_.clear();
+      errorCode_ = MMERR_OK;
+   }
+
+   LOG_INFO(core_.coreLogger_) << "Will start acquisition plan of " <<
+      plan_.getNumberOfImages() << " images";
+   boost::thread t(boost::bind(&AcquisitionEngine::Run, this));
+   thread_.swap(t);
+}
+
+
+void
+AcquisitionEngine::Stop()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (running_)
+   {
+      stopRequested_ = true;
+      stopCondition_.notify_all();
+   }
+}
+
+
+bool
+AcquisitionEngine::IsRunning() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return running_;
+}
+
+
+void
+AcquisitionEngine::Wait() throw (CMMError)
+{
+   {
+      boost::mutex::scoped_lock threadLock(threadMutex_);
+      if (thread_.joinable())
+         thread_.join();
+   }
+
+   boost::mutex::scoped_lock lock(mutex_);
+   if (failed_)
+      throw CMMError(errorText_, errorCode_);
+}
+
+
+std::vector<AcquisitionEvent>
+AcquisitionEngine::CompileBlock(const AcquisitionPlan& plan, long frameIndex,
+      long positionIndex, double zOrigin)
+{
+   const std::vector<double> zSlices = plan.getZSlices();
+   const long nSlices = std::max<long>(1, static_cast<long>(zSlices.size()));
+   const long nChannels = std::max<long>(1, plan.getNumberOfChannels());
+   const bool slicesFirst = plan.isSlicesFirst();
+
+   AcquisitionEvent event;
+   event.frameIndex = frameIndex;
+   event.positionIndex = positionIndex;
+   event.hasXY = plan.getNumberOfXYPositions() > 0;
+   event.x = event.hasXY ? plan.getXPosition(positionIndex) : 0.0;
+   event.y = event.hasXY ? plan.getYPosition(positionIndex) : 0.0;
+   event.hasZ = !zSlices.empty();
+
+   std::vector<AcquisitionEvent> events;
+   events.reserve(nSlices * nChannels);
+   const long nOuter = slicesFirst ? nChannels : nSlices;
+   const long nInner = slicesFirst ? nSlices : nChannels;
+   for (long outer = 0; outer < nOuter; ++outer)
+   {
+      for (long inner = 0; inner < nInner; ++inner)
+      {
+         event.sliceIndex = slicesFirst ? inner : outer;
+         event.channelIndex = slicesFirst ? outer : inner;
+         event.z = event.hasZ ?
+            zSlices[event.sliceIndex] + (plan.isZRelative() ? zOrigin : 0.0) :
+            0.0;
+         if (plan.getNumberOfChannels() > 0)
+         {
+            event.channelPreset = plan.getChannelPreset(event.channelIndex);
+            event.exposureMs = plan.getChannelExposure(event.channelIndex);
+         }
+         else
+         {
+            event.channelPreset.clear();
+            event.exposureMs = 0.0;
+         }
+         events.push_back(event);
+      }
+   }
+   return events;
+}
+
+
+void
+AcquisitionEngine::Run()
+{
+   try
+   {
+      const boost::int64_t startUs = MonotonicClock::NowUs();
+      const long nPositions = std::max<long>(1, plan_.getNumberOfXYPositions());
+      for (long frame = 0; frame < plan_.getNumberOfTimePoints(); ++frame)
+      {
+         const boost::int64_t frameStartUs = startUs +
+            static_cast<boost::int64_t>(frame * plan_.getTimePointIntervalMs() * 1000.0);
+         if (!WaitUntil(frameStartUs))
+            break;
+         for (long position = 0; position < nPositions && !IsStopRequested();
+               ++position)
+         {
+            RunBlock(CompileBlock(plan_, frame, position, zOrigin_));
+         }
+      }
+   }
+   catch (const CMMError& e)
+   {
+      LOG_ERROR(core_.coreLogger_) << "Acquisition plan failed: " <<
+         e.getFullMsg();
+      boost::mutex::scoped_lock lock(mutex_);
+      failed_ = true;
+      errorText_ = e.getMsg();
+      errorCode_ = e.getCode();
+   }
+   catch (const std::exception& e)
+   {
+      LOG_ERROR(core_.coreLogger_) << "Acquisition plan failed: " << e.what();
+      boost::mutex::scoped_lock lock(mutex_);
+      failed_ = true;
+      errorText_ = e.what();
+      errorCode_ = MMERR_GENERIC;
+   }
+
+   try
+   {
+      if (core_.isSequenceRunning(camera_.c_str()))
+         core_.stopSequenceAcquisition(camera_.c_str());
+   }
+   catch (const CMMError& e)
+   {
+      LOG_ERROR(core_.coreLogger_) << "Cannot stop camera after acquisition "
+         "plan: " << e.getMsg();
+   }
+   core_.cbuf_->ClearFrameTags();
+
+   boost::mutex::scoped_lock lock(mutex_);
+   LOG_INFO(core_.coreLogger_) << "Acquisition plan " <<
+      (failed_ ? "failed" : (stopRequested_ ? "stopped" : "finished"));
+   running_ = false;
+}
+
+
+void
+AcquisitionEngine::RunBlock(const std::vector<AcquisitionEvent>& events)
+   throw (CMMError)
+{
+   if (events.empty())
+      return;
+
+   if (events[0].hasXY)
+   {
+      core_.setXYPosition(xyStage_.c_str(), events[0].x, events[0].y);
+      core_.waitForDevice(xyStage_.c_str());
+   }
+
+   SequenceSetup setup;
+   if (CanSequence(events, setup))
+   {
+      RunSequenced(events, setup);
+      return;
+   }
+
+   for (std::vector<AcquisitionEvent>::const_iterator it = events.begin(),
+         end = events.end(); it != end && !IsStopRequested(); ++it)
+   {
+      RunSnapped(*it);
+   }
+}
+
+
+bool
+AcquisitionEngine::CanSequence(const std::vector<AcquisitionEvent>& events,
+      SequenceSetup& setup) throw (CMMError)
+{
+   setup.z = false;
+   setup.exposure = false;
+   setup.propertyDevices.clear();
+   setup.propertyNames.clear();
+   setup.propertyValues.clear();
+
+   const long n = static_cast<long>(events.size());
+   if (n < 2 || core_.getNumberOfCameraChannels() != 1)
+      return false;
+
+   bool zVaries = false;
+   bool exposureVaries = false;
+   bool presetVaries = false;
+   for (long i = 1; i < n; ++i)
+   {
+      zVaries = zVaries || events[i].z != events[0].z;
+      exposureVaries = exposureVaries ||
+         events[i].exposureMs != events[0].exposureMs;
+      presetVaries = presetVaries ||
+         events[i].channelPreset != events[0].channelPreset;
+   }
+
+   if (zVaries)
+   {
+      if (!core_.isStageSequenceable(focus_.c_str()) ||
+            core_.getStageSequenceMaxLength(focus_.c_str()) < n)
+         return false;
+      setup.z = true;
+   }
+
+   if (exposureVaries)
+   {
+      // A channel that leaves the exposure unchanged cannot be sequenced
+      for (long i = 0; i < n; ++i)
+      {
+         if (events[i].exposureMs <= 0.0)
+            return false;
+      }
+      if (!core_.isExposureSequenceable(camera_.c_str()) ||
+            core_.getExposureSequenceMaxLength(camera_.c_str()) < n)
+         return false;
+      setup.exposure = true;
+   }
+
+   if (presetVaries)
+   {
+      // Every property of the presets must be set by all of them; those
+      // whose value differs between the events are sequenced
+      const std::string group = plan_.getChannelGroup();
+      std::map<std::string, Configuration> presets;
+      for (long i = 0; i < n; ++i)
+      {
+         const std::string& name = events[i].channelPreset;
+         if (presets.find(name) == presets.end())
+            presets[name] = core_.getConfigData(group.c_str(), name.c_str());
+      }
+
+      Configuration& first = presets[events[0].channelPreset];
+      for (std::map<std::string, Configuration>::const_iterator it =
+            presets.begin(); it != presets.end(); ++it)
+      {
+         if (it->second.size() != first.size())
+            return false;
+      }
+
+      for (size_t s = 0; s < first.size(); ++s)
+      {
+         const PropertySetting setting = first.getSetting(s);
+         const std::string device = setting.getDeviceLabel();
+         const std::string property = setting.getPropertyName();
+         std::vector<std::string> values;
+         values.reserve(n);
+         bool varies = false;
+         for (long i = 0; i < n; ++i)
+         {
+            Configuration& preset = presets[events[i].channelPreset];
+            if (!preset.isPropertyIncluded(device.c_str(), property.c_str()))
+               return false;
+            values.push_back(preset.getSetting(device.c_str(),
+                     property.c_str()).getPropertyValue());
+            varies = varies || values.back() != values.front();
+         }
+         if (!varies)
+            continue;
+
+         if (!core_.isPropertySequenceable(device.c_str(), property.c_str()) ||
+               core_.getPropertySequenceMaxLength(device.c_str(),
+                  property.c_str()) < n)
+            return false;
+         setup.propertyDevices.push_back(device);
+         setup.propertyNames.push_back(property);
+         setup.propertyValues.push_back(values);
+      }
+   }
+
+   return true;
+}
+
+
+void
+AcquisitionEngine::RunSequenced(const std::vector<AcquisitionEvent>& events,
+      const SequenceSetup& setup) throw (CMMError)
+{
+   // The first event sets the properties that do not change
+   ApplyEvent(events[0]);
+
+   LOG_DEBUG(core_.coreLogger_) << "Will acquire " << events.size() <<
+      " images as a hardware sequence";
+   const long n = static_cast<long>(events.size());
+   try
+   {
+      if (setup.z)
+      {
+         std::vector<double> positions;
+         for (long i = 0; i < n; ++i)
+            positions.push_back(events[i].z);
+         core_.loadStageSequence(focus_.c_str(), positions);
+         core_.startStageSequence(focus_.c_str());
+      }
+      for (size_t p = 0; p < setup.propertyNames.size(); ++p)
+      {
+         core_.loadPropertySequence(setup.propertyDevices[p].c_str(),
+               setup.propertyNames[p].c_str(), setup.propertyValues[p]);
+         core_.startPropertySequence(setup.propertyDevices[p].c_str(),
+               setup.propertyNames[p].c_str());
+      }
+      if (setup.exposure)
+      {
+         std::vector<double> exposures;
+         for (long i = 0; i < n; ++i)
+            exposures.push_back(events[i].exposureMs);
+         core_.loadExposureSequence(camera_.c_str(), exposures);
+         core_.startExposureSequence(camera_.c_str());
+      }
+
+      std::vector<Metadata> tags;
+      tags.reserve(n);
+      for (long i = 0; i < n; ++i)
+         tags.push_back(events[i].GetTags());
+      core_.cbuf_->QueueFrameTags(tags);
+
+      // Some cameras report that they are capturing until stopped, even
+      // after a finite sequence, so the frames are counted as well
+      const long arrivedBefore =
+         core_.getInsertedFrameCount(camera_.c_str()) +
+         core_.getRejectedFrameCount(camera_.c_str());
+      core_.startSequenceAcquisition(camera_.c_str(), n, 0.0, true);
+      while (core_.isSequenceRunning(camera_.c_str()) &&
+            core_.getInsertedFrameCount(camera_.c_str()) +
+            core_.getRejectedFrameCount(camera_.c_str()) < arrivedBefore + n)
+      {
+         if (!WaitUntil(MonotonicClock::NowUs() + 1000))
+            break;
+      }
+      if (core_.isSequenceRunning(camera_.c_str()))
+         core_.stopSequenceAcquisition(camera_.c_str());
+      if (core_.isBufferOverflowed())
+         throw CMMError("Circular buffer overflowed during acquisition plan");
+   }
+   catch (...)
+   {
+      StopSequences(setup);
+      core_.cbuf_->ClearFrameTags();
+      throw;
+   }
+   StopSequences(setup);
+   core_.cbuf_->ClearFrameTags();
+
+   // The sequences leave the devices in the state of the last event
+   lastPreset_.clear();
+   lastExposureMs_ = 0.0;
+   hasLastZ_ = false;
+}
+
+
+void
+AcquisitionEngine::StopSequences(const SequenceSetup& setup)
+{
+   try
+   {
+      if (setup.z)
+         core_.stopStageSequence(focus_.c_str());
+      for (size_t p = 0; p < setup.propertyNames.size(); ++p)
+         core_.stopPropertySequence(setup.propertyDevices[p].c_str(),
+               setup.propertyNames[p].c_str());
+      if (setup.exposure)
+         core_.stopExposureSequence(camera_.c_str());
+   }
+   catch (const CMMError& e)
+   {
+      LOG_ERROR(core_.coreLogger_) << "Cannot stop hardware sequence: " <<
+         e.getMsg();
+   }
+}
+
+
+void
+AcquisitionEngine::RunSnapped(const AcquisitionEvent& event) throw (CMMError)
+{
+   ApplyEvent(event);
+   core_.snapImage();
+
+   const Metadata tags = event.GetTags();
+
+   // Store only the ROIs of multi-ROI frames if the Core packs them (the
+   // packer was set up when the circular buffer was initialized). Packed
+   // frames are not transposed, so the camera's own buffer is used, which
+   // getImage() has passed to the image processor.
+   boost::shared_ptr<CameraInstance> camera =
+      core_.deviceManager_->GetDeviceOfType<CameraInstance>(camera_);
+   boost::shared_ptr<const MultiROIPacker> packer;
+   {
+      DeviceModuleLockGuard guard(camera);
+      packer = camera->GetMultiROIPacker();
+      if (packer && (camera->GetImageWidth() != packer->GetFrameWidth() ||
+               camera->GetImageHeight() != packer->GetFrameHeight()))
+         packer.reset();
+   }
+   if (packer)
+   {
+      core_.getImage();
+      DeviceModuleLockGuard guard(camera);
+      const unsigned byteDepth = camera->GetImageBytesPerPixel();
+      Metadata md = tags;
+      md.PutImageTag(MM::g_Keyword_CoreCamera, camera_);
+      md.PutImageTag(MM::g_Keyword_CameraChannelIndex, 0);
+      md.PutImageTag(MM::g_Keyword_Metadata_PackedROIs,
+            packer->GetROITable());
+      MultiROIPacker::Copier copier(*packer, camera->GetImageBuffer(),
+            byteDepth);
+      if (!core_.cbuf_->InsertMultiChannel(copier, 1,
+               packer->GetPackedWidth(), packer->GetPackedHeight(),
+               byteDepth, camera->GetNumberOfComponents(), &md))
+         throw CMMError("Circular buffer overflowed during acquisition plan");
+      return;
+   }
+
+   const unsigned nChannels = core_.getNumberOfCameraChannels();
+   const unsigned width = core_.getImageWidth();
+   const unsigned height = core_.getImageHeight();
+   const unsigned byteDepth = core_.getBytesPerPixel();
+   const unsigned nComponents = core_.getNumberOfComponents();
+   for (unsigned c = 0; c < nChannels; ++c)
+   {
+      const unsigned char* pixels =
+         static_cast<const unsigned char*>(core_.getImage(c));
+      Metadata md = tags;
+      md.PutImageTag(MM::g_Keyword_CoreCamera,
+            nChannels > 1 ? core_.getCameraChannelName(c) : camera_);
+      md.PutImageTag(MM::g_Keyword_CameraChannelIndex, c);
+      if (!core_.cbuf_->InsertImage(pixels, width, height, byteDepth,
+               nComponents, &md))
+         throw CMMError("Circular buffer overflowed during acquisition plan");
+   }
+}
+
+
+void
+AcquisitionEngine::ApplyEvent(const AcquisitionEvent& event) throw (CMMError)
+{
+   if (!event.channelPreset.empty() && event.channelPreset != lastPreset_)
+   {
+      const std::string group = plan_.getChannelGroup();
+      core_.setConfig(group.c_str(), event.channelPreset.c_str());
+      core_.waitForConfig(group.c_str(), event.channelPreset.c_str());
+      lastPreset_ = event.channelPreset;
+      // The preset may have set the exposure
+      lastExposureMs_ = 0.0;
+   }
+   if (event.exposureMs > 0.0 && event.exposureMs != lastExposureMs_)
+   {
+      core_.setExposure(camera_.c_str(), event.exposureMs);
+      lastExposureMs_ = event.exposureMs;
+   }
+   if (event.hasZ && (!hasLastZ_ || event.z != lastZ_))
+   {
+      core_.setPosition(focus_.c_str(), event.z);
+      core_.waitForDevice(focus_.c_str());
+      hasLastZ_ = true;
+      lastZ_ = event.z;
+   }
+}
+
+
+bool
+AcquisitionEngine::WaitUntil(boost::int64_t deadlineUs)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   while (!stopRequested_)
+   {
+      const boost::int64_t nowUs = MonotonicClock::NowUs();
+      if (nowUs >= deadlineUs)
+         return true;
+      stopCondition_.timed_wait(lock,
+            boost::posix_time::microseconds(deadlineUs - nowUs));
+   }
+   return false;
+}
+
+
+bool
+AcquisitionEngine::IsStopRequested() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return stopRequested_;
+}
+
+} // namespace mm
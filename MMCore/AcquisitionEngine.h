@@ -0,0 +1,152 @@
+// DESCRIPTION:   Runs multi-dimensional acquisitions on a Core thread
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "AcquisitionPlan.h"
+#include "Error.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+class CMMCore;
+
+
+namespace mm
+{
+
+/**
+ * \brief One image of an acquisition plan.
+ */
+struct AcquisitionEvent
+{
+   long frameIndex;
+   long positionIndex;
+   long sliceIndex;
+   long channelIndex;
+   bool hasXY;
+   double x;
+   double y;
+   bool hasZ;
+   double z;
+   // Empty if the channel is not changed
+   std::string channelPreset;
+   // Not changed if <= 0
+   double exposureMs;
+
+   /// Tags identifying the image
+   Metadata GetTags() const;
+};
+
+/**
+ * \brief Runs an AcquisitionPlan on its own thread, inserting the tagged
+ * images into the circular buffer.
+ *
+ * The images of each time point and position are acquired as a block. When
+ * the camera, the focus stage and the properties that differ between
+ * channels can all be sequenced for the whole block, the block is loaded
+ * into the devices as hardware sequences and acquired with a single camera
+ * sequence acquisition; otherwise each image is snapped after setting the
+ * devices.
+ */
+class AcquisitionEngine /* final */
+{
+public:
+   explicit AcquisitionEngine(CMMCore& core);
+   /// Stops a running acquisition and waits for it to end
+   ~AcquisitionEngine();
+
+   /// Throws CMMError if an acquisition is running or the plan is invalid
+   void Start(const AcquisitionPlan& plan) throw (CMMError);
+   /// Requests a running acquisition to stop; returns immediately
+   void Stop();
+   bool IsRunning() const;
+   /**
+    * \brief Waits for the acquisition to end; throws CMMError if it failed.
+    *
+    * May be called from several threads at once.
+    */
+   void Wait() throw (CMMError);
+
+   /**
+    * \brief The images of one time point and position, in acquisition
+    * order.
+    *
+    * zOrigin is added to the Z slices of plans with relative slices.
+    */
+   static std::vector<AcquisitionEvent> CompileBlock(
+         const AcquisitionPlan& plan, long frameIndex, long positionIndex,
+         double zOrigin);
+
+private:
+   // The hardware sequences that acquire a block
+   struct SequenceSetup
+   {
+      bool z;
+      bool exposure;
+      // Label, property name and values of the channel properties that
+      // change during the block
+      std::vector<std::string> propertyDevices;
+      std::vector<std::string> propertyNames;
+      std::vector< std::vector<std::string> > propertyValues;
+   };
+
+   void Run();
+   void RunBlock(const std::vector<AcquisitionEvent>& events)
+      throw (CMMError);
+   bool CanSequence(const std::vector<AcquisitionEvent>& events,
+         SequenceSetup& setup) throw (CMMError);
+   void RunSequenced(const std::vector<AcquisitionEvent>& events,
+         const SequenceSetup& setup) throw (CMMError);
+   void StopSequences(const SequenceSetup& setup);
+   void RunSnapped(const AcquisitionEvent& event) throw (CMMError);
+   void ApplyEvent(const AcquisitionEvent& event) throw (CMMError);
+   // Returns false if a stop was requested before the deadline
+   bool WaitUntil(boost::int64_t deadlineUs);
+   bool IsStopRequested() const;
+
+   CMMCore& core_;
+   AcquisitionPlan plan_;
+   std::string camera_;
+   std::string focus_;
+   std::string xyStage_;
+   double zOrigin_;
+
+   // Settings applied by the previous event, so that unchanged settings are
+   // not applied again
+   std::string lastPreset_;
+   double lastExposureMs_;
+   bool hasLastZ_;
+   double lastZ_;
+
+   // Serializes starting and joining thread_
+   boost::mutex threadMutex_;
+   boost::thread thread_;
+   mutable boost::mutex mutex_;
+   boost::condition_variable stopCondition_;
+   // Guarded by mutex_
+   bool running_;
+   bool stopRequested_;
+   bool failed_;
+   std::string errorText_;
+   int errorCode_;
+};
+
+} // namespace mm
@@ -0,0 +1,143 @@
+// DESCRIPTION:   Description of a multi-dimensional acquisition
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AcquisitionPlan.h"
+
+#include "CoreUtils.h"
+
+#include <algorithm>
+
+
+namespace
+{
+
+void
+CheckIndex(long index, size_t size, const char* dimension) throw (CMMError)
+{
+   if (index < 0 || static_cast<size_t>(index) >= size)
+      throw CMMError("Acquisition plan has no " + std::string(dimension) +
+            " with index " + ToString(index));
+}
+
+} // anonymous namespace
+
+
+AcquisitionPlan::AcquisitionPlan() :
+   timePoints_(1),
+   intervalMs_(0.0),
+   zRelative_(false),
+   slicesFirst_(false)
+{
+}
+
+
+void
+AcquisitionPlan::setTimePoints(long count, double intervalMs) throw (CMMError)
+{
+   if (count < 1)
+      throw CMMError("Number of time points must be at least 1 (got " +
+            ToString(count) + ")");
+   timePoints_ = count;
+   intervalMs_ = std::max(0.0, intervalMs);
+}
+
+
+void
+AcquisitionPlan::addXYPosition(double x, double y)
+{
+   xPositions_.push_back(x);
+   yPositions_.push_back(y);
+}
+
+
+void
+AcquisitionPlan::clearXYPositions()
+{
+   xPositions_.clear();
+   yPositions_.clear();
+}
+
+
+double
+AcquisitionPlan::getXPosition(long index) const throw (CMMError)
+{
+   CheckIndex(index, xPositions_.size(), "XY position");
+   return xPositions_[index];
+}
+
+
+double
+AcquisitionPlan::getYPosition(long index) const throw (CMMError)
+{
+   CheckIndex(index, yPositions_.size(), "XY position");
+   return yPositions_[index];
+}
+
+
+void
+AcquisitionPlan::setZSlices(std::vector<double> positions, bool relative)
+{
+   zSlices_ = positions;
+   zRelative_ = relative;
+}
+
+
+void
+AcquisitionPlan::setChannelGroup(const char* group)
+{
+   channelGroup_ = group ? group : "";
+}
+
+
+void
+AcquisitionPlan::addChannel(const char* preset, double exposureMs)
+{
+   channelPresets_.push_back(preset ? preset : "");
+   channelExposures_.push_back(exposureMs);
+}
+
+
+void
+AcquisitionPlan::clearChannels()
+{
+   channelPresets_.clear();
+   channelExposures_.clear();
+}
+
+
+std::string
+AcquisitionPlan::getChannelPreset(long index) const throw (CMMError)
+{
+   CheckIndex(index, channelPresets_.size(), "channel");
+   return channelPresets_[index];
+}
+
+
+double
+AcquisitionPlan::getChannelExposure(long index) const throw (CMMError)
+{
+   CheckIndex(index, channelExposures_.size(), "channel");
+   return channelExposures_[index];
+}
+
+
+long
+AcquisitionPlan::getNumberOfImages() const
+{
+   return timePoints_ *
+      std::max<long>(1, getNumberOfXYPositions()) *
+      std::max<long>(1, static_cast<long>(zSlices_.size())) *
+      std::max<long>(1, getNumberOfChannels());
+}
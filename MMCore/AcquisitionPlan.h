@@ -0,0 +1,89 @@
+// DESCRIPTION:   Description of a multi-dimensional acquisition
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning( disable : 4290 ) // exception declaration warning
+#endif
+
+
+/**
+ * The dimensions of a multi-dimensional acquisition, to be run by
+ * CMMCore::startAcquisitionPlan().
+ *
+ * Images are acquired for each time point, at each XY position, for each Z
+ * slice and channel. By default the channel changes fastest; with
+ * setSlicesFirst(true), all slices are acquired in one channel before
+ * moving to the next. Dimensions that are not set are not changed during
+ * the acquisition (the current XY position, focus position, configuration
+ * and exposure are used).
+ */
+class AcquisitionPlan
+{
+public:
+   AcquisitionPlan();
+
+   /// Number of time points, at least 1, and the interval between their starts
+   void setTimePoints(long count, double intervalMs) throw (CMMError);
+   long getNumberOfTimePoints() const { return timePoints_; }
+   double getTimePointIntervalMs() const { return intervalMs_; }
+
+   void addXYPosition(double x, double y);
+   void clearXYPositions();
+   long getNumberOfXYPositions() const { return static_cast<long>(xPositions_.size()); }
+   double getXPosition(long index) const throw (CMMError);
+   double getYPosition(long index) const throw (CMMError);
+
+   /**
+    * Sets the positions of the focus stage. If relative is true, they are
+    * offsets from the focus position at the start of the acquisition.
+    */
+   void setZSlices(std::vector<double> positions, bool relative);
+   std::vector<double> getZSlices() const { return zSlices_; }
+   bool isZRelative() const { return zRelative_; }
+
+   void setChannelGroup(const char* group);
+   std::string getChannelGroup() const { return channelGroup_; }
+   /// Adds a preset of the channel group; an exposure <= 0 leaves it unchanged
+   void addChannel(const char* preset, double exposureMs);
+   void clearChannels();
+   long getNumberOfChannels() const { return static_cast<long>(channelPresets_.size()); }
+   std::string getChannelPreset(long index) const throw (CMMError);
+   double getChannelExposure(long index) const throw (CMMError);
+
+   void setSlicesFirst(bool slicesFirst) { slicesFirst_ = slicesFirst; }
+   bool isSlicesFirst() const { return slicesFirst_; }
+
+   /// Number of images (per camera channel) the plan acquires
+   long getNumberOfImages() const;
+
+private:
+   long timePoints_;
+   double intervalMs_;
+   std::vector<double> xPositions_;
+   std::vector<double> yPositions_;
+   std::vector<double> zSlices_;
+   bool zRelative_;
+   std::string channelGroup_;
+   std::vector<std::string> channelPresets_;
+   std::vector<double> channelExposures_;
+   bool slicesFirst_;
+};
@@ -0,0 +1,374 @@
+// DESCRIPTION:   Sequential file output in large aligned blocks, written on a
+//                separate thread
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
+#endif
+
+#include "AlignedFileOutput.h"
+
+#include "ErrorCodes.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+
+namespace mm
+{
+
+namespace
+{
+
+#ifdef _WIN32
+
+int OpenForWriting(const std::string& path, bool truncate)
+{
+   return _open(path.c_str(), _O_WRONLY | _O_BINARY |
+         (truncate ? _O_CREAT | _O_TRUNC : 0), _S_IREAD | _S_IWRITE);
+}
+
+// Windows unbuffered I/O also requires sector-aligned file offsets, which
+// the patches do not have; the large writes still avoid most of the cost
+int OpenBypassingCache(const std::string&) { return -1; }
+
+int WriteSome(int fd, const unsigned char* data, size_t size)
+{ return _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1 << 30))); }
+
+bool WriteAt(int fd, boost::uint64_t offset, const unsigned char* data,
+      size_t size)
+{
+   return _lseeki64(fd, offset, SEEK_SET) >= 0 &&
+      _write(fd, data, static_cast<unsigned>(size)) == static_cast<int>(size);
+}
+
+bool Truncate(int fd, boost::uint64_t size) { return _chsize_s(fd, size) == 0; }
+int CloseFile(int fd) { return _close(fd); }
+
+unsigned char* AllocateAligned(size_t size, size_t alignment)
+{ return static_cast<unsigned char*>(_aligned_malloc(size, alignment)); }
+void FreeAligned(unsigned char* p) { _aligned_free(p); }
+
+#else // _WIN32
+
+int OpenForWriting(const std::string& path, bool truncate)
+{
+   return open(path.c_str(), O_WRONLY | (truncate ? O_CREAT | O_TRUNC : 0),
+         0644);
+}
+
+int OpenBypassingCache(const std::string& path)
+{
+#if defined(__linux__) && defined(O_DIRECT)
+   return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+#elif defined(__APPLE__)
+   int fd = OpenForWriting(path, true);
+   if (fd >= 0 && fcntl(fd, F_NOCACHE, 1) == -1)
+   {
+      close(fd);
+      return -1;
+   }
+   return fd;
+#else
+   (void)path;
+   return -1;
+#endif
+}
+
+int WriteSome(int fd, const unsigned char* data, size_t size)
+{ return static_cast<int>(write(fd, data, std::min<size_t>(size, 1 << 30))); }
+
+bool WriteAt(int fd, boost::uint64_t offset, const unsigned char* data,
+      size_t size)
+{ return pwrite(fd, data, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size); }
+
+bool Truncate(int fd, boost::uint64_t size) { return ftruncate(fd, static_cast<off_t>(size)) == 0; }
+int CloseFile(int fd) { return close(fd); }
+
+unsigned char* AllocateAligned(size_t size, size_t alignment)
+{
+   void* p = 0;
+   if (posix_memalign(&p, alignment, size) != 0)
+      return 0;
+   return static_cast<unsigned char*>(p);
+}
+void FreeAligned(unsigned char* p) { std::free(p); }
+
+#endif // _WIN32
+
+} // anonymous namespace
+
+
+const size_t AlignedFileOutput::Alignment;
+
+
+AlignedFileOutput::AlignedFileOutput(const std::string& path,
+      size_t bufferSize, bool bypassCache) :
+   path_(path),
+   fd_(-1),
+   bypassCache_(false),
+   bufferSize_((std::max<size_t>(bufferSize, 1) + Alignment - 1) /
+         Alignment * Alignment),
+   fillIndex_(0),
+   fillSize_(0),
+   size_(0),
+   pendingIndex_(-1),
+   pendingSize_(0),
+   quit_(false)
+{
+   buffers_[0] = buffers_[1] = 0;
+
+   if (bypassCache)
+   {
+      fd_ = OpenBypassingCache(path);
+      bypassCache_ = (fd_ >= 0);
+   }
+   if (fd_ < 0)
+      fd_ = OpenForWriting(path, true);
+   if (fd_ < 0)
+      throw CMMError("Cannot open file " + path + " for writing: " +
+            std::strerror(errno), MMERR_FileOpenFailed);
+
+   buffers_[0] = AllocateAligned(bufferSize_, Alignment);
+   buffers_[1] = AllocateAligned(bufferSize_, Alignment);
+   if (!buffers_[0] || !buffers_[1])
+   {
+      FreeAligned(buffers_[0]);
+      FreeAligned(buffers_[1]);
+      CloseFile(fd_);
+      throw CMMError("Cannot allocate file output buffers", MMERR_OutOfMemory);
+   }
+
+   boost::thread t(boost::bind(&AlignedFileOutput::IoLoop, this));
+   ioThread_.swap(t);
+}
+
+
+AlignedFileOutput::~AlignedFileOutput()
+{
+   try
+   {
+      if (fd_ >= 0)
+         Close();
+   }
+   catch (const CMMError&)
+   {
+   }
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      quit_ = true;
+      condition_.notify_all();
+   }
+   if (ioThread_.joinable())
+      ioThread_.join();
+   if (fd_ >= 0)
+      CloseFile(fd_);
+   FreeAligned(buffers_[0]);
+   FreeAligned(buffers_[1]);
+}
+
+
+void
+AlignedFileOutput::Append(const void* data, size_t size) throw (CMMError)
+{
+   const unsigned char* src = static_cast<const unsigned char*>(data);
+   while (size > 0)
+   {
+      const size_t n = std::min(size, bufferSize_ - fillSize_);
+      std::memcpy(buffers_[fillIndex_] + fillSize_, src, n);
+      fillSize_ += n;
+      size_ += n;
+      src += n;
+      size -= n;
+      if (fillSize_ == bufferSize_)
+         Submit();
+   }
+}
+
+
+void
+AlignedFileOutput::AppendZeros(size_t size) throw (CMMError)
+{
+   while (size > 0)
+   {
+      const size_t n = std::min(size, bufferSize_ - fillSize_);
+      std::memset(buffers_[fillIndex_] + fillSize_, 0, n);
+      fillSize_ += n;
+      size_ += n;
+      size -= n;
+      if (fillSize_ == bufferSize_)
+         Submit();
+   }
+}
+
+
+void
+AlignedFileOutput::Patch(boost::uint64_t offset, const void* data,
+      size_t size)
+{
+   const unsigned char* bytes = static_cast<const unsigned char*>(data);
+   patches_.push_back(std::make_pair(offset,
+            std::vector<unsigned char>(bytes, bytes + size)));
+}
+
+
+void
+AlignedFileOutput::Close() throw (CMMError)
+{
+   if (fd_ < 0)
+      return;
+
+   std::string error;
+   try
+   {
+      WaitForIdle();
+   }
+   catch (const CMMError& e)
+   {
+      error = e.getMsg();
+   }
+
+   if (error.empty() && fillSize_ > 0)
+   {
+      // Unbuffered writes must be whole blocks; the padding is truncated
+      size_t writeSize = fillSize_;
+      if (bypassCache_)
+      {
+         writeSize = (fillSize_ + Alignment - 1) / Alignment * Alignment;
+         std::memset(buffers_[fillIndex_] + fillSize_, 0, writeSize - fillSize_);
+      }
+      error = WriteFully(buffers_[fillIndex_], writeSize);
+      if (error.empty() && writeSize != fillSize_ && !Truncate(fd_, size_))
+         error = std::strerror(errno);
+      fillSize_ = 0;
+   }
+
+   if (CloseFile(fd_) != 0 && error.empty())
+      error = std::strerror(errno);
+   fd_ = -1;
+
+   if (error.empty() && !patches_.empty())
+   {
+      // Patches are not aligned, so they are written without bypassing the
+      // cache
+      int fd = OpenForWriting(path_, false);
+      if (fd < 0)
+         error = std::strerror(errno);
+      for (size_t i = 0; error.empty() && i < patches_.size(); ++i)
+      {
+         if (!WriteAt(fd, patches_[i].first, &patches_[i].second[0],
+                  patches_[i].second.size()))
+            error = std::strerror(errno);
+      }
+      if (fd >= 0 && CloseFile(fd) != 0 && error.empty())
+         error = std::strerror(errno);
+      patches_.clear();
+   }
+
+   if (!error.empty())
+      throw CMMError("Cannot write file " + path_ + ": " + error);
+}
+
+
+void
+AlignedFileOutput::Submit() throw (CMMError)
+{
+   WaitForIdle();
+   boost::mutex::scoped_lock lock(mutex_);
+   pendingIndex_ = fillIndex_;
+   pendingSize_ = fillSize_;
+   condition_.notify_all();
+   fillIndex_ = 1 - fillIndex_;
+   fillSize_ = 0;
+}
+
+
+void
+AlignedFileOutput::WaitForIdle() throw (CMMError)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   while (pendingIndex_ >= 0)
+      condition_.wait(lock);
+   if (!ioError_.empty())
+      throw CMMError("Cannot write file " + path_ + ": " + ioError_);
+}
+
+
+void
+AlignedFileOutput::IoLoop()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   for (;;)
+   {
+      while (pendingIndex_ < 0 && !quit_)
+         condition_.wait(lock);
+      if (pendingIndex_ < 0)
+         return;
+
+      const unsigned char* data = buffers_[pendingIndex_];
+      const size_t size = pendingSize_;
+      const bool failed = !ioError_.empty();
+      std::string error;
+      lock.unlock();
+      // After a failure, the rest of the data is discarded
+      if (!failed)
+         error = WriteFully(data, size);
+      lock.lock();
+
+      if (!error.empty())
+         ioError_ = error;
+      pendingIndex_ = -1;
+      condition_.notify_all();
+   }
+}
+
+
+std::string
+AlignedFileOutput::WriteFully(const unsigned char* data, size_t size)
+{
+   while (size > 0)
+   {
+      int n = WriteSome(fd_, data, size);
+      if (n < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return std::strerror(errno);
+      }
+      data += n;
+      size -= n;
+   }
+   return std::string();
+}
+
+} // namespace mm
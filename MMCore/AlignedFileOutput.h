@@ -0,0 +1,103 @@
+// DESCRIPTION:   Sequential file output in large aligned blocks, written on a
+//                separate thread
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief Writes a file sequentially, in large blocks.
+ *
+ * Appended data is collected in one of two aligned buffers; when a buffer is
+ * full, it is written by a separate thread while the other buffer is
+ * filled. Where available, the file bypasses the OS page cache (O_DIRECT on
+ * Linux, F_NOCACHE on OS X), so that streaming large files neither evicts
+ * other data nor costs a copy in the kernel; this falls back to normal
+ * writes on file systems that do not support it.
+ *
+ * Data that has been appended can be overwritten with Patch(); patches are
+ * applied when the file is closed.
+ */
+class AlignedFileOutput /* final */
+{
+public:
+   /// Alignment of the buffers, and of the writes when bypassing the cache
+   static const size_t Alignment = 4096;
+
+   /**
+    * Creates (or truncates) the file. Throws CMMError if it cannot be opened.
+    * The buffer size is rounded up to a multiple of Alignment.
+    */
+   AlignedFileOutput(const std::string& path, size_t bufferSize,
+         bool bypassCache);
+   /// Closes the file if Close() was not called, ignoring errors
+   ~AlignedFileOutput();
+
+   /// Throws CMMError if a previous write failed
+   void Append(const void* data, size_t size) throw (CMMError);
+   void AppendZeros(size_t size) throw (CMMError);
+   void Patch(boost::uint64_t offset, const void* data, size_t size);
+
+   /// Bytes appended so far
+   boost::uint64_t GetSize() const { return size_; }
+   bool IsBypassingCache() const { return bypassCache_; }
+
+   /// Writes the remaining data and the patches; throws CMMError on failure
+   void Close() throw (CMMError);
+
+private:
+   AlignedFileOutput(const AlignedFileOutput&);
+   AlignedFileOutput& operator=(const AlignedFileOutput&);
+
+   // Hands the buffer being filled to the I/O thread
+   void Submit() throw (CMMError);
+   void WaitForIdle() throw (CMMError);
+   void IoLoop();
+   // Returns an error message, or an empty string on success
+   std::string WriteFully(const unsigned char* data, size_t size);
+
+   std::string path_;
+   int fd_;
+   bool bypassCache_;
+   size_t bufferSize_;
+   unsigned char* buffers_[2];
+   int fillIndex_;
+   size_t fillSize_;
+   boost::uint64_t size_;
+   std::vector< std::pair< boost::uint64_t, std::vector<unsigned char> > > patches_;
+
+   boost::thread ioThread_;
+   boost::mutex mutex_;
+   boost::condition_variable condition_;
+   // Guarded by mutex_
+   int pendingIndex_; // -1 if the I/O thread is idle
+   size_t pendingSize_;
+   bool quit_;
+   std::string ioError_;
+};
+
+} // namespace mm
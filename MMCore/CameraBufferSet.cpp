@@ -0,0 +1,167 @@
+// DESCRIPTION:   Separate sequence buffers for the images of each camera
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "CameraBufferSet.h"
+
+#include "CircularBuffer.h"
+#include "FrameBuffer.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/thread/locks.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+
+namespace mm
+{
+
+std::vector<unsigned>
+CameraBufferSet::DivideMemory(const std::vector<size_t>& frameBytes,
+      unsigned memoryMB)
+{
+   double totalBytes = 0.0;
+   for (size_t i = 0; i < frameBytes.size(); ++i)
+      totalBytes += static_cast<double>(frameBytes[i]);
+
+   std::vector<unsigned> result(frameBytes.size(), 1);
+   if (totalBytes <= 0.0)
+      return result;
+   for (size_t i = 0; i < frameBytes.size(); ++i)
+   {
+      double share = memoryMB * (static_cast<double>(frameBytes[i]) / totalBytes);
+      result[i] = std::max(1u, static_cast<unsigned>(share));
+   }
+   return result;
+}
+
+
+void
+CameraBufferSet::Reset(const std::vector<std::string>& cameras,
+      const std::vector<unsigned>& memoryMB)
+{
+   BufferList buffers;
+   for (size_t i = 0; i < cameras.size() && i < memoryMB.size(); ++i)
+   {
+      boost::shared_ptr<CircularBuffer> buffer(
+            new CircularBuffer(memoryMB[i]));
+      buffers.push_back(std::make_pair(cameras[i], buffer));
+   }
+
+   // Buffers still in use by an inserting camera are destroyed when it is
+   // done with them
+   boost::unique_lock<boost::shared_mutex> lock(mutex_);
+   buffers_.swap(buffers);
+}
+
+
+bool
+CameraBufferSet::IsEmpty() const
+{
+   boost::shared_lock<boost::shared_mutex> lock(mutex_);
+   return buffers_.empty();
+}
+
+
+std::vector<std::string>
+CameraBufferSet::GetCameras() const
+{
+   boost::shared_lock<boost::shared_mutex> lock(mutex_);
+   std::vector<std::string> cameras;
+   for (BufferList::const_iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+      cameras.push_back(it->first);
+   return cameras;
+}
+
+
+boost::shared_ptr<CircularBuffer>
+CameraBufferSet::Find(const std::string& camera) const
+{
+   boost::shared_lock<boost::shared_mutex> lock(mutex_);
+   for (BufferList::const_iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+   {
+      if (it->first == camera)
+         return it->second;
+   }
+   return boost::shared_ptr<CircularBuffer>();
+}
+
+
+void
+CameraBufferSet::ClearImages()
+{
+   boost::shared_lock<boost::shared_mutex> lock(mutex_);
+   for (BufferList::const_iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+      it->second->Clear();
+}
+
+
+void
+CameraBufferSet::SetOverwriteOldest(bool overwrite)
+{
+   boost::shared_lock<boost::shared_mutex> lock(mutex_);
+   for (BufferList::const_iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+      it->second->SetOverwriteOldest(overwrite);
+}
+
+
+const ImgBuffer*
+CameraBufferSet::PopEarliestImage(unsigned channel)
+{
+   boost::shared_lock<boost::shared_mutex> lock(mutex_);
+
+   // Ties go to the camera listed first
+   CircularBuffer* earliest = 0;
+   double earliestTimeMs = 0.0;
+   for (BufferList::const_iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+   {
+      const ImgBuffer* image = it->second->PeekImageBuffer(0, 0);
+      if (!image)
+         continue;
+      double timeMs = 0.0;
+      try
+      {
+         timeMs = std::atof(image->GetMetadata().
+               GetSingleTag(MM::g_Keyword_Metadata_ReceivedTime).
+               GetValue().c_str());
+      }
+      catch (const MetadataKeyError&)
+      {
+      }
+      if (!earliest || timeMs < earliestTimeMs)
+      {
+         earliest = it->second.get();
+         earliestTimeMs = timeMs;
+      }
+   }
+
+   if (!earliest)
+      return 0;
+   return earliest->GetNextImageBuffer(channel);
+}
+
+
+unsigned long
+CameraBufferSet::GetRemainingImageCount() const
+{
+   boost::shared_lock<boost::shared_mutex> lock(mutex_);
+   unsigned long count = 0;
+   for (BufferList::const_iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+      count += it->second->GetRemainingImageCount();
+   return count;
+}
+
+} // namespace mm
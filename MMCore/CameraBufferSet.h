@@ -0,0 +1,95 @@
+// DESCRIPTION:   Separate sequence buffers for the images of each camera
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class CircularBuffer;
+
+namespace mm
+{
+
+class ImgBuffer;
+
+/**
+ * \brief A circular buffer for each of a set of cameras.
+ *
+ * Each buffer has its own image size and locks, so that cameras with
+ * different ROIs or pixel types can stream at the same time without
+ * waiting for each other. The buffers are created by Reset() and must then
+ * be initialized for the images of their camera.
+ *
+ * Images can be popped from the buffer of one camera, or from all of them
+ * in the order in which the Core received them (the ReceivedTime-ms tag).
+ * Each buffer is assumed to have a single consumer.
+ */
+class CameraBufferSet /* final */
+{
+public:
+   CameraBufferSet() {}
+
+   /**
+    * \brief Divide memoryMB between buffers for images of the given sizes.
+    *
+    * The memory is divided in proportion to the image sizes, so that each
+    * buffer holds about the same number of images; each buffer gets at
+    * least 1 MB.
+    */
+   static std::vector<unsigned> DivideMemory(
+         const std::vector<size_t>& frameBytes, unsigned memoryMB);
+
+   /// Replaces the buffers with new, uninitialized ones for the cameras
+   void Reset(const std::vector<std::string>& cameras,
+         const std::vector<unsigned>& memoryMB);
+   /// Removes all the buffers
+   void Clear() { Reset(std::vector<std::string>(), std::vector<unsigned>()); }
+
+   bool IsEmpty() const;
+   std::vector<std::string> GetCameras() const;
+   /// The buffer of the camera, or null if it does not have one
+   boost::shared_ptr<CircularBuffer> Find(const std::string& camera) const;
+
+   void ClearImages();
+   void SetOverwriteOldest(bool overwrite);
+
+   /**
+    * \brief Remove the earliest received of the next images of the buffers.
+    *
+    * Returns the given channel of the image (which remains valid until its
+    * slot is reused), or null if all the buffers are empty.
+    */
+   const ImgBuffer* PopEarliestImage(unsigned channel);
+   /// Images that can be popped from all the buffers
+   unsigned long GetRemainingImageCount() const;
+
+private:
+   CameraBufferSet(const CameraBufferSet&);
+   CameraBufferSet& operator=(const CameraBufferSet&);
+
+   typedef std::vector< std::pair< std::string,
+           boost::shared_ptr<CircularBuffer> > > BufferList;
+
+   // Held shared while using buffers_, and exclusively while replacing it
+   mutable boost::shared_mutex mutex_;
+   BufferList buffers_;
+};
+
+} // namespace mm
@@ -25,14 +25,53 @@
 // 
 #include "CircularBuffer.h"
 #include "CoreUtils.h"
+#include "MonotonicClock.h"
 
 #include "../MMDevice/DeviceUtils.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
 
 const long long bytesInMB = 1 << 20;
 const long adjustThreshold = LONG_MAX / 2;
 const unsigned long maxCBSize = 100000;    //a reasonable limit to circular buffer size
 
+namespace
+{
+
+// Format a time in milliseconds as CDeviceUtils::ConvertToString() does, but
+// without its static buffer: the buffers of different cameras are filled
+// concurrently.
+std::string FormatMs(double ms)
+{
+   std::ostringstream strm;
+   strm << std::fixed << std::setprecision(2) << ms;
+   return strm.str();
+}
+
+// Collect the timestamps and frame counter supplied with a frame
+mm::FrameArrival GetFrameArrival(Metadata& md, const MM::MMTime& arrivalTime)
+{
+   mm::FrameArrival arrival;
+   arrival.hostTimeMs = arrivalTime.getMsec();
+   if (md.HasTag(MM::g_Keyword_Metadata_CameraFrameNumber))
+   {
+      arrival.hasCameraFrameNumber = true;
+      arrival.cameraFrameNumber = std::atol(md.GetSingleTag(MM::g_Keyword_Metadata_CameraFrameNumber).GetValue().c_str());
+   }
+   if (md.HasTag(MM::g_Keyword_Metadata_CameraTimeStamp))
+   {
+      arrival.hasCameraTime = true;
+      arrival.cameraTimeMs = std::atof(md.GetSingleTag(MM::g_Keyword_Metadata_CameraTimeStamp).GetValue().c_str());
+   }
+   return arrival;
+}
+
+} // anonymous namespace
+
 CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    width_(0), 
    height_(0), 
@@ -41,7 +80,11 @@ CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    insertIndex_(0), 
    saveIndex_(0), 
    memorySizeMB_(memorySizeMB), 
-   overflow_(false)
+   overflow_(false),
+   overwriteOldest_(false),
+   overwrittenCount_(0),
+   generation_(0),
+   nextCursorId_(0)
 {
 }
 
@@ -49,8 +92,17 @@ CircularBuffer::~CircularBuffer() {}
 
 bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth)
 {
+   boost::unique_lock<boost::shared_mutex> readersGuard(readMutex_);
+   {
+      // Lock order is g_insertLock before g_bufferLock
+      MMThreadGuard insertGuard(g_insertLock);
+      frameStats_.Reset();
+   }
+
    MMThreadGuard guard(g_bufferLock);
-   imageNumbers_.clear();
+   overwrittenCount_ = 0;
+   for (std::map<int, Cursor>::iterator it = cursors_.begin(); it != cursors_.end(); ++it)
+      it->second.missedCount = 0;
 
    bool ret = true;
    try
@@ -70,6 +122,9 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       insertIndex_ = 0;
       saveIndex_ = 0;
       overflow_ = false;
+      ++generation_;
+      for (std::map<int, Cursor>::iterator it = cursors_.begin(); it != cursors_.end(); ++it)
+         it->second.readIndex = 0;
 
       // calculate the size of the entire buffer array once all images get allocated
       // the actual size at the time of the creation is going to be less, because
@@ -118,7 +173,7 @@ unsigned long CircularBuffer::GetSize() const
 unsigned long CircularBuffer::GetFreeSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   long freeSize = (long)frameArray_.size() - (insertIndex_ - saveIndex_);
+   long freeSize = (long)frameArray_.size() - (insertIndex_ - OldestRetainedIndex());
    if (freeSize < 0)
       return 0;
    else
@@ -144,91 +199,9 @@ bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int wid
 */
 bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd) throw (CMMError)
 {
-   MMThreadGuard guard(g_insertLock);
-
-   mm::ImgBuffer* pImg;
-   unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
-
-   {
-      MMThreadGuard guard(g_bufferLock);
-
-      // check image dimensions
-      if (width != width_ || height != height_ || byteDepth != pixDepth_)
-         throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
-
-      bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
-      if (overflowed) {
-         overflow_ = true;
-         return false;
-      }
-   }
-
-   for (unsigned i=0; i<numChannels; i++)
-   {
-      Metadata md;
-      {
-         MMThreadGuard guard(g_bufferLock);
-         // we assume that all buffers are pre-allocated
-         pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
-         if (!pImg)
-            return false;
-
-         if (pMd)
-         {
-            // TODO: the same metadata is inserted for each channel ???
-            // Perhaps we need to add specific tags to each channel
-            md = *pMd;
-         }
-
-         std::string cameraName = md.GetSingleTag("Camera").GetValue();
-         if (imageNumbers_.end() == imageNumbers_.find(cameraName))
-         {
-            imageNumbers_[cameraName] = 0;
-         }
-
-         // insert image number. 
-         md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
-         ++imageNumbers_[cameraName];
-      }
-
-      if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
-      {
-         // if time tag was not supplied by the camera insert current timestamp
-         MM::MMTime timestamp = GetMMTimeNow();
-         md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString(timestamp.getMsec()));
-      }
-
-      md.PutImageTag("Width",width);
-      md.PutImageTag("Height",height);
-      if (byteDepth == 1)
-         md.PutImageTag("PixelType","GRAY8");
-      else if (byteDepth == 2)
-         md.PutImageTag("PixelType","GRAY16");
-      else if (byteDepth == 4)
-         md.PutImageTag("PixelType","RGB32");
-      else if (byteDepth == 8)
-         md.PutImageTag("PixelType","RGB64");
-      else
-         md.PutImageTag("PixelType","Unknown"); 
-
-      pImg->SetMetadata(md);
-      pImg->SetPixels(pixArray + i*singleChannelSize);
-   }
-
-   {
-      MMThreadGuard guard(g_bufferLock);
-
-      imageCounter_++;
-      insertIndex_++;
-      if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
-      {
-         // adjust buffer indices to avoid overflowing integer size
-         insertIndex_ -= adjustThreshold;
-         saveIndex_ -= adjustThreshold;
-      }
-   }
-
-   return true;
+   // 4-byte pixels were always taken to be RGB32 by this overload
+   unsigned nComponents = (byteDepth == 4) ? 4 : 1;
+   return InsertMultiChannel(pixArray, numChannels, width, height, byteDepth, nComponents, pMd);
 }
 
 /**
@@ -243,11 +216,29 @@ bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int wid
 * Inserts a multi-channel frame in the buffer.
 */
 bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd) throw (CMMError)
+{
+    mm::ContiguousPixelCopier copier(pixArray, (size_t)width * height * byteDepth);
+    return InsertMultiChannel(copier, numChannels, width, height, byteDepth, nComponents, pMd);
+}
+
+/**
+* Inserts a multi-channel frame in the buffer, with the pixels written by
+* the given copier.
+*/
+bool CircularBuffer::InsertMultiChannel(const mm::PixelCopier& copier, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd) throw (CMMError)
 {
     MMThreadGuard guard(g_insertLock);
+
+    const MM::MMTime arrivalTime = mm::MonotonicClock::NowAsMMTime();
  
     mm::ImgBuffer* pImg;
-    unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
+
+    Metadata frameMd;
+    if (pMd)
+       frameMd = *pMd;
+    MergeQueuedFrameTags(frameMd);
+    size_t cameraIndex = frameStats_.GetCameraIndex(
+          frameMd.HasTag("Camera") ? frameMd.GetSingleTag("Camera").GetValue() : std::string());
  
     {
        MMThreadGuard guard(g_bufferLock);
@@ -256,87 +247,246 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
        if (width != width_ || height != height_ || byteDepth != pixDepth_)
           throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
  
-       bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
-       if (overflowed) {
-          overflow_ = true;
+       if (!MakeRoom(insertIndex_)) {
+          frameStats_.RecordRejected(cameraIndex);
           return false;
        }
     }
+
+    frameStats_.RecordInserted(cameraIndex, GetFrameArrival(frameMd, arrivalTime));
+    frameMd.PutImageTag(MM::g_Keyword_Metadata_ReceivedTime, FormatMs(arrivalTime.getMsec()));
  
     for (unsigned i=0; i<numChannels; i++)
     {
-       Metadata md;
+       // TODO: the same metadata is inserted for each channel ???
+       // Perhaps we need to add specific tags to each channel
+       Metadata md = frameMd;
        {
           MMThreadGuard guard(g_bufferLock);
           // we assume that all buffers are pre-allocated
           pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
           if (!pImg)
              return false;
- 
-          if (pMd)
-          {
-             // TODO: the same metadata is inserted for each channel ???
-             // Perhaps we need to add specific tags to each channel
-             md = *pMd;
-          }
-
-         std::string cameraName = md.GetSingleTag("Camera").GetValue();
-         if (imageNumbers_.end() == imageNumbers_.find(cameraName))
+      }
+
+      // insert image number. 
+      md.put(MM::g_Keyword_Metadata_ImageNumber, ToString(frameStats_.NextImageNumber(cameraIndex)));
+      FillImage(*pImg, copier, i, md, nComponents, arrivalTime);
+   }
+
+   {
+      MMThreadGuard guard(g_bufferLock);
+      PublishInsertedImages(1);
+   }
+
+   return true;
+}
+
+/**
+* Inserts consecutive single-channel images, stored one after the other in
+* pixArray, with the given metadata for each. The buffer locks are taken
+* once for all the images that fit in the buffer. Images that do not fit
+* are rejected (and the buffer marked as overflowed); returns the number of
+* images inserted.
+*/
+unsigned CircularBuffer::InsertImages(const unsigned char* pixArray, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, std::vector<Metadata>& frameMds) throw (CMMError)
+{
+   MMThreadGuard guard(g_insertLock);
+
+   const MM::MMTime arrivalTime = mm::MonotonicClock::NowAsMMTime();
+   const size_t frameSize = (size_t)width * height * byteDepth;
+   const unsigned numFrames = (unsigned)frameMds.size();
+
+   std::vector<size_t> cameraIndices(numFrames);
+   for (unsigned k = 0; k < numFrames; ++k)
+   {
+      MergeQueuedFrameTags(frameMds[k]);
+      cameraIndices[k] = frameStats_.GetCameraIndex(
+            frameMds[k].HasTag("Camera") ? frameMds[k].GetSingleTag("Camera").GetValue() : std::string());
+   }
+
+   // Slots are reserved and published at most one buffer length at a time,
+   // so that the images of a batch do not overwrite each other
+   unsigned inserted = 0;
+   bool rejected = false;
+   std::vector<mm::ImgBuffer*> images;
+   while (inserted < numFrames && !rejected)
+   {
+      images.clear();
+      {
+         MMThreadGuard guard(g_bufferLock);
+
+         if (width != width_ || height != height_ || byteDepth != pixDepth_)
+            throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+
+         const size_t chunk = std::min<size_t>(numFrames - inserted, frameArray_.size());
+         for (size_t k = 0; k < chunk; ++k)
          {
-            imageNumbers_[cameraName] = 0;
+            const long index = insertIndex_ + (long)k;
+            mm::ImgBuffer* pImg = MakeRoom(index) ?
+               frameArray_[index % frameArray_.size()].FindImage(0) : 0;
+            if (!pImg)
+            {
+               rejected = true;
+               break;
+            }
+            images.push_back(pImg);
          }
-
-         // insert image number. 
-         md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
-         ++imageNumbers_[cameraName];
+         if (images.empty())
+            rejected = true;
       }
 
-      if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
+      for (size_t k = 0; k < images.size(); ++k)
       {
-         // if time tag was not supplied by the camera insert current timestamp
-         MM::MMTime timestamp = GetMMTimeNow();
-         md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString(timestamp.getMsec()));
+         const unsigned frame = inserted + (unsigned)k;
+         Metadata& md = frameMds[frame];
+         frameStats_.RecordInserted(cameraIndices[frame], GetFrameArrival(md, arrivalTime));
+         md.PutImageTag(MM::g_Keyword_Metadata_ReceivedTime, FormatMs(arrivalTime.getMsec()));
+         md.put(MM::g_Keyword_Metadata_ImageNumber, ToString(frameStats_.NextImageNumber(cameraIndices[frame])));
+         mm::ContiguousPixelCopier copier(pixArray + frame * frameSize, frameSize);
+         FillImage(*images[k], copier, 0, md, nComponents, arrivalTime);
       }
 
-      md.PutImageTag("Width",width);
-      md.PutImageTag("Height",height);
-      if (byteDepth == 1)
-         md.PutImageTag("PixelType","GRAY8");
-      else if (byteDepth == 2)
-         md.PutImageTag("PixelType","GRAY16");
-      else if (byteDepth == 4)
       {
-         if (nComponents == 1)
-            md.PutImageTag("PixelType","GRAY32");
-         else
-            md.PutImageTag("PixelType","RGB32");
+         MMThreadGuard guard(g_bufferLock);
+         PublishInsertedImages((long)images.size());
       }
-      else if (byteDepth == 8)
-         md.PutImageTag("PixelType","RGB64");
-      else
-         md.PutImageTag("PixelType","Unknown"); 
-
-      pImg->SetMetadata(md);
-      pImg->SetPixels(pixArray + i*singleChannelSize);
+      inserted += (unsigned)images.size();
    }
 
+   for (unsigned k = inserted; k < numFrames; ++k)
+      frameStats_.RecordRejected(cameraIndices[k]);
+   return inserted;
+}
+
+void CircularBuffer::MergeQueuedFrameTags(Metadata& md)
+{
+   if (!frameTags_.empty())
    {
-      MMThreadGuard guard(g_bufferLock);
+      md.Merge(frameTags_.front());
+      frameTags_.pop_front();
+   }
+}
 
-      imageCounter_++;
-      insertIndex_++;
-      if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
-      {
-         // adjust buffer indices to avoid overflowing integer size
-         insertIndex_ -= adjustThreshold;
-         saveIndex_ -= adjustThreshold;
+bool CircularBuffer::MakeRoom(long index)
+{
+   const long size = static_cast<long>(frameArray_.size());
+   const long oldestIndex = OldestRetainedIndex();
+   bool overflowed = (index - oldestIndex) >= size;
+   if (overflowed && overwriteOldest_ && !frameArray_.empty()) {
+      // discard the oldest image to make room for this one
+      if (saveIndex_ == oldestIndex) {
+         saveIndex_++;
+         overwrittenCount_++;
+      }
+      for (std::map<int, Cursor>::iterator it = cursors_.begin(); it != cursors_.end(); ++it) {
+         if (!it->second.lossy && it->second.readIndex == oldestIndex) {
+            it->second.readIndex++;
+            it->second.missedCount++;
+         }
       }
    }
+   else if (overflowed) {
+      overflow_ = true;
+      return false;
+   }
 
+   // GetNextImage() and lossy cursors skip the image whose slot is about to
+   // be reused
+   if (saveIndex_ <= index - size)
+      saveIndex_ = index - size + 1;
+   for (std::map<int, Cursor>::iterator it = cursors_.begin(); it != cursors_.end(); ++it) {
+      Cursor& cursor = it->second;
+      if (cursor.lossy && cursor.readIndex <= index - size) {
+         cursor.missedCount += index - size + 1 - cursor.readIndex;
+         cursor.readIndex = index - size + 1;
+      }
+   }
    return true;
 }
+
+void CircularBuffer::FillImage(mm::ImgBuffer& img, const mm::PixelCopier& copier, unsigned channel, Metadata& md, unsigned nComponents, const MM::MMTime& arrivalTime)
+{
+   const unsigned width = img.Width();
+   const unsigned height = img.Height();
+   const unsigned byteDepth = img.Depth();
+
+   if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
+   {
+      // if time tag was not supplied by the camera insert current timestamp
+      md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms, FormatMs(arrivalTime.getMsec()));
+   }
+
+   md.PutImageTag("Width",width);
+   md.PutImageTag("Height",height);
+   if (byteDepth == 1)
+      md.PutImageTag("PixelType","GRAY8");
+   else if (byteDepth == 2)
+      md.PutImageTag("PixelType","GRAY16");
+   else if (byteDepth == 4)
+   {
+      if (nComponents == 1)
+         md.PutImageTag("PixelType","GRAY32");
+      else
+         md.PutImageTag("PixelType","RGB32");
+   }
+   else if (byteDepth == 8)
+      md.PutImageTag("PixelType","RGB64");
+   else
+      md.PutImageTag("PixelType","Unknown"); 
+
+   if (pixelStats_ && mm::PixelStatistics::IsSupported(byteDepth, nComponents))
+   {
+      pixelStats_->Reset(byteDepth);
+      copier.CopyPixelsWithStatistics(channel, img.GetPixelsRW(),
+            static_cast<size_t>(width) * height, *pixelStats_);
+      pixelStats_->Finish();
+      pixelStats_->PutTags(md);
+   }
+   else
+   {
+      copier.CopyPixels(channel, img.GetPixelsRW());
+   }
+   img.SetMetadata(md);
+
+   if (channel == 0 && preview_)
+      preview_->Insert(img.GetPixels(), width, height, byteDepth,
+            nComponents, md, arrivalTime.getMsec());
+}
+
+void CircularBuffer::PublishInsertedImages(long count)
+{
+   imageCounter_ += count;
+   insertIndex_ += count;
+   long lowestIndex = saveIndex_;
+   for (std::map<int, Cursor>::const_iterator it = cursors_.begin(); it != cursors_.end(); ++it)
+      lowestIndex = std::min(lowestIndex, it->second.readIndex);
+   if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (lowestIndex - (long)frameArray_.size()) > adjustThreshold)
+   {
+      // adjust buffer indices to avoid overflowing integer size
+      insertIndex_ -= adjustThreshold;
+      saveIndex_ -= adjustThreshold;
+      for (std::map<int, Cursor>::iterator it = cursors_.begin(); it != cursors_.end(); ++it)
+         it->second.readIndex -= adjustThreshold;
+   }
+}
  
 
+void CircularBuffer::SetPixelStatistics(bool enable, unsigned histogramBins, unsigned bitDepth)
+{
+   MMThreadGuard guard(g_insertLock);
+   if (enable)
+      pixelStats_.reset(new mm::PixelStatistics(histogramBins, bitDepth));
+   else
+      pixelStats_.reset();
+}
+
+void CircularBuffer::QueueFrameTags(const std::vector<Metadata>& tags)
+{
+   MMThreadGuard guard(g_insertLock);
+   frameTags_.insert(frameTags_.end(), tags.begin(), tags.end());
+}
+
 const unsigned char* CircularBuffer::GetTopImage() const
 {
    const mm::ImgBuffer* img = GetNthFromTopImageBuffer(0, 0);
@@ -392,3 +542,134 @@ const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel)
    ++saveIndex_;
    return frameArray_[targetIndex].FindImage(channel);
 }
+
+void CircularBuffer::Clear()
+{
+   boost::unique_lock<boost::shared_mutex> readersGuard(readMutex_);
+   MMThreadGuard guard(g_bufferLock);
+   insertIndex_ = 0;
+   saveIndex_ = 0;
+   overflow_ = false;
+   ++generation_;
+   for (std::map<int, Cursor>::iterator it = cursors_.begin(); it != cursors_.end(); ++it)
+      it->second.readIndex = 0;
+}
+
+const mm::ImgBuffer* CircularBuffer::PeekImageBuffer(unsigned long offset, unsigned channel) const
+{
+   MMThreadGuard guard(g_bufferLock);
+   if ((unsigned long)(insertIndex_ - saveIndex_) <= offset)
+      return 0;
+   return frameArray_[(saveIndex_ + offset) % frameArray_.size()].FindImage(channel);
+}
+
+int CircularBuffer::AddCursor(bool lossy, bool ownsImages)
+{
+   MMThreadGuard guard(g_bufferLock);
+   Cursor cursor;
+   cursor.readIndex = insertIndex_;
+   cursor.lossy = lossy && !ownsImages;
+   cursor.ownsImages = ownsImages;
+   cursor.missedCount = 0;
+   int id = nextCursorId_++;
+   cursors_[id] = cursor;
+   return id;
+}
+
+void CircularBuffer::RemoveCursor(int cursor) throw (CMMError)
+{
+   MMThreadGuard guard(g_bufferLock);
+   FindCursor(cursor);
+   cursors_.erase(cursor);
+}
+
+const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(int cursor, unsigned channel) throw (CMMError)
+{
+   MMThreadGuard guard(g_bufferLock);
+   Cursor& c = FindCursor(cursor);
+
+   long availableImages = insertIndex_ - c.readIndex;
+   if (availableImages < 1)
+      return 0;
+
+   long targetIndex = c.readIndex % frameArray_.size();
+   ++c.readIndex;
+   return frameArray_[targetIndex].FindImage(channel);
+}
+
+const mm::ImgBuffer* CircularBuffer::PeekNextImageBuffer(int cursor, unsigned channel) const throw (CMMError)
+{
+   MMThreadGuard guard(g_bufferLock);
+   const Cursor& c = FindCursor(cursor);
+   if (insertIndex_ - c.readIndex < 1)
+      return 0;
+   return frameArray_[c.readIndex % frameArray_.size()].FindImage(channel);
+}
+
+void CircularBuffer::AdvanceCursor(int cursor) throw (CMMError)
+{
+   MMThreadGuard guard(g_bufferLock);
+   Cursor& c = FindCursor(cursor);
+   if (c.readIndex < insertIndex_)
+      ++c.readIndex;
+}
+
+unsigned long CircularBuffer::GetRemainingImageCount(int cursor) const throw (CMMError)
+{
+   MMThreadGuard guard(g_bufferLock);
+   return (unsigned long)(insertIndex_ - FindCursor(cursor).readIndex);
+}
+
+long CircularBuffer::GetMissedImageCount(int cursor) const throw (CMMError)
+{
+   MMThreadGuard guard(g_bufferLock);
+   return FindCursor(cursor).missedCount;
+}
+
+void CircularBuffer::CopyCursors(const CircularBuffer& other)
+{
+   std::map<int, Cursor> cursors;
+   int nextCursorId;
+   {
+      MMThreadGuard guard(other.g_bufferLock);
+      cursors = other.cursors_;
+      nextCursorId = other.nextCursorId_;
+   }
+
+   MMThreadGuard guard(g_bufferLock);
+   for (std::map<int, Cursor>::iterator it = cursors.begin(); it != cursors.end(); ++it)
+   {
+      it->second.readIndex = insertIndex_;
+      it->second.missedCount = 0;
+   }
+   cursors_ = cursors;
+   nextCursorId_ = nextCursorId;
+}
+
+long CircularBuffer::OldestRetainedIndex() const
+{
+   // GetNextImage() does not hold up insertion while a cursor owns the
+   // images
+   bool owned = false;
+   long oldestIndex = insertIndex_;
+   for (std::map<int, Cursor>::const_iterator it = cursors_.begin(); it != cursors_.end(); ++it)
+   {
+      owned = owned || it->second.ownsImages;
+      if (!it->second.lossy)
+         oldestIndex = std::min(oldestIndex, it->second.readIndex);
+   }
+   return owned ? oldestIndex : std::min(oldestIndex, saveIndex_);
+}
+
+CircularBuffer::Cursor& CircularBuffer::FindCursor(int cursor) throw (CMMError)
+{
+   std::map<int, Cursor>::iterator it = cursors_.find(cursor);
+   if (it == cursors_.end())
+      throw CMMError("No circular buffer cursor with id " + ToString(cursor));
+   return it->second;
+}
+
+const CircularBuffer::Cursor& CircularBuffer::FindCursor(int cursor) const throw (CMMError)
+{
+   return const_cast<CircularBuffer*>(this)->FindCursor(cursor);
+}
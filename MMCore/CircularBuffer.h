@@ -27,10 +27,21 @@
 #include "Error.h"
 #include "ErrorCodes.h"
 #include "FrameBuffer.h"
+#include "FrameStatistics.h"
+#include "PixelCopier.h"
+#include "PixelStatistics.h"
+#include "PreviewBuffer.h"
 
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/MMDevice.h"
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <deque>
+#include <map>
 #include <vector>
 
 #ifdef _MSC_VER
@@ -59,16 +70,80 @@ public:
    bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, const Metadata* pMd) throw (CMMError);
     bool InsertImage(const unsigned char* pixArray, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
    bool InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
+   // Inserts an image whose pixels are written into the buffer by copier
+   bool InsertMultiChannel(const mm::PixelCopier& copier, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError);
+   // Inserts consecutive single-channel images from pixArray, one per
+   // element of frameMds (which receives the tags added by the buffer);
+   // returns the number inserted before the buffer was full
+   unsigned InsertImages(const unsigned char* pixArray, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, std::vector<Metadata>& frameMds) throw (CMMError);
    const unsigned char* GetTopImage() const;
    const unsigned char* GetNextImage();
    const mm::ImgBuffer* GetTopImageBuffer(unsigned channel) const;
    const mm::ImgBuffer* GetNthFromTopImageBuffer(unsigned long n) const;
    const mm::ImgBuffer* GetNthFromTopImageBuffer(long n, unsigned channel) const;
    const mm::ImgBuffer* GetNextImageBuffer(unsigned channel);
-   void Clear() {MMThreadGuard guard(g_bufferLock); insertIndex_=0; saveIndex_=0; overflow_ = false;}
+   void Clear();
+
+   // Images obtained from the Peek functions remain valid while a ReadLock
+   // on GetReadMutex() is held: Initialize() and Clear() wait for it to be
+   // released (and must not be called by its holder).
+   typedef boost::shared_lock<boost::shared_mutex> ReadLock;
+   boost::shared_mutex& GetReadMutex() const { return readMutex_; }
+   // Incremented whenever Initialize() or Clear() discards the images
+   unsigned long GetGeneration() const {MMThreadGuard guard(g_bufferLock); return generation_;}
+   // The image offset places after the one GetNextImageBuffer() would
+   // return, without removing it; null if there is no such image
+   const mm::ImgBuffer* PeekImageBuffer(unsigned long offset, unsigned channel) const;
+
+   // Additional consumers of the images, each reading the buffer
+   // independently of GetNextImage() and of each other. An image is only
+   // discarded when it has been read by GetNextImage() and by every cursor
+   // that is not lossy. A lossy cursor never holds up insertion; images it
+   // has not read when their slot is reused are counted as missed. A new
+   // cursor starts at the next image to be inserted.
+   //
+   // A consumer such as the stack writer, which takes over from
+   // GetNextImage(), adds a cursor that owns the images (and is not lossy):
+   // while it exists, images are discarded once the lossless cursors have
+   // read them, and GetNextImage() skips those it has not read in time.
+   int AddCursor(bool lossy, bool ownsImages = false);
+   void RemoveCursor(int cursor) throw (CMMError);
+   const mm::ImgBuffer* GetNextImageBuffer(int cursor, unsigned channel) throw (CMMError);
+   // Like GetNextImageBuffer(), but the cursor is only advanced (releasing
+   // the image) by AdvanceCursor()
+   const mm::ImgBuffer* PeekNextImageBuffer(int cursor, unsigned channel) const throw (CMMError);
+   void AdvanceCursor(int cursor) throw (CMMError);
+   unsigned long GetRemainingImageCount(int cursor) const throw (CMMError);
+   long GetMissedImageCount(int cursor) const throw (CMMError);
+   // Registers the cursors of another buffer, as new cursors with the same ids
+   void CopyCursors(const CircularBuffer& other);
 
    bool Overflow() {MMThreadGuard guard(g_bufferLock); return overflow_;}
 
+   // When enabled, inserting into a full buffer discards the oldest image
+   // instead of failing
+   void SetOverwriteOldest(bool overwrite) {MMThreadGuard guard(g_bufferLock); overwriteOldest_ = overwrite;}
+   bool GetOverwriteOldest() const {MMThreadGuard guard(g_bufferLock); return overwriteOldest_;}
+   long GetOverwrittenCount() const {MMThreadGuard guard(g_bufferLock); return overwrittenCount_;}
+
+   mm::CameraFrameStatistics GetCameraFrameStatistics(const std::string& camera) const
+   {MMThreadGuard guard(g_insertLock); return frameStats_.GetStatistics(camera);}
+   std::vector<std::string> GetFrameStatisticsCameras() const
+   {MMThreadGuard guard(g_insertLock); return frameStats_.GetCameras();}
+
+   // When enabled, the pixel statistics of each inserted monochrome image are
+   // computed while copying it and added to its metadata
+   void SetPixelStatistics(bool enable, unsigned histogramBins, unsigned bitDepth);
+
+   // Feeds the first channel of inserted images to preview (null to stop)
+   void SetPreviewBuffer(boost::shared_ptr<mm::PreviewBuffer> preview)
+   {MMThreadGuard guard(g_insertLock); preview_ = preview;}
+
+   // Tags merged into the metadata of the next inserted images, one set per
+   // image (including images rejected because the buffer is full)
+   void QueueFrameTags(const std::vector<Metadata>& tags);
+   void ClearFrameTags() {MMThreadGuard guard(g_insertLock); frameTags_.clear();}
+
    mutable MMThreadLock g_bufferLock;
    mutable MMThreadLock g_insertLock;
 
@@ -77,7 +152,14 @@ private:
    unsigned int height_;
    unsigned int pixDepth_;
    long imageCounter_;
-   std::map<std::string, long> imageNumbers_;
+   // Guarded by g_insertLock
+   mm::FrameStatistics frameStats_;
+   // Guarded by g_insertLock; null if disabled
+   boost::scoped_ptr<mm::PixelStatistics> pixelStats_;
+   // Guarded by g_insertLock; null if disabled
+   boost::shared_ptr<mm::PreviewBuffer> preview_;
+   // Guarded by g_insertLock
+   std::deque<Metadata> frameTags_;
 
    // Invariants:
    // 0 <= saveIndex_ <= insertIndex_
@@ -88,5 +170,34 @@ private:
    unsigned long memorySizeMB_;
    unsigned int numChannels_;
    bool overflow_;
+   bool overwriteOldest_;
+   long overwrittenCount_;
    std::vector<mm::FrameBuffer> frameArray_;
+   unsigned long generation_;
+   mutable boost::shared_mutex readMutex_;
+
+   struct Cursor
+   {
+      long readIndex;
+      bool lossy;
+      bool ownsImages;
+      long missedCount;
+   };
+   // Guarded by g_bufferLock; readIndex has the same invariants as
+   // saveIndex_
+   std::map<int, Cursor> cursors_;
+   int nextCursorId_;
+
+   // Must be called with g_insertLock held
+   void MergeQueuedFrameTags(Metadata& md);
+   void FillImage(mm::ImgBuffer& img, const mm::PixelCopier& copier, unsigned channel, Metadata& md, unsigned nComponents, const MM::MMTime& arrivalTime);
+
+   // Must be called with g_bufferLock held
+   long OldestRetainedIndex() const;
+   // Prepares the slot for the image with the given index, discarding or
+   // skipping older images as needed; false if the buffer is full
+   bool MakeRoom(long index);
+   void PublishInsertedImages(long count);
+   Cursor& FindCursor(int cursor) throw (CMMError);
+   const Cursor& FindCursor(int cursor) const throw (CMMError);
 };
@@ -0,0 +1,234 @@
+// DESCRIPTION:   Compresses the images in the circular buffer on a pool of
+//                worker threads
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "CompressionStage.h"
+
+#include "CircularBuffer.h"
+#include "FrameBuffer.h"
+#include "FrameCodec.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/bind.hpp>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// Bytes per pixel component, by which the codec regroups bytes
+unsigned
+GetElementSize(unsigned depth, Metadata& md)
+{
+   if (md.HasTag("PixelType") &&
+         md.GetSingleTag("PixelType").GetValue().compare(0, 3, "RGB") == 0 &&
+         depth % 4 == 0)
+      return depth / 4;
+   return depth;
+}
+
+} // anonymous namespace
+
+
+CompressionStage::CompressionStage(CircularBuffer& buffer,
+      unsigned numThreads, size_t maxCompressedBytes) :
+   buffer_(buffer),
+   maxCompressedBytes_(maxCompressedBytes),
+   quit_(false),
+   generation_(buffer.GetGeneration()),
+   nextClaim_(0),
+   nextCommit_(0),
+   queuedBytes_(0),
+   totalUncompressedBytes_(0),
+   totalCompressedBytes_(0)
+{
+   if (numThreads == 0)
+      numThreads = 1;
+   for (unsigned i = 0; i < numThreads; ++i)
+      workers_.create_thread(boost::bind(&CompressionStage::WorkerLoop, this));
+}
+
+
+CompressionStage::~CompressionStage()
+{
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      quit_ = true;
+      condition_.notify_all();
+   }
+   workers_.join_all();
+}
+
+
+const unsigned char*
+CompressionStage::PopNextImage(unsigned channel, Metadata& md)
+   throw (CMMError)
+{
+   FramePtr frame;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      for (;;)
+      {
+         SyncWithBuffer();
+         if (!queue_.empty())
+            break;
+         // Images not yet compressed remain in the buffer until they are
+         if (buffer_.GetRemainingImageCount() == 0)
+            return 0;
+         condition_.timed_wait(lock, boost::posix_time::milliseconds(2));
+      }
+      frame = queue_.front();
+      queue_.pop_front();
+      queuedBytes_ -= frame->bytes;
+      condition_.notify_all();
+   }
+
+   if (channel >= frame->channels.size())
+      return 0;
+   const CompressedImage& image = frame->channels[channel];
+   const size_t size =
+      static_cast<size_t>(image.width) * image.height * image.depth;
+   popPixels_.resize(size);
+   if (size > 0)
+      popCodec_.Decompress(&image.data[0], image.data.size(),
+            &popPixels_[0], size);
+   md = image.md;
+   md.PutImageTag(MM::g_Keyword_Metadata_CompressedSize,
+         static_cast<unsigned long>(frame->bytes));
+   return size > 0 ? &popPixels_[0] : 0;
+}
+
+
+unsigned long
+CompressionStage::GetRemainingImageCount() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   const_cast<CompressionStage*>(this)->SyncWithBuffer();
+   return static_cast<unsigned long>(queue_.size()) +
+      buffer_.GetRemainingImageCount();
+}
+
+
+size_t
+CompressionStage::GetCompressedBytes() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return queuedBytes_;
+}
+
+
+double
+CompressionStage::GetCompressionRatio() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (totalCompressedBytes_ == 0)
+      return 1.0;
+   return static_cast<double>(totalUncompressedBytes_) /
+      static_cast<double>(totalCompressedBytes_);
+}
+
+
+void
+CompressionStage::WorkerLoop()
+{
+   FrameCodec codec;
+   for (;;)
+   {
+      // Held while the images are read in place, so that the buffer is not
+      // cleared or reallocated meanwhile
+      CircularBuffer::ReadLock readLock(buffer_.GetReadMutex());
+      boost::mutex::scoped_lock lock(mutex_);
+      if (quit_)
+         return;
+      SyncWithBuffer();
+
+      std::vector<const ImgBuffer*> images;
+      if (queuedBytes_ < maxCompressedBytes_)
+      {
+         for (unsigned channel = 0; ; ++channel)
+         {
+            const ImgBuffer* image =
+               buffer_.PeekImageBuffer(nextClaim_ - nextCommit_, channel);
+            if (!image)
+               break;
+            images.push_back(image);
+         }
+      }
+      if (images.empty())
+      {
+         readLock.unlock();
+         condition_.timed_wait(lock, boost::posix_time::milliseconds(2));
+         continue;
+      }
+      const unsigned long index = nextClaim_++;
+      lock.unlock();
+
+      FramePtr frame(new CompressedFrame);
+      frame->channels.resize(images.size());
+      frame->bytes = 0;
+      size_t uncompressedBytes = 0;
+      for (size_t i = 0; i < images.size(); ++i)
+      {
+         const ImgBuffer& image = *images[i];
+         CompressedImage& compressed = frame->channels[i];
+         compressed.width = image.Width();
+         compressed.height = image.Height();
+         compressed.depth = image.Depth();
+         compressed.md = image.GetMetadata();
+         const size_t size = static_cast<size_t>(image.Width()) *
+            image.Height() * image.Depth();
+         codec.Compress(image.GetPixels(), size,
+               GetElementSize(image.Depth(), compressed.md), compressed.data);
+         frame->bytes += compressed.data.size();
+         uncompressedBytes += size;
+      }
+
+      lock.lock();
+      completed_[index] = frame;
+      totalUncompressedBytes_ += uncompressedBytes;
+      totalCompressedBytes_ += frame->bytes;
+      // Images leave the circular buffer in order
+      while (!completed_.empty() && completed_.begin()->first == nextCommit_)
+      {
+         queue_.push_back(completed_.begin()->second);
+         queuedBytes_ += completed_.begin()->second->bytes;
+         completed_.erase(completed_.begin());
+         buffer_.GetNextImageBuffer(0);
+         ++nextCommit_;
+      }
+      condition_.notify_all();
+   }
+}
+
+
+void
+CompressionStage::SyncWithBuffer()
+{
+   // No image is being compressed when the generation changes, as the
+   // workers hold a read lock on the buffer
+   const unsigned long generation = buffer_.GetGeneration();
+   if (generation == generation_)
+      return;
+   generation_ = generation;
+   queue_.clear();
+   completed_.clear();
+   queuedBytes_ = 0;
+   nextClaim_ = nextCommit_ = 0;
+}
+
+} // namespace mm
@@ -0,0 +1,129 @@
+// DESCRIPTION:   Compresses the images in the circular buffer on a pool of
+//                worker threads
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+#include "FrameCodec.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+class CircularBuffer;
+
+namespace mm
+{
+
+class ImgBuffer;
+
+/**
+ * \brief Takes over the images queued in the circular buffer (those that
+ * GetNextImageBuffer() would return) and keeps them compressed.
+ *
+ * Worker threads compress the queued images with FrameCodec, in parallel,
+ * and remove them from the circular buffer in order once compressed, so
+ * that its slots can be reused; the buffer then holds as many more images
+ * as the compression ratio allows, up to a memory limit for the compressed
+ * images. The images are decompressed when popped, with their compressed
+ * size (of all channels) added to their metadata.
+ *
+ * Compressed images are discarded when the circular buffer is cleared or
+ * initialized. The buffer must not overwrite old images, as the images
+ * being compressed are read in place.
+ */
+class CompressionStage /* final */
+{
+public:
+   /// Starts numThreads (at least 1) worker threads
+   CompressionStage(CircularBuffer& buffer, unsigned numThreads,
+         size_t maxCompressedBytes);
+   /// Stops the workers; compressed images are discarded
+   ~CompressionStage();
+
+   /**
+    * \brief Remove the oldest image and return the given channel,
+    * decompressed.
+    *
+    * If the image is still being compressed, waits for it. Returns null if
+    * there are no images, or if the image has no such channel. The pixels
+    * remain valid until the next call.
+    */
+   const unsigned char* PopNextImage(unsigned channel, Metadata& md)
+      throw (CMMError);
+
+   /// Images that can be popped, compressed or not yet
+   unsigned long GetRemainingImageCount() const;
+   /// Bytes of compressed images held
+   size_t GetCompressedBytes() const;
+   /// Uncompressed over compressed size of all images compressed so far
+   double GetCompressionRatio() const;
+
+private:
+   CompressionStage(const CompressionStage&);
+   CompressionStage& operator=(const CompressionStage&);
+
+   struct CompressedImage
+   {
+      unsigned width;
+      unsigned height;
+      unsigned depth;
+      Metadata md;
+      std::vector<unsigned char> data;
+   };
+   struct CompressedFrame
+   {
+      std::vector<CompressedImage> channels;
+      size_t bytes;
+   };
+   typedef boost::shared_ptr<CompressedFrame> FramePtr;
+
+   void WorkerLoop();
+   // Must be called with mutex_ held
+   void SyncWithBuffer();
+
+   CircularBuffer& buffer_;
+   const size_t maxCompressedBytes_;
+   boost::thread_group workers_;
+
+   mutable boost::mutex mutex_;
+   boost::condition_variable condition_;
+   // Guarded by mutex_
+   bool quit_;
+   unsigned long generation_;
+   // Images are numbered from the first one queued in the buffer; the
+   // images from nextCommit_ on are still in the circular buffer
+   unsigned long nextClaim_;
+   unsigned long nextCommit_;
+   // Compressed images waiting for the preceding ones
+   std::map<unsigned long, FramePtr> completed_;
+   std::deque<FramePtr> queue_;
+   size_t queuedBytes_;
+   boost::uint64_t totalUncompressedBytes_;
+   boost::uint64_t totalCompressedBytes_;
+
+   // Used by PopNextImage() only
+   FrameCodec popCodec_;
+   std::vector<unsigned char> popPixels_;
+};
+
+} // namespace mm
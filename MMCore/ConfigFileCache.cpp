@@ -0,0 +1,132 @@
+// DESCRIPTION:   Parsed representation and cache of system configuration files
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ConfigFileCache.h"
+
+#include "../MMDevice/DeviceUtils.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <utility>
+
+namespace mm
+{
+
+namespace
+{
+
+// Maximum number of distinct file contents to keep parsed
+const size_t maxCachedFiles = 8;
+
+bool
+IsDevicePropertySetting(const std::vector<std::string>& tokens)
+{
+   return (tokens.size() == 3 || tokens.size() == 4) &&
+      tokens[0] == MM::g_CFGCommand_Property &&
+      tokens[1] != MM::g_Keyword_CoreDevice;
+}
+
+} // anonymous namespace
+
+
+boost::shared_ptr<const ParsedConfigFile>
+ConfigFileCache::GetParsed(const std::string& contents)
+{
+   std::map< std::string, boost::shared_ptr<const ParsedConfigFile> >::const_iterator
+      found = cache_.find(contents);
+   if (found != cache_.end())
+      return found->second;
+
+   boost::shared_ptr<const ParsedConfigFile> parsed =
+      boost::make_shared<ParsedConfigFile>(Parse(contents));
+   if (cache_.size() >= maxCachedFiles)
+      cache_.clear();
+   cache_.insert(std::make_pair(contents, parsed));
+   return parsed;
+}
+
+
+ParsedConfigFile
+ConfigFileCache::Parse(const std::string& contents)
+{
+   ParsedConfigFile commands;
+   std::vector<ConfigFileCommand> pendingSettings;
+
+   std::istringstream is(contents);
+   std::string line;
+   int lineNumber = 0;
+   while (std::getline(is, line))
+   {
+      lineNumber++;
+
+      // strip a potential Windows/dos CR
+      line = line.substr(0, line.find('\r'));
+
+      if (line.empty() || line[0] == '#')
+         continue;
+
+      ConfigFileCommand command;
+      command.lineNumber = lineNumber;
+      command.line = line;
+      CDeviceUtils::Tokenize(line, command.tokens, MM::g_FieldDelimiters);
+
+      if (IsDevicePropertySetting(command.tokens))
+      {
+         // A missing last token represents an empty value
+         if (command.tokens.size() == 3)
+            command.tokens.push_back("");
+         pendingSettings.push_back(command);
+         continue;
+      }
+
+      AppendPropertyBatch(commands, pendingSettings);
+      pendingSettings.clear();
+      commands.push_back(command);
+   }
+   AppendPropertyBatch(commands, pendingSettings);
+
+   return commands;
+}
+
+
+void
+ConfigFileCache::AppendPropertyBatch(ParsedConfigFile& commands,
+      const std::vector<ConfigFileCommand>& settings)
+{
+   if (settings.empty())
+      return;
+
+   ConfigFileCommand batch;
+   batch.kind = ConfigFileCommand::PropertyBatch;
+   batch.lineNumber = settings.front().lineNumber;
+
+   // Keep only the last write to each device property, in file order
+   std::set< std::pair<std::string, std::string> > seen;
+   for (std::vector<ConfigFileCommand>::const_reverse_iterator
+         it = settings.rbegin(), end = settings.rend(); it != end; ++it)
+   {
+      if (seen.insert(std::make_pair(it->tokens[1], it->tokens[2])).second)
+         batch.batch.push_back(*it);
+   }
+   std::reverse(batch.batch.begin(), batch.batch.end());
+
+   commands.push_back(batch);
+}
+
+} // namespace mm
@@ -0,0 +1,88 @@
+// DESCRIPTION:   Parsed representation and cache of system configuration files
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief A command from a configuration file, split into tokens.
+ */
+struct ConfigFileCommand
+{
+   enum Kind
+   {
+      /// A single line, to be executed as is
+      SingleLine,
+      /// A run of device property settings (see ConfigFileCommand::batch)
+      PropertyBatch
+   };
+
+   ConfigFileCommand() : kind(SingleLine), lineNumber(0) {}
+
+   Kind kind;
+   int lineNumber;
+   std::string line;
+   std::vector<std::string> tokens;
+
+   /**
+    * \brief Device property settings of a PropertyBatch.
+    *
+    * Holds the Property commands of consecutive lines that set device (not
+    * Core) properties, with all but the last write to each device property
+    * removed. The settings always have 4 tokens.
+    */
+   std::vector<ConfigFileCommand> batch;
+};
+
+typedef std::vector<ConfigFileCommand> ParsedConfigFile;
+
+
+/**
+ * \brief Cache of parsed configuration files, keyed by file contents.
+ */
+class ConfigFileCache
+{
+   // Keyed by the full contents, so that a hit never depends on a hash
+   std::map< std::string, boost::shared_ptr<const ParsedConfigFile> > cache_;
+
+public:
+   /**
+    * \brief Get the parsed form of configuration file contents.
+    *
+    * The contents are only parsed if no file with identical contents has
+    * been parsed before.
+    */
+   boost::shared_ptr<const ParsedConfigFile>
+   GetParsed(const std::string& contents);
+
+   void Clear() { cache_.clear(); }
+
+   static ParsedConfigFile Parse(const std::string& contents);
+
+private:
+   static void AppendPropertyBatch(ParsedConfigFile& commands,
+         const std::vector<ConfigFileCommand>& settings);
+};
+
+} // namespace mm
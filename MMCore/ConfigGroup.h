@@ -26,6 +26,11 @@
 #define _CONFIG_GROUP_H_
 
 #include "Configuration.h"
+#include "PresetMatcher.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <string>
 
 /**
@@ -42,6 +47,7 @@ public:
    void Define(const char* configName)
    {
       configs_[configName];
+      PresetsChanged();
    }
 
 	/**
@@ -51,6 +57,7 @@ public:
    {
       PropertySetting setting(deviceLabel, propName, value);
       configs_[configName].addSetting(setting);
+      PresetsChanged();
 	   }
 
    /**
@@ -80,6 +87,7 @@ public:
 	  
 	  configs_[newConfigName] = it->second;
       configs_.erase(it->first);
+      PresetsChanged();
       return true;
    }
 
@@ -96,6 +104,7 @@ public:
       if (it == configs_.end())
          return false;
       configs_.erase(configName);
+      PresetsChanged();
       return true;
    }
 
@@ -115,6 +124,7 @@ public:
 	  
 	  // Delete the specified property
       configs_[configName].deleteSetting(deviceLabel,propName);
+      PresetsChanged();
 	  return true;
    }
 
@@ -140,6 +150,11 @@ protected:
    ConfigGroupBase() {}
    virtual ~ConfigGroupBase() {}
 
+   /**
+    * Called after the presets have been modified.
+    */
+   virtual void PresetsChanged() {}
+
    std::map<std::string, T> configs_;
 };
 
@@ -149,6 +164,44 @@ protected:
  */
 class ConfigGroup : public ConfigGroupBase<Configuration>
 {
+public:
+   ConfigGroup() {}
+
+   ConfigGroup(const ConfigGroup& other) :
+      ConfigGroupBase<Configuration>(other),
+      matcher_(other.matcher_)
+   {}
+
+   ConfigGroup& operator=(const ConfigGroup& rhs)
+   {
+      configs_ = rhs.configs_;
+      boost::mutex::scoped_lock lock(matcherMutex_);
+      matcher_ = rhs.matcher_;
+      return *this;
+   }
+
+   /**
+    * Returns the presets compiled for matching, compiling them if they have
+    * changed since the last call.
+    */
+   boost::shared_ptr<const mm::PresetMatcher> GetPresetMatcher()
+   {
+      boost::mutex::scoped_lock lock(matcherMutex_);
+      if (!matcher_)
+         matcher_.reset(new mm::PresetMatcher(configs_));
+      return matcher_;
+   }
+
+protected:
+   virtual void PresetsChanged()
+   {
+      boost::mutex::scoped_lock lock(matcherMutex_);
+      matcher_.reset();
+   }
+
+private:
+   boost::mutex matcherMutex_;
+   boost::shared_ptr<const mm::PresetMatcher> matcher_;
 };
 
 /**
@@ -361,6 +414,18 @@ public:
       return confList;
    }
 
+   /**
+    * Returns the compiled presets of a group, or a null pointer if the
+    * group does not exist.
+    */
+   boost::shared_ptr<const mm::PresetMatcher> GetPresetMatcher(const char* groupName)
+   {
+      std::map<std::string, ConfigGroup>::iterator it = groups_.find(groupName);
+      if (it == groups_.end())
+         return boost::shared_ptr<const mm::PresetMatcher>();
+      return it->second.GetPresetMatcher();
+   }
+
    void Clear()
    {
       groups_.clear();
@@ -93,7 +93,10 @@ PropertySetting Configuration::getSetting(size_t index) const throw (CMMError)
 
 bool Configuration::isPropertyIncluded(const char* device, const char* prop)
 {
-   map<string, int>::iterator it = index_.find(PropertySetting::generateKey(device, prop));
+   SettingKey key;
+   if (!findKey(device, prop, key))
+      return false;
+   SettingIndex::iterator it = index_.find(key);
    if (it != index_.end())
       return true;
    else
@@ -106,7 +109,10 @@ bool Configuration::isPropertyIncluded(const char* device, const char* prop)
 
 PropertySetting Configuration::getSetting(const char* device, const char* prop)
 {
-   map<string, int>::iterator it = index_.find(PropertySetting::generateKey(device, prop));
+   SettingKey key;
+   SettingIndex::iterator it = index_.end();
+   if (findKey(device, prop, key))
+      it = index_.find(key);
    if (it == index_.end())
    {
       std::ostringstream errTxt;
@@ -128,8 +134,8 @@ PropertySetting Configuration::getSetting(const char* device, const char* prop)
 
 bool Configuration::isSettingIncluded(const PropertySetting& ps)
 {
-   map<string, int>::iterator it = index_.find(ps.getKey());
-   if (it != index_.end() && settings_[it->second].getPropertyValue().compare(ps.getPropertyValue()) == 0)
+   SettingIndex::iterator it = index_.find(makeKey(ps));
+   if (it != index_.end() && settings_[it->second].value_.compare(ps.value_) == 0)
       return true;
    else
       return false;
@@ -156,7 +162,7 @@ bool Configuration::isConfigurationIncluded(const Configuration& cfg)
  */
 void Configuration::addSetting(const PropertySetting& setting)
 {
-   map<string, int>::iterator it = index_.find(setting.getKey());
+   SettingIndex::iterator it = index_.find(makeKey(setting));
    if (it != index_.end())
    {
       // replace
@@ -165,17 +171,34 @@ void Configuration::addSetting(const PropertySetting& setting)
    else
    {
       // add new
-      index_[setting.getKey()] = (int)settings_.size();
+      index_[makeKey(setting)] = (int)settings_.size();
       settings_.push_back(setting);
    }
 }
 
+/**
+ * Looks up the index key for a device and property name. Fails if either
+ * name has never been interned, in which case no setting can match.
+ */
+bool Configuration::findKey(const char* device, const char* prop, SettingKey& key)
+{
+   mm::Symbol deviceSymbol, propSymbol;
+   if (!mm::SymbolTable::Find(device, deviceSymbol) ||
+         !mm::SymbolTable::Find(prop, propSymbol))
+      return false;
+   key = makeKey(deviceSymbol, propSymbol);
+   return true;
+}
+
 /**
  * Removes property setting, specified by device and property names, from the configuration.
  */
 void Configuration::deleteSetting(const char* device, const char* prop)
 {
-   map<string, int>::iterator it = index_.find(PropertySetting::generateKey(device, prop));
+   SettingKey key;
+   SettingIndex::iterator it = index_.end();
+   if (findKey(device, prop, key))
+      it = index_.find(key);
    if (it == index_.end())
    {
       std::ostringstream errTxt;
@@ -189,7 +212,7 @@ void Configuration::deleteSetting(const char* device, const char* prop)
    index_.clear();
    for (unsigned int i = 0; i < settings_.size(); i++) 
    {
-      index_[settings_[i].getKey()] = i;
+      index_[makeKey(settings_[i])] = i;
    }
 
 }
@@ -31,6 +31,10 @@
 #include <vector>
 #include <map>
 #include "Error.h"
+#include "SymbolTable.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
 
 
 /**
@@ -46,12 +50,13 @@ struct PropertySetting
     * @param value 
     */
     PropertySetting(const char* deviceLabel, const char* prop, const char* value, bool readOnly = false) :
-      deviceLabel_(deviceLabel), propertyName_(prop), value_(value), readOnly_(readOnly)
-      {
-        key_ = generateKey(deviceLabel, prop);
-      }
+      deviceLabel_(deviceLabel), propertyName_(prop), value_(value), readOnly_(readOnly),
+      deviceSymbol_(mm::SymbolTable::Intern(deviceLabel_)),
+      propertySymbol_(mm::SymbolTable::Intern(propertyName_))
+      {}
 
-    PropertySetting() : readOnly_(false) {}
+    PropertySetting() : readOnly_(false),
+      deviceSymbol_(mm::NullSymbol), propertySymbol_(mm::NullSymbol) {}
     ~PropertySetting() {}
 
    /**
@@ -71,7 +76,7 @@ struct PropertySetting
     */
    std::string getPropertyValue() const {return value_;}
 
-   std::string getKey() const {return key_;}
+   std::string getKey() const {return generateKey(deviceLabel_.c_str(), propertyName_.c_str());}
 
    static std::string generateKey(const char* device, const char* prop);
 
@@ -82,8 +87,12 @@ private:
    std::string deviceLabel_;
    std::string propertyName_;
    std::string value_;
-   std::string key_;
    bool readOnly_;
+   // Interned device label and property name, for fast lookup
+   mm::Symbol deviceSymbol_;
+   mm::Symbol propertySymbol_;
+
+   friend class Configuration;
 };
 
 /**
@@ -147,8 +156,18 @@ public:
    std::string getVerbose() const;
  
 private:
+   // Settings are indexed by the interned device label and property name
+   typedef boost::uint64_t SettingKey;
+   typedef boost::unordered_map<SettingKey, int> SettingIndex;
+
+   static SettingKey makeKey(mm::Symbol device, mm::Symbol prop)
+   { return (static_cast<SettingKey>(device) << 32) | prop; }
+   static SettingKey makeKey(const PropertySetting& setting)
+   { return makeKey(setting.deviceSymbol_, setting.propertySymbol_); }
+   static bool findKey(const char* device, const char* prop, SettingKey& key);
+
    std::vector<PropertySetting> settings_;
-   std::map<std::string, int> index_;
+   SettingIndex index_;
 };
 
 /**
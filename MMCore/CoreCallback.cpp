@@ -28,9 +28,13 @@
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImgBuffer.h"
+#include "CameraBufferSet.h"
 #include "CircularBuffer.h"
 #include "CoreCallback.h"
 #include "DeviceManager.h"
+#include "MonotonicClock.h"
+#include "PixelFormatConverter.h"
+#include "TraceRecorder.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <string>
@@ -203,6 +207,19 @@ CoreCallback::Sleep(const MM::Device*, double intervalMs)
 }
 
 
+/**
+ * Returns the sequence buffer of the camera: its own buffer if it has one
+ * (holder keeps it alive while in use), otherwise the shared circular buffer.
+ */
+CircularBuffer*
+CoreCallback::SequenceBufferFor(const std::string& camera,
+      boost::shared_ptr<CircularBuffer>& holder)
+{
+   holder = core_->cameraBuffers_->Find(camera);
+   return holder ? holder.get() : core_->cbuf_;
+}
+
+
 /**
  * Get the metadata tags attached to device caller, and merge them with metadata
  * in pMd (if not null). Returns a metadata object.
@@ -222,37 +239,15 @@ CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
 
    std::string label = camera->GetLabel();
    newMD.put("Camera", label);
-
-   std::string serializedMD;
-   try
-   {
-      serializedMD = camera->GetTags();
-   }
-   catch (const CMMError&)
-   {
-      return newMD;
-   }
-
-   Metadata devMD;
-   devMD.Restore(serializedMD.c_str());
-   newMD.Merge(devMD);
+   newMD.Merge(camera->GetTagsAsMetadata());
 
    return newMD;
 }
 
-int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess)
-{
-   Metadata md;
-   md.Restore(serializedMetadata);
-   return InsertImage(caller, buf, width, height, byteDepth, &md, doProcess);
-}
-
-int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd, bool doProcess)
+int CoreCallback::InsertImageWithMetadata(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata& md, bool doProcess)
 {
    try 
    {
-      Metadata md = AddCameraMetadata(caller, pMd);
-
       if(doProcess)
       {
          MM::ImageProcessor* ip = GetImageProcessor(caller);
@@ -261,7 +256,51 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
             ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
          }
       }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md))
+
+      boost::shared_ptr<CameraInstance> camera =
+         boost::static_pointer_cast<CameraInstance>(
+               core_->deviceManager_->GetDevice(caller));
+      boost::shared_ptr<CircularBuffer> cameraBuffer;
+      CircularBuffer* buffer = SequenceBufferFor(camera->GetLabel(), cameraBuffer);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "frame", "InsertImage");
+      if (traceScope.IsActive())
+         traceScope.SetArg("camera", camera->GetLabel());
+
+      // Store only the ROIs of multi-ROI frames, if so requested
+      boost::shared_ptr<const mm::MultiROIPacker> packer =
+         camera->GetMultiROIPacker();
+      if (packer && width == packer->GetFrameWidth() &&
+            height == packer->GetFrameHeight())
+      {
+         Metadata packedMd(md);
+         packedMd.PutImageTag(MM::g_Keyword_Metadata_PackedROIs,
+               packer->GetROITable());
+         mm::MultiROIPacker::Copier copier(*packer, buf, byteDepth);
+         if (buffer->InsertMultiChannel(copier, 1,
+                  packer->GetPackedWidth(), packer->GetPackedHeight(),
+                  byteDepth, nComponents, &packedMd))
+            return DEVICE_OK;
+         else
+            return DEVICE_BUFFER_OVERFLOW;
+      }
+
+      // Apply the camera's orientation correction while copying
+      boost::shared_ptr<const mm::ImageTransposer> transposer =
+         camera->GetImageTransposer();
+      if (transposer)
+      {
+         unsigned newWidth, newHeight;
+         transposer->GetTransformedSize(width, height, newWidth, newHeight);
+         mm::ImageTransposer::Copier copier(*transposer, buf,
+               width, height, byteDepth);
+         if (buffer->InsertMultiChannel(copier, 1, newWidth, newHeight,
+                  byteDepth, nComponents, &md))
+            return DEVICE_OK;
+         else
+            return DEVICE_BUFFER_OVERFLOW;
+      }
+
+      if (buffer->InsertImage(buf, width, height, byteDepth, nComponents, &md))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -272,28 +311,132 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
    }
 }
 
+int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess)
+{
+   // 4-byte pixels without a component count are taken to be RGB32
+   return InsertImage(caller, buf, width, height, byteDepth, byteDepth == 4 ? 4 : 1, serializedMetadata, doProcess);
+}
+
+int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd, bool doProcess)
+{
+   return InsertImage(caller, buf, width, height, byteDepth, byteDepth == 4 ? 4 : 1, pMd, doProcess);
+}
+
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess)
 {
    Metadata md;
-   md.Restore(serializedMetadata);
-   return InsertImage(caller, buf, width, height, byteDepth, nComponents, &md, doProcess);
+   try
+   {
+      boost::shared_ptr<CameraInstance> camera =
+         boost::static_pointer_cast<CameraInstance>(
+               core_->deviceManager_->GetDevice(caller));
+
+      // Avoids parsing the metadata when it is the same as for the previous image
+      md = camera->GetInsertedImageMetadata(serializedMetadata);
+   }
+   catch (CMMError& /*e*/)
+   {
+      return DEVICE_INCOMPATIBLE_IMAGE;
+   }
+   return InsertImageWithMetadata(caller, buf, width, height, byteDepth, nComponents, md, doProcess);
 }
 
-int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd, bool doProcess)
+int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned rowPitch, MM::SourcePixelFormat format, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess)
 {
-   try 
+   try
    {
-      Metadata md = AddCameraMetadata(caller, pMd);
+      boost::shared_ptr<CameraInstance> camera =
+         boost::static_pointer_cast<CameraInstance>(
+               core_->deviceManager_->GetDevice(caller));
+      Metadata md = camera->GetInsertedImageMetadata(serializedMetadata);
+      boost::shared_ptr<CircularBuffer> cameraBuffer;
+      CircularBuffer* buffer = SequenceBufferFor(camera->GetLabel(), cameraBuffer);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "frame", "InsertImage");
+      if (traceScope.IsActive())
+         traceScope.SetArg("camera", camera->GetLabel());
+
+      mm::PixelFormatConverter converter(format, width, height, rowPitch,
+            byteDepth, nComponents);
+
+      // Image processors, multi-ROI packing and transposition work on plain
+      // frames, so convert into a temporary first if any of them applies
+      if ((doProcess && GetImageProcessor(caller)) ||
+            camera->GetMultiROIPacker() || camera->GetImageTransposer())
+      {
+         std::vector<unsigned char> pixels(converter.GetConvertedSize());
+         converter.Convert(buf, &pixels[0]);
+         return InsertImageWithMetadata(caller, &pixels[0], width, height,
+               byteDepth, nComponents, md, doProcess);
+      }
 
-      if(doProcess)
+      // Otherwise convert directly into the buffer slot
+      mm::PixelFormatConverter::Copier copier(converter, buf);
+      if (buffer->InsertMultiChannel(copier, 1, width, height,
+               byteDepth, nComponents, &md))
+         return DEVICE_OK;
+      else
+         return DEVICE_BUFFER_OVERFLOW;
+   }
+   catch (CMMError& /*e*/)
+   {
+      return DEVICE_INCOMPATIBLE_IMAGE;
+   }
+}
+
+int CoreCallback::InsertImages(const MM::Device* caller, const unsigned char* buf, unsigned numFrames, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const char* const* frameMetadata, unsigned* numInserted, const bool doProcess)
+{
+   if (numInserted)
+      *numInserted = 0;
+   try
+   {
+      boost::shared_ptr<CameraInstance> camera =
+         boost::static_pointer_cast<CameraInstance>(
+               core_->deviceManager_->GetDevice(caller));
+      Metadata md = camera->GetInsertedImageMetadata(serializedMetadata);
+      boost::shared_ptr<CircularBuffer> cameraBuffer;
+      CircularBuffer* buffer = SequenceBufferFor(camera->GetLabel(), cameraBuffer);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "frame", "InsertImages");
+      if (traceScope.IsActive())
+         traceScope.SetArg("camera", camera->GetLabel());
+
+      std::vector<Metadata> frameMds(numFrames, md);
+      if (frameMetadata)
       {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
+         for (unsigned i = 0; i < numFrames; ++i)
          {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
+            if (frameMetadata[i] && frameMetadata[i][0])
+            {
+               Metadata frameTags;
+               frameTags.Restore(frameMetadata[i]);
+               frameMds[i].Merge(frameTags);
+            }
          }
       }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md))
+
+      // Image processors, multi-ROI packing and transposition work on one
+      // frame at a time
+      const size_t frameSize = (size_t)width * height * byteDepth;
+      if ((doProcess && GetImageProcessor(caller)) ||
+            camera->GetMultiROIPacker() || camera->GetImageTransposer())
+      {
+         for (unsigned i = 0; i < numFrames; ++i)
+         {
+            int ret = InsertImageWithMetadata(caller, buf + i * frameSize,
+                  width, height, byteDepth, nComponents, frameMds[i],
+                  doProcess);
+            if (ret != DEVICE_OK)
+               return ret;
+            if (numInserted)
+               ++*numInserted;
+         }
+         return DEVICE_OK;
+      }
+
+      unsigned inserted = buffer->InsertImages(buf, width, height,
+            byteDepth, nComponents, frameMds);
+      if (numInserted)
+         *numInserted = inserted;
+      if (inserted == numFrames)
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -304,6 +447,20 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
    }
 }
 
+int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd, bool doProcess)
+{
+   Metadata md;
+   try
+   {
+      md = AddCameraMetadata(caller, pMd);
+   }
+   catch (CMMError& /*e*/)
+   {
+      return DEVICE_INCOMPATIBLE_IMAGE;
+   }
+   return InsertImageWithMetadata(caller, buf, width, height, byteDepth, nComponents, md, doProcess);
+}
+
 int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf)
 {
    Metadata md = imgBuf.GetMetadata();
@@ -318,9 +475,18 @@ int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf
       imgBuf.Height(), imgBuf.Depth(), &md);
 }
 
-void CoreCallback::ClearImageBuffer(const MM::Device* /*caller*/)
+void CoreCallback::ClearImageBuffer(const MM::Device* caller)
 {
-   core_->cbuf_->Clear();
+   boost::shared_ptr<CircularBuffer> cameraBuffer;
+   std::string label;
+   try
+   {
+      label = core_->deviceManager_->GetDevice(caller)->GetLabel();
+   }
+   catch (const CMMError&)
+   {
+   }
+   SequenceBufferFor(label, cameraBuffer)->Clear();
 }
 
 bool CoreCallback::InitializeImageBuffer(unsigned channels, unsigned slices,
@@ -350,7 +516,32 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
       {
          ip->Process( const_cast<unsigned char*>(buf), width, height, byteDepth);
       }
-      if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md))
+
+      boost::shared_ptr<CameraInstance> camera =
+         boost::static_pointer_cast<CameraInstance>(
+               core_->deviceManager_->GetDevice(caller));
+      boost::shared_ptr<CircularBuffer> cameraBuffer;
+      CircularBuffer* buffer = SequenceBufferFor(camera->GetLabel(), cameraBuffer);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "frame", "InsertMultiChannel");
+      if (traceScope.IsActive())
+         traceScope.SetArg("camera", camera->GetLabel());
+      boost::shared_ptr<const mm::ImageTransposer> transposer =
+         camera->GetImageTransposer();
+      if (transposer)
+      {
+         unsigned newWidth, newHeight;
+         transposer->GetTransformedSize(width, height, newWidth, newHeight);
+         mm::ImageTransposer::Copier copier(*transposer, buf,
+               width, height, byteDepth);
+         unsigned nComponents = (byteDepth == 4) ? 4 : 1;
+         if (buffer->InsertMultiChannel(copier, numChannels,
+                  newWidth, newHeight, byteDepth, nComponents, &md))
+            return DEVICE_OK;
+         else
+            return DEVICE_BUFFER_OVERFLOW;
+      }
+
+      if (buffer->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md))
          return DEVICE_OK;
       else
          return DEVICE_BUFFER_OVERFLOW;
@@ -449,7 +640,11 @@ int CoreCallback::PrepareForAcq(const MM::Device* /*caller*/)
 int CoreCallback::OnPropertiesChanged(const MM::Device* /* caller */)
 {
    if (core_->externalCallback_)
+   {
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+            "onPropertiesChanged");
       core_->externalCallback_->onPropertiesChanged();
+   }
 
    // TODO It is inconsistent that we do not update the system state cache in
    // this case. However, doing so would be time-consuming (if not unsafe).
@@ -474,7 +669,12 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
          MMThreadGuard scg(core_->stateCacheLock_);
          core_->stateCache_.addSetting(*ps);
       }
-      core_->externalCallback_->onPropertyChanged(label, propName, value);
+      {
+         mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+               "onPropertyChanged");
+         traceScope.SetArg("device", label);
+         core_->externalCallback_->onPropertyChanged(label, propName, value);
+      }
 
       // Find all configs that contain this property and callback to indicate 
       // that the config group changed
@@ -537,6 +737,9 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
 int CoreCallback::OnConfigGroupChanged(const char* groupName, const char* newConfigName)
 {
    if (core_->externalCallback_) {
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+            "onConfigGroupChanged");
+      traceScope.SetArg("group", groupName);
       core_->externalCallback_->onConfigGroupChanged(groupName, newConfigName);
    }
 
@@ -549,6 +752,8 @@ int CoreCallback::OnConfigGroupChanged(const char* groupName, const char* newCon
 int CoreCallback::OnPixelSizeChanged(double newPixelSizeUm)
 {
    if (core_->externalCallback_) {
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+            "onPixelSizeChanged");
       core_->externalCallback_->onPixelSizeChanged(newPixelSizeUm);
    }
 
@@ -563,6 +768,9 @@ int CoreCallback::OnStagePositionChanged(const MM::Device* device, double pos)
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+            "onStagePositionChanged");
+      traceScope.SetArg("device", label);
       core_->externalCallback_->onStagePositionChanged(label, pos);
    }
 
@@ -577,6 +785,9 @@ int CoreCallback::OnXYStagePositionChanged(const MM::Device* device, double xPos
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+            "onXYStagePositionChanged");
+      traceScope.SetArg("device", label);
       core_->externalCallback_->onXYStagePositionChanged(label, xPos, yPos);
    }
 
@@ -592,6 +803,9 @@ int CoreCallback::OnExposureChanged(const MM::Device* device, double newExposure
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+            "onExposureChanged");
+      traceScope.SetArg("device", label);
       core_->externalCallback_->onExposureChanged(label, newExposure);
    }
    return DEVICE_OK;
@@ -607,6 +821,9 @@ int CoreCallback::OnSLMExposureChanged(const MM::Device* device, double newExpos
       MMThreadGuard g(*pValueChangeLock_);
       char label[MM::MaxStrLength];
       device->GetLabel(label);
+      mm::TraceScope traceScope(core_->traceRecorder_.get(), "callback",
+            "onSLMExposureChanged");
+      traceScope.SetArg("device", label);
       core_->externalCallback_->onSLMExposureChanged(label, newExposure);
    }
    return DEVICE_OK;
@@ -1054,5 +1271,5 @@ unsigned long CoreCallback::GetClockTicksUs(const MM::Device* /*caller*/)
 
 MM::MMTime CoreCallback::GetCurrentMMTime()
 {		
-	return GetMMTimeNow();
+	return mm::MonotonicClock::NowAsMMTime();
 }
@@ -0,0 +1,243 @@
+// DESCRIPTION:   Recording of the device calls made during a session
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceCallRecorder.h"
+
+#include "CoreUtils.h"
+#include "Error.h"
+
+#include <algorithm>
+#include <sstream>
+
+
+namespace mm
+{
+
+namespace
+{
+
+const char* const fileHeader = "# Micro-Manager device call recording 1";
+
+void
+WriteField(std::ostream& out, const std::string& field)
+{
+   for (std::string::const_iterator it = field.begin(), end = field.end();
+         it != end; ++it)
+   {
+      switch (*it)
+      {
+         case '\t': out << "\\t"; break;
+         case '\n': out << "\\n"; break;
+         case '\r': out << "\\r"; break;
+         case '\\': out << "\\\\"; break;
+         default: out << *it;
+      }
+   }
+}
+
+std::string
+UnescapeField(const std::string& field)
+{
+   std::string result;
+   result.reserve(field.size());
+   for (size_t i = 0; i < field.size(); ++i)
+   {
+      if (field[i] != '\\' || i + 1 == field.size())
+      {
+         result += field[i];
+         continue;
+      }
+      switch (field[++i])
+      {
+         case 't': result += '\t'; break;
+         case 'n': result += '\n'; break;
+         case 'r': result += '\r'; break;
+         default: result += field[i];
+      }
+   }
+   return result;
+}
+
+std::vector<std::string>
+SplitFields(const std::string& line)
+{
+   std::vector<std::string> fields;
+   std::string::size_type start = 0;
+   for (;;)
+   {
+      std::string::size_type tab = line.find('\t', start);
+      fields.push_back(UnescapeField(line.substr(start,
+                  tab == std::string::npos ? std::string::npos : tab - start)));
+      if (tab == std::string::npos)
+         break;
+      start = tab + 1;
+   }
+   return fields;
+}
+
+struct StartsEarlier
+{
+   bool operator()(const RecordedDeviceCall& lhs,
+         const RecordedDeviceCall& rhs) const
+   { return lhs.startUs < rhs.startUs; }
+};
+
+} // anonymous namespace
+
+
+const size_t DeviceCallRecorder::MaxCalls;
+
+DeviceCallRecorder::DeviceCallRecorder() :
+   enabled_(false),
+   dropped_(0)
+{
+}
+
+
+void
+DeviceCallRecorder::Record(const std::string& device, const char* method,
+      const std::vector<std::string>& args,
+      boost::int64_t startUs, boost::int64_t durationUs)
+{
+   const logging::internal::ThreadIdType tid = logging::internal::GetTid();
+
+   boost::mutex::scoped_lock lock(mutex_);
+   if (calls_.size() >= MaxCalls)
+   {
+      ++dropped_;
+      return;
+   }
+
+   std::map<logging::internal::ThreadIdType, unsigned>::const_iterator found =
+      threadNumbers_.find(tid);
+   unsigned thread;
+   if (found != threadNumbers_.end())
+   {
+      thread = found->second;
+   }
+   else
+   {
+      thread = static_cast<unsigned>(threadNumbers_.size() + 1);
+      threadNumbers_[tid] = thread;
+   }
+
+   calls_.push_back(RecordedDeviceCall());
+   RecordedDeviceCall& call = calls_.back();
+   call.startUs = startUs;
+   call.durationUs = durationUs;
+   call.thread = thread;
+   call.device = device;
+   call.method = method;
+   call.args = args;
+}
+
+
+void
+DeviceCallRecorder::Clear()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   calls_.clear();
+   dropped_ = 0;
+   threadNumbers_.clear();
+}
+
+
+size_t
+DeviceCallRecorder::GetCallCount() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return calls_.size();
+}
+
+
+size_t
+DeviceCallRecorder::GetDroppedCount() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return dropped_;
+}
+
+
+std::vector<RecordedDeviceCall>
+DeviceCallRecorder::GetCalls() const
+{
+   std::vector<RecordedDeviceCall> calls;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      calls = calls_;
+   }
+   std::stable_sort(calls.begin(), calls.end(), StartsEarlier());
+   return calls;
+}
+
+
+void
+DeviceCallRecorder::Write(std::ostream& out) const
+{
+   std::vector<RecordedDeviceCall> calls = GetCalls();
+
+   out << fileHeader << '\n';
+   for (std::vector<RecordedDeviceCall>::const_iterator it = calls.begin(),
+         end = calls.end(); it != end; ++it)
+   {
+      out << it->startUs << '\t' << it->durationUs << '\t' << it->thread <<
+         '\t';
+      WriteField(out, it->device);
+      out << '\t';
+      WriteField(out, it->method);
+      for (size_t i = 0; i < it->args.size(); ++i)
+      {
+         out << '\t';
+         WriteField(out, it->args[i]);
+      }
+      out << '\n';
+   }
+}
+
+
+std::vector<RecordedDeviceCall>
+DeviceCallRecorder::Read(std::istream& in)
+{
+   std::string line;
+   if (!std::getline(in, line) || line != fileHeader)
+      throw CMMError("Not a device call recording");
+
+   std::vector<RecordedDeviceCall> calls;
+   for (unsigned lineNr = 2; std::getline(in, line); ++lineNr)
+   {
+      if (!line.empty() && line[line.size() - 1] == '\r')
+         line.erase(line.size() - 1);
+      if (line.empty())
+         continue;
+
+      std::vector<std::string> fields = SplitFields(line);
+      RecordedDeviceCall call;
+      if (fields.size() < 5 ||
+            !(std::istringstream(fields[0]) >> call.startUs) ||
+            !(std::istringstream(fields[1]) >> call.durationUs) ||
+            !(std::istringstream(fields[2]) >> call.thread))
+      {
+         throw CMMError("Invalid device call recording at line " +
+               ToString(lineNr));
+      }
+      call.device = fields[3];
+      call.method = fields[4];
+      call.args.assign(fields.begin() + 5, fields.end());
+      calls.push_back(call);
+   }
+   return calls;
+}
+
+} // namespace mm
@@ -0,0 +1,108 @@
+// DESCRIPTION:   Recording of the device calls made during a session
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Logging/Metadata.h"
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief A device call, with its arguments and timing.
+ */
+struct RecordedDeviceCall
+{
+   RecordedDeviceCall() : startUs(0), durationUs(0), thread(0) {}
+
+   boost::int64_t startUs;
+   boost::int64_t durationUs;
+   /// Threads are numbered from 1 in order of their first call
+   unsigned thread;
+   std::string device;
+   /// Name of the DeviceInstance member function
+   std::string method;
+   std::vector<std::string> args;
+};
+
+
+/**
+ * \brief Records the device calls made while enabled, for later replay by
+ * DeviceCallReplayer.
+ *
+ * Calls are recorded (by DeviceCallTimer) when they return, so the list is
+ * ordered by end time; it is sorted by start time when written.
+ *
+ * Recording takes a mutex, unlike device call statistics and tracing, since
+ * the list grows; at most MaxCalls calls are kept, and later calls are
+ * counted as dropped.
+ *
+ * The file format is text, with a header line followed by one call per
+ * line: start time (us), duration (us), thread number, device label, method
+ * name and arguments, separated by tabs. Tabs, newlines and backslashes in
+ * the fields are escaped with a backslash.
+ */
+class DeviceCallRecorder /* final */
+{
+public:
+   static const size_t MaxCalls = 1000000;
+
+   DeviceCallRecorder();
+
+   void SetEnabled(bool enable) { enabled_.store(enable, boost::memory_order_relaxed); }
+   bool IsEnabled() const { return enabled_.load(boost::memory_order_relaxed); }
+
+   void Record(const std::string& device, const char* method,
+         const std::vector<std::string>& args,
+         boost::int64_t startUs, boost::int64_t durationUs);
+
+   void Clear();
+   size_t GetCallCount() const;
+   size_t GetDroppedCount() const;
+   std::vector<RecordedDeviceCall> GetCalls() const;
+
+   void Write(std::ostream& out) const;
+
+   /**
+    * \brief Read calls written by Write().
+    *
+    * Throws CMMError if the input is not a device call recording.
+    */
+   static std::vector<RecordedDeviceCall> Read(std::istream& in);
+
+private:
+   DeviceCallRecorder(const DeviceCallRecorder&);
+   DeviceCallRecorder& operator=(const DeviceCallRecorder&);
+
+   boost::atomic<bool> enabled_;
+
+   mutable boost::mutex mutex_;
+   std::vector<RecordedDeviceCall> calls_;
+   size_t dropped_;
+   std::map<logging::internal::ThreadIdType, unsigned> threadNumbers_;
+};
+
+} // namespace mm
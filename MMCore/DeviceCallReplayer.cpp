@@ -0,0 +1,360 @@
+// DESCRIPTION:   Replay of recorded device calls against the loaded devices
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceCallReplayer.h"
+
+#include "CoreUtils.h"
+#include "DeviceManager.h"
+#include "Devices/DeviceInstances.h"
+#include "Error.h"
+#include "LoadableModules/LoadedDeviceAdapter.h"
+#include "MonotonicClock.h"
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+
+
+namespace mm
+{
+
+namespace
+{
+
+template <typename T>
+T
+ParseArg(const RecordedDeviceCall& call, size_t index)
+{
+   T value;
+   std::istringstream strm(call.args[index]);
+   if (!(strm >> value))
+   {
+      throw CMMError("Invalid argument " + ToQuotedString(call.args[index]) +
+            " to recorded call " + call.method);
+   }
+   return value;
+}
+
+void
+SleepUntil(boost::int64_t timeUs)
+{
+   const boost::int64_t remainingUs = timeUs - MonotonicClock::NowUs();
+   if (remainingUs > 0)
+      boost::this_thread::sleep(boost::posix_time::microseconds(remainingUs));
+}
+
+} // anonymous namespace
+
+
+DeviceCallReplayer::DeviceCallReplayer(
+      boost::shared_ptr<DeviceManager> deviceManager,
+      logging::Logger logger) :
+   deviceManager_(deviceManager),
+   logger_(logger)
+{
+}
+
+
+DeviceCallReplayer::Result
+DeviceCallReplayer::Replay(const std::vector<RecordedDeviceCall>& calls,
+      bool withRecordedTiming, bool allowRealDevices)
+{
+   Result result;
+   if (calls.empty())
+      return result;
+
+   // Look up the devices and group the calls by recorded thread before
+   // issuing anything, so that a refused device stops the whole replay
+   DeviceMap devices;
+   std::set<std::string> missingDevices;
+   std::map< unsigned, std::vector<const RecordedDeviceCall*> > threadCalls;
+   for (std::vector<RecordedDeviceCall>::const_iterator it = calls.begin(),
+         end = calls.end(); it != end; ++it)
+   {
+      const RecordedDeviceCall& call = *it;
+      if (devices.find(call.device) == devices.end() &&
+            missingDevices.find(call.device) == missingDevices.end())
+      {
+         boost::shared_ptr<DeviceInstance> device;
+         try
+         {
+            device = deviceManager_->GetDevice(call.device);
+         }
+         catch (const CMMError&)
+         {
+            missingDevices.insert(call.device);
+            LOG_WARNING(logger_) << "Skipping replay of calls to device " <<
+               call.device << ", which is not loaded";
+         }
+         if (device)
+         {
+            const std::string moduleName =
+               device->GetAdapterModule()->GetName();
+            if (!allowRealDevices && !IsSimulatedAdapter(moduleName))
+            {
+               throw CMMError("Cannot replay calls to device " +
+                     ToQuotedString(call.device) + " of adapter " +
+                     ToQuotedString(moduleName) +
+                     ", which is not a simulated device");
+            }
+            devices[call.device] = device;
+         }
+      }
+      threadCalls[call.thread].push_back(&call);
+   }
+
+   const boost::int64_t replayStartUs = MonotonicClock::NowUs();
+   const boost::int64_t recordingStartUs = calls.front().startUs;
+   std::vector<Result> threadResults(threadCalls.size());
+   boost::thread_group threads;
+   size_t i = 0;
+   for (std::map< unsigned, std::vector<const RecordedDeviceCall*> >::
+         const_iterator it = threadCalls.begin(), end = threadCalls.end();
+         it != end; ++it, ++i)
+   {
+      threads.create_thread(boost::bind(&DeviceCallReplayer::ReplayThread,
+               this, boost::cref(it->second), boost::cref(devices),
+               replayStartUs, recordingStartUs, withRecordedTiming,
+               &threadResults[i]));
+   }
+   threads.join_all();
+
+   for (std::vector<Result>::const_iterator it = threadResults.begin(),
+         end = threadResults.end(); it != end; ++it)
+   {
+      result.replayed += it->replayed;
+      result.skipped += it->skipped;
+      result.failed += it->failed;
+   }
+   result.elapsedMs = (MonotonicClock::NowUs() - replayStartUs) / 1000.0;
+
+   boost::int64_t recordingEndUs = recordingStartUs;
+   for (std::vector<RecordedDeviceCall>::const_iterator it = calls.begin(),
+         end = calls.end(); it != end; ++it)
+      recordingEndUs = std::max(recordingEndUs, it->startUs + it->durationUs);
+
+   LOG_INFO(logger_) << "Replayed " << result.replayed << " device calls (" <<
+      result.failed << " failed, " << result.skipped << " skipped) from " <<
+      threadCalls.size() << " threads in " << result.elapsedMs <<
+      " ms; recorded session took " <<
+      (recordingEndUs - recordingStartUs) / 1000.0 << " ms";
+   return result;
+}
+
+
+bool
+DeviceCallReplayer::IsSimulatedAdapter(const std::string& moduleName)
+{
+   return moduleName == "DemoCamera" || moduleName == "SequenceTester";
+}
+
+
+void
+DeviceCallReplayer::ReplayThread(
+      const std::vector<const RecordedDeviceCall*>& calls,
+      const DeviceMap& devices, boost::int64_t replayStartUs,
+      boost::int64_t recordingStartUs, bool withRecordedTiming,
+      Result* result)
+{
+   for (std::vector<const RecordedDeviceCall*>::const_iterator it =
+         calls.begin(), end = calls.end(); it != end; ++it)
+   {
+      const RecordedDeviceCall& call = **it;
+      DeviceMap::const_iterator found = devices.find(call.device);
+      if (found == devices.end())
+      {
+         ++result->skipped;
+         continue;
+      }
+      boost::shared_ptr<DeviceInstance> device = found->second;
+
+      if (withRecordedTiming)
+         SleepUntil(replayStartUs + (call.startUs - recordingStartUs));
+
+      const boost::int64_t startUs = MonotonicClock::NowUs();
+      int ret = DEVICE_OK;
+      bool issued;
+      {
+         DeviceModuleLockGuard guard(device);
+         try
+         {
+            issued = Issue(device, call, ret);
+         }
+         catch (const CMMError& e)
+         {
+            LOG_DEBUG(logger_) << "Replayed call " << call.method <<
+               " to device " << call.device << " failed: " << e.getMsg();
+            issued = true;
+            ret = DEVICE_ERR;
+         }
+      }
+
+      if (!issued)
+      {
+         LOG_DEBUG(logger_) << "Cannot replay call " << call.method <<
+            " with " << call.args.size() << " arguments to device " <<
+            call.device;
+         ++result->skipped;
+         continue;
+      }
+      ++result->replayed;
+      if (ret != DEVICE_OK)
+         ++result->failed;
+
+      if (withRecordedTiming)
+         SleepUntil(startUs + call.durationUs);
+   }
+}
+
+
+bool
+DeviceCallReplayer::Issue(boost::shared_ptr<DeviceInstance> device,
+      const RecordedDeviceCall& call, int& result)
+{
+   const std::string& method = call.method;
+   const size_t argc = call.args.size();
+   result = DEVICE_OK;
+
+   if (method == "GetProperty" && argc == 1)
+   {
+      device->GetProperty(call.args[0]);
+      return true;
+   }
+   if (method == "SetProperty" && argc == 2)
+   {
+      device->SetProperty(call.args[0], call.args[1]);
+      return true;
+   }
+   if (method == "Busy" && argc == 0)
+   {
+      device->Busy();
+      return true;
+   }
+
+   if (boost::shared_ptr<CameraInstance> camera =
+         boost::dynamic_pointer_cast<CameraInstance>(device))
+   {
+      if (method == "SnapImage" && argc == 0)
+         result = camera->SnapImage();
+      else if (method == "GetImageBuffer" && argc == 0)
+         camera->GetImageBuffer();
+      else if (method == "GetImageBuffer" && argc == 1)
+         camera->GetImageBuffer(ParseArg<unsigned>(call, 0));
+      else if (method == "GetImageBufferAsRGB32" && argc == 0)
+         camera->GetImageBufferAsRGB32();
+      else if (method == "SetExposure" && argc == 1)
+         camera->SetExposure(ParseArg<double>(call, 0));
+      else if (method == "StartSequenceAcquisition" && argc == 3)
+         result = camera->StartSequenceAcquisition(ParseArg<long>(call, 0),
+               ParseArg<double>(call, 1), ParseArg<long>(call, 2) != 0);
+      else if (method == "StartSequenceAcquisition" && argc == 1)
+         result = camera->StartSequenceAcquisition(ParseArg<double>(call, 0));
+      else if (method == "StopSequenceAcquisition" && argc == 0)
+         result = camera->StopSequenceAcquisition();
+      else
+         return false;
+      return true;
+   }
+
+   if (boost::shared_ptr<ShutterInstance> shutter =
+         boost::dynamic_pointer_cast<ShutterInstance>(device))
+   {
+      if (method == "SetOpen" && argc == 1)
+         result = shutter->SetOpen(ParseArg<long>(call, 0) != 0);
+      else
+         return false;
+      return true;
+   }
+
+   if (boost::shared_ptr<StageInstance> stage =
+         boost::dynamic_pointer_cast<StageInstance>(device))
+   {
+      double pos;
+      long steps;
+      if (method == "SetPositionUm" && argc == 1)
+         result = stage->SetPositionUm(ParseArg<double>(call, 0));
+      else if (method == "SetRelativePositionUm" && argc == 1)
+         result = stage->SetRelativePositionUm(ParseArg<double>(call, 0));
+      else if (method == "GetPositionUm" && argc == 0)
+         result = stage->GetPositionUm(pos);
+      else if (method == "SetPositionSteps" && argc == 1)
+         result = stage->SetPositionSteps(ParseArg<long>(call, 0));
+      else if (method == "GetPositionSteps" && argc == 0)
+         result = stage->GetPositionSteps(steps);
+      else
+         return false;
+      return true;
+   }
+
+   if (boost::shared_ptr<XYStageInstance> xyStage =
+         boost::dynamic_pointer_cast<XYStageInstance>(device))
+   {
+      double x, y;
+      long xSteps, ySteps;
+      if (method == "SetPositionUm" && argc == 2)
+         result = xyStage->SetPositionUm(ParseArg<double>(call, 0),
+               ParseArg<double>(call, 1));
+      else if (method == "SetRelativePositionUm" && argc == 2)
+         result = xyStage->SetRelativePositionUm(ParseArg<double>(call, 0),
+               ParseArg<double>(call, 1));
+      else if (method == "GetPositionUm" && argc == 0)
+         result = xyStage->GetPositionUm(x, y);
+      else if (method == "SetPositionSteps" && argc == 2)
+         result = xyStage->SetPositionSteps(ParseArg<long>(call, 0),
+               ParseArg<long>(call, 1));
+      else if (method == "GetPositionSteps" && argc == 0)
+         result = xyStage->GetPositionSteps(xSteps, ySteps);
+      else if (method == "SetRelativePositionSteps" && argc == 2)
+         result = xyStage->SetRelativePositionSteps(ParseArg<long>(call, 0),
+               ParseArg<long>(call, 1));
+      else
+         return false;
+      return true;
+   }
+
+   if (boost::shared_ptr<StateInstance> state =
+         boost::dynamic_pointer_cast<StateInstance>(device))
+   {
+      long pos;
+      if (method == "SetPosition" && argc == 1)
+         result = state->SetPosition(ParseArg<long>(call, 0));
+      else if (method == "SetPositionByLabel" && argc == 1)
+         result = state->SetPosition(call.args[0].c_str());
+      else if (method == "GetPosition" && argc == 0)
+         result = state->GetPosition(pos);
+      else
+         return false;
+      return true;
+   }
+
+   if (boost::shared_ptr<AutoFocusInstance> autoFocus =
+         boost::dynamic_pointer_cast<AutoFocusInstance>(device))
+   {
+      if (method == "FullFocus" && argc == 0)
+         result = autoFocus->FullFocus();
+      else
+         return false;
+      return true;
+   }
+
+   return false;
+}
+
+} // namespace mm
@@ -0,0 +1,102 @@
+// DESCRIPTION:   Replay of recorded device calls against the loaded devices
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "DeviceCallRecorder.h"
+#include "Logging/Logger.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class DeviceInstance;
+
+
+namespace mm
+{
+
+class DeviceManager;
+
+/**
+ * \brief Issues recorded device calls to the loaded devices of the same
+ * labels, typically simulated devices (e.g. DemoCamera or SequenceTester).
+ *
+ * The calls of each recorded thread are issued from a thread of their own,
+ * in order of their recorded start times, holding the device's module lock
+ * as the Core does. Calls made concurrently during recording (e.g. a
+ * sequence acquisition thread inserting images while the application moves
+ * a stage) are therefore also concurrent during replay.
+ *
+ * With recorded timing, each call is issued no earlier than its recorded
+ * start time (relative to the first call of the recording), and the next
+ * call of the same thread is issued no earlier than the end of the recorded
+ * duration, so that the simulated devices show the latencies of the recorded
+ * ones. The module lock is not held while waiting. Without recorded timing,
+ * the calls of each thread are issued as fast as possible.
+ *
+ * Since replayed calls move hardware, the replay is refused if any of the
+ * devices belongs to an adapter other than the simulated ones, unless real
+ * devices are explicitly allowed.
+ */
+class DeviceCallReplayer /* final */
+{
+public:
+   struct Result
+   {
+      Result() : replayed(0), skipped(0), failed(0), elapsedMs(0.0) {}
+
+      /// Calls issued (including those that failed)
+      size_t replayed;
+      /// Calls to devices that are not loaded or do not support the method
+      size_t skipped;
+      /// Calls that returned an error
+      size_t failed;
+      double elapsedMs;
+   };
+
+   DeviceCallReplayer(boost::shared_ptr<DeviceManager> deviceManager,
+         logging::Logger logger);
+
+   /**
+    * Throws CMMError, before issuing any call, if a device is not from a
+    * simulated adapter and allowRealDevices is false.
+    */
+   Result Replay(const std::vector<RecordedDeviceCall>& calls,
+         bool withRecordedTiming, bool allowRealDevices);
+
+   /// Whether the adapter only contains simulated devices
+   static bool IsSimulatedAdapter(const std::string& moduleName);
+
+private:
+   typedef std::map< std::string, boost::shared_ptr<DeviceInstance> >
+      DeviceMap;
+
+   void ReplayThread(const std::vector<const RecordedDeviceCall*>& calls,
+         const DeviceMap& devices, boost::int64_t replayStartUs,
+         boost::int64_t recordingStartUs, bool withRecordedTiming,
+         Result* result);
+   // Returns false if the device does not support the call
+   bool Issue(boost::shared_ptr<DeviceInstance> device,
+         const RecordedDeviceCall& call, int& result);
+
+   boost::shared_ptr<DeviceManager> deviceManager_;
+   logging::Logger logger_;
+};
+
+} // namespace mm
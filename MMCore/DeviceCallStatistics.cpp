@@ -0,0 +1,205 @@
+// DESCRIPTION:   Per-device latency statistics of device calls
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceCallStatistics.h"
+
+#include <algorithm>
+#include <cstdio>
+
+
+namespace mm
+{
+
+namespace
+{
+
+const char* const deviceCallNames[DeviceCallCount] =
+{
+   "ModuleLockWait",
+   "GetProperty",
+   "SetProperty",
+   "Busy",
+   "SnapImage",
+   "GetImageBuffer",
+   "StartSequenceAcquisition",
+   "StopSequenceAcquisition",
+   "SetExposure",
+   "SetOpen",
+   "SetPosition",
+   "GetPosition",
+   "FullFocus",
+};
+
+unsigned
+LatencyBin(boost::uint64_t durationUs)
+{
+   unsigned bin = 0;
+   while (durationUs > 0 && bin < DeviceCallTiming::HistogramBins - 1)
+   {
+      durationUs >>= 1;
+      ++bin;
+   }
+   return bin;
+}
+
+} // anonymous namespace
+
+
+const char*
+GetDeviceCallName(DeviceCall call)
+{
+   if (call < 0 || call >= DeviceCallCount)
+      return "";
+   return deviceCallNames[call];
+}
+
+
+bool
+FindDeviceCall(const std::string& name, DeviceCall& call)
+{
+   for (int i = 0; i < DeviceCallCount; ++i)
+   {
+      if (name == deviceCallNames[i])
+      {
+         call = static_cast<DeviceCall>(i);
+         return true;
+      }
+   }
+   return false;
+}
+
+
+const unsigned DeviceCallTiming::HistogramBins;
+
+DeviceCallTiming::DeviceCallTiming() :
+   count(0),
+   totalMs(0.0),
+   maxMs(0.0),
+   histogram(HistogramBins, 0)
+{
+}
+
+
+double
+DeviceCallTiming::GetPercentileUpperBoundMs(double fraction) const
+{
+   long total = 0;
+   for (size_t i = 0; i < histogram.size(); ++i)
+      total += histogram[i];
+   if (total == 0)
+      return 0.0;
+
+   long accumulated = 0;
+   for (size_t i = 0; i < histogram.size(); ++i)
+   {
+      accumulated += histogram[i];
+      if (accumulated >= fraction * total)
+      {
+         // The last bin is open-ended
+         if (i + 1 == histogram.size())
+            return maxMs;
+         return std::min(maxMs, static_cast<double>(1 << i) / 1000.0);
+      }
+   }
+   return maxMs;
+}
+
+
+DeviceCallStatistics::DeviceCallStatistics() :
+   enabled_(false),
+   trace_(0),
+   recorder_(0)
+{
+   Reset();
+}
+
+
+void
+DeviceCallStatistics::Record(DeviceCall call, boost::int64_t durationUs)
+{
+   if (call < 0 || call >= DeviceCallCount)
+      return;
+   const boost::uint64_t us = durationUs > 0 ?
+      static_cast<boost::uint64_t>(durationUs) : 0;
+
+   Counters& counters = counters_[call];
+   counters.count.fetch_add(1, boost::memory_order_relaxed);
+   counters.totalUs.fetch_add(us, boost::memory_order_relaxed);
+   counters.histogram[LatencyBin(us)].fetch_add(1, boost::memory_order_relaxed);
+
+   boost::uint64_t max = counters.maxUs.load(boost::memory_order_relaxed);
+   while (us > max &&
+         !counters.maxUs.compare_exchange_weak(max, us, boost::memory_order_relaxed))
+      ;
+}
+
+
+DeviceCallTiming
+DeviceCallStatistics::GetTiming(DeviceCall call) const
+{
+   DeviceCallTiming timing;
+   if (call < 0 || call >= DeviceCallCount)
+      return timing;
+
+   const Counters& counters = counters_[call];
+   timing.count = static_cast<long>(counters.count.load(boost::memory_order_relaxed));
+   timing.totalMs = counters.totalUs.load(boost::memory_order_relaxed) / 1000.0;
+   timing.maxMs = counters.maxUs.load(boost::memory_order_relaxed) / 1000.0;
+   for (unsigned i = 0; i < DeviceCallTiming::HistogramBins; ++i)
+   {
+      timing.histogram[i] = static_cast<long>(
+            counters.histogram[i].load(boost::memory_order_relaxed));
+   }
+   return timing;
+}
+
+
+void
+DeviceCallStatistics::Reset()
+{
+   for (int call = 0; call < DeviceCallCount; ++call)
+   {
+      Counters& counters = counters_[call];
+      counters.count.store(0, boost::memory_order_relaxed);
+      counters.totalUs.store(0, boost::memory_order_relaxed);
+      counters.maxUs.store(0, boost::memory_order_relaxed);
+      for (unsigned i = 0; i < DeviceCallTiming::HistogramBins; ++i)
+         counters.histogram[i].store(0, boost::memory_order_relaxed);
+   }
+}
+
+
+void
+DeviceCallTimer::AddArg(double arg)
+{
+   if (!recording_)
+      return;
+   char buf[32];
+   std::sprintf(buf, "%.17g", arg);
+   args_.push_back(buf);
+}
+
+
+void
+DeviceCallTimer::AddArg(long arg)
+{
+   if (!recording_)
+      return;
+   char buf[32];
+   std::sprintf(buf, "%ld", arg);
+   args_.push_back(buf);
+}
+
+} // namespace mm
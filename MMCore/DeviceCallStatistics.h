@@ -0,0 +1,224 @@
+// DESCRIPTION:   Per-device latency statistics of device calls
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "DeviceCallRecorder.h"
+#include "MonotonicClock.h"
+#include "TraceRecorder.h"
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief Kinds of device calls that are timed.
+ */
+enum DeviceCall
+{
+   /// Waiting to acquire the device adapter module lock
+   DeviceCallModuleLockWait,
+   DeviceCallGetProperty,
+   DeviceCallSetProperty,
+   DeviceCallBusy,
+   DeviceCallSnapImage,
+   DeviceCallGetImageBuffer,
+   DeviceCallStartSequenceAcquisition,
+   DeviceCallStopSequenceAcquisition,
+   DeviceCallSetExposure,
+   DeviceCallSetOpen,
+   /// Moves of stages, XY stages and state devices
+   DeviceCallSetPosition,
+   DeviceCallGetPosition,
+   DeviceCallFullFocus,
+   DeviceCallCount
+};
+
+/// Name of a device call kind, as used by the Core API
+const char* GetDeviceCallName(DeviceCall call);
+
+/**
+ * \brief Look up a device call kind by name.
+ *
+ * Returns false if the name is not known.
+ */
+bool FindDeviceCall(const std::string& name, DeviceCall& call);
+
+
+/**
+ * \brief Latency statistics of one kind of call to one device.
+ */
+struct DeviceCallTiming
+{
+   /**
+    * \brief Number of bins of the latency histogram.
+    *
+    * Bin 0 counts calls taking less than 1 us; bin i (i > 0) counts calls
+    * taking [2^(i-1), 2^i) us. The last bin also counts all longer calls.
+    */
+   static const unsigned HistogramBins = 26;
+
+   DeviceCallTiming();
+
+   /// Upper bound of the latency below which the given fraction of calls fell
+   double GetPercentileUpperBoundMs(double fraction) const;
+
+   long count;
+   double totalMs;
+   double maxMs;
+   std::vector<long> histogram;
+};
+
+
+/**
+ * \brief Latency counters of the calls made to one device.
+ *
+ * Recording is lock-free and may be done from any thread. Each counter is
+ * updated atomically, so a snapshot taken while calls are being recorded may
+ * be slightly inconsistent (e.g. the histogram may not add up to the count).
+ *
+ * Disabled by default; when disabled (and not tracing), DeviceCallTimer does
+ * not read the clock, so the cost is that of testing a flag.
+ */
+class DeviceCallStatistics /* final */
+{
+public:
+   DeviceCallStatistics();
+
+   void SetEnabled(bool enable) { enabled_.store(enable, boost::memory_order_relaxed); }
+   bool IsEnabled() const { return enabled_.load(boost::memory_order_relaxed); }
+
+   void Record(DeviceCall call, boost::int64_t durationUs);
+   DeviceCallTiming GetTiming(DeviceCall call) const;
+   void Reset();
+
+   /**
+    * \brief Also record timed calls as trace spans attributed to the device.
+    *
+    * Must be set before any call is timed.
+    */
+   void SetTrace(TraceRecorder* trace, const std::string& deviceLabel)
+   { trace_ = trace; deviceLabel_ = deviceLabel; }
+   TraceRecorder* GetTrace() const { return trace_; }
+   const std::string& GetDeviceLabel() const { return deviceLabel_; }
+
+   /**
+    * \brief Also record timed calls, with their arguments, for replay.
+    *
+    * Must be set before any call is timed; the device label is that passed
+    * to SetTrace().
+    */
+   void SetRecorder(DeviceCallRecorder* recorder) { recorder_ = recorder; }
+   DeviceCallRecorder* GetRecorder() const { return recorder_; }
+
+private:
+   DeviceCallStatistics(const DeviceCallStatistics&);
+   DeviceCallStatistics& operator=(const DeviceCallStatistics&);
+
+   struct Counters
+   {
+      boost::atomic<boost::uint64_t> count;
+      boost::atomic<boost::uint64_t> totalUs;
+      boost::atomic<boost::uint64_t> maxUs;
+      boost::atomic<boost::uint64_t> histogram[DeviceCallTiming::HistogramBins];
+   };
+
+   boost::atomic<bool> enabled_;
+   Counters counters_[DeviceCallCount];
+   TraceRecorder* trace_;
+   DeviceCallRecorder* recorder_;
+   std::string deviceLabel_;
+};
+
+
+/**
+ * \brief Records the time from construction to destruction (or Stop()) as a
+ * device call, if statistics, tracing or recording are enabled.
+ *
+ * For recording, method is the name of the called DeviceInstance member
+ * function (if different from the name of the call kind), and its arguments
+ * must be added with AddArg().
+ */
+class DeviceCallTimer /* final */
+{
+public:
+   DeviceCallTimer(DeviceCallStatistics& stats, DeviceCall call,
+         const char* method = 0) :
+      stats_(stats),
+      call_(call),
+      method_(method ? method : GetDeviceCallName(call)),
+      timing_(stats.IsEnabled()),
+      tracing_(stats.GetTrace() && stats.GetTrace()->IsEnabled()),
+      // Lock waits are not calls to the device, so are not replayed
+      recording_(call != DeviceCallModuleLockWait &&
+            stats.GetRecorder() && stats.GetRecorder()->IsEnabled()),
+      startUs_(timing_ || tracing_ || recording_ ? MonotonicClock::NowUs() : 0)
+   {}
+
+   /// Whether arguments will be recorded; can be used to skip formatting
+   bool IsRecording() const { return recording_; }
+
+   void AddArg(const std::string& arg) { if (recording_) args_.push_back(arg); }
+   void AddArg(const char* arg) { if (recording_) args_.push_back(arg ? arg : ""); }
+   /// Formatted so as to be read back exactly
+   void AddArg(double arg);
+   void AddArg(long arg);
+
+   ~DeviceCallTimer() { Stop(); }
+
+   /// Records the call now instead of on destruction
+   void Stop()
+   {
+      if (!timing_ && !tracing_ && !recording_)
+         return;
+      const boost::int64_t durationUs = MonotonicClock::NowUs() - startUs_;
+      if (timing_)
+         stats_.Record(call_, durationUs);
+      if (tracing_)
+      {
+         stats_.GetTrace()->RecordSpan(
+               call_ == DeviceCallModuleLockWait ? "lock" : "device",
+               GetDeviceCallName(call_), "device",
+               stats_.GetDeviceLabel().c_str(), startUs_, durationUs);
+      }
+      if (recording_)
+      {
+         stats_.GetRecorder()->Record(stats_.GetDeviceLabel(), method_,
+               args_, startUs_, durationUs);
+      }
+      timing_ = tracing_ = recording_ = false;
+   }
+
+private:
+   DeviceCallTimer(const DeviceCallTimer&);
+   DeviceCallTimer& operator=(const DeviceCallTimer&);
+
+   DeviceCallStatistics& stats_;
+   const DeviceCall call_;
+   const char* const method_;
+   bool timing_;
+   bool tracing_;
+   bool recording_;
+   const boost::int64_t startUs_;
+   std::vector<std::string> args_;
+};
+
+} // namespace mm
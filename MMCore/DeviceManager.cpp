@@ -23,7 +23,6 @@
 #include "Error.h"
 #include "LoadableModules/LoadedDeviceAdapter.h"
 
-#include <algorithm>
 
 namespace mm
 {
@@ -41,13 +40,11 @@ DeviceManager::LoadDevice(boost::shared_ptr<LoadedDeviceAdapter> module,
       mm::logging::Logger deviceLogger,
       mm::logging::Logger coreLogger)
 {
-   for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+   Symbol labelSymbol;
+   if (SymbolTable::Find(label, labelSymbol) && labelIndex_.count(labelSymbol))
    {
-      if (it->first == label)
-      {
-         throw CMMError("The specified device label " + ToQuotedString(label) +
-               " is already in use", MMERR_DuplicateLabel);
-      }
+      throw CMMError("The specified device label " + ToQuotedString(label) +
+            " is already in use", MMERR_DuplicateLabel);
    }
 
    boost::shared_ptr<DeviceInstance> device = module->LoadDevice(core,
@@ -73,11 +70,162 @@ DeviceManager::LoadDevice(boost::shared_ptr<LoadedDeviceAdapter> module,
    }
 
    devices_.push_back(std::make_pair(label, device));
+   labelIndex_[SymbolTable::Intern(label)] = device;
    deviceRawPtrIndex_.insert(std::make_pair(device->GetRawPtr(), device));
    return device;
 }
 
 
+void
+DeviceManager::DeferDevice(const std::string& moduleName,
+      const std::string& deviceName, const std::string& label)
+{
+   Symbol labelSymbol;
+   if (SymbolTable::Find(label, labelSymbol) && labelIndex_.count(labelSymbol))
+   {
+      throw CMMError("The specified device label " + ToQuotedString(label) +
+            " is already in use", MMERR_DuplicateLabel);
+   }
+
+   DeferredDevice deferred;
+   deferred.moduleName = moduleName;
+   deferred.deviceName = deviceName;
+   MMThreadGuard g(bindLock_);
+   deferredDevices_[label] = deferred;
+   devices_.push_back(std::make_pair(label, boost::shared_ptr<DeviceInstance>()));
+   labelIndex_[SymbolTable::Intern(label)] = boost::shared_ptr<DeviceInstance>();
+}
+
+
+boost::shared_ptr<DeviceInstance>
+DeviceManager::BindDeferredDevice(boost::shared_ptr<LoadedDeviceAdapter> module,
+      const std::string& label, CMMCore* core,
+      mm::logging::Logger deviceLogger,
+      mm::logging::Logger coreLogger)
+{
+   MMThreadGuard g(bindLock_);
+   std::map<std::string, DeferredDevice>::iterator found =
+      deferredDevices_.find(label);
+   if (found == deferredDevices_.end())
+      throw CMMError("Device " + ToQuotedString(label) + " is not deferred");
+   const std::string deviceName = found->second.deviceName;
+
+   boost::shared_ptr<DeviceInstance> device = module->LoadDevice(core,
+         deviceName, label, deviceLogger, coreLogger);
+
+   try
+   {
+      std::string description = module->GetDeviceDescription(deviceName);
+      if (!description.empty())
+         device->SetDescription(description);
+   }
+   catch (const CMMError&)
+   {
+      // Module did not have a description for this device.
+   }
+
+   for (DeviceIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+   {
+      if (it->first == label)
+      {
+         it->second = device;
+         break;
+      }
+   }
+   deviceRawPtrIndex_.insert(std::make_pair(device->GetRawPtr(), device));
+   {
+      boost::lock_guard<boost::mutex> pendingGuard(pendingBindsMutex_);
+      std::map<std::string, PendingBind>::iterator pending =
+         pendingBinds_.find(label);
+      if (pending != pendingBinds_.end())
+      {
+         // Published by FinishBinding() once set up
+         pending->second.device = device;
+      }
+      else
+      {
+         // The slot may be read concurrently by lookups that do not take
+         // bindLock_
+         boost::atomic_store(&labelIndex_[SymbolTable::Intern(label)], device);
+      }
+   }
+   deferredDevices_.erase(found);
+   return device;
+}
+
+
+void
+DeviceManager::RestoreDeferredDevice(boost::shared_ptr<DeviceInstance> device,
+      const DeferredDevice& record)
+{
+   const std::string label = device->GetLabel();
+   {
+      DeviceModuleLockGuard guard(device);
+      device->Shutdown();
+   }
+
+   MMThreadGuard g(bindLock_);
+
+   for (DeviceIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+   {
+      if (it->first == label)
+      {
+         it->second.reset();
+         break;
+      }
+   }
+   boost::atomic_store(&labelIndex_[SymbolTable::Intern(label)],
+         boost::shared_ptr<DeviceInstance>());
+   deviceRawPtrIndex_.erase(device->GetRawPtr());
+   deferredDevices_[label] = record;
+}
+
+
+bool
+DeviceManager::IsDeviceDeferred(const std::string& label) const
+{
+   MMThreadGuard g(bindLock_);
+   return deferredDevices_.count(label) > 0;
+}
+
+
+DeferredDevice&
+DeviceManager::GetDeferredDevice(const std::string& label)
+{
+   MMThreadGuard g(bindLock_);
+   std::map<std::string, DeferredDevice>::iterator found =
+      deferredDevices_.find(label);
+   if (found == deferredDevices_.end())
+      throw CMMError("Device " + ToQuotedString(label) + " is not deferred");
+   return found->second;
+}
+
+
+MM::DeviceType
+DeviceManager::GetDeferredDeviceType(const std::string& label) const
+{
+   MMThreadGuard g(bindLock_);
+   std::map<std::string, DeferredDevice>::iterator found =
+      deferredDevices_.find(label);
+   if (found == deferredDevices_.end())
+      return MM::UnknownType; // Bound in the meantime
+   DeferredDevice& deferred = found->second;
+   if (deferred.advertisedType == MM::UnknownType && deviceTypeProbe_)
+   {
+      try
+      {
+         deferred.advertisedType =
+            deviceTypeProbe_(deferred.moduleName, deferred.deviceName);
+      }
+      catch (const CMMError&)
+      {
+         // Not advertised by the module (e.g. a peripheral device).
+      }
+   }
+   return deferred.advertisedType;
+}
+
+
 void
 DeviceManager::UnloadDevice(boost::shared_ptr<DeviceInstance> device)
 {
@@ -90,6 +238,9 @@ DeviceManager::UnloadDevice(boost::shared_ptr<DeviceInstance> device)
       {
          device->Shutdown(); // TODO Should be automatic
          deviceRawPtrIndex_.erase(it->second->GetRawPtr());
+         Symbol labelSymbol;
+         if (SymbolTable::Find(it->first, labelSymbol))
+            labelIndex_.erase(labelSymbol);
          devices_.erase(it);
          break;
       }
@@ -97,6 +248,28 @@ DeviceManager::UnloadDevice(boost::shared_ptr<DeviceInstance> device)
 }
 
 
+void
+DeviceManager::UnloadDeferredDevice(const std::string& label)
+{
+   MMThreadGuard g(bindLock_);
+   if (!IsDeviceDeferred(label))
+      return;
+
+   for (DeviceIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+   {
+      if (it->first == label)
+      {
+         devices_.erase(it);
+         break;
+      }
+   }
+   Symbol labelSymbol;
+   if (SymbolTable::Find(label, labelSymbol))
+      labelIndex_.erase(labelSymbol);
+   deferredDevices_.erase(label);
+}
+
+
 void
 DeviceManager::UnloadAllDevices()
 {
@@ -111,6 +284,8 @@ DeviceManager::UnloadAllDevices()
    std::vector< boost::shared_ptr<DeviceInstance> > serialDevices;
    for (DeviceIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
    {
+      if (!it->second)
+         continue; // Deferred device; nothing to shut down
       if (it->second->GetType() == MM::SerialDevice)
       {
          serialDevices.push_back(it->second);
@@ -140,7 +315,12 @@ DeviceManager::UnloadAllDevices()
    }
 
    deviceRawPtrIndex_.clear();
+   labelIndex_.clear();
    devices_.clear();
+   {
+      MMThreadGuard g(bindLock_);
+      deferredDevices_.clear();
+   }
 
    // Now the only remaining references to the device objects should be in
    // serialDevices and nonSerialDevices. Release the devices in order.
@@ -155,50 +335,146 @@ DeviceManager::UnloadAllDevices()
 }
 
 
-namespace
+boost::shared_ptr<DeviceInstance>
+DeviceManager::GetDevice(const std::string& label)
 {
-   class DevicePairMatcheslabel
+   Symbol labelSymbol;
+   if (!SymbolTable::Find(label, labelSymbol))
    {
-      std::string s_;
-   public:
-      DevicePairMatcheslabel(const std::string& s) : s_(s) {}
-      bool operator()(const std::pair< std::string,
-            boost::shared_ptr<DeviceInstance> >& p) const
-      { return p.first == s_; }
-   };
-} // anonymous namespace
+      throw CMMError("No device with label " + ToQuotedString(label));
+   }
+   return GetDevice(labelSymbol);
+}
 
 
 boost::shared_ptr<DeviceInstance>
-DeviceManager::GetDevice(const std::string& label) const
+DeviceManager::GetDevice(const char* label)
 {
-   DeviceConstIterator found =
-      std::find_if(devices_.begin(), devices_.end(),
-            DevicePairMatcheslabel(label));
-   if (found == devices_.end())
+   if (!label)
+   {
+      throw CMMError("Null device label");
+   }
+   Symbol labelSymbol;
+   if (!SymbolTable::Find(label, labelSymbol))
    {
       throw CMMError("No device with label " + ToQuotedString(label));
    }
-   return found->second;
+   return GetDevice(labelSymbol);
 }
 
 
 boost::shared_ptr<DeviceInstance>
-DeviceManager::GetDevice(const char* label) const
+DeviceManager::GetDevice(Symbol label)
 {
-   if (!label)
+   boost::shared_ptr<DeviceInstance> device = FindDevice(label);
+   if (!device)
+      device = BindDevice(label);
+   return device;
+}
+
+
+boost::shared_ptr<DeviceInstance>
+DeviceManager::FindDevice(Symbol label) const
+{
+   LabelIndex::const_iterator found = labelIndex_.find(label);
+   if (found == labelIndex_.end())
    {
-      throw CMMError("Null device label");
+      throw CMMError("No device with label " +
+            ToQuotedString(SymbolTable::Name(label)));
    }
-   return GetDevice(std::string(label));
+   return boost::atomic_load(&found->second);
+}
+
+
+boost::shared_ptr<DeviceInstance>
+DeviceManager::BindDevice(Symbol label)
+{
+   const std::string labelString = SymbolTable::Name(label);
+   {
+      boost::unique_lock<boost::mutex> lock(pendingBindsMutex_);
+      for (;;)
+      {
+         // Another thread may have bound the device while we waited
+         boost::shared_ptr<DeviceInstance> device = FindDevice(label);
+         if (device)
+            return device;
+
+         std::map<std::string, PendingBind>::const_iterator pending =
+            pendingBinds_.find(labelString);
+         if (pending == pendingBinds_.end())
+            break;
+         if (pending->second.thread == boost::this_thread::get_id())
+         {
+            // Looked up while being set up (by its configuration commands,
+            // or by its own callbacks)
+            if (!pending->second.device)
+               throw CMMError("Deferred device " +
+                     ToQuotedString(labelString) + " is not loaded yet");
+            return pending->second.device;
+         }
+         bindCondition_.wait(lock);
+      }
+
+      if (!deferredBinder_)
+         throw CMMError("Cannot bind deferred device " +
+               ToQuotedString(labelString));
+      pendingBinds_[labelString].thread = boost::this_thread::get_id();
+   }
+
+   try
+   {
+      deferredBinder_(labelString);
+   }
+   catch (...)
+   {
+      FinishBinding(label, false);
+      throw;
+   }
+   FinishBinding(label, true);
+
+   boost::shared_ptr<DeviceInstance> device = FindDevice(label);
+   if (!device)
+      throw CMMError("Failed to bind deferred device " +
+            ToQuotedString(labelString));
+   return device;
+}
+
+
+void
+DeviceManager::FinishBinding(Symbol label, bool publish)
+{
+   boost::lock_guard<boost::mutex> g(pendingBindsMutex_);
+   std::map<std::string, PendingBind>::iterator pending =
+      pendingBinds_.find(SymbolTable::Name(label));
+   if (pending == pendingBinds_.end())
+      return;
+   if (publish && pending->second.device)
+   {
+      LabelIndex::iterator slot = labelIndex_.find(label);
+      if (slot != labelIndex_.end())
+         boost::atomic_store(&slot->second, pending->second.device);
+   }
+   pendingBinds_.erase(pending);
+   bindCondition_.notify_all();
+}
+
+
+boost::shared_ptr<DeviceInstance>
+DeviceManager::FindPendingDevice(const std::string& label) const
+{
+   boost::lock_guard<boost::mutex> g(pendingBindsMutex_);
+   std::map<std::string, PendingBind>::const_iterator pending =
+      pendingBinds_.find(label);
+   if (pending == pendingBinds_.end())
+      return boost::shared_ptr<DeviceInstance>();
+   return pending->second.device;
 }
 
 
 boost::shared_ptr<DeviceInstance>
 DeviceManager::GetDevice(const MM::Device* rawPtr) const
 {
-   typedef std::map< const MM::Device*, boost::weak_ptr<DeviceInstance> >::const_iterator Iterator;
-   Iterator it = deviceRawPtrIndex_.find(rawPtr);
+   RawPtrIndex::const_iterator it = deviceRawPtrIndex_.find(rawPtr);
    if (it == deviceRawPtrIndex_.end())
       throw CMMError("Invalid device pointer");
    return it->second.lock();
@@ -211,10 +487,32 @@ DeviceManager::GetDeviceList(MM::DeviceType type) const
    std::vector<std::string> labels;
    for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
    {
-      if (type == MM::AnyType || it->second->GetType() == type)
+      if (type != MM::AnyType)
       {
-         labels.push_back(it->first);
+         boost::shared_ptr<DeviceInstance> device =
+            FindDevice(SymbolTable::Intern(it->first));
+         if (!device)
+            device = FindPendingDevice(it->first);
+         MM::DeviceType actualType = device ? device->GetType() :
+            GetDeferredDeviceType(it->first);
+         if (actualType != type)
+            continue;
       }
+      labels.push_back(it->first);
+   }
+   return labels;
+}
+
+
+std::vector<std::string>
+DeviceManager::GetDeferredDevicesOfUnknownType() const
+{
+   std::vector<std::string> labels;
+   for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+   {
+      if (IsDeviceDeferred(it->first) &&
+            GetDeferredDeviceType(it->first) == MM::UnknownType)
+         labels.push_back(it->first);
    }
    return labels;
 }
@@ -225,12 +523,16 @@ DeviceManager::GetLoadedPeripherals(const char* label) const
 {
    std::vector<std::string> labels;
 
-   // get hub
-   boost::shared_ptr<DeviceInstance> pDev;
+   // get hub, without binding it if it is deferred
    try
    {
-      pDev = GetDevice(label);
-      if (pDev->GetType() != MM::HubDevice)
+      if (!label)
+         return labels;
+      boost::shared_ptr<DeviceInstance> pDev =
+         FindDevice(SymbolTable::Intern(label));
+      MM::DeviceType hubType = pDev ? pDev->GetType() :
+         GetDeferredDeviceType(label);
+      if (hubType != MM::HubDevice)
          return labels;
    }
    catch (...)
@@ -240,10 +542,24 @@ DeviceManager::GetLoadedPeripherals(const char* label) const
 
    for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
    {
-      std::string parentID = it->second->GetParentID();
+      boost::shared_ptr<DeviceInstance> device =
+         FindDevice(SymbolTable::Intern(it->first));
+      if (!device)
+         device = FindPendingDevice(it->first);
+      std::string parentID;
+      if (device)
+         parentID = device->GetParentID();
+      else
+      {
+         MMThreadGuard g(bindLock_);
+         std::map<std::string, DeferredDevice>::const_iterator deferred =
+            deferredDevices_.find(it->first);
+         if (deferred != deferredDevices_.end())
+            parentID = deferred->second.parentLabel;
+      }
       if (parentID == label)
       {
-         labels.push_back(it->second->GetLabel());
+         labels.push_back(it->first);
       }
    }
 
@@ -252,7 +568,7 @@ DeviceManager::GetLoadedPeripherals(const char* label) const
 
 
 boost::shared_ptr<HubInstance>
-DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device) const
+DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device)
 {
    std::string parentLabel = device->GetParentID();
 
@@ -261,13 +577,38 @@ DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device) const
       // no parent specified, but we will try to infer one anyway
       // TODO So what happens if there is more than one hub in a given device
       // adapter? Answer: bad things.
+      // Collect the labels first, as binding a deferred hub modifies
+      // devices_.
+      std::vector<std::string> labels = GetDeviceList();
       boost::shared_ptr<HubInstance> parentHub;
-      for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+      for (std::vector<std::string>::const_iterator it = labels.begin(),
+            end = labels.end(); it != end; ++it)
       {
-         if (it->second->GetType() == MM::HubDevice &&
-               device->GetAdapterModule() == it->second->GetAdapterModule())
+         boost::shared_ptr<DeviceInstance> candidate;
+         if (IsDeviceDeferred(*it))
+         {
+            // A deferred hub from the same module must be bound before it
+            // can serve as parent.
+            if (GetDeferredDevice(*it).moduleName !=
+                  device->GetAdapterModule()->GetName() ||
+                  GetDeferredDeviceType(*it) != MM::HubDevice)
+               continue;
+            candidate = GetDevice(*it);
+         }
+         else
+         {
+            // Do not wait for devices being bound by other threads: they may
+            // need the module lock, which our caller may hold.
+            candidate = FindDevice(SymbolTable::Intern(*it));
+            if (!candidate)
+               candidate = FindPendingDevice(*it);
+            if (!candidate)
+               continue;
+         }
+         if (candidate->GetType() == MM::HubDevice &&
+               device->GetAdapterModule() == candidate->GetAdapterModule())
          {
-            parentHub = boost::static_pointer_cast<HubInstance>(it->second);
+            parentHub = boost::static_pointer_cast<HubInstance>(candidate);
          }
       }
       // This returns the last matching hub; not sure why it was coded that
@@ -277,14 +618,19 @@ DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device) const
    }
    else
    {
-      for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+      boost::shared_ptr<DeviceInstance> parent;
+      try
       {
-         if (it->first == parentLabel &&
-               it->second->GetType() == MM::HubDevice &&
-               it->second->GetAdapterModule() == device->GetAdapterModule())
-         {
-            return boost::static_pointer_cast<HubInstance>(it->second);
-         }
+         parent = GetDevice(parentLabel);
+      }
+      catch (const CMMError&)
+      {
+         // Parent not loaded
+      }
+      if (parent && parent->GetType() == MM::HubDevice &&
+            parent->GetAdapterModule() == device->GetAdapterModule())
+      {
+         return boost::static_pointer_cast<HubInstance>(parent);
       }
       // TODO We should probably throw when the parent is missing.
       return boost::shared_ptr<HubInstance>();
@@ -293,8 +639,14 @@ DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device) const
 
 
 DeviceModuleLockGuard::DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device) :
-   g_(device->GetAdapterModule()->GetLock())
-{}
+   waitTimer_(device->GetCallStatistics(), DeviceCallModuleLockWait),
+   g_(device->GetAdapterModule()->GetLock()),
+   heldScope_(device->GetCallStatistics().GetTrace(), "lock", "ModuleLockHeld")
+{
+   waitTimer_.Stop();
+   if (heldScope_.IsActive())
+      heldScope_.SetArg("device", device->GetLabel());
+}
 
 
 } // namespace mm
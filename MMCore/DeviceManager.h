@@ -20,11 +20,17 @@
 #include "../MMDevice/MMDevice.h"
 #include "../MMDevice/DeviceThreads.h"
 #include "CoreUtils.h"
+#include "DeviceCallStatistics.h"
 #include "Devices/DeviceInstance.h"
 #include "Error.h"
 #include "Logging/Logger.h"
+#include "SymbolTable.h"
+#include "TraceRecorder.h"
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/weak_ptr.hpp>
 
 #include <map>
@@ -39,20 +45,88 @@ class LoadedDeviceAdapter;
 namespace mm
 {
 
+/**
+ * \brief Record of a device whose loading has been deferred.
+ *
+ * A deferred device has a label but no DeviceInstance (and its adapter module
+ * has not necessarily been loaded). Configuration commands addressed to the
+ * device are kept so that they can be replayed when the device is bound.
+ */
+struct DeferredDevice
+{
+   DeferredDevice() :
+      advertisedType(MM::UnknownType),
+      initializeOnBind(false)
+   {}
+
+   std::string moduleName;
+   std::string deviceName;
+   std::string parentLabel;
+   MM::DeviceType advertisedType; // UnknownType until probed
+   bool initializeOnBind;
+
+   // Tokenized configuration commands, recorded before and after
+   // initialization was requested
+   std::vector< std::vector<std::string> > preInitCommands;
+   std::vector< std::vector<std::string> > postInitCommands;
+};
+
+
 class DeviceManager /* final */
 {
-   // Store devices in an ordered container. We could use a map or hash map to
-   // retrieve by name, but the number of devices is so small that it is not
-   // known to be worth it.
+public:
+   /// Called to bind a deferred device; must call BindDeferredDevice().
+   typedef boost::function<void (const std::string& label)> DeferredBindFunction;
+   /// Called to look up the advertised type of a deferred device.
+   typedef boost::function<MM::DeviceType (const std::string& moduleName,
+         const std::string& deviceName)> DeviceTypeProbeFunction;
+
+private:
+   // Store devices in an ordered container, which determines the order of
+   // device lists and of unloading.
+   // Deferred devices keep their place in the load order but hold a null
+   // instance until they are bound.
    std::vector< std::pair<std::string, boost::shared_ptr<DeviceInstance> > > devices_;
    typedef std::vector< std::pair<std::string, boost::shared_ptr<DeviceInstance> > >::const_iterator
       DeviceConstIterator;
    typedef std::vector< std::pair<std::string, boost::shared_ptr<DeviceInstance> > >::iterator
       DeviceIterator;
 
-   // Map raw device pointers to DeviceInstance objects, for those few places
-   // where we need to retrieve device information from raw pointers.
-   std::map< const MM::Device*, boost::weak_ptr<DeviceInstance> > deviceRawPtrIndex_;
+   // Index of devices_ by interned label, since devices are retrieved by
+   // label on every core call. Deferred devices map to a null instance.
+   typedef boost::unordered_map< Symbol, boost::shared_ptr<DeviceInstance> >
+      LabelIndex;
+   LabelIndex labelIndex_;
+
+   // Map raw device pointers to DeviceInstance objects, for those places
+   // where we need to retrieve device information from raw pointers (notably
+   // every callback from a device).
+   typedef boost::unordered_map< const MM::Device*, boost::weak_ptr<DeviceInstance> >
+      RawPtrIndex;
+   RawPtrIndex deviceRawPtrIndex_;
+
+   // Mutable so that probed device types can be cached from const methods.
+   mutable std::map<std::string, DeferredDevice> deferredDevices_;
+   DeferredBindFunction deferredBinder_;
+   DeviceTypeProbeFunction deviceTypeProbe_;
+
+   // Guards deferredDevices_ and the bookkeeping of binding. Never held while
+   // a device is being set up, as initializing a device takes its module's
+   // lock, and a device holding the module lock may look up (and so bind)
+   // other deferred devices, such as its parent hub.
+   mutable MMThreadLock bindLock_;
+
+   // Deferred devices being bound, by label. The device is published in
+   // labelIndex_ only when it has been set up; until then it is returned
+   // only to the binding thread, and other threads wait on bindCondition_.
+   struct PendingBind
+   {
+      boost::thread::id thread;
+      boost::shared_ptr<DeviceInstance> device; // Null until instantiated
+   };
+   std::map<std::string, PendingBind> pendingBinds_;
+   mutable boost::mutex pendingBindsMutex_; // Taken after bindLock_, if both
+   boost::condition_variable bindCondition_;
 
 public:
    ~DeviceManager();
@@ -66,11 +140,62 @@ public:
          mm::logging::Logger deviceLogger,
          mm::logging::Logger coreLogger);
 
+   /**
+    * \brief Register a device label without loading the device.
+    *
+    * The device is bound (instantiated from its adapter module) the first
+    * time it is retrieved with GetDevice().
+    */
+   void DeferDevice(const std::string& moduleName,
+         const std::string& deviceName, const std::string& label);
+
+   /**
+    * \brief Instantiate a deferred device into its reserved slot.
+    *
+    * The deferred record is removed; if setting up the device subsequently
+    * fails, RestoreDeferredDevice() must be called with a copy of the record.
+    * When called from the deferred binder, other threads see the device only
+    * after the binder returns.
+    */
+   boost::shared_ptr<DeviceInstance>
+   BindDeferredDevice(boost::shared_ptr<LoadedDeviceAdapter> module,
+         const std::string& label, CMMCore* core,
+         mm::logging::Logger deviceLogger,
+         mm::logging::Logger coreLogger);
+
+   /**
+    * \brief Undo BindDeferredDevice() after a failure to set up the device.
+    *
+    * The device is shut down and released, and the label is deferred again
+    * with the given record, so that the next access retries the binding.
+    */
+   void RestoreDeferredDevice(boost::shared_ptr<DeviceInstance> device,
+         const DeferredDevice& record);
+
+   /**
+    * \brief Set the functions used to bind and probe deferred devices.
+    */
+   void SetDeferredDeviceHandlers(DeferredBindFunction binder,
+         DeviceTypeProbeFunction typeProbe)
+   { deferredBinder_ = binder; deviceTypeProbe_ = typeProbe; }
+
+   bool IsDeviceDeferred(const std::string& label) const;
+
+   /**
+    * \brief Access the record of a deferred device.
+    */
+   DeferredDevice& GetDeferredDevice(const std::string& label);
+
    /**
     * \brief Unload a device.
     */
    void UnloadDevice(boost::shared_ptr<DeviceInstance> device);
 
+   /**
+    * \brief Forget a deferred device that was never bound.
+    */
+   void UnloadDeferredDevice(const std::string& label);
+
    /**
     * \brief Unload all devices.
     */
@@ -78,10 +203,13 @@ public:
 
    /**
     * \brief Get a device by label.
+    *
+    * Binds the device first if it is deferred.
     */
    ///@{
-   boost::shared_ptr<DeviceInstance> GetDevice(const std::string& label) const;
-   boost::shared_ptr<DeviceInstance> GetDevice(const char* label) const;
+   boost::shared_ptr<DeviceInstance> GetDevice(const std::string& label);
+   boost::shared_ptr<DeviceInstance> GetDevice(const char* label);
+   boost::shared_ptr<DeviceInstance> GetDevice(Symbol label);
    ///@}
 
    /**
@@ -99,11 +227,11 @@ public:
    }
 
    template <class TDeviceInstance>
-   boost::shared_ptr<TDeviceInstance> GetDeviceOfType(const std::string& label) const
+   boost::shared_ptr<TDeviceInstance> GetDeviceOfType(const std::string& label)
    { return GetDeviceOfType<TDeviceInstance>(GetDevice(label)); }
 
    template <class TDeviceInstance>
-   boost::shared_ptr<TDeviceInstance> GetDeviceOfType(const char* label) const
+   boost::shared_ptr<TDeviceInstance> GetDeviceOfType(const char* label)
    { return GetDeviceOfType<TDeviceInstance>(GetDevice(label)); }
    ///@}
 
@@ -114,9 +242,20 @@ public:
 
    /**
     * \brief Get the labels of all loaded devices of a given type.
+    *
+    * Deferred devices are never bound by this call. They are included when
+    * their type is advertised by their adapter module (which may require the
+    * module to be loaded); see GetDeferredDevicesOfUnknownType() for the
+    * rest.
     */
    std::vector<std::string> GetDeviceList(MM::DeviceType t = MM::AnyType) const;
 
+   /**
+    * \brief Get the labels of deferred devices whose type is not known
+    * without binding them (typically hub peripherals).
+    */
+   std::vector<std::string> GetDeferredDevicesOfUnknownType() const;
+
    /**
     * \brief Get the labels of all loaded peripherals of a hub device.
     */
@@ -129,15 +268,29 @@ public:
     * \param device
     * \return The hub device, or null if device has no parent.
     */
-   boost::shared_ptr<HubInstance> GetParentDevice(boost::shared_ptr<DeviceInstance> device) const;
+   boost::shared_ptr<HubInstance> GetParentDevice(boost::shared_ptr<DeviceInstance> device);
    // TODO GetParentDevice() should be a DeviceInstance method.
+
+private:
+   // Returns null for a deferred device, without binding it
+   boost::shared_ptr<DeviceInstance> FindDevice(Symbol label) const;
+   boost::shared_ptr<DeviceInstance> BindDevice(Symbol label);
+   void FinishBinding(Symbol label, bool publish);
+   // Returns the device being bound under the label, if any
+   boost::shared_ptr<DeviceInstance> FindPendingDevice(const std::string& label) const;
+   // Returns UnknownType if not advertised by the module
+   MM::DeviceType GetDeferredDeviceType(const std::string& label) const;
 };
 
 
-// Scoped acquisition of a device's module's lock
+// Scoped acquisition of a device's module's lock. The time spent waiting for
+// the lock is recorded in the device's call statistics, and the time the lock
+// is held is traced.
 class DeviceModuleLockGuard
 {
+   DeviceCallTimer waitTimer_; // Must be constructed before g_
    MMThreadGuard g_;
+   TraceScope heldScope_; // Must be destroyed before g_
 public:
    explicit DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device);
 };
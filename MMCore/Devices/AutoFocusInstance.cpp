@@ -25,7 +25,11 @@
 int AutoFocusInstance::SetContinuousFocusing(bool state) { return GetImpl()->SetContinuousFocusing(state); }
 int AutoFocusInstance::GetContinuousFocusing(bool& state) { return GetImpl()->GetContinuousFocusing(state); }
 bool AutoFocusInstance::IsContinuousFocusLocked() { return GetImpl()->IsContinuousFocusLocked(); }
-int AutoFocusInstance::FullFocus() { return GetImpl()->FullFocus(); }
+int AutoFocusInstance::FullFocus()
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallFullFocus);
+   return GetImpl()->FullFocus();
+}
 int AutoFocusInstance::IncrementalFocus() { return GetImpl()->IncrementalFocus(); }
 int AutoFocusInstance::GetLastFocusScore(double& score) { return GetImpl()->GetLastFocusScore(score); }
 int AutoFocusInstance::GetCurrentFocusScore(double& score) { return GetImpl()->GetCurrentFocusScore(score); }
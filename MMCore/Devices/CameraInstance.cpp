@@ -22,10 +22,27 @@
 #include "CameraInstance.h"
 
 
-int CameraInstance::SnapImage() { return GetImpl()->SnapImage(); }
-const unsigned char* CameraInstance::GetImageBuffer() { return GetImpl()->GetImageBuffer(); }
-const unsigned char* CameraInstance::GetImageBuffer(unsigned channelNr) { return GetImpl()->GetImageBuffer(channelNr); }
-const unsigned int* CameraInstance::GetImageBufferAsRGB32() { return GetImpl()->GetImageBufferAsRGB32(); }
+int CameraInstance::SnapImage()
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSnapImage);
+   return GetImpl()->SnapImage();
+}
+const unsigned char* CameraInstance::GetImageBuffer()
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetImageBuffer);
+   return GetImpl()->GetImageBuffer();
+}
+const unsigned char* CameraInstance::GetImageBuffer(unsigned channelNr)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetImageBuffer);
+   timer.AddArg(static_cast<long>(channelNr));
+   return GetImpl()->GetImageBuffer(channelNr);
+}
+const unsigned int* CameraInstance::GetImageBufferAsRGB32()
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetImageBuffer, "GetImageBufferAsRGB32");
+   return GetImpl()->GetImageBufferAsRGB32();
+}
 unsigned CameraInstance::GetNumberOfComponents() const { return GetImpl()->GetNumberOfComponents(); }
 
 std::string CameraInstance::GetComponentName(unsigned component)
@@ -55,7 +72,12 @@ unsigned CameraInstance::GetBitDepth() const { return GetImpl()->GetBitDepth();
 double CameraInstance::GetPixelSizeUm() const { return GetImpl()->GetPixelSizeUm(); }
 int CameraInstance::GetBinning() const { return GetImpl()->GetBinning(); }
 int CameraInstance::SetBinning(int binSize) { return GetImpl()->SetBinning(binSize); }
-void CameraInstance::SetExposure(double exp_ms) { return GetImpl()->SetExposure(exp_ms); }
+void CameraInstance::SetExposure(double exp_ms)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetExposure);
+   timer.AddArg(exp_ms);
+   return GetImpl()->SetExposure(exp_ms);
+}
 double CameraInstance::GetExposure() const { return GetImpl()->GetExposure(); }
 int CameraInstance::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize) { return GetImpl()->SetROI(x, y, xSize, ySize); }
 int CameraInstance::GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize) { return GetImpl()->GetROI(x, y, xSize, ySize); }
@@ -120,9 +142,25 @@ int CameraInstance::GetMultiROI(unsigned* xs, unsigned* ys, unsigned* widths,
    return GetImpl()->GetMultiROI(xs, ys, widths, heights, length);
 }
 
-int CameraInstance::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow) { return GetImpl()->StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow); }
-int CameraInstance::StartSequenceAcquisition(double interval_ms) { return GetImpl()->StartSequenceAcquisition(interval_ms); }
-int CameraInstance::StopSequenceAcquisition() { return GetImpl()->StopSequenceAcquisition(); }
+int CameraInstance::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallStartSequenceAcquisition);
+   timer.AddArg(numImages);
+   timer.AddArg(interval_ms);
+   timer.AddArg(static_cast<long>(stopOnOverflow));
+   return GetImpl()->StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow);
+}
+int CameraInstance::StartSequenceAcquisition(double interval_ms)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallStartSequenceAcquisition);
+   timer.AddArg(interval_ms);
+   return GetImpl()->StartSequenceAcquisition(interval_ms);
+}
+int CameraInstance::StopSequenceAcquisition()
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallStopSequenceAcquisition);
+   return GetImpl()->StopSequenceAcquisition();
+}
 int CameraInstance::PrepareSequenceAcqusition() { return GetImpl()->PrepareSequenceAcqusition(); }
 bool CameraInstance::IsCapturing() { return GetImpl()->IsCapturing(); }
 
@@ -146,3 +184,106 @@ int CameraInstance::StopExposureSequence() { return GetImpl()->StopExposureSeque
 int CameraInstance::ClearExposureSequence() { return GetImpl()->ClearExposureSequence(); }
 int CameraInstance::AddToExposureSequence(double exposureTime_ms) { return GetImpl()->AddToExposureSequence(exposureTime_ms); }
 int CameraInstance::SendExposureSequence() const { return GetImpl()->SendExposureSequence(); }
+
+
+Metadata
+CameraInstance::GetTagsAsMetadata()
+{
+   boost::mutex::scoped_lock lock(metadataCacheMutex_);
+   bool changed;
+   return GetCachedTags(changed);
+}
+
+
+Metadata
+CameraInstance::GetInsertedImageMetadata(const char* serializedMetadata)
+{
+   boost::mutex::scoped_lock lock(metadataCacheMutex_);
+
+   bool tagsChanged;
+   const Metadata& tags = GetCachedTags(tagsChanged);
+   if (!tagsChanged && haveCachedImageMetadata_ &&
+         serializedImageMetadata_ == serializedMetadata)
+      return imageMetadata_;
+
+   Metadata md;
+   md.Restore(serializedMetadata);
+   md.put("Camera", GetLabel());
+   md.Merge(tags);
+
+   serializedImageMetadata_ = serializedMetadata;
+   imageMetadata_ = md;
+   haveCachedImageMetadata_ = true;
+   return md;
+}
+
+
+void
+CameraInstance::SetMultiROIPacker(
+      boost::shared_ptr<const mm::MultiROIPacker> packer)
+{
+   boost::mutex::scoped_lock lock(insertionSettingsMutex_);
+   multiROIPacker_ = packer;
+}
+
+
+boost::shared_ptr<const mm::MultiROIPacker>
+CameraInstance::GetMultiROIPacker()
+{
+   boost::mutex::scoped_lock lock(insertionSettingsMutex_);
+   return multiROIPacker_;
+}
+
+
+void
+CameraInstance::SetImageTransposer(
+      boost::shared_ptr<const mm::ImageTransposer> transposer)
+{
+   boost::mutex::scoped_lock lock(insertionSettingsMutex_);
+   imageTransposer_ = transposer;
+}
+
+
+boost::shared_ptr<const mm::ImageTransposer>
+CameraInstance::GetImageTransposer()
+{
+   boost::mutex::scoped_lock lock(insertionSettingsMutex_);
+   return imageTransposer_;
+}
+
+
+unsigned char*
+CameraInstance::GetTransposedImageBuffer(size_t bytes)
+{
+   transposedImage_.resize(bytes);
+   if (transposedImage_.empty())
+      return 0;
+   return &transposedImage_[0];
+}
+
+
+const Metadata&
+CameraInstance::GetCachedTags(bool& changed)
+{
+   std::string serialized;
+   try
+   {
+      serialized = GetTags();
+   }
+   catch (const CMMError&)
+   {
+      changed = haveCachedTags_;
+      haveCachedTags_ = false;
+      tags_.Clear();
+      return tags_;
+   }
+
+   changed = !haveCachedTags_ || serialized != serializedTags_;
+   if (changed)
+   {
+      tags_.Restore(serialized.c_str());
+      serializedTags_ = serialized;
+      haveCachedTags_ = true;
+   }
+   return tags_;
+}
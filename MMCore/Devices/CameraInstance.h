@@ -21,6 +21,15 @@
 
 #include "DeviceInstanceBase.h"
 
+#include "../../MMDevice/ImageMetadata.h"
+#include "../ImageTransposer.h"
+#include "../MultiROIPacker.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
 
 class CameraInstance : public DeviceInstanceBase<MM::Camera>
 {
@@ -33,7 +42,9 @@ public:
          const std::string& label,
          mm::logging::Logger deviceLogger,
          mm::logging::Logger coreLogger) :
-      DeviceInstanceBase<MM::Camera>(core, adapter, name, pDevice, deleteFunction, label, deviceLogger, coreLogger)
+      DeviceInstanceBase<MM::Camera>(core, adapter, name, pDevice, deleteFunction, label, deviceLogger, coreLogger),
+      haveCachedTags_(false),
+      haveCachedImageMetadata_(false)
    {}
 
    int SnapImage();
@@ -82,4 +93,67 @@ public:
    int ClearExposureSequence();
    int AddToExposureSequence(double exposureTime_ms);
    int SendExposureSequence() const;
+
+   /**
+    * \brief Get the camera's tags, parsed.
+    *
+    * The tags are only parsed when their serialized form has changed since
+    * the previous call. Returns no tags if they cannot be retrieved.
+    */
+   Metadata GetTagsAsMetadata();
+
+   /**
+    * \brief Get the metadata for an image inserted by the camera.
+    *
+    * The result is the serialized image metadata merged with the camera
+    * label and the camera's tags. If neither the image metadata nor the
+    * tags have changed since the previous call (as is typical during a
+    * sequence acquisition), the previous result is reused without parsing.
+    */
+   Metadata GetInsertedImageMetadata(const char* serializedMetadata);
+
+   /**
+    * \brief Set the layout for packing the camera's multi-ROI frames.
+    *
+    * Set by the Core when starting an acquisition; null if the camera's
+    * frames are inserted as is.
+    */
+   void SetMultiROIPacker(boost::shared_ptr<const mm::MultiROIPacker> packer);
+   boost::shared_ptr<const mm::MultiROIPacker> GetMultiROIPacker();
+
+   /**
+    * \brief Set the orientation correction for the camera's inserted images.
+    *
+    * Set by the Core when starting an acquisition; null if the camera's
+    * images are inserted as is.
+    */
+   void SetImageTransposer(boost::shared_ptr<const mm::ImageTransposer> transposer);
+   boost::shared_ptr<const mm::ImageTransposer> GetImageTransposer();
+
+   /**
+    * \brief Get a buffer for the orientation-corrected copy of a snapped
+    * image.
+    *
+    * The buffer belongs to the camera, so it is only accessed with the
+    * camera's module lock held. It remains valid until the next call.
+    */
+   unsigned char* GetTransposedImageBuffer(size_t bytes);
+
+private:
+   const Metadata& GetCachedTags(bool& changed);
+
+   boost::mutex metadataCacheMutex_;
+   bool haveCachedTags_;
+   std::string serializedTags_;
+   Metadata tags_;
+   bool haveCachedImageMetadata_;
+   std::string serializedImageMetadata_;
+   Metadata imageMetadata_;
+
+   // Guards multiROIPacker_ and imageTransposer_
+   boost::mutex insertionSettingsMutex_;
+   boost::shared_ptr<const mm::MultiROIPacker> multiROIPacker_;
+   boost::shared_ptr<const mm::ImageTransposer> imageTransposer_;
+
+   std::vector<unsigned char> transposedImage_;
 };
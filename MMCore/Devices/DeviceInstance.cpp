@@ -66,6 +66,13 @@ DeviceInstance::DeviceInstance(CMMCore* core,
    }
 
    pImpl_->SetLabel(label_.c_str());
+
+   if (core_)
+   {
+      callStatistics_.SetEnabled(core_->isDeviceCallTimingEnabled());
+      callStatistics_.SetTrace(core_->traceRecorder_.get(), label_);
+      callStatistics_.SetRecorder(core_->callRecorder_.get());
+   }
 }
 
 DeviceInstance::~DeviceInstance()
@@ -149,7 +156,12 @@ std::string
 DeviceInstance::GetProperty(const std::string& name) const
 {
    DeviceStringBuffer valueBuf(this, "GetProperty");
-   int err = pImpl_->GetProperty(name.c_str(), valueBuf.GetBuffer());
+   int err;
+   {
+      mm::DeviceCallTimer timer(callStatistics_, mm::DeviceCallGetProperty);
+      timer.AddArg(name);
+      err = pImpl_->GetProperty(name.c_str(), valueBuf.GetBuffer());
+   }
    ThrowIfError(err, "Cannot get value of property " +
          ToQuotedString(name));
    return valueBuf.Get();
@@ -162,7 +174,13 @@ DeviceInstance::SetProperty(const std::string& name,
    LOG_DEBUG(Logger()) << "Will set property \"" << name << "\" to \"" <<
       value << "\"";
 
-   int err = pImpl_->SetProperty(name.c_str(), value.c_str());
+   int err;
+   {
+      mm::DeviceCallTimer timer(callStatistics_, mm::DeviceCallSetProperty);
+      timer.AddArg(name);
+      timer.AddArg(value);
+      err = pImpl_->SetProperty(name.c_str(), value.c_str());
+   }
 
    ThrowIfError(err, "Cannot set property " + ToQuotedString(name) +
          " to " + ToQuotedString(value));
@@ -315,7 +333,10 @@ DeviceInstance::GetErrorText(int code) const
 
 bool
 DeviceInstance::Busy()
-{ return pImpl_->Busy(); }
+{
+   mm::DeviceCallTimer timer(callStatistics_, mm::DeviceCallBusy);
+   return pImpl_->Busy();
+}
 
 double
 DeviceInstance::GetDelayMs() const
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "../../MMDevice/MMDeviceConstants.h"
+#include "../DeviceCallStatistics.h"
 #include "../Error.h"
 #include "../Logging/Logger.h"
 
@@ -71,6 +72,7 @@ private:
    DeleteDeviceFunction deleteFunction_;
    mm::logging::Logger deviceLogger_;
    mm::logging::Logger coreLogger_;
+   mutable mm::DeviceCallStatistics callStatistics_;
 
 public:
    boost::shared_ptr<LoadedDeviceAdapter> GetAdapterModule() const /* final */ { return adapter_; }
@@ -78,6 +80,9 @@ public:
    std::string GetDescription() const /* final */ { return description_; }
    void SetDescription(const std::string& description) /* final */ { description_ = description; }
 
+   /// Latency statistics of the calls made to this device
+   mm::DeviceCallStatistics& GetCallStatistics() const /* final */ { return callStatistics_; }
+
    // It would be nice to get rid of the need for raw pointers, but for now we
    // need it for the few CoreCallback methods that return a device pointer.
    MM::Device* GetRawPtr() const /* final */ { return pImpl_; }
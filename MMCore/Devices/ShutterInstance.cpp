@@ -22,6 +22,11 @@
 #include "ShutterInstance.h"
 
 
-int ShutterInstance::SetOpen(bool open) { return GetImpl()->SetOpen(open); }
+int ShutterInstance::SetOpen(bool open)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetOpen);
+   timer.AddArg(static_cast<long>(open));
+   return GetImpl()->SetOpen(open);
+}
 int ShutterInstance::GetOpen(bool& open) { return GetImpl()->GetOpen(open); }
 int ShutterInstance::Fire(double deltaT) { return GetImpl()->Fire(deltaT); }
@@ -22,15 +22,38 @@
 #include "StageInstance.h"
 
 
-int StageInstance::SetPositionUm(double pos) { return GetImpl()->SetPositionUm(pos); }
-int StageInstance::SetRelativePositionUm(double d) { return GetImpl()->SetRelativePositionUm(d); }
+int StageInstance::SetPositionUm(double pos)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetPositionUm");
+   timer.AddArg(pos);
+   return GetImpl()->SetPositionUm(pos);
+}
+int StageInstance::SetRelativePositionUm(double d)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetRelativePositionUm");
+   timer.AddArg(d);
+   return GetImpl()->SetRelativePositionUm(d);
+}
 int StageInstance::Move(double velocity) { return GetImpl()->Move(velocity); }
 int StageInstance::Stop() { return GetImpl()->Stop(); }
 int StageInstance::Home() { return GetImpl()->Home(); }
 int StageInstance::SetAdapterOriginUm(double d) { return GetImpl()->SetAdapterOriginUm(d); }
-int StageInstance::GetPositionUm(double& pos) { return GetImpl()->GetPositionUm(pos); }
-int StageInstance::SetPositionSteps(long steps) { return GetImpl()->SetPositionSteps(steps); }
-int StageInstance::GetPositionSteps(long& steps) { return GetImpl()->GetPositionSteps(steps); }
+int StageInstance::GetPositionUm(double& pos)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetPosition, "GetPositionUm");
+   return GetImpl()->GetPositionUm(pos);
+}
+int StageInstance::SetPositionSteps(long steps)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetPositionSteps");
+   timer.AddArg(steps);
+   return GetImpl()->SetPositionSteps(steps);
+}
+int StageInstance::GetPositionSteps(long& steps)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetPosition, "GetPositionSteps");
+   return GetImpl()->GetPositionSteps(steps);
+}
 int StageInstance::SetOrigin() { return GetImpl()->SetOrigin(); }
 int StageInstance::GetLimits(double& lower, double& upper) { return GetImpl()->GetLimits(lower, upper); }
 
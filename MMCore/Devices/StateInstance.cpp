@@ -22,9 +22,23 @@
 #include "StateInstance.h"
 
 
-int StateInstance::SetPosition(long pos) { return GetImpl()->SetPosition(pos); }
-int StateInstance::SetPosition(const char* label) { return GetImpl()->SetPosition(label); }
-int StateInstance::GetPosition(long& pos) const { return GetImpl()->GetPosition(pos); }
+int StateInstance::SetPosition(long pos)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition);
+   timer.AddArg(pos);
+   return GetImpl()->SetPosition(pos);
+}
+int StateInstance::SetPosition(const char* label)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetPositionByLabel");
+   timer.AddArg(label);
+   return GetImpl()->SetPosition(label);
+}
+int StateInstance::GetPosition(long& pos) const
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetPosition);
+   return GetImpl()->GetPosition(pos);
+}
 
 std::string StateInstance::GetPositionLabel() const
 {
@@ -22,15 +22,47 @@
 #include "XYStageInstance.h"
 
 
-int XYStageInstance::SetPositionUm(double x, double y) { return GetImpl()->SetPositionUm(x, y); }
-int XYStageInstance::SetRelativePositionUm(double dx, double dy) { return GetImpl()->SetRelativePositionUm(dx, dy); }
+int XYStageInstance::SetPositionUm(double x, double y)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetPositionUm");
+   timer.AddArg(x);
+   timer.AddArg(y);
+   return GetImpl()->SetPositionUm(x, y);
+}
+int XYStageInstance::SetRelativePositionUm(double dx, double dy)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetRelativePositionUm");
+   timer.AddArg(dx);
+   timer.AddArg(dy);
+   return GetImpl()->SetRelativePositionUm(dx, dy);
+}
 int XYStageInstance::SetAdapterOriginUm(double x, double y) { return GetImpl()->SetAdapterOriginUm(x, y); }
-int XYStageInstance::GetPositionUm(double& x, double& y) { return GetImpl()->GetPositionUm(x, y); }
+int XYStageInstance::GetPositionUm(double& x, double& y)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetPosition, "GetPositionUm");
+   return GetImpl()->GetPositionUm(x, y);
+}
 int XYStageInstance::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax) { return GetImpl()->GetLimitsUm(xMin, xMax, yMin, yMax); }
 int XYStageInstance::Move(double vx, double vy) { return GetImpl()->Move(vx, vy); }
-int XYStageInstance::SetPositionSteps(long x, long y) { return GetImpl()->SetPositionSteps(x, y); }
-int XYStageInstance::GetPositionSteps(long& x, long& y) { return GetImpl()->GetPositionSteps(x, y); }
-int XYStageInstance::SetRelativePositionSteps(long x, long y) { return GetImpl()->SetRelativePositionSteps(x, y); }
+int XYStageInstance::SetPositionSteps(long x, long y)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetPositionSteps");
+   timer.AddArg(x);
+   timer.AddArg(y);
+   return GetImpl()->SetPositionSteps(x, y);
+}
+int XYStageInstance::GetPositionSteps(long& x, long& y)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallGetPosition, "GetPositionSteps");
+   return GetImpl()->GetPositionSteps(x, y);
+}
+int XYStageInstance::SetRelativePositionSteps(long x, long y)
+{
+   mm::DeviceCallTimer timer(GetCallStatistics(), mm::DeviceCallSetPosition, "SetRelativePositionSteps");
+   timer.AddArg(x);
+   timer.AddArg(y);
+   return GetImpl()->SetRelativePositionSteps(x, y);
+}
 int XYStageInstance::Home() { return GetImpl()->Home(); }
 int XYStageInstance::Stop() { return GetImpl()->Stop(); }
 int XYStageInstance::SetOrigin() { return GetImpl()->SetOrigin(); }
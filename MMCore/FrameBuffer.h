@@ -43,6 +43,7 @@ public:
    unsigned int Depth() const {return pixDepth_;}
    void SetPixels(const void* pixArray);
    const unsigned char* GetPixels() const;
+   unsigned char* GetPixelsRW() { return pixels_; }
 
    void Resize(unsigned xSize, unsigned ySize, unsigned pixDepth);
    void Resize(unsigned xSize, unsigned ySize);
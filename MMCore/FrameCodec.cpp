@@ -0,0 +1,340 @@
+// DESCRIPTION:   Lossless compression of image pixels
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// Compressed data starts with the method and the element size
+enum
+{
+   MethodStored = 0,
+   MethodShuffleLZ4 = 1
+};
+const size_t headerSize = 2;
+
+// LZ4 block format parameters
+const unsigned hashLog = 16;
+const size_t minMatch = 4;
+const size_t lastLiterals = 5; // The block ends with at least 5 literals
+const size_t matchFindLimit = 12; // The last match starts 12 bytes before the end
+const size_t maxOffset = 65535;
+
+inline boost::uint32_t
+Read32(const unsigned char* p)
+{
+   boost::uint32_t v;
+   std::memcpy(&v, p, 4);
+   return v;
+}
+
+inline unsigned
+Hash(boost::uint32_t v)
+{
+   return (v * 2654435761U) >> (32 - hashLog);
+}
+
+inline unsigned char*
+WriteLengthBytes(unsigned char* op, size_t length)
+{
+   for (; length >= 255; length -= 255)
+      *op++ = 255;
+   *op++ = static_cast<unsigned char>(length);
+   return op;
+}
+
+inline unsigned char*
+WriteLiterals(unsigned char* op, unsigned char* token,
+      const unsigned char* literals, size_t count)
+{
+   *token = static_cast<unsigned char>(std::min<size_t>(count, 15) << 4);
+   if (count >= 15)
+      op = WriteLengthBytes(op, count - 15);
+   std::memcpy(op, literals, count);
+   return op + count;
+}
+
+// Returns the compressed size; dest must hold
+// GetMaxCompressedSize(size) - headerSize bytes
+size_t
+CompressLZ4(const unsigned char* src, size_t size, boost::uint32_t* table,
+      unsigned char* dest)
+{
+   unsigned char* op = dest;
+   size_t anchor = 0;
+
+   if (size > matchFindLimit)
+   {
+      std::fill(table, table + (1 << hashLog), 0);
+      const size_t matchLimit = size - lastLiterals;
+      const size_t ipLimit = size - matchFindLimit;
+      size_t ip = 1;
+      while (ip < ipLimit)
+      {
+         const boost::uint32_t sequence = Read32(src + ip);
+         const unsigned h = Hash(sequence);
+         const size_t ref = table[h];
+         table[h] = static_cast<boost::uint32_t>(ip);
+         if (ip - ref > maxOffset || Read32(src + ref) != sequence)
+         {
+            // Step faster through data that does not match
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+         }
+
+         size_t start = ip;
+         size_t matchStart = ref;
+         while (start > anchor && matchStart > 0 &&
+               src[start - 1] == src[matchStart - 1])
+         {
+            --start;
+            --matchStart;
+         }
+         size_t end = ip + minMatch;
+         for (size_t r = ref + minMatch; end < matchLimit && src[end] == src[r]; ++r)
+            ++end;
+
+         unsigned char* token = op++;
+         op = WriteLiterals(op, token, src + anchor, start - anchor);
+         const size_t offset = ip - ref;
+         *op++ = static_cast<unsigned char>(offset & 0xff);
+         *op++ = static_cast<unsigned char>(offset >> 8);
+         const size_t matchLength = end - start - minMatch;
+         *token |= static_cast<unsigned char>(std::min<size_t>(matchLength, 15));
+         if (matchLength >= 15)
+            op = WriteLengthBytes(op, matchLength - 15);
+
+         anchor = ip = end;
+         if (ip < ipLimit)
+            table[Hash(Read32(src + ip - 2))] = static_cast<boost::uint32_t>(ip - 2);
+      }
+   }
+
+   unsigned char* token = op++;
+   op = WriteLiterals(op, token, src + anchor, size - anchor);
+   return op - dest;
+}
+
+// Returns false if the data is corrupt
+bool
+DecompressLZ4(const unsigned char* src, size_t srcSize,
+      unsigned char* dest, size_t destSize)
+{
+   size_t ip = 0;
+   size_t op = 0;
+   for (;;)
+   {
+      if (ip >= srcSize)
+         return false;
+      const unsigned token = src[ip++];
+
+      size_t literals = token >> 4;
+      if (literals == 15)
+      {
+         unsigned b;
+         do
+         {
+            if (ip >= srcSize)
+               return false;
+            b = src[ip++];
+            literals += b;
+         } while (b == 255);
+      }
+      if (literals > srcSize - ip || literals > destSize - op)
+         return false;
+      std::memcpy(dest + op, src + ip, literals);
+      ip += literals;
+      op += literals;
+      if (ip == srcSize)
+         return op == destSize;
+
+      if (srcSize - ip < 2)
+         return false;
+      const size_t offset = src[ip] | (src[ip + 1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > op)
+         return false;
+
+      size_t length = token & 15;
+      if (length == 15)
+      {
+         unsigned b;
+         do
+         {
+            if (ip >= srcSize)
+               return false;
+            b = src[ip++];
+            length += b;
+         } while (b == 255);
+      }
+      length += minMatch;
+      if (length > destSize - op)
+         return false;
+
+      const unsigned char* match = dest + op - offset;
+      if (offset >= length)
+         std::memcpy(dest + op, match, length);
+      else
+      {
+         // Overlapping copy repeats the last offset bytes
+         for (size_t i = 0; i < length; ++i)
+            dest[op + i] = match[i];
+      }
+      op += length;
+   }
+}
+
+// Group byte j of every element together; trailing bytes that do not form
+// a whole element are copied unchanged. The loops over elements are simple
+// enough for the compiler to vectorize.
+void
+Shuffle(const unsigned char* src, size_t size, unsigned elementSize,
+      unsigned char* dest)
+{
+   const size_t n = size / elementSize;
+   if (elementSize == 2)
+   {
+      for (size_t i = 0; i < n; ++i)
+      {
+         dest[i] = src[2 * i];
+         dest[n + i] = src[2 * i + 1];
+      }
+   }
+   else
+   {
+      for (unsigned j = 0; j < elementSize; ++j)
+         for (size_t i = 0; i < n; ++i)
+            dest[j * n + i] = src[i * elementSize + j];
+   }
+   std::memcpy(dest + n * elementSize, src + n * elementSize,
+         size - n * elementSize);
+}
+
+void
+Unshuffle(const unsigned char* src, size_t size, unsigned elementSize,
+      unsigned char* dest)
+{
+   const size_t n = size / elementSize;
+   if (elementSize == 2)
+   {
+      for (size_t i = 0; i < n; ++i)
+      {
+         dest[2 * i] = src[i];
+         dest[2 * i + 1] = src[n + i];
+      }
+   }
+   else
+   {
+      for (unsigned j = 0; j < elementSize; ++j)
+         for (size_t i = 0; i < n; ++i)
+            dest[i * elementSize + j] = src[j * n + i];
+   }
+   std::memcpy(dest + n * elementSize, src + n * elementSize,
+         size - n * elementSize);
+}
+
+} // anonymous namespace
+
+
+FrameCodec::FrameCodec() :
+   hashTable_(1 << hashLog)
+{
+}
+
+
+size_t
+FrameCodec::GetMaxCompressedSize(size_t size)
+{
+   return headerSize + size + size / 255 + 16;
+}
+
+
+void
+FrameCodec::Compress(const unsigned char* src, size_t size,
+      unsigned elementSize, std::vector<unsigned char>& dest)
+{
+   if (elementSize == 0)
+      elementSize = 1;
+
+   const unsigned char* input = src;
+   if (elementSize > 1)
+   {
+      shuffled_.resize(size);
+      if (size > 0)
+         Shuffle(src, size, elementSize, &shuffled_[0]);
+      input = size > 0 ? &shuffled_[0] : src;
+   }
+
+   dest.resize(GetMaxCompressedSize(size));
+   dest[1] = static_cast<unsigned char>(elementSize);
+   const size_t compressedSize =
+      CompressLZ4(input, size, &hashTable_[0], &dest[headerSize]);
+   if (compressedSize < size)
+   {
+      dest[0] = MethodShuffleLZ4;
+      dest.resize(headerSize + compressedSize);
+   }
+   else
+   {
+      dest[0] = MethodStored;
+      if (size > 0)
+         std::memcpy(&dest[headerSize], src, size);
+      dest.resize(headerSize + size);
+   }
+}
+
+
+void
+FrameCodec::Decompress(const unsigned char* src, size_t compressedSize,
+      unsigned char* dest, size_t size) throw (CMMError)
+{
+   if (compressedSize < headerSize || src[1] == 0)
+      throw CMMError("Corrupt compressed image");
+   const unsigned method = src[0];
+   const unsigned elementSize = src[1];
+   src += headerSize;
+   compressedSize -= headerSize;
+
+   if (method == MethodStored)
+   {
+      if (compressedSize != size)
+         throw CMMError("Corrupt compressed image");
+      std::memcpy(dest, src, size);
+      return;
+   }
+   if (method != MethodShuffleLZ4)
+      throw CMMError("Unknown image compression method");
+
+   unsigned char* output = dest;
+   if (elementSize > 1)
+   {
+      shuffled_.resize(size);
+      output = size > 0 ? &shuffled_[0] : dest;
+   }
+   if (!DecompressLZ4(src, compressedSize, output, size))
+      throw CMMError("Corrupt compressed image");
+   if (elementSize > 1 && size > 0)
+      Unshuffle(output, size, elementSize, dest);
+}
+
+} // namespace mm
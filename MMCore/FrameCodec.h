@@ -0,0 +1,73 @@
+// DESCRIPTION:   Lossless compression of image pixels
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <boost/cstdint.hpp>
+
+#include <cstddef>
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief Fast lossless compression of image pixels.
+ *
+ * The bytes of the pixel components are first regrouped by significance
+ * (byte shuffling), so that the mostly-zero high bytes of sparse 16-bit
+ * images form long runs, and the result is compressed in the LZ4 block
+ * format, a fast LZ77 variant. Data that does not compress is stored as is,
+ * so the compressed size never exceeds GetMaxCompressedSize().
+ *
+ * An instance holds scratch memory and must not be used by more than one
+ * thread at a time; the compressed data is self-describing and can be
+ * decompressed by any instance.
+ */
+class FrameCodec /* final */
+{
+public:
+   FrameCodec();
+
+   static size_t GetMaxCompressedSize(size_t size);
+
+   /**
+    * \brief Compress size bytes from src, replacing the contents of dest.
+    *
+    * \param elementSize Bytes per pixel component (1 for 8-bit and RGB32
+    * pixels, 2 for 16-bit and RGB64 pixels); bytes are regrouped within
+    * elements of this size.
+    */
+   void Compress(const unsigned char* src, size_t size, unsigned elementSize,
+         std::vector<unsigned char>& dest);
+
+   /**
+    * \brief Decompress data written by Compress().
+    *
+    * Throws CMMError if the data is corrupt or does not decompress to
+    * exactly size bytes.
+    */
+   void Decompress(const unsigned char* src, size_t compressedSize,
+         unsigned char* dest, size_t size) throw (CMMError);
+
+private:
+   std::vector<unsigned char> shuffled_;
+   std::vector<boost::uint32_t> hashTable_;
+};
+
+} // namespace mm
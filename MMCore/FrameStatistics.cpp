@@ -0,0 +1,217 @@
+// DESCRIPTION:   Per-camera frame counters and arrival statistics
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameStatistics.h"
+
+#include <cmath>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// Weight of a new sample in the running mean of the arrival interval
+const double meanIntervalWeight = 1.0 / 16.0;
+
+// An arrival interval longer than this multiple of the expected interval
+// counts as a late frame
+const double lateIntervalFactor = 2.0;
+
+unsigned
+JitterBin(double deviationMs)
+{
+   double deviationUs = std::fabs(deviationMs) * 1000.0;
+   unsigned bin = 0;
+   while (deviationUs >= 1.0 &&
+         bin < CameraFrameStatistics::JitterHistogramBins - 1)
+   {
+      deviationUs /= 2.0;
+      ++bin;
+   }
+   return bin;
+}
+
+} // anonymous namespace
+
+
+const unsigned CameraFrameStatistics::JitterHistogramBins;
+
+
+CameraFrameStatistics::CameraFrameStatistics() :
+   inserted(0),
+   rejected(0),
+   dropped(0),
+   late(0),
+   jitterHistogram(JitterHistogramBins, 0)
+{
+}
+
+
+FrameStatistics::Counters::Counters(const std::string& name) :
+   name(name),
+   nextImageNumber(0),
+   hasLastArrival(false),
+   meanIntervalMs(0.0)
+{
+}
+
+
+FrameStatistics::FrameStatistics() :
+   lastIndex_(0)
+{
+}
+
+
+size_t
+FrameStatistics::GetCameraIndex(const std::string& camera)
+{
+   // Frames nearly always come from the same camera as the previous one
+   if (lastIndex_ < cameras_.size() && cameras_[lastIndex_].name == camera)
+      return lastIndex_;
+
+   for (size_t i = 0; i < cameras_.size(); ++i)
+   {
+      if (cameras_[i].name == camera)
+         return lastIndex_ = i;
+   }
+
+   cameras_.push_back(Counters(camera));
+   return lastIndex_ = cameras_.size() - 1;
+}
+
+
+long
+FrameStatistics::NextImageNumber(size_t index)
+{
+   return cameras_[index].nextImageNumber++;
+}
+
+
+void
+FrameStatistics::RecordInserted(size_t index, const FrameArrival& arrival)
+{
+   Counters& counters = cameras_[index];
+   ++counters.stats.inserted;
+
+   bool gapDetected = false;
+   if (counters.hasLastArrival && arrival.hasCameraFrameNumber &&
+         counters.lastArrival.hasCameraFrameNumber)
+   {
+      // A counter that does not increase means the camera was restarted
+      long gap = arrival.cameraFrameNumber -
+         counters.lastArrival.cameraFrameNumber - 1;
+      if (gap > 0)
+      {
+         counters.stats.dropped += gap;
+         gapDetected = true;
+      }
+   }
+
+   if (counters.hasLastArrival)
+      RecordInterval(counters, arrival, gapDetected);
+
+   counters.lastArrival = arrival;
+   counters.hasLastArrival = true;
+}
+
+
+void
+FrameStatistics::RecordRejected(size_t index)
+{
+   ++cameras_[index].stats.rejected;
+}
+
+
+void
+FrameStatistics::RecordInterval(Counters& counters,
+      const FrameArrival& arrival, bool gapDetected)
+{
+   const FrameArrival& last = counters.lastArrival;
+   const double hostIntervalMs = arrival.hostTimeMs - last.hostTimeMs;
+
+   double expectedMs;
+   if (arrival.hasCameraTime && last.hasCameraTime &&
+         arrival.cameraTimeMs > last.cameraTimeMs)
+   {
+      expectedMs = arrival.cameraTimeMs - last.cameraTimeMs;
+   }
+   else if (gapDetected)
+   {
+      // Without camera timestamps there is no way to know how long the
+      // interval spanning the missing frames should have been
+      return;
+   }
+   else if (counters.meanIntervalMs <= 0.0)
+   {
+      counters.meanIntervalMs = hostIntervalMs;
+      return;
+   }
+   else
+   {
+      expectedMs = counters.meanIntervalMs;
+   }
+
+   const bool isLate = hostIntervalMs > lateIntervalFactor * expectedMs;
+   if (isLate)
+      ++counters.stats.late;
+   else if (!gapDetected)
+   {
+      if (counters.meanIntervalMs <= 0.0)
+         counters.meanIntervalMs = hostIntervalMs;
+      else
+         counters.meanIntervalMs += meanIntervalWeight *
+            (hostIntervalMs - counters.meanIntervalMs);
+   }
+
+   ++counters.stats.jitterHistogram[JitterBin(hostIntervalMs - expectedMs)];
+}
+
+
+CameraFrameStatistics
+FrameStatistics::GetStatistics(const std::string& camera) const
+{
+   for (std::vector<Counters>::const_iterator it = cameras_.begin(),
+         end = cameras_.end(); it != end; ++it)
+   {
+      if (it->name == camera)
+         return it->stats;
+   }
+   return CameraFrameStatistics();
+}
+
+
+std::vector<std::string>
+FrameStatistics::GetCameras() const
+{
+   std::vector<std::string> cameras;
+   for (std::vector<Counters>::const_iterator it = cameras_.begin(),
+         end = cameras_.end(); it != end; ++it)
+   {
+      cameras.push_back(it->name);
+   }
+   return cameras;
+}
+
+
+void
+FrameStatistics::Reset()
+{
+   cameras_.clear();
+   lastIndex_ = 0;
+}
+
+} // namespace mm
@@ -0,0 +1,132 @@
+// DESCRIPTION:   Per-camera frame counters and arrival statistics
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief Frame statistics of one camera since the last reset.
+ */
+struct CameraFrameStatistics
+{
+   /**
+    * \brief Number of bins of the jitter histogram.
+    *
+    * Bin 0 counts deviations below 1 us; bin i (i > 0) counts deviations in
+    * [2^(i-1), 2^i) us. The last bin also counts all larger deviations.
+    */
+   static const unsigned JitterHistogramBins = 22;
+
+   CameraFrameStatistics();
+
+   /// Frames inserted into the buffer
+   long inserted;
+   /// Frames rejected because the buffer was full
+   long rejected;
+   /// Frames missing according to the camera's frame counter
+   long dropped;
+   /// Frames that arrived more than twice the expected interval late
+   long late;
+   /// Histogram of the deviation of arrival intervals from the expected
+   std::vector<long> jitterHistogram;
+};
+
+
+/**
+ * \brief Timestamps and counters attached to an arriving frame.
+ */
+struct FrameArrival
+{
+   FrameArrival() :
+      hostTimeMs(0.0),
+      hasCameraFrameNumber(false), cameraFrameNumber(0),
+      hasCameraTime(false), cameraTimeMs(0.0)
+   {}
+
+   /// Time of arrival on the host (monotonic)
+   double hostTimeMs;
+   bool hasCameraFrameNumber;
+   long cameraFrameNumber;
+   bool hasCameraTime;
+   double cameraTimeMs;
+};
+
+
+/**
+ * \brief Per-camera frame counters for sequence acquisition.
+ *
+ * Cameras are assigned a small integer index on first use, so that counting
+ * a frame does not require a map lookup. The expected frame interval is taken
+ * from the camera's timestamps if provided, and otherwise estimated from the
+ * host arrival times.
+ *
+ * Not thread-safe; the caller is responsible for synchronization.
+ */
+class FrameStatistics
+{
+public:
+   FrameStatistics();
+
+   /**
+    * \brief Get the index of a camera, adding it if not yet known.
+    */
+   size_t GetCameraIndex(const std::string& camera);
+
+   /**
+    * \brief Return the next image number (starting from 0) of a camera.
+    */
+   long NextImageNumber(size_t index);
+
+   void RecordInserted(size_t index, const FrameArrival& arrival);
+   void RecordRejected(size_t index);
+
+   /**
+    * \brief Get the statistics of a camera.
+    *
+    * Returns all-zero statistics for a camera that has not sent any frames.
+    */
+   CameraFrameStatistics GetStatistics(const std::string& camera) const;
+
+   std::vector<std::string> GetCameras() const;
+
+   void Reset();
+
+private:
+   struct Counters
+   {
+      Counters(const std::string& name);
+
+      std::string name;
+      long nextImageNumber;
+      bool hasLastArrival;
+      FrameArrival lastArrival;
+      double meanIntervalMs;
+      CameraFrameStatistics stats;
+   };
+
+   void RecordInterval(Counters& counters, const FrameArrival& arrival,
+         bool gapDetected);
+
+   std::vector<Counters> cameras_;
+   size_t lastIndex_;
+};
+
+} // namespace mm
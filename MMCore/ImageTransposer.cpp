@@ -0,0 +1,161 @@
+// DESCRIPTION:   Transposition and mirroring of camera images
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ImageTransposer.h"
+
+#include "CoreUtils.h"
+#include "Error.h"
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// Side of the square tiles in which images are transposed, chosen so that
+// the tile buffer for the largest pixels (32 KiB) fits in L1 cache
+const unsigned transposeTileSize = 64;
+
+struct Pixel64
+{
+   boost::uint64_t value;
+};
+
+// Transform with the destination position of source pixel (x, y) being
+// origin + x * xStep + y * yStep.
+template <typename Pixel>
+void
+TransformPixels(const Pixel* src, unsigned width, unsigned height,
+      bool swapXY, bool mirrorX, bool mirrorY, Pixel* dest)
+{
+   const unsigned newWidth = swapXY ? height : width;
+   const unsigned newHeight = swapXY ? width : height;
+   const std::ptrdiff_t colStep = mirrorX ? -1 : 1;
+   const std::ptrdiff_t rowStep = mirrorY ? -std::ptrdiff_t(newWidth) :
+      std::ptrdiff_t(newWidth);
+   Pixel* origin = dest +
+      (mirrorY ? std::ptrdiff_t(newHeight - 1) * newWidth : 0) +
+      (mirrorX ? newWidth - 1 : 0);
+
+   if (!swapXY)
+   {
+      // Row by row; rows are copied as is unless mirrored
+      for (unsigned y = 0; y < height; ++y)
+      {
+         const Pixel* in = src + std::ptrdiff_t(y) * width;
+         Pixel* out = origin + y * rowStep;
+         if (mirrorX)
+            std::reverse_copy(in, in + width, out - (width - 1));
+         else
+            std::memcpy(out, in, width * sizeof(Pixel));
+      }
+      return;
+   }
+
+   // Source rows become destination rows. Work in tiles, each gathered
+   // transposed into a local buffer, so that both the image reads and the
+   // image writes are sequential; only the buffer is accessed with a stride.
+   // Going through the buffer also avoids the cache set conflicts that
+   // strided accesses to images with power-of-two widths cause.
+   const std::ptrdiff_t xStep = rowStep;
+   const std::ptrdiff_t yStep = colStep;
+   Pixel tile[transposeTileSize * transposeTileSize];
+   for (unsigned y0 = 0; y0 < height; y0 += transposeTileSize)
+   {
+      const unsigned tileHeight = std::min(height - y0, transposeTileSize);
+      for (unsigned x0 = 0; x0 < width; x0 += transposeTileSize)
+      {
+         const unsigned tileWidth = std::min(width - x0, transposeTileSize);
+         for (unsigned y = 0; y < tileHeight; ++y)
+         {
+            const Pixel* in = src + std::ptrdiff_t(y0 + y) * width + x0;
+            for (unsigned x = 0; x < tileWidth; ++x)
+               tile[x * transposeTileSize + y] = in[x];
+         }
+         for (unsigned x = 0; x < tileWidth; ++x)
+         {
+            const Pixel* in = tile + x * transposeTileSize;
+            Pixel* out = origin + (x0 + x) * xStep + y0 * yStep;
+            if (mirrorX)
+               std::reverse_copy(in, in + tileHeight, out - (tileHeight - 1));
+            else
+               std::memcpy(out, in, tileHeight * sizeof(Pixel));
+         }
+      }
+   }
+}
+
+} // anonymous namespace
+
+
+void
+ImageTransposer::GetTransformedSize(unsigned width, unsigned height,
+      unsigned& newWidth, unsigned& newHeight) const
+{
+   newWidth = swapXY_ ? height : width;
+   newHeight = swapXY_ ? width : height;
+}
+
+
+void
+ImageTransposer::Transform(const unsigned char* src,
+      unsigned width, unsigned height, unsigned bytesPerPixel,
+      unsigned char* dest) const
+{
+   switch (bytesPerPixel)
+   {
+      case 1:
+         TransformPixels(src, width, height, swapXY_, mirrorX_, mirrorY_,
+               dest);
+         break;
+      case 2:
+         TransformPixels(reinterpret_cast<const boost::uint16_t*>(src),
+               width, height, swapXY_, mirrorX_, mirrorY_,
+               reinterpret_cast<boost::uint16_t*>(dest));
+         break;
+      case 4:
+         TransformPixels(reinterpret_cast<const boost::uint32_t*>(src),
+               width, height, swapXY_, mirrorX_, mirrorY_,
+               reinterpret_cast<boost::uint32_t*>(dest));
+         break;
+      case 8:
+         TransformPixels(reinterpret_cast<const Pixel64*>(src),
+               width, height, swapXY_, mirrorX_, mirrorY_,
+               reinterpret_cast<Pixel64*>(dest));
+         break;
+      default:
+         throw CMMError("Cannot transpose images with " +
+               ToString(bytesPerPixel) + "-byte pixels");
+   }
+}
+
+
+void
+ImageTransposer::Copier::CopyPixels(unsigned channel, unsigned char* dest) const
+{
+   const size_t channelSize =
+      static_cast<size_t>(width_) * height_ * bytesPerPixel_;
+   transposer_.Transform(pixels_ + channel * channelSize,
+         width_, height_, bytesPerPixel_, dest);
+}
+
+} // namespace mm
@@ -0,0 +1,86 @@
+// DESCRIPTION:   Transposition and mirroring of camera images
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "PixelCopier.h"
+
+
+namespace mm
+{
+
+/**
+ * \brief Orientation correction as specified by the camera Transpose
+ * properties.
+ *
+ * The image is first transposed (if swapXY), then mirrored left-right (if
+ * mirrorX), then mirrored top-bottom (if mirrorY). Pixels of 1, 2, 4 and 8
+ * bytes are supported; multi-component (RGB) pixels are moved as a whole.
+ */
+class ImageTransposer /* final */
+{
+public:
+   ImageTransposer(bool swapXY, bool mirrorX, bool mirrorY) :
+      swapXY_(swapXY), mirrorX_(mirrorX), mirrorY_(mirrorY)
+   {}
+
+   bool IsIdentity() const { return !swapXY_ && !mirrorX_ && !mirrorY_; }
+   bool SwapsXY() const { return swapXY_; }
+
+   /// Dimensions of the result of transforming an image
+   void GetTransformedSize(unsigned width, unsigned height,
+         unsigned& newWidth, unsigned& newHeight) const;
+
+   /**
+    * \brief Write the transformed image.
+    *
+    * \param dest Must not overlap with src. Holds width * height pixels.
+    *
+    * Throws CMMError if the pixel size is not supported.
+    */
+   void Transform(const unsigned char* src, unsigned width, unsigned height,
+         unsigned bytesPerPixel, unsigned char* dest) const;
+
+   /**
+    * \brief Copier that transforms images while inserting them.
+    *
+    * Channels are consecutive in the source pixels.
+    */
+   class Copier : public PixelCopier
+   {
+   public:
+      Copier(const ImageTransposer& transposer, const unsigned char* pixels,
+            unsigned width, unsigned height, unsigned bytesPerPixel) :
+         transposer_(transposer), pixels_(pixels),
+         width_(width), height_(height), bytesPerPixel_(bytesPerPixel)
+      {}
+
+      virtual void CopyPixels(unsigned channel, unsigned char* dest) const;
+
+   private:
+      const ImageTransposer& transposer_;
+      const unsigned char* pixels_;
+      unsigned width_;
+      unsigned height_;
+      unsigned bytesPerPixel_;
+   };
+
+private:
+   bool swapXY_;
+   bool mirrorX_;
+   bool mirrorY_;
+};
+
+} // namespace mm
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "GenericMetadata.h"
+#include "../MonotonicClock.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -39,13 +40,11 @@ namespace internal
 
 typedef boost::posix_time::ptime TimestampType;
 
-// Note: Boost's local_time() internally calls the C library function
-// localtime_r() or localtime(). On the platforms we are interested in, either
-// the thread-safe localtime_r() is provided (OS X, Linux), or localtime() is
-// made thread-safe by using thread-local storage (Windows).
+// Derived from the monotonic clock shared with the rest of the Core, so that
+// log timestamps are consistent with device and image timestamps.
 inline TimestampType
 Now()
-{ return boost::posix_time::microsec_clock::local_time(); }
+{ return MonotonicClock::NowAsLocalTime(); }
 
 
 #ifdef _WIN32
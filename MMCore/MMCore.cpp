@@ -42,20 +42,37 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMDevice/ModuleInterface.h"
+#include "AcquisitionEngine.h"
+#include "CameraBufferSet.h"
 #include "CircularBuffer.h"
+#include "ConfigFileCache.h"
 #include "ConfigGroup.h"
 #include "Configuration.h"
+#include "CompressionStage.h"
 #include "CoreCallback.h"
 #include "CoreProperty.h"
 #include "CoreUtils.h"
+#include "DeviceCallRecorder.h"
+#include "DeviceCallReplayer.h"
+#include "DeviceCallStatistics.h"
 #include "DeviceManager.h"
 #include "Devices/DeviceInstances.h"
 #include "Host.h"
+#include "ImageTransposer.h"
 #include "LogManager.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
+#include "MonotonicClock.h"
+#include "MultiROIPacker.h"
 #include "PluginManager.h"
-
+#include "PreviewBuffer.h"
+#include "SnapTask.h"
+#include "StackWriter.h"
+#include "TraceRecorder.h"
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <algorithm>
@@ -106,7 +123,7 @@ using namespace std;
  * (Keep the 3 numbers on one line to make it easier to look at diffs when
  * merging/rebasing.)
  */
-const int MMCore_versionMajor = 8, MMCore_versionMinor = 5, MMCore_versionPatch = 0;
+const int MMCore_versionMajor = 8, MMCore_versionMinor = 22, MMCore_versionPatch = 0;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -122,18 +139,32 @@ CMMCore::CMMCore() :
    logManager_(new mm::LogManager()),
    appLogger_(logManager_->NewLogger("App")),
    coreLogger_(logManager_->NewLogger("Core")),
+   traceRecorder_(new mm::TraceRecorder()),
+   callRecorder_(new mm::DeviceCallRecorder()),
    everSnapped_(false),
+   lastSnapId_(0),
    pollingIntervalMs_(10),
    timeoutMs_(5000),
    autoShutter_(true),
+   circularBufferOverwrite_(false),
+   lazyDeviceLoading_(false),
+   multiROIPacking_(false),
+   pixelStatistics_(false),
+   pixelStatisticsHistogramBins_(0),
+   previewStream_(false),
+   deviceCallTiming_(false),
    callback_(0),
    configGroups_(0),
    properties_(0),
    externalCallback_(0),
    pixelSizeGroup_(0),
    cbuf_(0),
+   cameraBuffers_(new mm::CameraBufferSet()),
+   previewBuffer_(new mm::PreviewBuffer()),
    pluginManager_(new CPluginManager()),
    deviceManager_(new mm::DeviceManager()),
+   configFileCache_(new mm::ConfigFileCache()),
+   acquisitionEngine_(new mm::AcquisitionEngine(*this)),
    pPostedErrorsLock_(NULL)
 {
    configGroups_ = new ConfigGroupCollection();
@@ -147,6 +178,10 @@ CMMCore::CMMCore() :
    const unsigned seqBufMegabytes = (sizeof(void*) > 4) ? 250 : 25;
    cbuf_ = new CircularBuffer(seqBufMegabytes);
 
+   deviceManager_->SetDeferredDeviceHandlers(
+         boost::bind(&CMMCore::bindDeferredDevice, this, _1),
+         boost::bind(&CMMCore::probeDeferredDeviceType, this, _1, _2));
+
    CreateCoreProperties();
 }
 
@@ -156,6 +191,17 @@ CMMCore::CMMCore() :
  */
 CMMCore::~CMMCore()
 {
+   // Stop a running acquisition plan while the devices are still loaded
+   acquisitionEngine_.reset();
+   // The stack writer and the compression stage read from the circular
+   // buffer
+   stackWriter_.reset();
+   compressionStage_.reset();
+   {
+      MMThreadGuard g(snapTaskLock_);
+      snapTask_.reset();
+   }
+
    try
    {
       // TODO We should attempt to continue cleanup beyond the first device
@@ -292,6 +338,379 @@ void CMMCore::stopSecondaryLogFile(int handle) throw (CMMError)
 }
 
 
+/**
+ * Enable or disable timing of device calls.
+ *
+ * When enabled, the latency of calls to each device (property access, Busy(),
+ * snapping, stage and state device moves, etc.) and the time spent waiting
+ * for device adapter module locks are recorded per device. See
+ * getTimedDeviceCalls() for the kinds of calls that are timed. Timing is
+ * disabled by default; it adds two clock reads to every timed call.
+ *
+ * The setting applies to all loaded devices and to devices loaded later.
+ */
+void CMMCore::enableDeviceCallTiming(bool enable)
+{
+   deviceCallTiming_ = enable;
+
+   std::vector<std::string> devices = deviceManager_->GetDeviceList();
+   for (std::vector<std::string>::const_iterator it = devices.begin(),
+         end = devices.end(); it != end; ++it)
+   {
+      // Deferred devices pick up the setting when bound
+      if (deviceManager_->IsDeviceDeferred(*it))
+         continue;
+      deviceManager_->GetDevice(*it)->GetCallStatistics().SetEnabled(enable);
+   }
+   LOG_INFO(coreLogger_) << "Device call timing " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether device calls are being timed.
+ */
+bool CMMCore::isDeviceCallTimingEnabled() const
+{
+   return deviceCallTiming_;
+}
+
+/**
+ * Discard the device call timing recorded so far for all loaded devices.
+ */
+void CMMCore::resetDeviceCallTiming()
+{
+   std::vector<std::string> devices = deviceManager_->GetDeviceList();
+   for (std::vector<std::string>::const_iterator it = devices.begin(),
+         end = devices.end(); it != end; ++it)
+   {
+      if (deviceManager_->IsDeviceDeferred(*it))
+         continue;
+      deviceManager_->GetDevice(*it)->GetCallStatistics().Reset();
+   }
+}
+
+/**
+ * Returns the names of the kinds of device calls that are timed, for use
+ * with getDeviceCallCount() and related functions.
+ *
+ * "ModuleLockWait" is the time spent by the Core waiting to acquire the lock
+ * of the device's adapter module, which is held during every call to any
+ * device of the module.
+ */
+std::vector<std::string> CMMCore::getTimedDeviceCalls() const
+{
+   std::vector<std::string> calls;
+   for (int i = 0; i < mm::DeviceCallCount; ++i)
+      calls.push_back(mm::GetDeviceCallName(static_cast<mm::DeviceCall>(i)));
+   return calls;
+}
+
+/**
+ * Returns the number of timed calls of the given kind made to a device.
+ *
+ * @param label the device label
+ * @param call the kind of call (see getTimedDeviceCalls())
+ */
+long CMMCore::getDeviceCallCount(const char* label, const char* call)
+   throw (CMMError)
+{
+   return getDeviceCallTiming(label, call).count;
+}
+
+/**
+ * Returns the total time, in milliseconds, taken by the timed calls of the
+ * given kind made to a device.
+ */
+double CMMCore::getDeviceCallTotalTimeMs(const char* label, const char* call)
+   throw (CMMError)
+{
+   return getDeviceCallTiming(label, call).totalMs;
+}
+
+/**
+ * Returns the time, in milliseconds, taken by the slowest timed call of the
+ * given kind made to a device.
+ */
+double CMMCore::getDeviceCallMaxTimeMs(const char* label, const char* call)
+   throw (CMMError)
+{
+   return getDeviceCallTiming(label, call).maxMs;
+}
+
+/**
+ * Returns a histogram of the time taken by the timed calls of the given kind
+ * made to a device.
+ *
+ * Element 0 counts calls taking less than 1 microsecond; element i counts
+ * calls taking between 2^(i-1) and 2^i microseconds. The last element also
+ * counts all longer calls.
+ */
+std::vector<long> CMMCore::getDeviceCallHistogram(const char* label,
+      const char* call) throw (CMMError)
+{
+   return getDeviceCallTiming(label, call).histogram;
+}
+
+/**
+ * Write a summary of the device call timing of all loaded devices to the
+ * log.
+ *
+ * Percentiles are upper bounds, within a factor of 2, taken from the
+ * histogram.
+ */
+void CMMCore::logDeviceCallTiming()
+{
+   std::vector<std::string> devices = deviceManager_->GetDeviceList();
+   LOG_INFO(coreLogger_) << "Device call timing of " << devices.size() <<
+      " devices (ms):";
+   for (std::vector<std::string>::const_iterator it = devices.begin(),
+         end = devices.end(); it != end; ++it)
+   {
+      if (deviceManager_->IsDeviceDeferred(*it))
+         continue;
+      const mm::DeviceCallStatistics& stats =
+         deviceManager_->GetDevice(*it)->GetCallStatistics();
+      for (int i = 0; i < mm::DeviceCallCount; ++i)
+      {
+         mm::DeviceCall call = static_cast<mm::DeviceCall>(i);
+         mm::DeviceCallTiming timing = stats.GetTiming(call);
+         if (timing.count == 0)
+            continue;
+         LOG_INFO(coreLogger_) << *it << " " << mm::GetDeviceCallName(call) <<
+            ": " << timing.count << " calls, mean " <<
+            timing.totalMs / timing.count << ", p50 <= " <<
+            timing.GetPercentileUpperBoundMs(0.5) << ", p99 <= " <<
+            timing.GetPercentileUpperBoundMs(0.99) << ", max " <<
+            timing.maxMs;
+      }
+   }
+}
+
+mm::DeviceCallTiming CMMCore::getDeviceCallTiming(const char* label,
+      const char* call) throw (CMMError)
+{
+   CheckDeviceLabel(label);
+   if (!call)
+      throw CMMError("Null device call name");
+   mm::DeviceCall deviceCall;
+   if (!mm::FindDeviceCall(call, deviceCall))
+      throw CMMError("Unknown device call " + ToQuotedString(call));
+
+   boost::shared_ptr<DeviceInstance> device = deviceManager_->GetDevice(label);
+   return device->GetCallStatistics().GetTiming(deviceCall);
+}
+
+
+/**
+ * Enable or disable tracing of Core activity.
+ *
+ * When enabled, the Core records timed events into an in-memory ring buffer
+ * (of 65536 events; the oldest are overwritten first): device calls (of the
+ * kinds listed by getTimedDeviceCalls()), waiting for and holding device adapter
+ * module locks, waiting for devices, insertion and retrieval of sequence
+ * images, application of configuration presets, and notifications sent to
+ * the registered MMEventCallback. The trace can be saved with saveTrace().
+ *
+ * Recording an event does not take any lock. Tracing is disabled by default.
+ */
+void CMMCore::enableTracing(bool enable)
+{
+   traceRecorder_->SetEnabled(enable);
+   LOG_INFO(coreLogger_) << "Tracing " << (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether Core activity is being traced.
+ */
+bool CMMCore::isTracingEnabled() const
+{
+   return traceRecorder_->IsEnabled();
+}
+
+/**
+ * Discard the trace events recorded so far.
+ */
+void CMMCore::clearTrace()
+{
+   traceRecorder_->Clear();
+}
+
+/**
+ * Returns the number of trace events held in the buffer.
+ */
+long CMMCore::getTraceEventCount() const
+{
+   return static_cast<long>(traceRecorder_->GetEventCount());
+}
+
+/**
+ * Save the recorded trace events to a file, in the Chrome trace event JSON
+ * format (which can be opened in chrome://tracing or ui.perfetto.dev).
+ *
+ * Timestamps are in microseconds of the same monotonic clock as the
+ * ReceivedTime-ms image tag. Threads are named after the thread ids printed
+ * in the log. Tracing need not be stopped to save the trace.
+ */
+void CMMCore::saveTrace(const char* filename) throw (CMMError)
+{
+   if (!filename)
+      throw CMMError("Null filename");
+
+   std::ofstream os(filename, std::ios_base::out | std::ios_base::trunc);
+   if (!os.is_open())
+   {
+      throw CMMError(ToQuotedString(filename) + ": " +
+            getCoreErrorText(MMERR_FileOpenFailed), MMERR_FileOpenFailed);
+   }
+   traceRecorder_->WriteJSON(os);
+   os.close();
+   if (os.fail())
+      throw CMMError("Failed to write trace to " + ToQuotedString(filename));
+   LOG_INFO(coreLogger_) << "Saved " << traceRecorder_->GetEventCount() <<
+      " trace events to " << filename;
+}
+
+/**
+ * Enable or disable recording of device calls.
+ *
+ * When enabled, the Core records each device call of the kinds listed by
+ * getTimedDeviceCalls() (property access, snaps, sequence acquisition,
+ * stage, shutter and state device moves, and so on) together with its
+ * arguments, start time, duration and calling thread. The recording can be
+ * saved with saveDeviceCallRecording() and later replayed against simulated
+ * devices with replayDeviceCalls().
+ *
+ * At most 1000000 calls are kept. Recording is disabled by default.
+ */
+void CMMCore::enableDeviceCallRecording(bool enable)
+{
+   callRecorder_->SetEnabled(enable);
+   LOG_INFO(coreLogger_) << "Device call recording " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether device calls are being recorded.
+ */
+bool CMMCore::isDeviceCallRecordingEnabled() const
+{
+   return callRecorder_->IsEnabled();
+}
+
+/**
+ * Discard the device calls recorded so far.
+ */
+void CMMCore::clearDeviceCallRecording()
+{
+   callRecorder_->Clear();
+}
+
+/**
+ * Returns the number of device calls recorded so far.
+ */
+long CMMCore::getRecordedDeviceCallCount() const
+{
+   return static_cast<long>(callRecorder_->GetCallCount());
+}
+
+/**
+ * Save the recorded device calls to a text file, one call per line in order
+ * of start time. Recording need not be stopped to save the calls.
+ */
+void CMMCore::saveDeviceCallRecording(const char* filename) throw (CMMError)
+{
+   if (!filename)
+      throw CMMError("Null filename");
+
+   std::ofstream os(filename, std::ios_base::out | std::ios_base::trunc);
+   if (!os.is_open())
+   {
+      throw CMMError(ToQuotedString(filename) + ": " +
+            getCoreErrorText(MMERR_FileOpenFailed), MMERR_FileOpenFailed);
+   }
+   callRecorder_->Write(os);
+   os.close();
+   if (os.fail())
+   {
+      throw CMMError("Failed to write device call recording to " +
+            ToQuotedString(filename));
+   }
+
+   size_t dropped = callRecorder_->GetDroppedCount();
+   LOG_INFO(coreLogger_) << "Saved " << callRecorder_->GetCallCount() <<
+      " recorded device calls to " << filename;
+   if (dropped > 0)
+   {
+      LOG_WARNING(coreLogger_) << dropped <<
+         " device calls were not recorded because the recording was full";
+   }
+}
+
+/**
+ * Replay device calls saved by saveDeviceCallRecording() against simulated
+ * devices.
+ *
+ * Same as replayDeviceCalls(filename, withRecordedTiming, false).
+ */
+long CMMCore::replayDeviceCalls(const char* filename, bool withRecordedTiming)
+   throw (CMMError)
+{
+   return replayDeviceCalls(filename, withRecordedTiming, false);
+}
+
+/**
+ * Replay device calls saved by saveDeviceCallRecording().
+ *
+ * The calls are issued to the currently loaded devices with the same labels
+ * -- typically simulated devices (such as those of DemoCamera or
+ * SequenceTester) loaded under the labels of the recorded hardware. The calls
+ * recorded from each thread are issued from a separate thread, in order of
+ * their recorded start times, so that calls that overlapped during recording
+ * also overlap during replay. Calls to devices that are not loaded, or that
+ * the device type does not support, are skipped. Errors returned by the
+ * devices are counted but do not stop the replay.
+ *
+ * With withRecordedTiming, each call is issued no earlier than its recorded
+ * offset from the first call, and the next call from the same thread no
+ * earlier than the end of the recorded duration, so that the simulated
+ * devices exhibit the latencies of the recorded ones. Otherwise the calls are
+ * issued as fast as possible.
+ *
+ * Unless allowRealDevices is true, the replay is refused, before any call is
+ * issued, if one of the devices is not from the DemoCamera or SequenceTester
+ * adapters.
+ *
+ * The counts and elapsed time are logged.
+ *
+ * @return the number of calls issued
+ * @param filename the recording to replay
+ * @param withRecordedTiming whether to reproduce the recorded timing
+ * @param allowRealDevices whether to issue calls to non-simulated devices
+ */
+long CMMCore::replayDeviceCalls(const char* filename, bool withRecordedTiming,
+      bool allowRealDevices) throw (CMMError)
+{
+   if (!filename)
+      throw CMMError("Null filename");
+
+   std::ifstream is(filename);
+   if (!is.is_open())
+   {
+      throw CMMError(ToQuotedString(filename) + ": " +
+            getCoreErrorText(MMERR_FileOpenFailed), MMERR_FileOpenFailed);
+   }
+   std::vector<mm::RecordedDeviceCall> calls = mm::DeviceCallRecorder::Read(is);
+
+   LOG_INFO(coreLogger_) << "Replaying " << calls.size() <<
+      " device calls from " << filename <<
+      (withRecordedTiming ? " with recorded timing" : "");
+   mm::DeviceCallReplayer replayer(deviceManager_, coreLogger_);
+   mm::DeviceCallReplayer::Result result =
+      replayer.Replay(calls, withRecordedTiming, allowRealDevices);
+   return static_cast<long>(result.replayed);
+}
+
+
 /*!
  Displays current user name.
  */
@@ -413,6 +832,9 @@ Configuration CMMCore::getSystemState()
    vector<string> devices = deviceManager_->GetDeviceList();
    for (vector<string>::const_iterator i = devices.begin(), end = devices.end(); i != end; ++i)
    {
+      if (deviceManager_->IsDeviceDeferred(*i))
+         continue; // Not accessed yet, so no state to report
+
       boost::shared_ptr<DeviceInstance> pDev = deviceManager_->GetDevice(*i);
       mm::DeviceModuleLockGuard guard(pDev);
       std::vector<std::string> propertyNames = pDev->GetPropertyNames();
@@ -513,47 +935,48 @@ Configuration CMMCore::getConfigGroupState(const char* group, bool fromCache) th
 {
    CheckConfigGroupName(group);
 
-   std::vector<std::string> allPresets =
-      configGroups_->GetAvailableConfigs(group);
-
    Configuration state;
+   boost::shared_ptr<const mm::PresetMatcher> matcher =
+      configGroups_->GetPresetMatcher(group);
+   if (!matcher)
+      return state;
 
-   // Loop over every property that appears in every preset, and collect the
-   // value (from cache or from devices).
-   for (std::vector<std::string>::const_iterator
-         it = allPresets.begin(), end = allPresets.end(); it != end; ++it)
+   // Collect the value (from cache or from devices) of every property that
+   // appears in any preset.
+   const std::vector<mm::PresetMatcher::PropertyKey>& properties =
+      matcher->GetProperties();
+   std::vector<std::string> values =
+      getPresetPropertyValues(*matcher, fromCache);
+   for (size_t i = 0; i < properties.size(); ++i)
    {
-      Configuration preset = getConfigData(group, it->c_str());
+      state.addSetting(PropertySetting(properties[i].first.c_str(),
+               properties[i].second.c_str(), values[i].c_str()));
+   }
+   return state;
+}
 
-      for (size_t i = 0; i < preset.size(); i++)
+std::vector<std::string> CMMCore::getPresetPropertyValues(
+      const mm::PresetMatcher& matcher, bool fromCache) throw (CMMError)
+{
+   const std::vector<mm::PresetMatcher::PropertyKey>& properties =
+      matcher.GetProperties();
+   std::vector<std::string> values;
+   values.reserve(properties.size());
+   for (std::vector<mm::PresetMatcher::PropertyKey>::const_iterator
+         it = properties.begin(), end = properties.end(); it != end; ++it)
+   {
+      if (fromCache)
       {
-         PropertySetting cs = preset.getSetting(i);
-         std::string deviceLabel = cs.getDeviceLabel();
-         std::string propertyName = cs.getPropertyName();
-
-         // Skip properties that we have already added.
-         if (!state.isPropertyIncluded(deviceLabel.c_str(),
-                  propertyName.c_str()))
-         {
-            std::string value;
-            if (fromCache)
-            {
-               value = getPropertyFromCache(deviceLabel.c_str(),
-                     propertyName.c_str());
-            }
-            else
-            {
-               value = getProperty(deviceLabel.c_str(),
-                     propertyName.c_str());
-            }
-
-            PropertySetting ss(deviceLabel.c_str(), propertyName.c_str(),
-                  value.c_str());
-            state.addSetting(ss);
-         }
+         values.push_back(getPropertyFromCache(it->first.c_str(),
+                  it->second.c_str()));
+      }
+      else
+      {
+         values.push_back(getProperty(it->first.c_str(),
+                  it->second.c_str()));
       }
    }
-   return state;
+   return values;
 }
 
 /**
@@ -675,6 +1098,16 @@ void CMMCore::loadDevice(const char* label, const char* moduleName, const char*
    if (!deviceName)
       throw CMMError("Null device name");
 
+   if (lazyDeviceLoading_)
+   {
+      // Only record the device; the adapter module is not loaded until the
+      // device is first accessed.
+      deviceManager_->DeferDevice(moduleName, deviceName, label);
+      LOG_INFO(coreLogger_) << "Deferred loading of device " << deviceName <<
+         " from " << moduleName << "; label = " << label;
+      return;
+   }
+
    // Logger for logging from device adapter code
    mm::logging::Logger deviceLogger =
       logManager_->NewLogger("dev:" + std::string(label));
@@ -705,50 +1138,197 @@ void CMMCore::loadDevice(const char* label, const char* moduleName, const char*
       " from " << moduleName << "; label = " << label;
 }
 
-void CMMCore::assignDefaultRole(boost::shared_ptr<DeviceInstance> pDevice)
+/**
+ * Enables or disables lazy (on-demand) device loading.
+ *
+ * While enabled, loadDevice() only records the device. The device adapter
+ * module is loaded and the device is instantiated (and, if
+ * initializeAllDevices() has been called in the meantime, initialized) when
+ * the device is first accessed. Device settings read from a configuration
+ * file are stored and applied at that point.
+ *
+ * This speeds up loading of configurations containing devices that are not
+ * used in a given session. Devices that have already been loaded are not
+ * affected.
+ *
+ * @param enable  true to defer loading of subsequently loaded devices
+ */
+void CMMCore::enableLazyDeviceLoading(bool enable)
 {
-   // default special roles for particular devices
-   // The roles which are assigned at the load time will make sense for a simple
-   // configuration. More complicated configurations will typically override default settings.
-   mm::DeviceModuleLockGuard guard(pDevice);
-   const std::string label(pDevice->GetLabel());
+   lazyDeviceLoading_ = enable;
+   LOG_DEBUG(coreLogger_) << "Lazy device loading " <<
+      (enable ? "enabled" : "disabled");
+}
 
-   switch(pDevice->GetType())
-   {
-      case MM::CameraDevice:
-         currentCameraDevice_ =
-            boost::static_pointer_cast<CameraInstance>(pDevice);
-         LOG_INFO(coreLogger_) << "Default camera set to " << label;
-         break;
+/**
+ * Returns true if lazy device loading is enabled.
+ */
+bool CMMCore::isLazyDeviceLoadingEnabled() const
+{
+   return lazyDeviceLoading_;
+}
 
-      case MM::ShutterDevice:
-         currentShutterDevice_ =
-            boost::static_pointer_cast<ShutterInstance>(pDevice);
-         LOG_INFO(coreLogger_) << "Default shutter set to " << label;
-         break;
+/**
+ * Returns true if the device has been loaded lazily and not yet accessed.
+ *
+ * @param label   the device label
+ */
+bool CMMCore::isDeviceDeferred(const char* label) throw (CMMError)
+{
+   CheckDeviceLabel(label);
+   return deviceManager_->IsDeviceDeferred(label);
+}
 
-      case MM::XYStageDevice:
-         currentXYStageDevice_ =
-            boost::static_pointer_cast<XYStageInstance>(pDevice);
-         LOG_INFO(coreLogger_) << "Default xy stage set to " << label;
-         break;
+/**
+ * Instantiates a deferred device and applies the settings recorded for it.
+ *
+ * Called by the device manager on first access to the device.
+ */
+void CMMCore::bindDeferredDevice(const std::string& label)
+{
+   // Copy, as the record is removed once the device is bound (and must be
+   // restored if setting up the device fails).
+   mm::DeferredDevice deferred = deviceManager_->GetDeferredDevice(label);
 
-      case MM::AutoFocusDevice:
-         currentAutofocusDevice_ =
-            boost::static_pointer_cast<AutoFocusInstance>(pDevice);
-         LOG_INFO(coreLogger_) << "Default autofocus set to " << label;
-         break;
+   LOG_DEBUG(coreLogger_) << "Will load deferred device " <<
+      deferred.deviceName << " from " << deferred.moduleName;
 
-      case MM::SLMDevice:
-         currentSLMDevice_ =
-            boost::static_pointer_cast<SLMInstance>(pDevice);
-         LOG_INFO(coreLogger_) << "Default SLM set to " << label;
-         break;
+   mm::logging::Logger deviceLogger = logManager_->NewLogger("dev:" + label);
+   mm::logging::Logger coreLogger = logManager_->NewLogger("Core:dev:" + label);
 
-      case MM::GalvoDevice:
-         currentGalvoDevice_ =
-            boost::static_pointer_cast<GalvoInstance>(pDevice);
-         LOG_INFO(coreLogger_) << "Default galvo set to " << label;
+   boost::shared_ptr<DeviceInstance> pDevice;
+   try
+   {
+      boost::shared_ptr<LoadedDeviceAdapter> module =
+         pluginManager_->GetDeviceAdapter(deferred.moduleName);
+      pDevice = deviceManager_->BindDeferredDevice(module, label, this,
+            deviceLogger, coreLogger);
+      pDevice->SetCallback(callback_);
+   }
+   catch (const CMMError& e)
+   {
+      throw CMMError("Failed to load device " +
+            ToQuotedString(deferred.deviceName) + " from adapter module " +
+            ToQuotedString(deferred.moduleName), e);
+   }
+
+   LOG_INFO(coreLogger_) << "Did load deferred device " <<
+      deferred.deviceName << " from " << deferred.moduleName <<
+      "; label = " << label;
+
+   typedef std::vector< std::vector<std::string> >::const_iterator CommandIterator;
+   try
+   {
+      for (CommandIterator it = deferred.preInitCommands.begin(),
+            end = deferred.preInitCommands.end(); it != end; ++it)
+      {
+         executeConfigurationCommand(*it, boost::algorithm::join(*it, ",").c_str());
+      }
+
+      if (deferred.initializeOnBind)
+      {
+         mm::DeviceModuleLockGuard guard(pDevice);
+         LOG_INFO(coreLogger_) << "Will initialize device " << label;
+         pDevice->Initialize();
+         LOG_INFO(coreLogger_) << "Did initialize device " << label;
+         // Default roles are not assigned here, as that would override the
+         // roles chosen after initializeAllDevices().
+      }
+
+      for (CommandIterator it = deferred.postInitCommands.begin(),
+            end = deferred.postInitCommands.end(); it != end; ++it)
+      {
+         executeConfigurationCommand(*it, boost::algorithm::join(*it, ",").c_str());
+      }
+   }
+   catch (const CMMError& e)
+   {
+      // Leave the device deferred, so that the next access retries
+      LOG_ERROR(coreLogger_) << "Failed to set up deferred device " << label <<
+         "; unloading it again";
+      deviceManager_->RestoreDeferredDevice(pDevice, deferred);
+      throw CMMError("Failed to set up deferred device " +
+            ToQuotedString(label), e);
+   }
+
+   // Deferred devices were left out of the system state cache
+   std::vector<PropertySetting> settings;
+   {
+      mm::DeviceModuleLockGuard guard(pDevice);
+      std::vector<std::string> propertyNames = pDevice->GetPropertyNames();
+      for (std::vector<std::string>::const_iterator it = propertyNames.begin(),
+            end = propertyNames.end(); it != end; ++it)
+      {
+         try
+         {
+            settings.push_back(PropertySetting(label.c_str(), it->c_str(),
+                     pDevice->GetProperty(*it).c_str(),
+                     pDevice->GetPropertyReadOnly(it->c_str())));
+         }
+         catch (const CMMError&)
+         {
+            // Leave the property out of the cache, as getSystemState() would
+            // for a property that cannot be read.
+         }
+      }
+   }
+   addToStateCache(settings);
+}
+
+/**
+ * Returns the device type advertised by a module, without creating the device.
+ */
+MM::DeviceType CMMCore::probeDeferredDeviceType(const std::string& moduleName,
+      const std::string& deviceName)
+{
+   return pluginManager_->GetDeviceAdapter(moduleName)->
+      GetAdvertisedDeviceType(deviceName);
+}
+
+void CMMCore::assignDefaultRole(boost::shared_ptr<DeviceInstance> pDevice)
+{
+   // default special roles for particular devices
+   // The roles which are assigned at the load time will make sense for a simple
+   // configuration. More complicated configurations will typically override default settings.
+   mm::DeviceModuleLockGuard guard(pDevice);
+   const std::string label(pDevice->GetLabel());
+
+   switch(pDevice->GetType())
+   {
+      case MM::CameraDevice:
+         currentCameraDevice_ =
+            boost::static_pointer_cast<CameraInstance>(pDevice);
+         LOG_INFO(coreLogger_) << "Default camera set to " << label;
+         break;
+
+      case MM::ShutterDevice:
+         currentShutterDevice_ =
+            boost::static_pointer_cast<ShutterInstance>(pDevice);
+         LOG_INFO(coreLogger_) << "Default shutter set to " << label;
+         break;
+
+      case MM::XYStageDevice:
+         currentXYStageDevice_ =
+            boost::static_pointer_cast<XYStageInstance>(pDevice);
+         LOG_INFO(coreLogger_) << "Default xy stage set to " << label;
+         break;
+
+      case MM::AutoFocusDevice:
+         currentAutofocusDevice_ =
+            boost::static_pointer_cast<AutoFocusInstance>(pDevice);
+         LOG_INFO(coreLogger_) << "Default autofocus set to " << label;
+         break;
+
+      case MM::SLMDevice:
+         currentSLMDevice_ =
+            boost::static_pointer_cast<SLMInstance>(pDevice);
+         LOG_INFO(coreLogger_) << "Default SLM set to " << label;
+         break;
+
+      case MM::GalvoDevice:
+         currentGalvoDevice_ =
+            boost::static_pointer_cast<GalvoInstance>(pDevice);
+         LOG_INFO(coreLogger_) << "Default galvo set to " << label;
          break;
 
       default:
@@ -763,6 +1343,15 @@ void CMMCore::assignDefaultRole(boost::shared_ptr<DeviceInstance> pDevice)
 void CMMCore::unloadDevice(const char* label///< the name of the device to unload
                            ) throw (CMMError)
 {
+   CheckDeviceLabel(label);
+   checkAcquisitionPlanNotRunning("unload a device");
+   if (deviceManager_->IsDeviceDeferred(label))
+   {
+      deviceManager_->UnloadDeferredDevice(label);
+      LOG_DEBUG(coreLogger_) << "Did unload deferred device " << label;
+      return;
+   }
+
    boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
 
    try {
@@ -783,6 +1372,7 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
  */
 void CMMCore::unloadAllDevices() throw (CMMError)
 {
+   checkAcquisitionPlanNotRunning("unload devices");
    try {
       configGroups_->Clear();
 
@@ -867,6 +1457,14 @@ void CMMCore::initializeAllDevices() throw (CMMError)
 
    for (size_t i=0; i<devices.size(); i++)
    {
+      if (deviceManager_->IsDeviceDeferred(devices[i]))
+      {
+         // Initialized when first accessed
+         deviceManager_->GetDeferredDevice(devices[i]).initializeOnBind = true;
+         LOG_INFO(coreLogger_) << "Deferred initialization of device " << devices[i];
+         continue;
+      }
+
       boost::shared_ptr<DeviceInstance> pDevice;
       try {
          pDevice = deviceManager_->GetDevice(devices[i]);
@@ -907,6 +1505,10 @@ void CMMCore::updateCoreProperty(const char* propName, MM::DeviceType devType) t
    CheckPropertyName(propName);
 
    vector<string> devices = getLoadedDevicesOfType(devType);
+   // Deferred devices whose type cannot be known without loading them are
+   // allowed as well; assigning one loads it and checks its type.
+   vector<string> untyped = deviceManager_->GetDeferredDevicesOfUnknownType();
+   devices.insert(devices.end(), untyped.begin(), untyped.end());
    devices.push_back(""); // add empty value
    properties_->ClearAllowedValues(propName);
    for (size_t i=0; i<devices.size(); i++)
@@ -921,6 +1523,16 @@ void CMMCore::updateCoreProperty(const char* propName, MM::DeviceType devType) t
 void CMMCore::initializeDevice(const char* label ///< the device to initialize
                                ) throw (CMMError)
 {
+   CheckDeviceLabel(label);
+   if (deviceManager_->IsDeviceDeferred(label))
+   {
+      // Binding the device performs the initialization
+      deviceManager_->GetDeferredDevice(label).initializeOnBind = true;
+      deviceManager_->GetDevice(label);
+      updateCoreProperties();
+      return;
+   }
+
    boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
 
    mm::DeviceModuleLockGuard guard(pDevice);
@@ -934,6 +1546,19 @@ void CMMCore::initializeDevice(const char* label ///< the device to initialize
 
 
 
+/**
+ * Records property values that have been set or read in the system state cache.
+ */
+void CMMCore::addToStateCache(const std::vector<PropertySetting>& settings)
+{
+   MMThreadGuard scg(stateCacheLock_);
+   for (std::vector<PropertySetting>::const_iterator it = settings.begin(),
+         end = settings.end(); it != end; ++it)
+   {
+      stateCache_.addSetting(*it);
+   }
+}
+
 /**
  * Updates the state of the entire hardware.
  */
@@ -989,6 +1614,12 @@ void CMMCore::unloadLibrary(const char* moduleName) throw (CMMError)
       vector<string>::reverse_iterator it;
       for (it=devices.rbegin(); it != devices.rend(); it++)
       {
+         if (deviceManager_->IsDeviceDeferred(*it))
+         {
+            if (deviceManager_->GetDeferredDevice(*it).moduleName == moduleName)
+               deviceManager_->UnloadDeferredDevice(*it);
+            continue;
+         }
          boost::shared_ptr<DeviceInstance> pDev = deviceManager_->GetDevice(*it);
          mm::DeviceModuleLockGuard guard(pDev);
 
@@ -1178,12 +1809,16 @@ void CMMCore::waitForDevice(boost::shared_ptr<DeviceInstance> pDev) throw (CMMEr
 {
    LOG_DEBUG(coreLogger_) << "Waiting for device " << pDev->GetLabel() << "...";
 
-   MM::TimeoutMs timeout(GetMMTimeNow(),timeoutMs_);
+   mm::TraceScope traceScope(traceRecorder_.get(), "wait", "waitForDevice");
+   if (traceScope.IsActive())
+      traceScope.SetArg("device", pDev->GetLabel());
+
+   MM::TimeoutMs timeout(mm::MonotonicClock::NowAsMMTime(),timeoutMs_);
    mm::DeviceModuleLockGuard guard(pDev);
    
    while (pDev->Busy())
    {
-      if (timeout.expired(GetMMTimeNow()))
+      if (timeout.expired(mm::MonotonicClock::NowAsMMTime()))
       {
          string label = pDev->GetLabel();
          std::ostringstream mez;
@@ -1230,6 +1865,9 @@ bool CMMCore::deviceTypeBusy(MM::DeviceType devType) throw (CMMError)
    vector<string> devices = deviceManager_->GetDeviceList(devType);
    for (size_t i=0; i<devices.size(); i++)
    {
+      // A device that has not been loaded yet cannot be busy
+      if (deviceManager_->IsDeviceDeferred(devices[i]))
+         continue;
       try {
          boost::shared_ptr<DeviceInstance> pDevice =
             deviceManager_->GetDevice(devices[i]);
@@ -1254,7 +1892,10 @@ void CMMCore::waitForDeviceType(MM::DeviceType devType) throw (CMMError)
 {
    vector<string> devices = deviceManager_->GetDeviceList(devType);
    for (size_t i=0; i<devices.size(); i++)
-      waitForDevice(devices[i].c_str());
+   {
+      if (!deviceManager_->IsDeviceDeferred(devices[i]))
+         waitForDevice(devices[i].c_str());
+   }
 }
 
 /**
@@ -2354,6 +2995,136 @@ void CMMCore::snapImage() throw (CMMError)
 }
 
 
+namespace
+{
+   // Readout step of an asynchronous snap: GetImageBuffer() waits for the
+   // image to be read out
+   int ReadOutSnappedImage(boost::shared_ptr<CameraInstance> camera)
+   {
+      camera->GetImageBuffer();
+      return DEVICE_OK;
+   }
+}
+
+/**
+ * Starts acquiring a single image with current settings, returning once the
+ * exposure has ended.
+ *
+ * The image is read out on a separate thread, so that the caller can move
+ * stages or change other settings for the next image in the meantime; the
+ * image is then retrieved with getAsyncSnapImage(). As required of cameras,
+ * the exposure is taken to have ended when the camera's SnapImage()
+ * returns; cameras that wait for the readout in SnapImage() only return
+ * once the image has been read out.
+ *
+ * If auto-shutter is on, the shutter is opened before the exposure and
+ * closed as soon as it has ended. Devices in the same adapter module as the
+ * camera can only be used once the readout is finished.
+ *
+ * Only the image of the last snap can be retrieved; starting a snap waits
+ * for the readout of the previous one.
+ *
+ * @return the id of the snap, for isAsyncSnapDone() and getAsyncSnapImage()
+ */
+long CMMCore::snapImageAsync() throw (CMMError)
+{
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (!camera)
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(), MMERR_CameraNotAvailable);
+   if (camera->IsCapturing())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+            MMERR_NotAllowedDuringSequenceAcquisition);
+
+   boost::shared_ptr<mm::SnapTask> previous;
+   {
+      MMThreadGuard g(snapTaskLock_);
+      previous = snapTask_;
+   }
+   if (previous)
+      previous->WaitForReadout();
+
+   // wait for all synchronized devices to stop before taking an image
+   waitForImageSynchro();
+
+   boost::shared_ptr<ShutterInstance> shutter = currentShutterDevice_.lock();
+   if (autoShutter_ && shutter)
+   {
+      mm::DeviceModuleLockGuard shutterGuard(shutter);
+      int sret = shutter->SetOpen(true);
+      if (DEVICE_OK != sret)
+      {
+         logError("CMMCore::snapImageAsync", getDeviceErrorText(sret, shutter).c_str());
+         throw CMMError(getDeviceErrorText(sret, shutter).c_str(), MMERR_DEVICE_GENERIC);
+      }
+      waitForDevice(shutter);
+   }
+
+   boost::shared_ptr<mm::SnapTask> task;
+   long snap;
+   {
+      MMThreadGuard g(snapTaskLock_);
+      snap = ++lastSnapId_;
+      LOG_DEBUG(coreLogger_) << "Will start asynchronous snap " << snap <<
+         " from current camera";
+      task.reset(new mm::SnapTask(snap,
+               camera->GetAdapterModule()->GetLock(),
+               boost::bind(&CameraInstance::SnapImage, camera),
+               boost::bind(&ReadOutSnappedImage, camera)));
+      snapTask_ = task;
+   }
+   everSnapped_ = true;
+
+   int ret = task->WaitForExposureEnd();
+   LOG_DEBUG(coreLogger_) << "Exposure of asynchronous snap " << snap <<
+      " ended";
+
+   if (autoShutter_ && shutter)
+   {
+      // Waits for the readout if the shutter is in the camera's module
+      mm::DeviceModuleLockGuard shutterGuard(shutter);
+      int sret = shutter->SetOpen(false);
+      if (DEVICE_OK != sret)
+      {
+         logError("CMMCore::snapImageAsync", getDeviceErrorText(sret, shutter).c_str());
+         throw CMMError(getDeviceErrorText(sret, shutter).c_str(), MMERR_DEVICE_GENERIC);
+      }
+      waitForDevice(shutter);
+   }
+
+   if (ret != DEVICE_OK)
+   {
+      logError("CMMCore::snapImageAsync", getDeviceErrorText(ret, camera).c_str());
+      throw CMMError(getDeviceErrorText(ret, camera).c_str(), MMERR_DEVICE_GENERIC);
+   }
+   return snap;
+}
+
+/**
+ * Returns whether the image of a snap started by snapImageAsync() has been
+ * read out.
+ */
+bool CMMCore::isAsyncSnapDone(long snap) throw (CMMError)
+{
+   return findSnapTask(snap)->IsDone();
+}
+
+/**
+ * Waits for the image of a snap started by snapImageAsync() to be read out,
+ * and returns it as getImage() does. The snap must be the last one started,
+ * and the camera must still be the current camera.
+ */
+void* CMMCore::getAsyncSnapImage(long snap) throw (CMMError)
+{
+   boost::shared_ptr<mm::SnapTask> task = findSnapTask(snap);
+   int ret = task->WaitForReadout();
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (!camera)
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(), MMERR_CameraNotAvailable);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, camera).c_str(), MMERR_DEVICE_GENERIC);
+   return getImage();
+}
+
 // Predicate used by assignImageSynchro() and removeImageSynchro()
 namespace
 {
@@ -2516,6 +3287,11 @@ bool CMMCore::getShutterOpen() throw (CMMError)
  * Multi-Channel cameras will return the content of the first 
  * channel in this function
  *
+ * If the camera's TransposeCorrection property is set (and the camera does
+ * not correct its images itself), the returned image is a copy to which the
+ * Transpose properties have been applied. Sequence acquisition images are
+ * corrected in the same way as they are inserted into the circular buffer.
+ *
  * Designed specifically for the SWIG wrapping for Java and scripting languages.
  * @return a pointer to the internal image buffer.
  * @throws CMMError   when the camera returns no data
@@ -2557,6 +3333,7 @@ void* CMMCore::getImage() throw (CMMError)
 	      {
             imageProcessor->Process((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
 	      }
+         pBuf = getTransposedImage(camera, pBuf);
 		} catch( CMMError& e){
 			throw e;
 		} catch (...) {
@@ -2604,6 +3381,7 @@ void* CMMCore::getImage(unsigned channelNr) throw (CMMError)
 	      {
             imageProcessor->Process((unsigned char*)pBuf, camera->GetImageWidth(),  camera->GetImageHeight(), camera->GetImageBytesPerPixel() );
 	      }
+         pBuf = getTransposedImage(camera, pBuf);
 		} catch( CMMError& e){
 			throw e;
 		} catch (...) {
@@ -2665,15 +3443,18 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
             ,MMERR_NotAllowedDuringSequenceAcquisition);
       }
 
+      // The camera may stream through the cameras of a multi-camera device
+      initializePerCameraBuffers();
+
 		try
 		{
-			if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+         mm::DeviceModuleLockGuard guard(camera);
+			if (!initializeCircularBufferForCamera(camera))
 			{
 				logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
 				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
 			}
 			cbuf_->Clear();
-         mm::DeviceModuleLockGuard guard(camera);
 
          LOG_DEBUG(coreLogger_) << "Will start sequence acquisition from default camera";
 			int nRet = camera->StartSequenceAcquisition(numImages, intervalMs, stopOnOverflow);
@@ -2710,6 +3491,16 @@ void CMMCore::startSequenceAcquisition(const char* label, long numImages, double
    if(pCam->IsCapturing())
       throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(), 
                      MMERR_NotAllowedDuringSequenceAcquisition);
+   updateMultiROIPacking(pCam);
+   updateImageTransposition(pCam);
+
+   boost::shared_ptr<CircularBuffer> cameraBuffer = cameraBuffers_->Find(label);
+   if (cameraBuffer)
+   {
+      if (!initializeSequenceBufferForCamera(*cameraBuffer, pCam))
+         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+      cameraBuffer->Clear();
+   }
    
    LOG_DEBUG(coreLogger_) <<
       "Will start sequence acquisition from camera " << label;
@@ -2755,7 +3546,7 @@ void CMMCore::initializeCircularBuffer() throw (CMMError)
    if (camera)
    {
       mm::DeviceModuleLockGuard guard(camera);
-      if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+      if (!initializeCircularBufferForCamera(camera))
       {
          logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
          throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
@@ -2799,6 +3590,9 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
    boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
    if (camera)
    {
+      // Takes the module lock of each camera in turn
+      initializePerCameraBuffers();
+
       mm::DeviceModuleLockGuard guard(camera);
       if(camera->IsCapturing())
       {
@@ -2807,7 +3601,7 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
             ,MMERR_NotAllowedDuringSequenceAcquisition);
       }
 
-      if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+      if (!initializeCircularBufferForCamera(camera))
       {
          logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
          throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
@@ -2883,6 +3677,146 @@ bool CMMCore::isSequenceRunning(const char* label) throw (CMMError)
    return pCam->IsCapturing();
 };
 
+/**
+ * Starts a multi-dimensional acquisition, run by the Core on its own
+ * thread.
+ *
+ * The images are acquired with the current camera and inserted into the
+ * circular buffer (which is initialized first), tagged with their frame,
+ * position, slice and channel indices, to be retrieved with popNextImageMD()
+ * or a buffer cursor. At each time point and XY position, the Z slices and
+ * channels are acquired as hardware sequences when the focus stage, the
+ * camera exposure and the properties that differ between the channel
+ * presets are all sequenceable for the required length; otherwise each
+ * image is snapped after moving the devices.
+ *
+ * This function returns once the acquisition has started. Errors during the
+ * acquisition end it and are reported by waitForAcquisitionPlan().
+ *
+ * @param plan  the dimensions of the acquisition
+ */
+void CMMCore::startAcquisitionPlan(const AcquisitionPlan& plan) throw (CMMError)
+{
+   acquisitionEngine_->Start(plan);
+}
+
+/**
+ * Requests the running acquisition plan to stop after the current image (or
+ * by stopping the current hardware sequence). Returns immediately.
+ */
+void CMMCore::stopAcquisitionPlan()
+{
+   acquisitionEngine_->Stop();
+}
+
+/**
+ * Returns whether an acquisition started by startAcquisitionPlan() is
+ * running.
+ */
+bool CMMCore::isAcquisitionPlanRunning()
+{
+   return acquisitionEngine_->IsRunning();
+}
+
+/**
+ * Waits for the acquisition started by startAcquisitionPlan() to end.
+ * Throws the error that ended the acquisition, if any.
+ */
+void CMMCore::waitForAcquisitionPlan() throw (CMMError)
+{
+   acquisitionEngine_->Wait();
+}
+
+/**
+ * Throws if an acquisition plan is running, which uses the current camera,
+ * the loaded devices and the circular buffer.
+ */
+void CMMCore::checkAcquisitionPlanNotRunning(const char* operation) throw (CMMError)
+{
+   // The engine is destroyed first when the Core is destroyed
+   if (acquisitionEngine_ && acquisitionEngine_->IsRunning())
+      throw CMMError(std::string("Cannot ") + operation +
+            " while an acquisition plan is running",
+            MMERR_NotAllowedDuringSequenceAcquisition);
+}
+
+/**
+ * Starts writing the images inserted into the circular buffer to a file, on
+ * a separate thread.
+ *
+ * Images are written directly from the circular buffer, which keeps them
+ * until they have been written (and read by any lossless buffer cursor).
+ * They can still be retrieved with popNextImage(), but only until their
+ * place in the buffer is reused: the writer, not popNextImage(), determines
+ * when the buffer is full. Channel 0 of each image is written,
+ * with its metadata listed in an index file (the file name followed by
+ * ".idx").
+ *
+ * @param path       the file to create
+ * @param format     "tiff" for a multi-page BigTIFF file, "raw" for the
+ *                   pixels of each image, one after the other, or
+ *                   "compressed" for each image losslessly compressed as
+ *                   with enableCircularBufferCompression() (the index then
+ *                   lists the compressed size)
+ * @param maxFrames  the number of images after which writing ends, or 0 to
+ *                   write until stopStackWriter() is called
+ */
+void CMMCore::startStackWriter(const char* path, const char* format,
+      long maxFrames) throw (CMMError)
+{
+   if (!path || !format)
+      throw CMMError("Null filename or format", MMERR_NullPointerException);
+   if (stackWriter_)
+      throw CMMError("A stack writer is already open; call stopStackWriter() first",
+            MMERR_NotAllowedDuringSequenceAcquisition);
+
+   mm::StackWriter::Format fmt;
+   if (boost::iequals(format, "tiff"))
+      fmt = mm::StackWriter::FormatBigTiff;
+   else if (boost::iequals(format, "raw"))
+      fmt = mm::StackWriter::FormatRaw;
+   else if (boost::iequals(format, "compressed"))
+      fmt = mm::StackWriter::FormatCompressedRaw;
+   else
+      throw CMMError("Unknown stack file format: " + ToQuotedString(format));
+
+   stackWriter_.reset(new mm::StackWriter(*cbuf_, path, fmt, maxFrames));
+   LOG_INFO(coreLogger_) << "Started writing images to " << path;
+}
+
+/**
+ * Writes the images remaining in the circular buffer, then closes the file
+ * started by startStackWriter(). Throws if writing failed.
+ */
+void CMMCore::stopStackWriter() throw (CMMError)
+{
+   if (!stackWriter_)
+      return;
+
+   boost::shared_ptr<mm::StackWriter> writer;
+   writer.swap(stackWriter_);
+   writer->Finish();
+   LOG_INFO(coreLogger_) << "Finished writing " <<
+      writer->GetFrameCount() << " images";
+}
+
+/**
+ * Returns whether the stack writer is writing images; it stops by itself
+ * after the requested number of images, or after an error.
+ */
+bool CMMCore::isStackWriterRunning()
+{
+   return stackWriter_ && stackWriter_->IsRunning();
+}
+
+/**
+ * Returns the number of images written by the stack writer.
+ */
+long CMMCore::getStackWriterFrameCount()
+{
+   return stackWriter_ ? stackWriter_->GetFrameCount() : 0;
+}
+
 /**
  * Gets the last image from the circular buffer.
  * Returns 0 if the buffer is empty.
@@ -2961,6 +3895,13 @@ void* CMMCore::getNBeforeLastImageMD(unsigned long n, Metadata& md) const throw
  */
 void* CMMCore::popNextImage() throw (CMMError)
 {
+   if (compressionStage_)
+   {
+      Metadata md;
+      return popNextImageMD(0, 0, md);
+   }
+
+   mm::TraceScope traceScope(traceRecorder_.get(), "frame", "popNextImage");
    unsigned char* pBuf = const_cast<unsigned char*>(cbuf_->GetNextImage());
    if (pBuf != 0)
       return pBuf;
@@ -2974,6 +3915,16 @@ void* CMMCore::popNextImageMD(unsigned channel, unsigned slice, Metadata& md) th
    if (slice != 0)
       throw CMMError("Slice must be 0");
 
+   mm::TraceScope traceScope(traceRecorder_.get(), "frame", "popNextImageMD");
+   if (compressionStage_)
+   {
+      const unsigned char* pixels =
+         compressionStage_->PopNextImage(channel, md);
+      if (!pixels)
+         throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+      return const_cast<unsigned char*>(pixels);
+   }
+
    const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBuffer(channel);
    if (pBuf != 0)
    {
@@ -2990,31 +3941,300 @@ void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
 }
 
 /**
- * Removes all images from the circular buffer.
+ * Registers an additional consumer of the images in the circular buffer.
  *
- * It is rarely necessary to call this directly since starting a sequence
- * acquisition or changing the ROI will always clear the buffer.
+ * Each cursor reads the sequence of inserted images independently of
+ * popNextImage() and of the other cursors, so that, for example, images can
+ * be saved and analyzed in parallel without copying them. A new cursor
+ * starts at the next image to be inserted; cursors are kept when the buffer
+ * is cleared or reallocated, and start again at its beginning.
+ *
+ * A slot of the buffer is only reused when the image it holds has been
+ * retrieved by popNextImage() and by all cursors that are not lossy, so a
+ * non-lossy cursor that falls behind causes the buffer to overflow (or,
+ * with enableCircularBufferOverwrite(), to discard images from all
+ * consumers). A lossy cursor never holds up the acquisition; images that
+ * are reused before it reads them are skipped and counted (see
+ * getMissedImageCountForCursor()).
+ *
+ * Images retrieved through a lossy cursor, like those retrieved while
+ * overwriting is enabled, may be overwritten once newer images arrive.
+ *
+ * @param lossy  whether the cursor may miss images instead of holding up
+ * insertion
+ * @return the id of the cursor, to be passed to popNextImageForCursor() and
+ * the related functions
  */
-void CMMCore::clearCircularBuffer() throw (CMMError)
+int CMMCore::addSequenceBufferCursor(bool lossy)
 {
-   cbuf_->Clear();
+   int cursor = cbuf_->AddCursor(lossy);
+   LOG_DEBUG(coreLogger_) << "Added " << (lossy ? "lossy " : "") <<
+      "circular buffer cursor " << cursor;
+   return cursor;
 }
 
 /**
- * Reserve memory for the circular buffer.
+ * Unregisters a cursor added with addSequenceBufferCursor(). Images that
+ * only it had not read can then be discarded.
  */
-void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
-                                               ) throw (CMMError)
+void CMMCore::removeSequenceBufferCursor(int cursor) throw (CMMError)
 {
-   delete cbuf_; // discard old buffer
-   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
-      sizeMB << " MB";
-	try
-	{
-		cbuf_ = new CircularBuffer(sizeMB);
+   cbuf_->RemoveCursor(cursor);
+   LOG_DEBUG(coreLogger_) << "Removed circular buffer cursor " << cursor;
+}
+
+/**
+ * Gets the next image from the circular buffer that the given cursor has not
+ * read, and advances the cursor. See addSequenceBufferCursor().
+ */
+void* CMMCore::popNextImageForCursor(int cursor) throw (CMMError)
+{
+   Metadata md;
+   return popNextImageMDForCursor(cursor, 0, md);
+}
+
+/**
+ * Gets the next image, and its metadata, from the circular buffer that the
+ * given cursor has not read, and advances the cursor. See
+ * addSequenceBufferCursor().
+ */
+void* CMMCore::popNextImageMDForCursor(int cursor, unsigned channel,
+      Metadata& md) throw (CMMError)
+{
+   mm::TraceScope traceScope(traceRecorder_.get(), "frame",
+         "popNextImageMDForCursor");
+   if (traceScope.IsActive())
+      traceScope.SetArg("cursor", ToString(cursor));
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBuffer(cursor, channel);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Returns the number of images in the circular buffer that the given cursor
+ * has not read.
+ */
+long CMMCore::getRemainingImageCountForCursor(int cursor) throw (CMMError)
+{
+   return cbuf_->GetRemainingImageCount(cursor);
+}
+
+/**
+ * Returns the number of images that the given cursor did not read before
+ * they were discarded, since the circular buffer was last initialized. Only
+ * nonzero for lossy cursors or when overwriting is enabled.
+ */
+long CMMCore::getMissedImageCountForCursor(int cursor) throw (CMMError)
+{
+   return cbuf_->GetMissedImageCount(cursor);
+}
+
+/**
+ * Gives each of the given cameras a sequence buffer of its own.
+ *
+ * The images that these cameras insert during sequence acquisitions are
+ * kept in their own buffers instead of the circular buffer, so that cameras
+ * with different image sizes or pixel types (for example the cameras of a
+ * multi-camera device with different ROIs) can stream at the same time,
+ * without being padded to a common size and without contending for a
+ * single buffer. The images are retrieved with popNextImageMDForCamera(),
+ * or from all the cameras in the order in which they were received with
+ * popNextMergedImageMD().
+ *
+ * memoryMB is divided between the cameras in proportion to the size of
+ * their current images, so that each buffer holds about the same number of
+ * images; call this again to divide it anew after changing ROIs. Each
+ * buffer is initialized for its camera's current settings when a sequence
+ * acquisition is started. Overwriting (see
+ * enableCircularBufferOverwrite()) applies to the per-camera buffers;
+ * buffer cursors, compression, the stack writer and the preview stream
+ * only see the circular buffer.
+ *
+ * @param cameraLabels  the cameras that get their own buffers, replacing
+ * any previously given
+ * @param memoryMB      the memory for all the buffers, in megabytes
+ */
+void CMMCore::enablePerCameraBuffers(
+      const std::vector<std::string>& cameraLabels, unsigned memoryMB)
+   throw (CMMError)
+{
+   if (cameraLabels.empty() || memoryMB == 0)
+      throw CMMError("Per-camera buffers need at least 1 camera and 1 MB of "
+            "memory");
+   if (isPerCameraBufferInUse())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+            MMERR_NotAllowedDuringSequenceAcquisition);
+
+   std::vector<size_t> frameBytes;
+   for (std::vector<std::string>::const_iterator it = cameraLabels.begin();
+         it != cameraLabels.end(); ++it)
+   {
+      // Throws if the label does not refer to a camera
+      boost::shared_ptr<CameraInstance> camera =
+         deviceManager_->GetDeviceOfType<CameraInstance>(*it);
+      if (std::count(cameraLabels.begin(), it, *it) > 0)
+         throw CMMError("Camera " + ToQuotedString(*it) +
+               " is listed more than once");
+
+      mm::DeviceModuleLockGuard guard(camera);
+      if (camera->IsCapturing())
+         throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+               MMERR_NotAllowedDuringSequenceAcquisition);
+      unsigned width, height;
+      getBufferedImageSize(camera, width, height);
+      frameBytes.push_back(static_cast<size_t>(width) * height *
+            camera->GetImageBytesPerPixel() * camera->GetNumberOfChannels());
+   }
+
+   cameraBuffers_->Reset(cameraLabels,
+         mm::CameraBufferSet::DivideMemory(frameBytes, memoryMB));
+   cameraBuffers_->SetOverwriteOldest(circularBufferOverwrite_);
+   try
+   {
+      initializePerCameraBuffers();
+   }
+   catch (const CMMError&)
+   {
+      cameraBuffers_->Clear();
+      throw;
+   }
+   LOG_INFO(coreLogger_) << "Per-camera buffers enabled for " <<
+      cameraLabels.size() << " cameras with " << memoryMB << " MB";
+}
+
+/**
+ * Removes the per-camera buffers given by enablePerCameraBuffers(), with
+ * any images they hold. All cameras then insert into the circular buffer.
+ */
+void CMMCore::disablePerCameraBuffers() throw (CMMError)
+{
+   if (cameraBuffers_->IsEmpty())
+      return;
+   if (isPerCameraBufferInUse())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+            MMERR_NotAllowedDuringSequenceAcquisition);
+   cameraBuffers_->Clear();
+   LOG_INFO(coreLogger_) << "Per-camera buffers disabled";
+}
+
+/**
+ * Returns the cameras that have their own sequence buffers. See
+ * enablePerCameraBuffers().
+ */
+std::vector<std::string> CMMCore::getPerCameraBufferCameras() const
+{
+   return cameraBuffers_->GetCameras();
+}
+
+/**
+ * Gets and removes the next image, and its metadata, from the sequence
+ * buffer of the given camera. See enablePerCameraBuffers().
+ */
+void* CMMCore::popNextImageMDForCamera(const char* cameraLabel,
+      Metadata& md) throw (CMMError)
+{
+   boost::shared_ptr<CircularBuffer> buffer =
+      findPerCameraBuffer(cameraLabel);
+   mm::TraceScope traceScope(traceRecorder_.get(), "frame",
+         "popNextImageMDForCamera");
+   traceScope.SetArg("camera", cameraLabel);
+   const mm::ImgBuffer* pBuf = buffer->GetNextImageBuffer(0);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the earliest received of the next images of all the
+ * per-camera buffers, with its metadata. The Camera tag tells which camera
+ * the image came from. See enablePerCameraBuffers().
+ */
+void* CMMCore::popNextMergedImageMD(Metadata& md) throw (CMMError)
+{
+   mm::TraceScope traceScope(traceRecorder_.get(), "frame",
+         "popNextMergedImageMD");
+   const mm::ImgBuffer* pBuf = cameraBuffers_->PopEarliestImage(0);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Returns the number of images in the sequence buffer of the given camera.
+ * See enablePerCameraBuffers().
+ */
+long CMMCore::getRemainingImageCountForCamera(const char* cameraLabel)
+   throw (CMMError)
+{
+   return findPerCameraBuffer(cameraLabel)->GetRemainingImageCount();
+}
+
+/**
+ * Returns the number of images in all the per-camera buffers, which can be
+ * retrieved with popNextMergedImageMD().
+ */
+long CMMCore::getMergedRemainingImageCount()
+{
+   return cameraBuffers_->GetRemainingImageCount();
+}
+
+/**
+ * Removes all images from the circular buffer.
+ *
+ * It is rarely necessary to call this directly since starting a sequence
+ * acquisition or changing the ROI will always clear the buffer.
+ */
+void CMMCore::clearCircularBuffer() throw (CMMError)
+{
+   cbuf_->Clear();
+   cameraBuffers_->ClearImages();
+}
+
+/**
+ * Reserve memory for the circular buffer.
+ */
+void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
+                                               ) throw (CMMError)
+{
+   checkAcquisitionPlanNotRunning("change the circular buffer size");
+   if (stackWriter_)
+      throw CMMError("Cannot change the circular buffer size while the stack "
+            "writer is running", MMERR_NotAllowedDuringSequenceAcquisition);
+   if (compressionStage_)
+      throw CMMError("Cannot change the circular buffer size while "
+            "compression is enabled", MMERR_NotAllowedDuringSequenceAcquisition);
+
+   // The old buffer is kept until its settings have been copied
+   CircularBuffer* oldBuffer = cbuf_;
+   cbuf_ = 0;
+   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
+      sizeMB << " MB";
+	try
+	{
+		cbuf_ = new CircularBuffer(sizeMB);
+		cbuf_->SetOverwriteOldest(circularBufferOverwrite_);
+		if (oldBuffer)
+			cbuf_->CopyCursors(*oldBuffer);
+		if (previewStream_)
+			cbuf_->SetPreviewBuffer(previewBuffer_);
+		delete oldBuffer; // discard old buffer
 	}
 	catch(bad_alloc& ex)
 	{
+		delete oldBuffer;
       // This is an out-of-memory error before even allocating the buffers.
 		ostringstream messs;
 		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
@@ -3031,7 +4251,7 @@ void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
       if (camera)
 		{
          mm::DeviceModuleLockGuard guard(camera);
-         if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+         if (!initializeCircularBufferForCamera(camera))
 				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
 		}
 
@@ -3059,6 +4279,8 @@ unsigned CMMCore::getCircularBufferMemoryFootprint()
 
 long CMMCore::getRemainingImageCount()
 {
+   if (compressionStage_)
+      return compressionStage_->GetRemainingImageCount();
    if (cbuf_)
    {
       return cbuf_->GetRemainingImageCount();
@@ -3084,9 +4306,445 @@ long CMMCore::getBufferFreeCapacity()
    return 0;
 }
 
-bool CMMCore::isBufferOverflowed() const
+bool CMMCore::isBufferOverflowed() const
+{
+   return cbuf_->Overflow();
+}
+
+/**
+ * Sets what happens when a camera inserts an image into a full circular
+ * buffer.
+ *
+ * By default the insertion fails; the camera then either stops the sequence
+ * acquisition or clears the entire buffer, depending on the stopOnOverflow
+ * argument of startSequenceAcquisition(). When overwriting is enabled, the
+ * oldest image in the buffer is discarded instead, so that the buffer
+ * always holds the most recent images. The buffer then never overflows, and
+ * stopOnOverflow has no effect.
+ *
+ * The setting applies to all subsequent insertions, so it can be chosen
+ * before each acquisition. It is kept when the buffer memory footprint is
+ * changed, and also applies to per-camera buffers (see
+ * enablePerCameraBuffers()).
+ *
+ * Overwriting cannot be enabled together with compression (see
+ * enableCircularBufferCompression()).
+ *
+ * @param enable  whether to discard the oldest image when the buffer is full
+ */
+void CMMCore::enableCircularBufferOverwrite(bool enable) throw (CMMError)
+{
+   if (enable && compressionStage_)
+      throw CMMError("Circular buffer overwrite cannot be enabled while "
+            "compression is enabled");
+   circularBufferOverwrite_ = enable;
+   // Otherwise applied when the buffer is next allocated
+   if (cbuf_)
+   {
+      cbuf_->SetOverwriteOldest(enable);
+   }
+   cameraBuffers_->SetOverwriteOldest(enable);
+   LOG_DEBUG(coreLogger_) << "Circular buffer overwrite " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether the oldest image is discarded when inserting into a full
+ * circular buffer. See enableCircularBufferOverwrite().
+ */
+bool CMMCore::isCircularBufferOverwriteEnabled() const
+{
+   return circularBufferOverwrite_;
+}
+
+/**
+ * Compresses the images waiting in the circular buffer, so that it can hold
+ * more of them.
+ *
+ * Worker threads compress each image losslessly (regrouping the bytes of
+ * the pixels and compressing them with a fast LZ77 coder, which typically
+ * reduces sparse fluorescence images several-fold) and then release its
+ * slot in the circular buffer, keeping the compressed images in up to
+ * memoryMB of additional memory. When that is full, images stay in the
+ * circular buffer uncompressed, which eventually overflows as usual.
+ *
+ * popNextImage() and popNextImageMD() return the images decompressed, in
+ * order, with their compressed size in the CompressedSize tag, and
+ * getRemainingImageCount() includes the compressed images. Buffer cursors
+ * and the stack writer are not affected, but images held for them are not
+ * released by compression. Clearing or initializing the buffer also
+ * discards the compressed images.
+ *
+ * @param numThreads  the number of worker threads (at least 1)
+ * @param memoryMB    the memory for compressed images, in megabytes
+ */
+void CMMCore::enableCircularBufferCompression(unsigned numThreads,
+      unsigned memoryMB) throw (CMMError)
+{
+   if (NULL == cbuf_)
+      throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+   if (circularBufferOverwrite_)
+      throw CMMError("Compression cannot be enabled while circular buffer "
+            "overwrite is enabled");
+   if (numThreads == 0 || memoryMB == 0)
+      throw CMMError("Compression needs at least 1 thread and 1 MB of memory");
+
+   // Images already compressed are discarded with the previous stage
+   compressionStage_.reset();
+   compressionStage_.reset(new mm::CompressionStage(*cbuf_, numThreads,
+            static_cast<size_t>(memoryMB) << 20));
+   LOG_INFO(coreLogger_) << "Circular buffer compression enabled with " <<
+      numThreads << " threads and " << memoryMB << " MB";
+}
+
+/**
+ * Stops compressing images in the circular buffer. Images that have been
+ * compressed and not yet retrieved are discarded.
+ */
+void CMMCore::disableCircularBufferCompression()
+{
+   if (!compressionStage_)
+      return;
+   compressionStage_.reset();
+   LOG_INFO(coreLogger_) << "Circular buffer compression disabled";
+}
+
+/**
+ * Returns whether images in the circular buffer are compressed. See
+ * enableCircularBufferCompression().
+ */
+bool CMMCore::isCircularBufferCompressionEnabled() const
+{
+   return compressionStage_.get() != 0;
+}
+
+/**
+ * Returns the total uncompressed size of the images compressed since
+ * compression was enabled, divided by their total compressed size (1 if
+ * none).
+ */
+double CMMCore::getCircularBufferCompressionRatio() const
+{
+   if (!compressionStage_)
+      return 1.0;
+   return compressionStage_->GetCompressionRatio();
+}
+
+/**
+ * Enables or disables the computation of pixel statistics for images
+ * inserted into the circular buffer.
+ *
+ * When enabled, the minimum, maximum, mean and standard deviation of the
+ * pixel values of each monochrome 8- or 16-bit image are computed while the
+ * image is copied into the buffer, and added to the image metadata as the
+ * "PixelMin", "PixelMax", "PixelMean" and "PixelStdDev" tags. If a number of
+ * histogram bins is set (see setPixelStatisticsHistogramBins()), the
+ * "PixelHistogram" tag holds the comma-separated counts of the bins, which
+ * evenly divide the range from 0 to 2^(camera bit depth).
+ *
+ * The setting applies to sequence acquisitions started after this call.
+ *
+ * @param enable  whether to compute pixel statistics
+ */
+void CMMCore::enablePixelStatistics(bool enable)
+{
+   pixelStatistics_ = enable;
+   LOG_DEBUG(coreLogger_) << "Pixel statistics " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether pixel statistics are computed for images inserted into the
+ * circular buffer. See enablePixelStatistics().
+ */
+bool CMMCore::isPixelStatisticsEnabled() const
+{
+   return pixelStatistics_;
+}
+
+/**
+ * Sets the number of bins of the histogram computed when pixel statistics
+ * are enabled (see enablePixelStatistics()). No histogram is computed
+ * unless this is set to a nonzero value.
+ *
+ * @param bins  number of histogram bins, or 0 for no histogram
+ */
+void CMMCore::setPixelStatisticsHistogramBins(unsigned bins)
+{
+   pixelStatisticsHistogramBins_ = bins;
+}
+
+/**
+ * Returns the number of bins of the pixel statistics histogram, or 0 if no
+ * histogram is computed. See setPixelStatisticsHistogramBins().
+ */
+unsigned CMMCore::getPixelStatisticsHistogramBins() const
+{
+   return pixelStatisticsHistogramBins_;
+}
+
+/**
+ * Enables or disables the preview stream.
+ *
+ * The preview stream keeps a small number of reduced copies of the images
+ * inserted into the circular buffer, for display during fast sequence
+ * acquisitions: at most one image per interval (see
+ * setPreviewStreamInterval()), binned in both dimensions (see
+ * setPreviewStreamBinning()). Retrieving preview images with
+ * getLastPreviewImage() does not contend with the insertion or retrieval of
+ * images from the circular buffer. Only the first channel of multi-channel
+ * cameras is previewed.
+ *
+ * The setting takes effect immediately.
+ *
+ * @param enable  whether to keep preview images
+ */
+void CMMCore::enablePreviewStream(bool enable)
+{
+   previewStream_ = enable;
+   if (cbuf_)
+   {
+      cbuf_->SetPreviewBuffer(enable ? previewBuffer_ :
+            boost::shared_ptr<mm::PreviewBuffer>());
+   }
+   LOG_DEBUG(coreLogger_) << "Preview stream " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether the preview stream is enabled. See enablePreviewStream().
+ */
+bool CMMCore::isPreviewStreamEnabled() const
+{
+   return previewStream_;
+}
+
+/**
+ * Sets the minimum time between preview images. For example, an interval of
+ * 33 ms limits the preview to about 30 images per second, however fast the
+ * camera. The default of 0 previews every image.
+ *
+ * @param intervalMs  minimum interval, in milliseconds, between the arrival
+ * times of preview images
+ */
+void CMMCore::setPreviewStreamInterval(double intervalMs)
+{
+   previewBuffer_->SetIntervalMs(intervalMs);
+}
+
+/**
+ * Returns the minimum time between preview images, in milliseconds. See
+ * setPreviewStreamInterval().
+ */
+double CMMCore::getPreviewStreamInterval() const
+{
+   return previewBuffer_->GetIntervalMs();
+}
+
+/**
+ * Sets the factor by which preview images are binned in both dimensions.
+ * Each pixel of a preview image is the average of a square of binning x
+ * binning pixels. Binning is supported for 8- and 16-bit monochrome and for
+ * RGB images; other images are only previewed when the binning is 1 (the
+ * default).
+ *
+ * @param binning  the binning factor, from 1 to 64
+ */
+void CMMCore::setPreviewStreamBinning(unsigned binning) throw (CMMError)
+{
+   previewBuffer_->SetBinning(binning);
+}
+
+/**
+ * Returns the factor by which preview images are binned. See
+ * setPreviewStreamBinning().
+ */
+unsigned CMMCore::getPreviewStreamBinning() const
+{
+   return previewBuffer_->GetBinning();
+}
+
+/**
+ * Returns a copy of the most recent preview image. See
+ * enablePreviewStream(). The copy belongs to the calling thread and remains
+ * valid until the thread next retrieves a preview image; its dimensions are
+ * given by getRetrievedPreviewImageFormat(). (getPreviewImageWidth() and the
+ * related functions describe the most recent preview image, which may
+ * already be a newer one.)
+ *
+ * @return a pointer to the pixels of the preview image
+ */
+void* CMMCore::getLastPreviewImage() throw (CMMError)
+{
+   Metadata md;
+   return getLastPreviewImageMD(md);
+}
+
+/**
+ * Returns a copy of the most recent preview image and its metadata, which
+ * are those of the inserted image, with the Width and Height tags of the
+ * preview image. See getLastPreviewImage().
+ */
+void* CMMCore::getLastPreviewImageMD(Metadata& md) const throw (CMMError)
+{
+   if (!retrievedPreviewImage_.get())
+      retrievedPreviewImage_.reset(new mm::PreviewImage());
+   mm::PreviewImage& image = *retrievedPreviewImage_;
+   if (!previewBuffer_->GetLastImage(image))
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+   md = image.md;
+   return &image.pixels[0];
+}
+
+/**
+ * Returns the format of the preview image last returned to the calling
+ * thread by getLastPreviewImage() or getLastPreviewImageMD(), or zeros if
+ * the thread has not retrieved a preview image.
+ *
+ * @param width  the width of the image
+ * @param height  the height of the image
+ * @param bytesPerPixel  the bytes per pixel of the image
+ * @param nComponents  the number of components per pixel (1 for monochrome,
+ * 4 for RGB)
+ */
+void CMMCore::getRetrievedPreviewImageFormat(unsigned& width,
+      unsigned& height, unsigned& bytesPerPixel, unsigned& nComponents) const
+{
+   const mm::PreviewImage* image = retrievedPreviewImage_.get();
+   width = image ? image->width : 0;
+   height = image ? image->height : 0;
+   bytesPerPixel = image ? image->byteDepth : 0;
+   nComponents = image ? image->nComponents : 0;
+}
+
+/**
+ * Returns the width of the most recent preview image, or 0 if there is none.
+ */
+unsigned CMMCore::getPreviewImageWidth() const
+{
+   unsigned width = 0, height = 0, byteDepth = 0, nComponents = 0;
+   previewBuffer_->GetLastImageFormat(width, height, byteDepth, nComponents);
+   return width;
+}
+
+/**
+ * Returns the height of the most recent preview image, or 0 if there is
+ * none.
+ */
+unsigned CMMCore::getPreviewImageHeight() const
+{
+   unsigned width = 0, height = 0, byteDepth = 0, nComponents = 0;
+   previewBuffer_->GetLastImageFormat(width, height, byteDepth, nComponents);
+   return height;
+}
+
+/**
+ * Returns the bytes per pixel of the most recent preview image, or 0 if
+ * there is none.
+ */
+unsigned CMMCore::getPreviewImageBytesPerPixel() const
+{
+   unsigned width = 0, height = 0, byteDepth = 0, nComponents = 0;
+   previewBuffer_->GetLastImageFormat(width, height, byteDepth, nComponents);
+   return byteDepth;
+}
+
+/**
+ * Returns the number of components per pixel of the most recent preview
+ * image (1 for monochrome, 4 for RGB), or 0 if there is none.
+ */
+unsigned CMMCore::getPreviewImageNumberOfComponents() const
+{
+   unsigned width = 0, height = 0, byteDepth = 0, nComponents = 0;
+   previewBuffer_->GetLastImageFormat(width, height, byteDepth, nComponents);
+   return nComponents;
+}
+
+/**
+ * Returns the number of images that were discarded, without having been
+ * retrieved, to make room for new images since the circular buffer was last
+ * initialized. Only nonzero when overwriting is enabled (see
+ * enableCircularBufferOverwrite()).
+ */
+long CMMCore::getOverwrittenImageCount()
+{
+   if (cbuf_)
+   {
+      return cbuf_->GetOverwrittenCount();
+   }
+   return 0;
+}
+
+/**
+ * Returns the number of frames from the specified camera that were inserted
+ * into the circular buffer since the buffer was last initialized (which
+ * happens at the start of each sequence acquisition).
+ */
+long CMMCore::getInsertedFrameCount(const char* cameraLabel) throw (CMMError)
+{
+   return getCameraFrameStatistics(cameraLabel).inserted;
+}
+
+/**
+ * Returns the number of frames from the specified camera that were discarded
+ * because the circular buffer was full.
+ */
+long CMMCore::getRejectedFrameCount(const char* cameraLabel) throw (CMMError)
+{
+   return getCameraFrameStatistics(cameraLabel).rejected;
+}
+
+/**
+ * Returns the number of frames that never reached the Core, as detected from
+ * gaps in the hardware frame counter (the CameraFrameNumber image tag) of the
+ * specified camera. Always 0 for cameras that do not report a frame counter.
+ */
+long CMMCore::getDroppedFrameCount(const char* cameraLabel) throw (CMMError)
+{
+   return getCameraFrameStatistics(cameraLabel).dropped;
+}
+
+/**
+ * Returns the number of frames from the specified camera that arrived after
+ * more than twice the expected frame interval.
+ *
+ * The expected interval is derived from the hardware timestamps (the
+ * CameraTimeStamp-ms image tag) if the camera provides them, and from the
+ * average arrival interval otherwise.
+ */
+long CMMCore::getLateFrameCount(const char* cameraLabel) throw (CMMError)
+{
+   return getCameraFrameStatistics(cameraLabel).late;
+}
+
+/**
+ * Returns a histogram of the deviation of the arrival intervals of frames
+ * from the expected interval (see getLateFrameCount()).
+ *
+ * Element 0 counts deviations below 1 microsecond; element i counts
+ * deviations between 2^(i-1) and 2^i microseconds. The last element also
+ * counts all larger deviations.
+ */
+std::vector<long> CMMCore::getFrameJitterHistogram(const char* cameraLabel)
+   throw (CMMError)
+{
+   return getCameraFrameStatistics(cameraLabel).jitterHistogram;
+}
+
+mm::CameraFrameStatistics CMMCore::getCameraFrameStatistics(const char* cameraLabel)
+   throw (CMMError)
 {
-   return cbuf_->Overflow();
+   // Throws if the label does not refer to a camera
+   boost::shared_ptr<CameraInstance> camera =
+      deviceManager_->GetDeviceOfType<CameraInstance>(cameraLabel);
+
+   boost::shared_ptr<CircularBuffer> cameraBuffer =
+      cameraBuffers_->Find(camera->GetLabel());
+   if (cameraBuffer)
+      return cameraBuffer->GetCameraFrameStatistics(camera->GetLabel());
+   if (!cbuf_)
+      return mm::CameraFrameStatistics();
+   return cbuf_->GetCameraFrameStatistics(camera->GetLabel());
 }
 
 /**
@@ -3445,6 +5103,7 @@ void CMMCore::setCameraDevice(const char* cameraLabel) throw (CMMError)
       throw CMMError("Cannot switch camera device while sequence acquisition "
             "is running");
    }
+   checkAcquisitionPlanNotRunning("switch camera device");
 
    if (cameraLabel && strlen(cameraLabel) > 0)
    {
@@ -3905,6 +5564,9 @@ MM::PropertyType CMMCore::getPropertyType(const char* label, const char* propNam
 
 /**
  * Horizontal dimension of the image buffer in pixels.
+ *
+ * If the Core corrects the camera's image orientation and the correction
+ * swaps X and Y, this is the height of the camera's image buffer.
  * @return   the width in pixels (an integer)
  */
 unsigned CMMCore::getImageWidth()
@@ -3916,11 +5578,17 @@ unsigned CMMCore::getImageWidth()
    }
 
    mm::DeviceModuleLockGuard guard(camera);
+   boost::shared_ptr<const mm::ImageTransposer> transposer = getCameraTransposer(camera);
+   if (transposer && transposer->SwapsXY())
+      return camera->GetImageHeight();
    return camera->GetImageWidth();
 }
 
 /**
  * Vertical dimension of the image buffer in pixels.
+ *
+ * If the Core corrects the camera's image orientation and the correction
+ * swaps X and Y, this is the width of the camera's image buffer.
  * @return   the height in pixels (an integer)
  */
 unsigned CMMCore::getImageHeight()
@@ -3932,6 +5600,9 @@ unsigned CMMCore::getImageHeight()
    }
 
    mm::DeviceModuleLockGuard guard(camera);
+   boost::shared_ptr<const mm::ImageTransposer> transposer = getCameraTransposer(camera);
+   if (transposer && transposer->SwapsXY())
+      return camera->GetImageWidth();
    return camera->GetImageHeight();
 }
 
@@ -4417,6 +6088,275 @@ void CMMCore::getMultiROI(std::vector<unsigned>& xs, std::vector<unsigned>& ys,
    free(heightsArr);
 }
 
+/**
+ * Enables or disables packing of multi-ROI images in the circular buffer.
+ *
+ * Cameras with multiple ROIs deliver each frame as the bounding box of the
+ * ROIs, with the pixels outside of the ROIs filled with a constant value.
+ * When packing is enabled, only the pixels of the ROIs are stored: those of
+ * each ROI in turn, row by row, in the order given to setMultiROI(). The
+ * stored image has the width of the widest ROI and just enough rows to hold
+ * all of the ROI pixels, so that ROIs of equal width are simply stacked
+ * vertically. Its "PackedROIs" metadata tag lists the x, y, width and height
+ * of each ROI, as "x,y,width,height" separated by semicolons.
+ *
+ * Packing applies to sequence acquisitions started after this call, from
+ * single-channel cameras that have multiple ROIs set. Snapped images are
+ * not affected.
+ *
+ * @param enable  whether to store only the ROI pixels of multi-ROI images
+ */
+void CMMCore::enableMultiROIPacking(bool enable)
+{
+   multiROIPacking_ = enable;
+   LOG_DEBUG(coreLogger_) << "Multi-ROI packing " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns whether multi-ROI images are packed in the circular buffer. See
+ * enableMultiROIPacking().
+ */
+bool CMMCore::isMultiROIPackingEnabled() const
+{
+   return multiROIPacking_;
+}
+
+/**
+ * Sets up packing of a camera's multi-ROI images for the coming sequence
+ * acquisition, or turns it off. The caller must hold the camera's module
+ * lock.
+ */
+void CMMCore::updateMultiROIPacking(boost::shared_ptr<CameraInstance> camera) throw (CMMError)
+{
+   boost::shared_ptr<const mm::MultiROIPacker> packer;
+   if (multiROIPacking_ && camera->GetNumberOfChannels() == 1 &&
+         camera->SupportsMultiROI() && camera->IsMultiROISet())
+   {
+      unsigned numROI;
+      int nRet = camera->GetMultiROICount(numROI);
+      if (nRet != DEVICE_OK)
+         throw CMMError(getDeviceErrorText(nRet, camera).c_str(), MMERR_DEVICE_GENERIC);
+
+      std::vector<unsigned> xs(numROI), ys(numROI), widths(numROI), heights(numROI);
+      if (numROI > 0)
+      {
+         nRet = camera->GetMultiROI(&xs[0], &ys[0], &widths[0], &heights[0], &numROI);
+         if (nRet != DEVICE_OK)
+            throw CMMError(getDeviceErrorText(nRet, camera).c_str(), MMERR_DEVICE_GENERIC);
+      }
+      if (numROI > xs.size())
+         throw CMMError("Camera returned too many ROIs");
+
+      std::vector<mm::MultiROIPacker::ROI> rois;
+      for (unsigned i = 0; i < numROI; ++i)
+         rois.push_back(mm::MultiROIPacker::ROI(xs[i], ys[i], widths[i], heights[i]));
+      if (!rois.empty())
+         packer.reset(new mm::MultiROIPacker(rois));
+   }
+   camera->SetMultiROIPacker(packer);
+}
+
+/**
+ * Returns the orientation correction that the Core should apply to a
+ * camera's images, according to the camera's Transpose properties, or null
+ * if there is none. The correction is only applied if the TransposeCorrection
+ * property is set and the camera does not apply it itself (see
+ * MM::g_Keyword_Transpose_InCamera). The caller must hold the camera's
+ * module lock.
+ */
+boost::shared_ptr<const mm::ImageTransposer> CMMCore::getCameraTransposer(boost::shared_ptr<CameraInstance> camera) throw (CMMError)
+{
+   boost::shared_ptr<const mm::ImageTransposer> transposer;
+   if (!camera->HasProperty(MM::g_Keyword_Transpose_Correction) ||
+         camera->GetProperty(MM::g_Keyword_Transpose_Correction) != "1")
+      return transposer;
+   if (camera->HasProperty(MM::g_Keyword_Transpose_InCamera) &&
+         camera->GetProperty(MM::g_Keyword_Transpose_InCamera) == "1")
+      return transposer;
+
+   bool swapXY = camera->HasProperty(MM::g_Keyword_Transpose_SwapXY) &&
+      camera->GetProperty(MM::g_Keyword_Transpose_SwapXY) == "1";
+   bool mirrorX = camera->HasProperty(MM::g_Keyword_Transpose_MirrorX) &&
+      camera->GetProperty(MM::g_Keyword_Transpose_MirrorX) == "1";
+   bool mirrorY = camera->HasProperty(MM::g_Keyword_Transpose_MirrorY) &&
+      camera->GetProperty(MM::g_Keyword_Transpose_MirrorY) == "1";
+   if (swapXY || mirrorX || mirrorY)
+      transposer.reset(new mm::ImageTransposer(swapXY, mirrorX, mirrorY));
+   return transposer;
+}
+
+/**
+ * Sets up orientation correction of a camera's images for the coming
+ * sequence acquisition, or turns it off. Packed multi-ROI images are not
+ * transposed. The caller must hold the camera's module lock.
+ */
+void CMMCore::updateImageTransposition(boost::shared_ptr<CameraInstance> camera) throw (CMMError)
+{
+   boost::shared_ptr<const mm::ImageTransposer> transposer;
+   if (!camera->GetMultiROIPacker())
+      transposer = getCameraTransposer(camera);
+   camera->SetImageTransposer(transposer);
+}
+
+/**
+ * Applies the camera's orientation correction, if any, to a snapped image.
+ * Returns the corrected copy, or the image itself if there is no
+ * correction. The caller must hold the camera's module lock.
+ */
+void* CMMCore::getTransposedImage(boost::shared_ptr<CameraInstance> camera, void* pBuf) throw (CMMError)
+{
+   boost::shared_ptr<const mm::ImageTransposer> transposer = getCameraTransposer(camera);
+   if (!transposer || !pBuf)
+      return pBuf;
+
+   unsigned width = camera->GetImageWidth();
+   unsigned height = camera->GetImageHeight();
+   unsigned bytesPerPixel = camera->GetImageBytesPerPixel();
+   unsigned char* transposed = camera->GetTransposedImageBuffer(
+         static_cast<size_t>(width) * height * bytesPerPixel);
+   if (!transposed)
+      return pBuf;
+   transposer->Transform(static_cast<const unsigned char*>(pBuf),
+         width, height, bytesPerPixel, transposed);
+   return transposed;
+}
+
+/**
+ * Initializes the circular buffer for the images of a camera. The caller
+ * must hold the camera's module lock.
+ */
+bool CMMCore::initializeCircularBufferForCamera(boost::shared_ptr<CameraInstance> camera) throw (CMMError)
+{
+   previewBuffer_->Clear();
+   return initializeSequenceBufferForCamera(*cbuf_, camera);
+}
+
+/**
+ * Initializes a sequence buffer for the images of a camera, taking
+ * multi-ROI packing and orientation correction into account, and sets up
+ * pixel statistics for its bit depth. The caller must hold the camera's
+ * module lock.
+ */
+bool CMMCore::initializeSequenceBufferForCamera(CircularBuffer& buffer,
+      boost::shared_ptr<CameraInstance> camera) throw (CMMError)
+{
+   unsigned width, height;
+   getBufferedImageSize(camera, width, height);
+   buffer.SetPixelStatistics(pixelStatistics_, pixelStatisticsHistogramBins_,
+         camera->GetBitDepth());
+   return buffer.Initialize(camera->GetNumberOfChannels(), width, height, camera->GetImageBytesPerPixel());
+}
+
+/**
+ * Gets the size of the images of a camera as stored in the sequence
+ * buffers, after multi-ROI packing or orientation correction. The caller
+ * must hold the camera's module lock.
+ */
+void CMMCore::getBufferedImageSize(boost::shared_ptr<CameraInstance> camera,
+      unsigned& width, unsigned& height) throw (CMMError)
+{
+   updateMultiROIPacking(camera);
+   updateImageTransposition(camera);
+
+   width = camera->GetImageWidth();
+   height = camera->GetImageHeight();
+   boost::shared_ptr<const mm::MultiROIPacker> packer = camera->GetMultiROIPacker();
+   boost::shared_ptr<const mm::ImageTransposer> transposer = camera->GetImageTransposer();
+   if (packer && width == packer->GetFrameWidth() && height == packer->GetFrameHeight())
+   {
+      width = packer->GetPackedWidth();
+      height = packer->GetPackedHeight();
+   }
+   else if (transposer)
+   {
+      unsigned cameraWidth = width, cameraHeight = height;
+      transposer->GetTransformedSize(cameraWidth, cameraHeight, width, height);
+   }
+}
+
+/**
+ * Returns the buffer of a camera given by enablePerCameraBuffers(); throws
+ * if it has none.
+ */
+boost::shared_ptr<CircularBuffer> CMMCore::findPerCameraBuffer(
+      const char* cameraLabel) const throw (CMMError)
+{
+   const std::string label = cameraLabel ? cameraLabel : "";
+   boost::shared_ptr<CircularBuffer> buffer = cameraBuffers_->Find(label);
+   if (!buffer)
+      throw CMMError("Camera " + ToQuotedString(label) +
+            " does not have its own sequence buffer");
+   return buffer;
+}
+
+/**
+ * Returns the task of the given asynchronous snap; throws if it is not the
+ * last one started.
+ */
+boost::shared_ptr<mm::SnapTask> CMMCore::findSnapTask(long snap) throw (CMMError)
+{
+   MMThreadGuard g(snapTaskLock_);
+   if (!snapTask_ || snapTask_->GetId() != snap)
+      throw CMMError("Snap " + ToString(snap) + " is not the last "
+            "asynchronous snap", MMERR_InvalidImageSequence);
+   return snapTask_;
+}
+
+/**
+ * Returns whether a camera with its own buffer is capturing.
+ */
+bool CMMCore::isPerCameraBufferInUse() const
+{
+   std::vector<std::string> labels = cameraBuffers_->GetCameras();
+   for (std::vector<std::string>::const_iterator it = labels.begin();
+         it != labels.end(); ++it)
+   {
+      boost::shared_ptr<CameraInstance> camera;
+      try
+      {
+         camera = deviceManager_->GetDeviceOfType<CameraInstance>(*it);
+      }
+      catch (const CMMError&)
+      {
+         // Unloaded cameras cannot be capturing
+         continue;
+      }
+      mm::DeviceModuleLockGuard guard(camera);
+      if (camera->IsCapturing())
+         return true;
+   }
+   return false;
+}
+
+/**
+ * Initializes and clears the per-camera buffers, for the current settings
+ * of their cameras, except those of cameras that are capturing.
+ */
+void CMMCore::initializePerCameraBuffers() throw (CMMError)
+{
+   std::vector<std::string> labels = cameraBuffers_->GetCameras();
+   for (std::vector<std::string>::const_iterator it = labels.begin();
+         it != labels.end(); ++it)
+   {
+      boost::shared_ptr<CameraInstance> camera =
+         deviceManager_->GetDeviceOfType<CameraInstance>(*it);
+      boost::shared_ptr<CircularBuffer> buffer = cameraBuffers_->Find(*it);
+      if (!buffer)
+         continue;
+
+      mm::DeviceModuleLockGuard guard(camera);
+      if (camera->IsCapturing())
+         continue;
+      if (!initializeSequenceBufferForCamera(*buffer, camera))
+      {
+         logError(it->c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
+         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+      }
+      buffer->Clear();
+   }
+}
+
 /**
  * Sets the state (position) on the specific device. The command will fail if
  * the device does not support states.
@@ -4832,6 +6772,9 @@ void CMMCore::setPixelSizeConfig(const char* resolutionID) throw (CMMError)
    }
    
    try {
+      mm::TraceScope traceScope(traceRecorder_.get(), "config",
+            "setPixelSizeConfig");
+      traceScope.SetArg("preset", resolutionID);
       applyConfiguration(*psc);
    } catch (CMMError& err) {
       logError("setPixelSizeConfig", getCoreErrorText(err.getCode()).c_str());
@@ -4869,6 +6812,9 @@ void CMMCore::setConfig(const char* groupName, const char* configName) throw (CM
       ": will apply preset " << configName;
 
    try {
+      mm::TraceScope traceScope(traceRecorder_.get(), "config", "setConfig");
+      if (traceScope.IsActive())
+         traceScope.SetArg("config", os.str());
       applyConfiguration(*pCfg);
    } catch (CMMError&) {
       throw;
@@ -4994,23 +6940,7 @@ vector<string> CMMCore::getAvailablePixelSizeConfigs() const
  */
 string CMMCore::getCurrentConfig(const char* groupName) throw (CMMError)
 {
-   CheckConfigGroupName(groupName);
-
-   vector<string> cfgs = configGroups_->GetAvailableConfigs(groupName);
-   if (cfgs.empty())
-      return "";
-
-   Configuration curState = getConfigGroupState(groupName, false);
-
-   for (size_t i=0; i<cfgs.size(); i++)
-   {
-      Configuration* pCfg = configGroups_->Find(groupName, cfgs[i].c_str());
-      if (pCfg && curState.isConfigurationIncluded(*pCfg))
-         return cfgs[i];
-   }
-
-   // no match
-   return "";
+   return getCurrentConfig(groupName, false);
 }
 
 /**
@@ -5023,24 +6953,22 @@ string CMMCore::getCurrentConfig(const char* groupName) throw (CMMError)
  * @return The cache's current configuration preset name
  */
 string CMMCore::getCurrentConfigFromCache(const char* groupName) throw (CMMError)
+{
+   return getCurrentConfig(groupName, true);
+}
+
+string CMMCore::getCurrentConfig(const char* groupName, bool fromCache) throw (CMMError)
 {
    CheckConfigGroupName(groupName);
 
-   vector<string> cfgs = configGroups_->GetAvailableConfigs(groupName);
-   if (cfgs.empty())
+   boost::shared_ptr<const mm::PresetMatcher> matcher =
+      configGroups_->GetPresetMatcher(groupName);
+   if (!matcher)
       return "";
 
-   Configuration curState = getConfigGroupState(groupName, true);
-
-   for (size_t i=0; i<cfgs.size(); i++)
-   {
-      Configuration* pCfg = configGroups_->Find(groupName, cfgs[i].c_str());
-      if (pCfg && curState.isConfigurationIncluded(*pCfg))
-         return cfgs[i];
-   }
-
-   // no match
-   return "";
+   // The matcher finds the first matching preset with one lookup per
+   // property, and remembers the result for unchanged values
+   return matcher->Match(getPresetPropertyValues(*matcher, fromCache));
 }
 
 /**
@@ -6331,6 +8259,7 @@ void CMMCore::saveSystemConfiguration(const char* fileName) throw (CMMError)
  */
 void CMMCore::loadSystemConfiguration(const char* fileName) throw (CMMError)
 {
+   checkAcquisitionPlanNotRunning("load a system configuration");
    try
    {
       loadSystemConfigurationImpl(fileName);
@@ -6362,11 +8291,24 @@ void CMMCore::loadSystemConfiguration(const char* fileName) throw (CMMError)
 }
 
 
+static CMMError ConfigFileLineError(const mm::ConfigFileCommand& command,
+      const CMMError& err)
+{
+   std::ostringstream errorText;
+   errorText << "Line " << command.lineNumber << ": " << command.line << endl;
+   errorText << err.getFullMsg() << endl << endl;
+   return CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+}
+
 void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 {
    if (!fileName)
       throw CMMError("Null filename");
 
+   mm::TraceScope traceScope(traceRecorder_.get(), "config",
+         "loadSystemConfiguration");
+   traceScope.SetArg("file", fileName);
+
    ifstream is;
    is.open(fileName, ios_base::in);
    if (!is.is_open())
@@ -6376,188 +8318,35 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
             MMERR_FileOpenFailed);
    }
 
-   // Process commands
-   const int maxLineLength = 4 * MM::MaxStrLength + 4; // accommodate up to 4 strings and delimiters
-   char line[maxLineLength+1];
-   vector<string> tokens;
-
-   int lineCount = 0;
+   // Parsing is skipped if a file with identical contents has been loaded
+   // before
+   std::ostringstream contents;
+   contents << is.rdbuf();
+   boost::shared_ptr<const mm::ParsedConfigFile> commands =
+      configFileCache_->GetParsed(contents.str());
 
-   while(is.getline(line, maxLineLength, '\n'))
+   for (mm::ParsedConfigFile::const_iterator it = commands->begin(),
+         end = commands->end(); it != end; ++it)
    {
-      // strip a potential Windows/dos CR
-      istringstream il(line);
-      il.getline(line, maxLineLength, '\r');
-
-      lineCount++;
-      if (strlen(line) > 0)
+      const mm::ConfigFileCommand& command = *it;
+      try
       {
-         if (line[0] == '#')
-         {
-            // comment, so skip processing
-            continue;
-         }
-
-         // parse tokens
-         tokens.clear();
-         CDeviceUtils::Tokenize(line, tokens, MM::g_FieldDelimiters);
-
-         try
-         {
-
-            // non-empty and non-comment lines mush have at least one token
-            if (tokens.size() < 1)
-               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                     ToQuotedString(line) + ")",
-                     MMERR_InvalidCFGEntry);
-               
-            if(tokens[0].compare(MM::g_CFGCommand_Device) == 0)
-            {
-               // load device command
-               // -------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               loadDevice(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Property) == 0)
-            {
-               // set property command
-               // --------------------
-               if (tokens.size() == 4)
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-               else if (tokens.size() == 3)
-                  // ...assuming here that the last missing toke represents an empty string
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), "");
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
-            {
-               // set delay command
-               // -----------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setDeviceDelayMs(tokens[1].c_str(), atof(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
-            {
-               // set focus direction command
-               // ---------------------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
-            {
-               // define label command
-               // --------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               defineStateLabel(tokens[1].c_str(), atol(tokens[2].c_str()), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 5)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
-                  " ignored in configuration file";
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
-            {
-               // define grouped configuration command
-               // ------------------------------------
-               if (tokens.size() == 6)
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), tokens[5].c_str());
-               else if (tokens.size() == 5)
-               {
-                  // we will assume here that the last (missing) token is representing an empty string
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), "");
-               }
-               else if (tokens.size() == 2)
-                  defineConfigGroup(tokens[1].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
-            {
-               // define pixel size configuration command
-               // ---------------------------------------
-               if (tokens.size() == 5)
-                  definePixelSizeConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
-            {
-               // set pixel size
-               // --------------
-               if (tokens.size() == 3)
-                  setPixelSizeUm(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               definePropertyBlock(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
-            {
-               // define image synchro
-               // --------------------
-               if (tokens.size() != 2)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               assignImageSynchro(tokens[1].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
-            {
-               // set parent ID
-               // -------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-
-               setParentLabel(tokens[1].c_str(), tokens[2].c_str());
-            }
-
-         }
-         catch (CMMError& err)
+         if (command.kind == mm::ConfigFileCommand::PropertyBatch)
+            applyConfigurationPropertyBatch(command.batch);
+         else if (!(lazyDeviceLoading_ && deferConfigurationCommand(command.tokens)))
+            executeConfigurationCommand(command.tokens, command.line.c_str());
+      }
+      catch (CMMError& err)
+      {
+         if (externalCallback_)
          {
-            if (externalCallback_)
-               externalCallback_->onSystemConfigurationLoaded();
-            std::ostringstream errorText;
-            errorText << "Line " << lineCount << ": " << line << endl;
-            errorText << err.getFullMsg() << endl << endl;
-            throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+            mm::TraceScope traceScope(traceRecorder_.get(), "callback",
+                  "onSystemConfigurationLoaded");
+            externalCallback_->onSystemConfigurationLoaded();
          }
+         if (command.kind == mm::ConfigFileCommand::PropertyBatch)
+            throw; // Already refers to the failing line
+         throw ConfigFileLineError(command, err);
       }
    }
 
@@ -6579,10 +8368,241 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 
    if (externalCallback_)
    {
+      mm::TraceScope traceScope(traceRecorder_.get(), "callback",
+            "onSystemConfigurationLoaded");
       externalCallback_->onSystemConfigurationLoaded();
    }
 }
 
+/**
+ * Sets the device properties of a run of configuration file Property lines.
+ *
+ * The settings are applied in order, but devices are looked up only once per
+ * run of settings for the same device and the system state cache is updated
+ * once for the whole batch.
+ */
+void CMMCore::applyConfigurationPropertyBatch(
+      const std::vector<mm::ConfigFileCommand>& settings) throw (CMMError)
+{
+   std::vector<PropertySetting> applied;
+   applied.reserve(settings.size());
+
+   boost::shared_ptr<DeviceInstance> pDevice;
+   for (std::vector<mm::ConfigFileCommand>::const_iterator it = settings.begin(),
+         end = settings.end(); it != end; ++it)
+   {
+      const std::string& label = it->tokens[1];
+      const std::string& propName = it->tokens[2];
+      const std::string& propValue = it->tokens[3];
+      try
+      {
+         if (lazyDeviceLoading_ && deferConfigurationCommand(it->tokens))
+            continue;
+
+         CheckDeviceLabel(label.c_str());
+         CheckPropertyName(propName.c_str());
+         CheckPropertyValue(propValue.c_str());
+
+         if (!pDevice || pDevice->GetLabel() != label)
+            pDevice = deviceManager_->GetDevice(label);
+
+         mm::DeviceModuleLockGuard guard(pDevice);
+         pDevice->SetProperty(propName, propValue);
+         applied.push_back(PropertySetting(label.c_str(), propName.c_str(),
+                  propValue.c_str()));
+      }
+      catch (const CMMError& err)
+      {
+         addToStateCache(applied);
+         throw ConfigFileLineError(*it, err);
+      }
+   }
+   addToStateCache(applied);
+}
+
+/**
+ * Executes a single (tokenized) configuration file command.
+ */
+void CMMCore::executeConfigurationCommand(const std::vector<std::string>& tokens,
+      const char* line) throw (CMMError)
+{
+   // non-empty and non-comment lines mush have at least one token
+   if (tokens.size() < 1)
+      throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+            ToQuotedString(line) + ")",
+            MMERR_InvalidCFGEntry);
+      
+   if(tokens[0].compare(MM::g_CFGCommand_Device) == 0)
+   {
+      // load device command
+      // -------------------
+      if (tokens.size() != 4)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      loadDevice(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Property) == 0)
+   {
+      // set property command
+      // --------------------
+      if (tokens.size() == 4)
+         setProperty(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
+      else if (tokens.size() == 3)
+         // ...assuming here that the last missing toke represents an empty string
+         setProperty(tokens[1].c_str(), tokens[2].c_str(), "");
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
+   {
+      // set delay command
+      // -----------------
+      if (tokens.size() != 3)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      setDeviceDelayMs(tokens[1].c_str(), atof(tokens[2].c_str()));
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
+   {
+      // set focus direction command
+      // ---------------------------
+      if (tokens.size() != 3)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
+   {
+      // define label command
+      // --------------------
+      if (tokens.size() != 4)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      defineStateLabel(tokens[1].c_str(), atol(tokens[2].c_str()), tokens[3].c_str());
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
+   {
+      // define configuration command
+      // ----------------------------
+      if (tokens.size() != 5)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
+         " ignored in configuration file";
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
+   {
+      // define grouped configuration command
+      // ------------------------------------
+      if (tokens.size() == 6)
+         defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), tokens[5].c_str());
+      else if (tokens.size() == 5)
+      {
+         // we will assume here that the last (missing) token is representing an empty string
+         defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), "");
+      }
+      else if (tokens.size() == 2)
+         defineConfigGroup(tokens[1].c_str());
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
+   {
+      // define pixel size configuration command
+      // ---------------------------------------
+      if (tokens.size() == 5)
+         definePixelSizeConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str());
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
+   {
+      // set pixel size
+      // --------------
+      if (tokens.size() == 3)
+         setPixelSizeUm(tokens[1].c_str(), atof(tokens[2].c_str()));
+      else
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
+   {
+      // define configuration command
+      // ----------------------------
+      if (tokens.size() != 4)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      definePropertyBlock(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
+   {
+      // define image synchro
+      // --------------------
+      if (tokens.size() != 2)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+      assignImageSynchro(tokens[1].c_str());
+   }
+   else if(tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
+   {
+      // set parent ID
+      // -------------
+      if (tokens.size() != 3)
+         throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+               ToQuotedString(line) + ")",
+               MMERR_InvalidCFGEntry);
+
+      setParentLabel(tokens[1].c_str(), tokens[2].c_str());
+   }
+}
+
+/**
+ * Records a configuration file command addressed to a deferred device, so that
+ * it can be applied when the device is bound.
+ * @return true if the command was recorded
+ */
+bool CMMCore::deferConfigurationCommand(const std::vector<std::string>& tokens)
+{
+   if (tokens.size() < 2)
+      return false;
+
+   const std::string& command = tokens[0];
+   if (command != MM::g_CFGCommand_Property &&
+         command != MM::g_CFGCommand_Delay &&
+         command != MM::g_CFGCommand_FocusDirection &&
+         command != MM::g_CFGCommand_Label &&
+         command != MM::g_CFGCommand_ImageSynchro &&
+         command != MM::g_CFGCommand_ParentID)
+      return false;
+
+   if (!deviceManager_->IsDeviceDeferred(tokens[1]))
+      return false;
+
+   mm::DeferredDevice& deferred = deviceManager_->GetDeferredDevice(tokens[1]);
+   if (command == MM::g_CFGCommand_ParentID && tokens.size() == 3)
+      deferred.parentLabel = tokens[2];
+
+   if (deferred.initializeOnBind)
+      deferred.postInitCommands.push_back(tokens);
+   else
+      deferred.preInitCommands.push_back(tokens);
+   return true;
+}
+
 
 /**
  * Register a callback (listener class).
@@ -63,6 +63,7 @@
 #include "Logging/Logger.h"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/weak_ptr.hpp>
 
 #include <cstring>
@@ -105,11 +106,27 @@ class ShutterInstance;
 class StageInstance;
 class XYStageInstance;
 
+class AcquisitionPlan;
 class CMMCore;
 
 namespace mm {
+   class AcquisitionEngine;
+   class CameraBufferSet;
+   struct CameraFrameStatistics;
+   class CompressionStage;
+   class ConfigFileCache;
+   struct ConfigFileCommand;
+   class DeviceCallRecorder;
+   struct DeviceCallTiming;
    class DeviceManager;
+   class ImageTransposer;
    class LogManager;
+   class PresetMatcher;
+   class PreviewBuffer;
+   struct PreviewImage;
+   class SnapTask;
+   class StackWriter;
+   class TraceRecorder;
 } // namespace mm
 
 typedef unsigned int* imgRGB32;
@@ -127,7 +144,9 @@ typedef unsigned int* imgRGB32;
 class CMMCore
 {
    friend class CoreCallback;
+   friend class DeviceInstance;
    friend class CorePropertyCollection;
+   friend class mm::AcquisitionEngine;
 
 public:
    CMMCore();
@@ -153,6 +172,10 @@ public:
 
    void unloadLibrary(const char* moduleName) throw (CMMError);
 
+   void enableLazyDeviceLoading(bool enable);
+   bool isLazyDeviceLoadingEnabled() const;
+   bool isDeviceDeferred(const char* label) throw (CMMError);
+
    void updateCoreProperties() throw (CMMError);
 
    std::string getCoreErrorText(int code) const;
@@ -188,6 +211,44 @@ public:
 
    ///@}
 
+   /** \name Device call timing. */
+   ///@{
+   void enableDeviceCallTiming(bool enable);
+   bool isDeviceCallTimingEnabled() const;
+   void resetDeviceCallTiming();
+   std::vector<std::string> getTimedDeviceCalls() const;
+   long getDeviceCallCount(const char* label, const char* call) throw (CMMError);
+   double getDeviceCallTotalTimeMs(const char* label, const char* call)
+      throw (CMMError);
+   double getDeviceCallMaxTimeMs(const char* label, const char* call)
+      throw (CMMError);
+   std::vector<long> getDeviceCallHistogram(const char* label,
+         const char* call) throw (CMMError);
+   void logDeviceCallTiming();
+   ///@}
+
+   /** \name Activity tracing. */
+   ///@{
+   void enableTracing(bool enable);
+   bool isTracingEnabled() const;
+   void clearTrace();
+   long getTraceEventCount() const;
+   void saveTrace(const char* filename) throw (CMMError);
+   ///@}
+
+   /** \name Device call recording and replay. */
+   ///@{
+   void enableDeviceCallRecording(bool enable);
+   bool isDeviceCallRecordingEnabled() const;
+   void clearDeviceCallRecording();
+   long getRecordedDeviceCallCount() const;
+   void saveDeviceCallRecording(const char* filename) throw (CMMError);
+   long replayDeviceCalls(const char* filename, bool withRecordedTiming)
+      throw (CMMError);
+   long replayDeviceCalls(const char* filename, bool withRecordedTiming,
+         bool allowRealDevices) throw (CMMError);
+   ///@}
+
    /** \name Device listing. */
    ///@{
    std::vector<std::string> getDeviceAdapterSearchPaths();
@@ -363,6 +424,8 @@ public:
    void getMultiROI(std::vector<unsigned>& xs, std::vector<unsigned>& ys,
            std::vector<unsigned>& widths,
            std::vector<unsigned>& heights) throw (CMMError);
+   void enableMultiROIPacking(bool enable);
+   bool isMultiROIPackingEnabled() const;
 
    void setExposure(double exp) throw (CMMError);
    void setExposure(const char* cameraLabel, double dExp) throw (CMMError);
@@ -370,6 +433,9 @@ public:
    double getExposure(const char* label) throw (CMMError);
 
    void snapImage() throw (CMMError);
+   long snapImageAsync() throw (CMMError);
+   bool isAsyncSnapDone(long snap) throw (CMMError);
+   void* getAsyncSnapImage(long snap) throw (CMMError);
    void* getImage() throw (CMMError);
    void* getImage(unsigned numChannel) throw (CMMError);
 
@@ -404,6 +470,17 @@ public:
    bool isSequenceRunning() throw ();
    bool isSequenceRunning(const char* cameraLabel) throw (CMMError);
 
+   void startAcquisitionPlan(const AcquisitionPlan& plan) throw (CMMError);
+   void stopAcquisitionPlan();
+   bool isAcquisitionPlanRunning();
+   void waitForAcquisitionPlan() throw (CMMError);
+
+   void startStackWriter(const char* path, const char* format,
+         long maxFrames) throw (CMMError);
+   void stopStackWriter() throw (CMMError);
+   bool isStackWriterRunning();
+   long getStackWriterFrameCount();
+
    void* getLastImage() throw (CMMError);
    void* popNextImage() throw (CMMError);
    void* getLastImageMD(unsigned channel, unsigned slice, Metadata& md)
@@ -414,11 +491,60 @@ public:
    void* getNBeforeLastImageMD(unsigned long n, Metadata& md)
       const throw (CMMError);
    void* popNextImageMD(Metadata& md) throw (CMMError);
+   int addSequenceBufferCursor(bool lossy);
+   void removeSequenceBufferCursor(int cursor) throw (CMMError);
+   void* popNextImageForCursor(int cursor) throw (CMMError);
+   void* popNextImageMDForCursor(int cursor, unsigned channel, Metadata& md)
+      throw (CMMError);
+   long getRemainingImageCountForCursor(int cursor) throw (CMMError);
+   long getMissedImageCountForCursor(int cursor) throw (CMMError);
+   void enablePerCameraBuffers(const std::vector<std::string>& cameraLabels,
+         unsigned memoryMB) throw (CMMError);
+   void disablePerCameraBuffers() throw (CMMError);
+   std::vector<std::string> getPerCameraBufferCameras() const;
+   void* popNextImageMDForCamera(const char* cameraLabel, Metadata& md)
+      throw (CMMError);
+   void* popNextMergedImageMD(Metadata& md) throw (CMMError);
+   long getRemainingImageCountForCamera(const char* cameraLabel)
+      throw (CMMError);
+   long getMergedRemainingImageCount();
 
    long getRemainingImageCount();
    long getBufferTotalCapacity();
    long getBufferFreeCapacity();
    bool isBufferOverflowed() const;
+   void enableCircularBufferOverwrite(bool enable) throw (CMMError);
+   bool isCircularBufferOverwriteEnabled() const;
+   void enableCircularBufferCompression(unsigned numThreads,
+         unsigned memoryMB) throw (CMMError);
+   void disableCircularBufferCompression();
+   bool isCircularBufferCompressionEnabled() const;
+   double getCircularBufferCompressionRatio() const;
+   void enablePixelStatistics(bool enable);
+   bool isPixelStatisticsEnabled() const;
+   void setPixelStatisticsHistogramBins(unsigned bins);
+   unsigned getPixelStatisticsHistogramBins() const;
+   void enablePreviewStream(bool enable);
+   bool isPreviewStreamEnabled() const;
+   void setPreviewStreamInterval(double intervalMs);
+   double getPreviewStreamInterval() const;
+   void setPreviewStreamBinning(unsigned binning) throw (CMMError);
+   unsigned getPreviewStreamBinning() const;
+   void* getLastPreviewImage() throw (CMMError);
+   void* getLastPreviewImageMD(Metadata& md) const throw (CMMError);
+   unsigned getPreviewImageWidth() const;
+   unsigned getPreviewImageHeight() const;
+   unsigned getPreviewImageBytesPerPixel() const;
+   unsigned getPreviewImageNumberOfComponents() const;
+   void getRetrievedPreviewImageFormat(unsigned& width, unsigned& height,
+         unsigned& bytesPerPixel, unsigned& nComponents) const;
+   long getOverwrittenImageCount();
+   long getInsertedFrameCount(const char* cameraLabel) throw (CMMError);
+   long getRejectedFrameCount(const char* cameraLabel) throw (CMMError);
+   long getDroppedFrameCount(const char* cameraLabel) throw (CMMError);
+   long getLateFrameCount(const char* cameraLabel) throw (CMMError);
+   std::vector<long> getFrameJitterHistogram(const char* cameraLabel)
+      throw (CMMError);
    void setCircularBufferMemoryFootprint(unsigned sizeMB) throw (CMMError);
    unsigned getCircularBufferMemoryFootprint();
    void initializeCircularBuffer() throw (CMMError);
@@ -643,8 +769,16 @@ private:
    boost::shared_ptr<mm::LogManager> logManager_;
    mm::logging::Logger appLogger_;
    mm::logging::Logger coreLogger_;
+   // Referenced by devices, so must outlive them
+   boost::shared_ptr<mm::TraceRecorder> traceRecorder_;
+   boost::shared_ptr<mm::DeviceCallRecorder> callRecorder_;
 
    bool everSnapped_;
+   // The last snap started by snapImageAsync(), with its id; guarded by
+   // snapTaskLock_
+   boost::shared_ptr<mm::SnapTask> snapTask_;
+   long lastSnapId_;
+   MMThreadLock snapTaskLock_;
 
    boost::weak_ptr<CameraInstance> currentCameraDevice_;
    boost::weak_ptr<ShutterInstance> currentShutterDevice_;
@@ -659,16 +793,31 @@ private:
    long pollingIntervalMs_;
    long timeoutMs_;
    bool autoShutter_;
+   bool circularBufferOverwrite_;
+   bool lazyDeviceLoading_;
+   bool multiROIPacking_;
+   bool pixelStatistics_;
+   unsigned pixelStatisticsHistogramBins_;
+   bool previewStream_;
+   bool deviceCallTiming_;
    MM::Core* callback_;                 // core services for devices
    ConfigGroupCollection* configGroups_;
    CorePropertyCollection* properties_;
    MMEventCallback* externalCallback_;  // notification hook to the higher layer (e.g. GUI)
    PixelSizeConfigGroup* pixelSizeGroup_;
    CircularBuffer* cbuf_;
+   boost::shared_ptr<mm::CameraBufferSet> cameraBuffers_;
+   boost::shared_ptr<mm::PreviewBuffer> previewBuffer_;
+   // Copy of the preview image last returned to each thread
+   mutable boost::thread_specific_ptr<mm::PreviewImage> retrievedPreviewImage_;
 
    std::vector< boost::weak_ptr<DeviceInstance> > imageSynchroDevices_;
    boost::shared_ptr<CPluginManager> pluginManager_;
    boost::shared_ptr<mm::DeviceManager> deviceManager_;
+   boost::shared_ptr<mm::ConfigFileCache> configFileCache_;
+   boost::shared_ptr<mm::AcquisitionEngine> acquisitionEngine_;
+   boost::shared_ptr<mm::StackWriter> stackWriter_;
+   boost::shared_ptr<mm::CompressionStage> compressionStage_;
    std::map<int, std::string> errorText_;
    CPropBlockMap propBlocks_;
 
@@ -698,6 +847,9 @@ private:
    int applyProperties(std::vector<PropertySetting>& props, std::string& lastError);
    void waitForDevice(boost::shared_ptr<DeviceInstance> pDev) throw (CMMError);
    Configuration getConfigGroupState(const char* group, bool fromCache) throw (CMMError);
+   std::string getCurrentConfig(const char* groupName, bool fromCache) throw (CMMError);
+   std::vector<std::string> getPresetPropertyValues(
+         const mm::PresetMatcher& matcher, bool fromCache) throw (CMMError);
    std::string getDeviceErrorText(int deviceCode, boost::shared_ptr<DeviceInstance> pDevice);
    std::string getDeviceName(boost::shared_ptr<DeviceInstance> pDev);
    void logError(const char* device, const char* msg);
@@ -705,6 +857,31 @@ private:
    void assignDefaultRole(boost::shared_ptr<DeviceInstance> pDev);
    void updateCoreProperty(const char* propName, MM::DeviceType devType) throw (CMMError);
    void loadSystemConfigurationImpl(const char* fileName) throw (CMMError);
+   void executeConfigurationCommand(const std::vector<std::string>& tokens,
+         const char* line) throw (CMMError);
+   void addToStateCache(const std::vector<PropertySetting>& settings);
+   void applyConfigurationPropertyBatch(
+         const std::vector<mm::ConfigFileCommand>& settings) throw (CMMError);
+   bool deferConfigurationCommand(const std::vector<std::string>& tokens);
+   void bindDeferredDevice(const std::string& label);
+   MM::DeviceType probeDeferredDeviceType(const std::string& moduleName,
+         const std::string& deviceName);
+   mm::DeviceCallTiming getDeviceCallTiming(const char* label,
+         const char* call) throw (CMMError);
+   mm::CameraFrameStatistics getCameraFrameStatistics(const char* cameraLabel)
+      throw (CMMError);
+   void updateMultiROIPacking(boost::shared_ptr<CameraInstance> camera) throw (CMMError);
+   bool initializeCircularBufferForCamera(boost::shared_ptr<CameraInstance> camera) throw (CMMError);
+   bool initializeSequenceBufferForCamera(CircularBuffer& buffer, boost::shared_ptr<CameraInstance> camera) throw (CMMError);
+   void getBufferedImageSize(boost::shared_ptr<CameraInstance> camera, unsigned& width, unsigned& height) throw (CMMError);
+   void initializePerCameraBuffers() throw (CMMError);
+   boost::shared_ptr<CircularBuffer> findPerCameraBuffer(const char* cameraLabel) const throw (CMMError);
+   bool isPerCameraBufferInUse() const;
+   void checkAcquisitionPlanNotRunning(const char* operation) throw (CMMError);
+   boost::shared_ptr<mm::SnapTask> findSnapTask(long snap) throw (CMMError);
+   boost::shared_ptr<const mm::ImageTransposer> getCameraTransposer(boost::shared_ptr<CameraInstance> camera) throw (CMMError);
+   void updateImageTransposition(boost::shared_ptr<CameraInstance> camera) throw (CMMError);
+   void* getTransposedImage(boost::shared_ptr<CameraInstance> camera, void* pBuf) throw (CMMError);
 };
 
 #endif //_MMCORE_H_
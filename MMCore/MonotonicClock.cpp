@@ -0,0 +1,133 @@
+// DESCRIPTION:   Monotonic timestamps for the Core, devices and logging
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "MonotonicClock.h"
+
+#include "../MMDevice/MMDevice.h"
+
+#include <boost/date_time/gregorian/gregorian_types.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifdef _WIN32
+#  include <windows.h>
+#elif defined(__APPLE__)
+#  include <mach/mach_time.h>
+#else
+#  include <time.h>
+#endif
+
+
+namespace mm
+{
+
+namespace
+{
+
+#ifdef _WIN32
+boost::int64_t
+PerformanceCounterFrequency()
+{
+   LARGE_INTEGER freq;
+   QueryPerformanceFrequency(&freq);
+   return freq.QuadPart;
+}
+#elif defined(__APPLE__)
+mach_timebase_info_data_t
+MachTimebase()
+{
+   mach_timebase_info_data_t timebase;
+   mach_timebase_info(&timebase);
+   return timebase;
+}
+#endif
+
+} // anonymous namespace
+
+
+boost::int64_t
+MonotonicClock::NowUs()
+{
+#ifdef _WIN32
+   static const boost::int64_t freq = PerformanceCounterFrequency();
+   LARGE_INTEGER count;
+   QueryPerformanceCounter(&count);
+   // Split to avoid overflow of count * 1000000
+   return (count.QuadPart / freq) * 1000000 +
+      ((count.QuadPart % freq) * 1000000) / freq;
+#elif defined(__APPLE__)
+   static const mach_timebase_info_data_t timebase = MachTimebase();
+   const boost::uint64_t ticks = mach_absolute_time();
+   // Scale to nanoseconds before dividing, so that no precision is lost;
+   // split to avoid overflow of ticks * numer
+   const boost::uint64_t ns = (ticks / timebase.denom) * timebase.numer +
+      ((ticks % timebase.denom) * timebase.numer) / timebase.denom;
+   return static_cast<boost::int64_t>(ns / 1000);
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return static_cast<boost::int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+
+MM::MMTime
+MonotonicClock::NowAsMMTime()
+{
+   const Anchor& anchor = GetAnchor();
+   return MM::MMTime(static_cast<double>(anchor.mmTimeUs +
+            (NowUs() - anchor.monotonicUs)));
+}
+
+
+boost::posix_time::ptime
+MonotonicClock::ToLocalTime(boost::int64_t monotonicUs)
+{
+   const Anchor& anchor = GetAnchor();
+   return anchor.localTime +
+      boost::posix_time::microseconds(monotonicUs - anchor.monotonicUs);
+}
+
+
+MonotonicClock::Anchor::Anchor() :
+   monotonicUs(NowUs()),
+   localTime(boost::posix_time::microsec_clock::local_time())
+{
+   //NB we are starting the 'epoch' on 2000 01 01
+   const boost::posix_time::ptime epoch(boost::gregorian::date(2000, 1, 1));
+   mmTimeUs = (localTime - epoch).total_microseconds();
+}
+
+
+const MonotonicClock::Anchor&
+MonotonicClock::GetAnchor()
+{
+   static const Anchor anchor;
+   return anchor;
+}
+
+
+namespace
+{
+
+// Make sure the anchor (and the platform clock parameters) are initialized
+// before any threads are started, as function-local statics are not
+// guaranteed to be initialized in a thread-safe manner by all compilers we
+// support.
+const boost::posix_time::ptime g_forceAnchorInitialization =
+   MonotonicClock::NowAsLocalTime();
+
+} // anonymous namespace
+
+} // namespace mm
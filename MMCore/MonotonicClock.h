@@ -0,0 +1,81 @@
+// DESCRIPTION:   Monotonic timestamps for the Core, devices and logging
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+// Not including MMDevice.h, so that this header can be used by the logging
+// code without pulling in the device interface.
+namespace MM {
+   class MMTime;
+} // namespace MM
+
+
+namespace mm
+{
+
+/**
+ * \brief Process-wide monotonic clock.
+ *
+ * Timestamps are read from the OS monotonic clock (clock_gettime() with
+ * CLOCK_MONOTONIC, mach_absolute_time() or QueryPerformanceCounter()), so
+ * they are cheap to obtain and unaffected by adjustments of the system time.
+ *
+ * The wall clock is read once, when the clock is first used, and serves as
+ * the anchor for converting monotonic timestamps to local time.
+ */
+class MonotonicClock
+{
+public:
+   /**
+    * \brief Microseconds since an arbitrary, fixed origin.
+    */
+   static boost::int64_t NowUs();
+
+   /**
+    * \brief Current time as MM::MMTime.
+    *
+    * As with the MMTime values traditionally used by the Core, the value is
+    * the time since 2000-01-01 00:00 local time (as of the anchor), but it
+    * advances monotonically.
+    */
+   static MM::MMTime NowAsMMTime();
+
+   /**
+    * \brief Local time corresponding to a timestamp returned by NowUs().
+    */
+   static boost::posix_time::ptime ToLocalTime(boost::int64_t monotonicUs);
+
+   /**
+    * \brief Current local time, derived from the monotonic clock.
+    */
+   static boost::posix_time::ptime NowAsLocalTime()
+   { return ToLocalTime(NowUs()); }
+
+private:
+   struct Anchor
+   {
+      Anchor();
+      boost::int64_t monotonicUs;
+      boost::posix_time::ptime localTime;
+      boost::int64_t mmTimeUs;
+   };
+
+   static const Anchor& GetAnchor();
+};
+
+} // namespace mm
@@ -0,0 +1,105 @@
+// DESCRIPTION:   Packing of multi-ROI frames into the ROIs' pixels only
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "MultiROIPacker.h"
+
+#include "Error.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+
+namespace mm
+{
+
+MultiROIPacker::MultiROIPacker(const std::vector<ROI>& rois) :
+   rois_(rois),
+   frameWidth_(0),
+   frameHeight_(0),
+   packedWidth_(0),
+   packedHeight_(0)
+{
+   if (rois.empty())
+      throw CMMError("No ROIs to pack");
+
+   unsigned minX = rois[0].x, minY = rois[0].y;
+   unsigned maxX = 0, maxY = 0;
+   size_t totalPixels = 0;
+   std::ostringstream table;
+   for (std::vector<ROI>::const_iterator it = rois.begin(), end = rois.end();
+         it != end; ++it)
+   {
+      if (it->width == 0 || it->height == 0)
+         throw CMMError("Cannot pack an empty ROI");
+      minX = std::min(minX, it->x);
+      minY = std::min(minY, it->y);
+      maxX = std::max(maxX, it->x + it->width);
+      maxY = std::max(maxY, it->y + it->height);
+      packedWidth_ = std::max(packedWidth_, it->width);
+      totalPixels += static_cast<size_t>(it->width) * it->height;
+
+      if (it != rois.begin())
+         table << ';';
+      table << it->x << ',' << it->y << ',' << it->width << ',' << it->height;
+   }
+
+   for (std::vector<ROI>::iterator it = rois_.begin(), end = rois_.end();
+         it != end; ++it)
+   {
+      it->x -= minX;
+      it->y -= minY;
+   }
+   frameWidth_ = maxX - minX;
+   frameHeight_ = maxY - minY;
+   packedHeight_ = static_cast<unsigned>(
+         (totalPixels + packedWidth_ - 1) / packedWidth_);
+   roiTable_ = table.str();
+}
+
+
+void
+MultiROIPacker::Pack(const unsigned char* frame, unsigned bytesPerPixel,
+      unsigned char* dest) const
+{
+   const size_t frameRowBytes = static_cast<size_t>(frameWidth_) * bytesPerPixel;
+   unsigned char* out = dest;
+   for (std::vector<ROI>::const_iterator it = rois_.begin(), end = rois_.end();
+         it != end; ++it)
+   {
+      const size_t rowBytes = static_cast<size_t>(it->width) * bytesPerPixel;
+      const unsigned char* in = frame + it->y * frameRowBytes +
+         static_cast<size_t>(it->x) * bytesPerPixel;
+      for (unsigned row = 0; row < it->height; ++row)
+      {
+         std::memcpy(out, in, rowBytes);
+         out += rowBytes;
+         in += frameRowBytes;
+      }
+   }
+
+   unsigned char* destEnd = dest +
+      static_cast<size_t>(packedWidth_) * packedHeight_ * bytesPerPixel;
+   std::fill(out, destEnd, static_cast<unsigned char>(0));
+}
+
+
+void
+MultiROIPacker::Copier::CopyPixels(unsigned, unsigned char* dest) const
+{
+   packer_.Pack(frame_, bytesPerPixel_, dest);
+}
+
+} // namespace mm
@@ -0,0 +1,110 @@
+// DESCRIPTION:   Packing of multi-ROI frames into the ROIs' pixels only
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "PixelCopier.h"
+
+#include <string>
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief Layout for packing the ROIs of a multi-ROI camera.
+ *
+ * Multi-ROI cameras deliver frames covering the bounding box of their ROIs,
+ * with the pixels outside of the ROIs filled with a constant. The packed
+ * image instead consists of the pixels of each ROI (row by row, each ROI
+ * with its own width) in the order the ROIs were set, so that its size
+ * scales with the total ROI area rather than the bounding box.
+ *
+ * The packed image is given the width of the widest ROI and the smallest
+ * height that holds all the pixels; the remainder of the last row is zero.
+ * When all ROIs have the same width, the packed image is simply the ROIs
+ * stacked vertically.
+ */
+class MultiROIPacker /* final */
+{
+public:
+   struct ROI
+   {
+      ROI(unsigned x, unsigned y, unsigned width, unsigned height) :
+         x(x), y(y), width(width), height(height)
+      {}
+
+      unsigned x, y, width, height;
+   };
+
+   /**
+    * \brief Compute the layout for ROIs given in sensor coordinates.
+    *
+    * Throws CMMError if there are no ROIs or any ROI is empty.
+    */
+   explicit MultiROIPacker(const std::vector<ROI>& rois);
+
+   /// Dimensions of the (bounding box) frames delivered by the camera
+   unsigned GetFrameWidth() const { return frameWidth_; }
+   unsigned GetFrameHeight() const { return frameHeight_; }
+
+   unsigned GetPackedWidth() const { return packedWidth_; }
+   unsigned GetPackedHeight() const { return packedHeight_; }
+
+   /**
+    * \brief The ROI table, as stored in the image metadata.
+    *
+    * See MM::g_Keyword_Metadata_PackedROIs.
+    */
+   const std::string& GetROITable() const { return roiTable_; }
+
+   /**
+    * \brief Pack a bounding box frame.
+    *
+    * \param dest Must hold GetPackedWidth() * GetPackedHeight() pixels.
+    */
+   void Pack(const unsigned char* frame, unsigned bytesPerPixel,
+         unsigned char* dest) const;
+
+   /**
+    * \brief Copier that packs a bounding box frame while inserting it.
+    */
+   class Copier : public PixelCopier
+   {
+   public:
+      Copier(const MultiROIPacker& packer, const unsigned char* frame,
+            unsigned bytesPerPixel) :
+         packer_(packer), frame_(frame), bytesPerPixel_(bytesPerPixel)
+      {}
+
+      virtual void CopyPixels(unsigned channel, unsigned char* dest) const;
+
+   private:
+      const MultiROIPacker& packer_;
+      const unsigned char* frame_;
+      unsigned bytesPerPixel_;
+   };
+
+private:
+   std::vector<ROI> rois_; // Relative to the bounding box
+   unsigned frameWidth_;
+   unsigned frameHeight_;
+   unsigned packedWidth_;
+   unsigned packedHeight_;
+   std::string roiTable_;
+};
+
+} // namespace mm
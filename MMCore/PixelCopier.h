@@ -0,0 +1,88 @@
+// DESCRIPTION:   Interface for writing inserted images into buffer memory
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "PixelStatistics.h"
+
+#include <cstring>
+
+
+namespace mm
+{
+
+/**
+ * \brief Writes the pixels of an inserted image into buffer memory.
+ *
+ * Allows an image to be converted while it is copied into the circular
+ * buffer, instead of in a separate pass over a temporary copy.
+ */
+class PixelCopier
+{
+public:
+   virtual ~PixelCopier() {}
+
+   /**
+    * \brief Write one channel of the image.
+    *
+    * \param dest Holds exactly one channel of the dimensions and pixel
+    * depth that the image is inserted with.
+    */
+   virtual void CopyPixels(unsigned channel, unsigned char* dest) const = 0;
+
+   /**
+    * \brief Write one channel of the image and accumulate its statistics.
+    *
+    * The default implementation accumulates the pixels from dest after
+    * writing them; copiers that can should do both in one pass.
+    */
+   virtual void CopyPixelsWithStatistics(unsigned channel,
+         unsigned char* dest, size_t numPixels,
+         PixelStatistics& stats) const
+   {
+      CopyPixels(channel, dest);
+      stats.Accumulate(dest, numPixels);
+   }
+};
+
+
+/**
+ * \brief Copier for images that are inserted as is.
+ */
+class ContiguousPixelCopier : public PixelCopier
+{
+public:
+   /// Channels are consecutive in pixels, each of channelSize bytes.
+   ContiguousPixelCopier(const unsigned char* pixels, size_t channelSize) :
+      pixels_(pixels), channelSize_(channelSize)
+   {}
+
+   virtual void CopyPixels(unsigned channel, unsigned char* dest) const
+   { std::memcpy(dest, pixels_ + channel * channelSize_, channelSize_); }
+
+   virtual void CopyPixelsWithStatistics(unsigned channel,
+         unsigned char* dest, size_t numPixels,
+         PixelStatistics& stats) const
+   {
+      stats.CopyAndAccumulate(pixels_ + channel * channelSize_, dest,
+            numPixels);
+   }
+
+private:
+   const unsigned char* pixels_;
+   size_t channelSize_;
+};
+
+} // namespace mm
@@ -0,0 +1,254 @@
+// DESCRIPTION:   Unpadding and unpacking of camera pixel formats
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PixelFormatConverter.h"
+
+#include "CoreUtils.h"
+#include "Error.h"
+
+#include <boost/cstdint.hpp>
+
+#include <cstring>
+
+
+namespace mm
+{
+
+namespace
+{
+
+bool
+HostIsLittleEndian()
+{
+   const boost::uint16_t test = 1;
+   return *reinterpret_cast<const unsigned char*>(&test) != 0;
+}
+
+const bool hostIsLittleEndian = HostIsLittleEndian();
+
+// Each unpacker converts one row. Pixels come in pairs of 3 bytes. On
+// little-endian hosts, a pair is decoded from a single 32-bit load, which
+// takes fewer instructions than assembling it byte by byte and lets the
+// compiler vectorize the loop.
+
+struct Mono10Packed
+{
+   static void Pair(const unsigned char* in, boost::uint16_t* out)
+   {
+      out[0] = static_cast<boost::uint16_t>((in[0] << 2) | (in[1] & 0x03));
+      out[1] = static_cast<boost::uint16_t>((in[2] << 2) | ((in[1] >> 4) & 0x03));
+   }
+   static void Pair(boost::uint32_t v, boost::uint16_t* out)
+   {
+      out[0] = static_cast<boost::uint16_t>(((v & 0xff) << 2) | ((v >> 8) & 0x03));
+      out[1] = static_cast<boost::uint16_t>(((v >> 14) & 0x3fc) | ((v >> 12) & 0x03));
+   }
+};
+
+struct Mono12Packed
+{
+   static void Pair(const unsigned char* in, boost::uint16_t* out)
+   {
+      out[0] = static_cast<boost::uint16_t>((in[0] << 4) | (in[1] & 0x0f));
+      out[1] = static_cast<boost::uint16_t>((in[2] << 4) | (in[1] >> 4));
+   }
+   static void Pair(boost::uint32_t v, boost::uint16_t* out)
+   {
+      out[0] = static_cast<boost::uint16_t>(((v & 0xff) << 4) | ((v >> 8) & 0x0f));
+      out[1] = static_cast<boost::uint16_t>(((v >> 12) & 0xff0) | ((v >> 12) & 0x0f));
+   }
+};
+
+struct Mono12p
+{
+   static void Pair(const unsigned char* in, boost::uint16_t* out)
+   {
+      out[0] = static_cast<boost::uint16_t>(in[0] | ((in[1] & 0x0f) << 8));
+      out[1] = static_cast<boost::uint16_t>((in[1] >> 4) | (in[2] << 4));
+   }
+   static void Pair(boost::uint32_t v, boost::uint16_t* out)
+   {
+      out[0] = static_cast<boost::uint16_t>(v & 0xfff);
+      out[1] = static_cast<boost::uint16_t>((v >> 12) & 0xfff);
+   }
+};
+
+template <typename Format>
+void
+UnpackRow(const unsigned char* in, unsigned width, boost::uint16_t* out)
+{
+   const unsigned pairs = width / 2;
+   unsigned i = 0;
+   if (hostIsLittleEndian)
+   {
+      // The 32-bit load reads one byte past the pair, so the last pair of
+      // the row is left to the bytewise loop
+      for (; i + 1 < pairs; ++i)
+      {
+         boost::uint32_t v;
+         std::memcpy(&v, in + 3 * i, sizeof(v));
+         Format::Pair(v, out + 2 * i);
+      }
+   }
+   for (; i < pairs; ++i)
+      Format::Pair(in + 3 * i, out + 2 * i);
+
+   if (width % 2)
+   {
+      // Only the first pixel of the last pair, which has 2 bytes
+      const unsigned char last[3] = { in[3 * pairs], in[3 * pairs + 1], 0 };
+      boost::uint16_t lastPair[2];
+      Format::Pair(last, lastPair);
+      out[width - 1] = lastPair[0];
+   }
+}
+
+void
+SwapBytesRow(const unsigned char* in, unsigned width, boost::uint16_t* out)
+{
+   if (hostIsLittleEndian)
+   {
+      for (unsigned i = 0; i < width; ++i)
+      {
+         boost::uint16_t v;
+         std::memcpy(&v, in + 2 * i, sizeof(v));
+         out[i] = static_cast<boost::uint16_t>((v >> 8) | (v << 8));
+      }
+   }
+   else
+   {
+      std::memcpy(out, in, 2 * static_cast<size_t>(width));
+   }
+}
+
+// Bytes used by a source row
+size_t
+SourceRowSize(MM::SourcePixelFormat format, unsigned width,
+      unsigned byteDepth)
+{
+   switch (format)
+   {
+      case MM::SourceMono10Packed:
+      case MM::SourceMono12Packed:
+      case MM::SourceMono12p:
+         return (3 * static_cast<size_t>(width) + 1) / 2;
+      case MM::SourceMono16BigEndian:
+         return 2 * static_cast<size_t>(width);
+      default:
+         return static_cast<size_t>(width) * byteDepth;
+   }
+}
+
+} // anonymous namespace
+
+
+PixelFormatConverter::PixelFormatConverter(MM::SourcePixelFormat format,
+      unsigned width, unsigned height, unsigned rowPitch,
+      unsigned byteDepth, unsigned nComponents) :
+   format_(format),
+   width_(width),
+   height_(height),
+   rowPitch_(rowPitch),
+   byteDepth_(byteDepth),
+   nComponents_(nComponents)
+{
+   switch (format)
+   {
+      case MM::SourceNative:
+         break;
+      case MM::SourceMono10Packed:
+      case MM::SourceMono12Packed:
+      case MM::SourceMono12p:
+      case MM::SourceMono16BigEndian:
+         if (byteDepth != 2 || nComponents != 1)
+            throw CMMError("Packed and big-endian source pixels can only be "
+                  "converted to 16-bit monochrome pixels");
+         break;
+      default:
+         throw CMMError("Unknown source pixel format (" +
+               ToString(static_cast<int>(format)) + ")");
+   }
+
+   const size_t rowSize = SourceRowSize(format, width, byteDepth);
+   if (rowPitch_ == 0)
+      rowPitch_ = rowSize;
+   else if (rowPitch_ < rowSize)
+      throw CMMError("Row pitch (" + ToString(rowPitch) + " bytes) is "
+            "smaller than a row of the image (" + ToString(rowSize) +
+            " bytes)");
+}
+
+
+bool
+PixelFormatConverter::IsIdentity() const
+{
+   return format_ == MM::SourceNative &&
+      rowPitch_ == SourceRowSize(format_, width_, byteDepth_);
+}
+
+
+size_t
+PixelFormatConverter::GetConvertedSize() const
+{
+   return static_cast<size_t>(width_) * height_ * byteDepth_;
+}
+
+
+void
+PixelFormatConverter::Convert(const unsigned char* src,
+      unsigned char* dest) const
+{
+   if (IsIdentity())
+   {
+      std::memcpy(dest, src, GetConvertedSize());
+      return;
+   }
+
+   const size_t destRowSize = static_cast<size_t>(width_) * byteDepth_;
+   for (unsigned y = 0; y < height_; ++y)
+   {
+      const unsigned char* in = src + y * rowPitch_;
+      unsigned char* out = dest + y * destRowSize;
+      boost::uint16_t* out16 = reinterpret_cast<boost::uint16_t*>(out);
+      switch (format_)
+      {
+         case MM::SourceMono10Packed:
+            UnpackRow<Mono10Packed>(in, width_, out16);
+            break;
+         case MM::SourceMono12Packed:
+            UnpackRow<Mono12Packed>(in, width_, out16);
+            break;
+         case MM::SourceMono12p:
+            UnpackRow<Mono12p>(in, width_, out16);
+            break;
+         case MM::SourceMono16BigEndian:
+            SwapBytesRow(in, width_, out16);
+            break;
+         default:
+            std::memcpy(out, in, destRowSize);
+            break;
+      }
+   }
+}
+
+
+void
+PixelFormatConverter::Copier::CopyPixels(unsigned /* channel */,
+      unsigned char* dest) const
+{
+   converter_.Convert(pixels_, dest);
+}
+
+} // namespace mm
@@ -0,0 +1,94 @@
+// DESCRIPTION:   Unpadding and unpacking of camera pixel formats
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "PixelCopier.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <cstddef>
+
+
+namespace mm
+{
+
+/**
+ * \brief Conversion of camera frames to the pixels stored by the Core.
+ *
+ * The source rows may be padded to a row pitch, and the source pixels may
+ * be in one of the packed or big-endian formats of MM::SourcePixelFormat,
+ * in which case the result has 16-bit pixels in host byte order.
+ */
+class PixelFormatConverter /* final */
+{
+public:
+   /**
+    * \param rowPitch Bytes from one source row to the next, or 0 if the
+    * rows are not padded.
+    * \param byteDepth Bytes per resulting pixel.
+    * \param nComponents Components per resulting pixel.
+    *
+    * Throws CMMError if the format is unknown, if the resulting pixels do
+    * not match the format, or if the row pitch is too small.
+    */
+   PixelFormatConverter(MM::SourcePixelFormat format,
+         unsigned width, unsigned height, unsigned rowPitch,
+         unsigned byteDepth, unsigned nComponents);
+
+   unsigned GetWidth() const { return width_; }
+   unsigned GetHeight() const { return height_; }
+   unsigned GetByteDepth() const { return byteDepth_; }
+   unsigned GetNumberOfComponents() const { return nComponents_; }
+
+   /// Whether the source is already laid out as the result
+   bool IsIdentity() const;
+
+   /// Size of the resulting image in bytes
+   size_t GetConvertedSize() const;
+
+   /**
+    * \brief Write the converted image.
+    *
+    * \param dest Must not overlap with src. Holds GetConvertedSize() bytes.
+    */
+   void Convert(const unsigned char* src, unsigned char* dest) const;
+
+   /// Copier that converts a single-channel image while inserting it
+   class Copier : public PixelCopier
+   {
+   public:
+      Copier(const PixelFormatConverter& converter,
+            const unsigned char* pixels) :
+         converter_(converter), pixels_(pixels)
+      {}
+
+      virtual void CopyPixels(unsigned channel, unsigned char* dest) const;
+
+   private:
+      const PixelFormatConverter& converter_;
+      const unsigned char* pixels_;
+   };
+
+private:
+   MM::SourcePixelFormat format_;
+   unsigned width_;
+   unsigned height_;
+   size_t rowPitch_;
+   unsigned byteDepth_;
+   unsigned nComponents_;
+};
+
+} // namespace mm
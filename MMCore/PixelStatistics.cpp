@@ -0,0 +1,252 @@
+// DESCRIPTION:   Pixel value statistics of inserted images
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PixelStatistics.h"
+
+#include "../MMDevice/DeviceUtils.h"
+#include "../MMDevice/ImageMetadata.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// Pixels copied at a time by CopyAndAccumulate(), so that they are still in
+// L1 cache when accumulated
+const size_t copyChunkBytes = 16 * 1024;
+
+// Pixels reduced at a time; small enough that the sum of a block fits in
+// 32 bits
+const size_t reduceBlockPixels = 1024;
+
+// Two decimals, as CDeviceUtils::ConvertToString(), whose static buffer is
+// shared by the concurrently inserting cameras
+std::string FormatStatistic(double value)
+{
+   std::ostringstream strm;
+   strm << std::fixed << std::setprecision(2) << value;
+   return strm.str();
+}
+
+} // anonymous namespace
+
+
+PixelStatistics::PixelStatistics(unsigned histogramBins, unsigned bitDepth) :
+   histogramBins_(histogramBins),
+   bitDepth_(bitDepth),
+   bytesPerPixel_(1)
+{
+   Reset(1);
+}
+
+
+void
+PixelStatistics::Reset(unsigned bytesPerPixel)
+{
+   bytesPerPixel_ = bytesPerPixel;
+   count_ = 0;
+   min_ = 0xffffffff;
+   max_ = 0;
+   sum_ = 0;
+   sumOfSquares_ = 0;
+   histogram_.clear();
+   if (histogramBins_ > 0)
+      valueCounts_.assign(size_t(1) << (8 * bytesPerPixel), 0);
+}
+
+
+template <typename Pixel>
+void
+PixelStatistics::Reduce(const Pixel* pixels, size_t n)
+{
+   // One simple loop per quantity, over blocks of a fixed size, so that
+   // compilers vectorize them without needing to handle a remainder
+   boost::uint64_t sum = 0;
+   boost::uint64_t sumOfSquares = 0;
+   Pixel lo = pixels[0];
+   Pixel hi = pixels[0];
+   for (; n >= reduceBlockPixels; n -= reduceBlockPixels,
+         pixels += reduceBlockPixels)
+   {
+      Pixel blockLo = pixels[0];
+      Pixel blockHi = pixels[0];
+      for (size_t i = 0; i < reduceBlockPixels; ++i)
+      {
+         blockLo = pixels[i] < blockLo ? pixels[i] : blockLo;
+         blockHi = pixels[i] > blockHi ? pixels[i] : blockHi;
+      }
+      boost::uint32_t blockSum = 0;
+      for (size_t i = 0; i < reduceBlockPixels; ++i)
+         blockSum += pixels[i];
+      boost::uint64_t blockSumOfSquares = 0;
+      for (size_t i = 0; i < reduceBlockPixels; ++i)
+         blockSumOfSquares += boost::uint32_t(pixels[i]) * pixels[i];
+
+      lo = std::min(lo, blockLo);
+      hi = std::max(hi, blockHi);
+      sum += blockSum;
+      sumOfSquares += blockSumOfSquares;
+   }
+   for (size_t i = 0; i < n; ++i)
+   {
+      lo = std::min(lo, pixels[i]);
+      hi = std::max(hi, pixels[i]);
+      sum += pixels[i];
+      sumOfSquares += boost::uint32_t(pixels[i]) * pixels[i];
+   }
+
+   min_ = std::min<unsigned>(min_, lo);
+   max_ = std::max<unsigned>(max_, hi);
+   sum_ += sum;
+   sumOfSquares_ += sumOfSquares;
+}
+
+
+template <typename Pixel>
+void
+PixelStatistics::Count(const Pixel* pixels, size_t n)
+{
+   boost::uint32_t* counts = &valueCounts_[0];
+   for (size_t i = 0; i < n; ++i)
+      ++counts[pixels[i]];
+}
+
+
+void
+PixelStatistics::Accumulate(const unsigned char* pixels, size_t numPixels)
+{
+   if (numPixels == 0)
+      return;
+   count_ += numPixels;
+   if (bytesPerPixel_ == 1)
+   {
+      if (histogramBins_ > 0)
+         Count(pixels, numPixels);
+      else
+         Reduce(pixels, numPixels);
+   }
+   else
+   {
+      const boost::uint16_t* pixels16 =
+         reinterpret_cast<const boost::uint16_t*>(pixels);
+      if (histogramBins_ > 0)
+         Count(pixels16, numPixels);
+      else
+         Reduce(pixels16, numPixels);
+   }
+}
+
+
+void
+PixelStatistics::CopyAndAccumulate(const unsigned char* src,
+      unsigned char* dest, size_t numPixels)
+{
+   const size_t chunkPixels = copyChunkBytes / bytesPerPixel_;
+   while (numPixels > 0)
+   {
+      const size_t n = std::min(numPixels, chunkPixels);
+      std::memcpy(dest, src, n * bytesPerPixel_);
+      Accumulate(dest, n);
+      src += n * bytesPerPixel_;
+      dest += n * bytesPerPixel_;
+      numPixels -= n;
+   }
+}
+
+
+void
+PixelStatistics::Finish()
+{
+   if (histogramBins_ == 0)
+      return;
+
+   // The range of the histogram is 2^bitDepth, unless the bit depth is
+   // unknown or larger than the pixels
+   unsigned bits = 8 * bytesPerPixel_;
+   if (bitDepth_ > 0 && bitDepth_ < bits)
+      bits = bitDepth_;
+
+   histogram_.assign(histogramBins_, 0);
+   for (size_t value = 0; value < valueCounts_.size(); ++value)
+   {
+      const boost::uint64_t n = valueCounts_[value];
+      if (n == 0)
+         continue;
+      min_ = std::min<unsigned>(min_, static_cast<unsigned>(value));
+      max_ = static_cast<unsigned>(value);
+      sum_ += n * value;
+      sumOfSquares_ += n * value * value;
+      const size_t bin = std::min<boost::uint64_t>(histogramBins_ - 1,
+            (boost::uint64_t(value) * histogramBins_) >> bits);
+      histogram_[bin] += n;
+   }
+}
+
+
+double
+PixelStatistics::GetMean() const
+{
+   if (count_ == 0)
+      return 0.0;
+   return static_cast<double>(sum_) / count_;
+}
+
+
+double
+PixelStatistics::GetStdDev() const
+{
+   if (count_ == 0)
+      return 0.0;
+   const double mean = GetMean();
+   const double variance =
+      static_cast<double>(sumOfSquares_) / count_ - mean * mean;
+   return variance > 0.0 ? std::sqrt(variance) : 0.0;
+}
+
+
+void
+PixelStatistics::PutTags(Metadata& md) const
+{
+   if (count_ == 0)
+      return;
+   md.PutImageTag(MM::g_Keyword_Metadata_PixelMin, min_);
+   md.PutImageTag(MM::g_Keyword_Metadata_PixelMax, max_);
+   md.PutImageTag(MM::g_Keyword_Metadata_PixelMean,
+         FormatStatistic(GetMean()));
+   md.PutImageTag(MM::g_Keyword_Metadata_PixelStdDev,
+         FormatStatistic(GetStdDev()));
+   if (!histogram_.empty())
+   {
+      std::ostringstream counts;
+      for (size_t i = 0; i < histogram_.size(); ++i)
+      {
+         if (i > 0)
+            counts << ',';
+         counts << histogram_[i];
+      }
+      md.PutImageTag(MM::g_Keyword_Metadata_PixelHistogram, counts.str());
+   }
+}
+
+} // namespace mm
@@ -0,0 +1,98 @@
+// DESCRIPTION:   Pixel value statistics of inserted images
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/cstdint.hpp>
+
+#include <cstddef>
+#include <vector>
+
+class Metadata;
+
+
+namespace mm
+{
+
+/**
+ * \brief Minimum, maximum, mean, standard deviation and histogram of the
+ * pixels of an image.
+ *
+ * Only monochrome pixels of 1 or 2 bytes are supported. Pixels are
+ * accumulated while being copied, or from memory that was just written, so
+ * that the statistics do not need another pass over the image.
+ *
+ * When a histogram is requested, a count of every pixel value is kept, from
+ * which all the statistics are derived; otherwise the pixels are reduced
+ * directly.
+ */
+class PixelStatistics /* final */
+{
+public:
+   /**
+    * \param histogramBins Number of histogram bins, or 0 for no histogram.
+    * \param bitDepth Significant bits per pixel; the histogram bins evenly
+    * divide the range from 0 to 2^bitDepth. Pixels beyond the range are
+    * counted in the last bin.
+    */
+   PixelStatistics(unsigned histogramBins, unsigned bitDepth);
+
+   static bool IsSupported(unsigned bytesPerPixel, unsigned nComponents)
+   { return nComponents == 1 && (bytesPerPixel == 1 || bytesPerPixel == 2); }
+
+   /// Start a new image with the given pixel size
+   void Reset(unsigned bytesPerPixel);
+
+   void Accumulate(const unsigned char* pixels, size_t numPixels);
+
+   /// Copy pixels and accumulate them in the same pass
+   void CopyAndAccumulate(const unsigned char* src, unsigned char* dest,
+         size_t numPixels);
+
+   /// Compute the results; must be called after accumulating all pixels
+   void Finish();
+
+   boost::uint64_t GetCount() const { return count_; }
+   unsigned GetMin() const { return min_; }
+   unsigned GetMax() const { return max_; }
+   double GetMean() const;
+   /// Population standard deviation
+   double GetStdDev() const;
+   const std::vector<boost::uint64_t>& GetHistogram() const
+   { return histogram_; }
+
+   /// Add the statistics to image metadata
+   void PutTags(Metadata& md) const;
+
+private:
+   template <typename Pixel> void Reduce(const Pixel* pixels, size_t n);
+   template <typename Pixel> void Count(const Pixel* pixels, size_t n);
+
+   unsigned histogramBins_;
+   unsigned bitDepth_;
+   unsigned bytesPerPixel_;
+
+   boost::uint64_t count_;
+   unsigned min_;
+   unsigned max_;
+   boost::uint64_t sum_;
+   boost::uint64_t sumOfSquares_;
+   std::vector<boost::uint64_t> histogram_;
+
+   // Count of each pixel value, when a histogram is requested
+   std::vector<boost::uint32_t> valueCounts_;
+};
+
+} // namespace mm
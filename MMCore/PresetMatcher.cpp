@@ -0,0 +1,121 @@
+// DESCRIPTION:   Lookup of the configuration preset matching the current state
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PresetMatcher.h"
+
+#include "Configuration.h"
+
+
+namespace mm
+{
+
+PresetMatcher::PresetMatcher(
+      const std::map<std::string, Configuration>& presets) :
+   haveCachedMatch_(false)
+{
+   const size_t numPresets = presets.size();
+
+   std::map<PropertyKey, size_t> propertyNumbers;
+   size_t presetNumber = 0;
+   for (std::map<std::string, Configuration>::const_iterator
+         it = presets.begin(), end = presets.end(); it != end;
+         ++it, ++presetNumber)
+   {
+      presetNames_.push_back(it->first);
+
+      const Configuration& preset = it->second;
+      for (size_t i = 0; i < preset.size(); ++i)
+      {
+         PropertySetting setting = preset.getSetting(i);
+         PropertyKey key(setting.getDeviceLabel(), setting.getPropertyName());
+
+         std::map<PropertyKey, size_t>::const_iterator found =
+            propertyNumbers.find(key);
+         size_t propertyNumber;
+         if (found != propertyNumbers.end())
+         {
+            propertyNumber = found->second;
+         }
+         else
+         {
+            propertyNumber = properties_.size();
+            propertyNumbers.insert(std::make_pair(key, propertyNumber));
+            properties_.push_back(key);
+            index_.push_back(PropertyIndex());
+            index_.back().unconstrained.resize(numPresets, true);
+         }
+
+         PropertyIndex& index = index_[propertyNumber];
+         index.unconstrained.reset(presetNumber);
+         PresetSet& accepting = index.accepting[setting.getPropertyValue()];
+         accepting.resize(numPresets);
+         accepting.set(presetNumber);
+      }
+   }
+
+   // Presets that do not specify a property accept any of its values
+   for (std::vector<PropertyIndex>::iterator it = index_.begin(),
+         end = index_.end(); it != end; ++it)
+   {
+      for (boost::unordered_map<std::string, PresetSet>::iterator
+            v = it->accepting.begin(), vEnd = it->accepting.end();
+            v != vEnd; ++v)
+      {
+         v->second |= it->unconstrained;
+      }
+   }
+}
+
+
+std::string
+PresetMatcher::Match(const std::vector<std::string>& values) const
+{
+   boost::mutex::scoped_lock lock(cacheMutex_);
+   if (!haveCachedMatch_ || values != cachedValues_)
+   {
+      cachedMatch_ = MatchUncached(values);
+      cachedValues_ = values;
+      haveCachedMatch_ = true;
+   }
+   return cachedMatch_;
+}
+
+
+std::string
+PresetMatcher::MatchUncached(const std::vector<std::string>& values) const
+{
+   if (presetNames_.empty() || values.size() != properties_.size())
+      return std::string();
+
+   PresetSet candidates(presetNames_.size());
+   candidates.set();
+   for (size_t i = 0; i < values.size() && candidates.any(); ++i)
+   {
+      const PropertyIndex& index = index_[i];
+      boost::unordered_map<std::string, PresetSet>::const_iterator found =
+         index.accepting.find(values[i]);
+      if (found != index.accepting.end())
+         candidates &= found->second;
+      else
+         candidates &= index.unconstrained;
+   }
+
+   PresetSet::size_type first = candidates.find_first();
+   if (first == PresetSet::npos)
+      return std::string();
+   return presetNames_[first];
+}
+
+} // namespace mm
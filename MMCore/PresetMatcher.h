@@ -0,0 +1,92 @@
+// DESCRIPTION:   Lookup of the configuration preset matching the current state
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/dynamic_bitset.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Configuration;
+
+
+namespace mm
+{
+
+/**
+ * \brief The presets of a configuration group, compiled for matching.
+ *
+ * For each property used by the group, the presets are indexed by the value
+ * they require, so that the first preset matching a given state is found
+ * with one lookup per property, independent of the number of presets.
+ *
+ * A preset matches if every property it specifies has the specified value;
+ * properties that it does not specify may have any value.
+ */
+class PresetMatcher
+{
+public:
+   /// Device label and property name
+   typedef std::pair<std::string, std::string> PropertyKey;
+
+   explicit PresetMatcher(const std::map<std::string, Configuration>& presets);
+
+   /**
+    * \brief The properties used by any of the presets.
+    *
+    * In order of first appearance, going through the presets in name order.
+    */
+   const std::vector<PropertyKey>& GetProperties() const
+   { return properties_; }
+
+   /**
+    * \brief Find the first preset (in name order) matching a state.
+    *
+    * \param values The values of the properties returned by GetProperties(),
+    * in the same order.
+    * \return The preset name, or an empty string if no preset matches.
+    */
+   std::string Match(const std::vector<std::string>& values) const;
+
+private:
+   typedef boost::dynamic_bitset<> PresetSet;
+
+   struct PropertyIndex
+   {
+      /// Presets that do not specify the property
+      PresetSet unconstrained;
+      /// For each specified value, the presets that accept it
+      boost::unordered_map<std::string, PresetSet> accepting;
+   };
+
+   std::string MatchUncached(const std::vector<std::string>& values) const;
+
+   std::vector<std::string> presetNames_;
+   std::vector<PropertyKey> properties_;
+   std::vector<PropertyIndex> index_;
+
+   // The result for the most recently matched state
+   mutable boost::mutex cacheMutex_;
+   mutable bool haveCachedMatch_;
+   mutable std::vector<std::string> cachedValues_;
+   mutable std::string cachedMatch_;
+};
+
+} // namespace mm
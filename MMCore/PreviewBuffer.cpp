@@ -0,0 +1,222 @@
+// DESCRIPTION:   Decimated and downsampled copies of inserted images, for
+//                display
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PreviewBuffer.h"
+
+#include "CoreUtils.h"
+#include "Error.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// Average the pixels in each binning x binning square. Source rows are first
+// summed into rowSums, element by element, which compilers vectorize; the
+// sums of each square are then completed from rowSums, which is only 1/binning
+// of the work.
+template <typename Component>
+void
+BinPixels(const Component* src, unsigned width, unsigned height,
+      unsigned components, unsigned binning,
+      std::vector<boost::uint32_t>& rowSums, Component* dest)
+{
+   const unsigned newWidth = width / binning;
+   const unsigned newHeight = height / binning;
+   const size_t rowLength = static_cast<size_t>(newWidth) * binning * components;
+   const boost::uint32_t squareSize = binning * binning;
+
+   rowSums.resize(rowLength);
+   boost::uint32_t* sums = &rowSums[0];
+   for (unsigned y = 0; y < newHeight; ++y)
+   {
+      std::fill(sums, sums + rowLength, 0);
+      for (unsigned row = 0; row < binning; ++row)
+      {
+         const Component* in =
+            src + (static_cast<size_t>(y) * binning + row) * width * components;
+         for (size_t i = 0; i < rowLength; ++i)
+            sums[i] += in[i];
+      }
+
+      Component* out = dest + static_cast<size_t>(y) * newWidth * components;
+      for (unsigned x = 0; x < newWidth; ++x)
+      {
+         for (unsigned c = 0; c < components; ++c)
+         {
+            const boost::uint32_t* square =
+               sums + static_cast<size_t>(x) * binning * components + c;
+            boost::uint32_t sum = 0;
+            for (unsigned i = 0; i < binning; ++i)
+               sum += square[i * components];
+            out[x * components + c] =
+               static_cast<Component>((sum + squareSize / 2) / squareSize);
+         }
+      }
+   }
+}
+
+} // anonymous namespace
+
+
+const unsigned PreviewBuffer::MaxBinning;
+const unsigned PreviewBuffer::numSlots;
+
+
+PreviewBuffer::PreviewBuffer() :
+   binning_(1),
+   intervalMs_(0.0),
+   hasLastTime_(false),
+   lastTimeMs_(0.0),
+   lastSlot_(-1)
+{
+}
+
+
+void
+PreviewBuffer::SetBinning(unsigned binning)
+{
+   if (binning == 0 || binning > MaxBinning)
+      throw CMMError("Preview binning must be between 1 and " +
+            ToString(MaxBinning) + " (got " + ToString(binning) + ")");
+   boost::mutex::scoped_lock lock(mutex_);
+   binning_ = binning;
+}
+
+
+unsigned
+PreviewBuffer::GetBinning() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return binning_;
+}
+
+
+void
+PreviewBuffer::SetIntervalMs(double intervalMs)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   intervalMs_ = std::max(0.0, intervalMs);
+}
+
+
+double
+PreviewBuffer::GetIntervalMs() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return intervalMs_;
+}
+
+
+void
+PreviewBuffer::Insert(const unsigned char* pixels, unsigned width,
+      unsigned height, unsigned byteDepth, unsigned nComponents,
+      const Metadata& md, double timeMs)
+{
+   unsigned binning;
+   int slotIndex;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      // A clock going backwards means a new acquisition
+      if (hasLastTime_ && timeMs >= lastTimeMs_ &&
+            timeMs - lastTimeMs_ < intervalMs_)
+         return;
+      binning = binning_;
+      slotIndex = (lastSlot_ + 1) % numSlots;
+   }
+
+   const bool mono = (nComponents == 1 && (byteDepth == 1 || byteDepth == 2));
+   const bool rgb = (nComponents == 4 && (byteDepth == 4 || byteDepth == 8));
+   if (binning > 1 && !mono && !rgb)
+      return;
+   if (width / binning == 0 || height / binning == 0)
+      return;
+
+   // The slot is not visible to readers until it is published below
+   PreviewImage& slot = slots_[slotIndex];
+   slot.width = width / binning;
+   slot.height = height / binning;
+   slot.byteDepth = byteDepth;
+   slot.nComponents = nComponents;
+   slot.pixels.resize(static_cast<size_t>(slot.width) * slot.height * byteDepth);
+   if (binning == 1)
+   {
+      std::memcpy(&slot.pixels[0], pixels, slot.pixels.size());
+   }
+   else
+   {
+      const unsigned components = mono ? 1 : 4;
+      if (byteDepth / components == 1)
+         BinPixels(pixels, width, height, components, binning, rowSums_,
+               &slot.pixels[0]);
+      else
+         BinPixels(reinterpret_cast<const boost::uint16_t*>(pixels),
+               width, height, components, binning, rowSums_,
+               reinterpret_cast<boost::uint16_t*>(&slot.pixels[0]));
+   }
+
+   slot.md = md;
+   slot.md.PutImageTag("Width", slot.width);
+   slot.md.PutImageTag("Height", slot.height);
+
+   boost::mutex::scoped_lock lock(mutex_);
+   lastSlot_ = slotIndex;
+   lastTimeMs_ = timeMs;
+   hasLastTime_ = true;
+}
+
+
+bool
+PreviewBuffer::GetLastImage(PreviewImage& image) const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (lastSlot_ < 0)
+      return false;
+   image = slots_[lastSlot_];
+   return true;
+}
+
+
+bool
+PreviewBuffer::GetLastImageFormat(unsigned& width, unsigned& height,
+      unsigned& byteDepth, unsigned& nComponents) const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (lastSlot_ < 0)
+      return false;
+   const PreviewImage& slot = slots_[lastSlot_];
+   width = slot.width;
+   height = slot.height;
+   byteDepth = slot.byteDepth;
+   nComponents = slot.nComponents;
+   return true;
+}
+
+
+void
+PreviewBuffer::Clear()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   lastSlot_ = -1;
+   hasLastTime_ = false;
+}
+
+} // namespace mm
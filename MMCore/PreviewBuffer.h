@@ -0,0 +1,119 @@
+// DESCRIPTION:   Decimated and downsampled copies of inserted images, for
+//                display
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+
+namespace mm
+{
+
+/**
+ * \brief A copy of a preview image and its format.
+ */
+struct PreviewImage
+{
+   PreviewImage() : width(0), height(0), byteDepth(0), nComponents(0) {}
+
+   std::vector<unsigned char> pixels;
+   unsigned width;
+   unsigned height;
+   unsigned byteDepth;
+   unsigned nComponents;
+   Metadata md;
+};
+
+/**
+ * \brief A small ring of preview images, fed from the circular buffer.
+ *
+ * At most one inserted image per interval is kept, binned by an integer
+ * factor (the pixels of each square of binning x binning pixels are
+ * averaged; a partial square at the right or bottom edge is dropped). The
+ * preview has its own lock, so that displaying images neither contends with
+ * the sequence acquisition nor reads full-size images.
+ *
+ * Binning is supported for 8- and 16-bit monochrome and for RGB32 and RGB64
+ * pixels; other images are previewed only if the binning is 1.
+ */
+class PreviewBuffer /* final */
+{
+public:
+   /// Largest binning factor, so that sums of 16-bit values fit in 32 bits
+   static const unsigned MaxBinning = 64;
+
+   PreviewBuffer();
+
+   /// Throws CMMError if binning is 0 or larger than MaxBinning
+   void SetBinning(unsigned binning);
+   unsigned GetBinning() const;
+   void SetIntervalMs(double intervalMs);
+   double GetIntervalMs() const;
+
+   /**
+    * \brief Store a downsampled copy of an image, unless the previous
+    * preview image arrived less than the interval before.
+    *
+    * Returns quickly if the image is not due. Must not be called
+    * concurrently with itself.
+    */
+   void Insert(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const Metadata& md,
+         double timeMs);
+
+   /**
+    * \brief Copy the most recent preview image.
+    *
+    * The pixels, format and metadata are copied under the lock, so they
+    * always belong to the same image, whatever is inserted meanwhile.
+    * Returns false, leaving image unchanged, if there is no preview image.
+    */
+   bool GetLastImage(PreviewImage& image) const;
+
+   /**
+    * \brief The format of the most recent preview image, without copying
+    * it.
+    *
+    * Returns false if there is no preview image.
+    */
+   bool GetLastImageFormat(unsigned& width, unsigned& height,
+         unsigned& byteDepth, unsigned& nComponents) const;
+
+   void Clear();
+
+private:
+   static const unsigned numSlots = 3;
+
+   mutable boost::mutex mutex_;
+   unsigned binning_;
+   double intervalMs_;
+   bool hasLastTime_;
+   double lastTimeMs_;
+   // Index of the most recent image in slots_, or -1 if none. Insert() only
+   // writes to a slot other than lastSlot_, and readers only copy from
+   // lastSlot_ while holding the lock.
+   int lastSlot_;
+   PreviewImage slots_[numSlots];
+   // Row sums used while binning; only accessed by Insert()
+   std::vector<boost::uint32_t> rowSums_;
+};
+
+} // namespace mm
@@ -0,0 +1,122 @@
+// DESCRIPTION:   Snaps an image on a separate thread, returning control to
+//                the caller at the end of the exposure
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SnapTask.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/bind.hpp>
+
+
+namespace mm
+{
+
+namespace
+{
+
+int
+RunStep(const SnapTask::Step& step)
+{
+   try
+   {
+      return step();
+   }
+   catch (...)
+   {
+      return DEVICE_ERR;
+   }
+}
+
+} // anonymous namespace
+
+
+SnapTask::SnapTask(long id, MMThreadLock* moduleLock, Step expose,
+      Step readout) :
+   id_(id),
+   moduleLock_(moduleLock),
+   expose_(expose),
+   readout_(readout),
+   exposureEnded_(false),
+   done_(false),
+   exposeResult_(DEVICE_OK),
+   result_(DEVICE_OK)
+{
+   boost::thread t(boost::bind(&SnapTask::Run, this));
+   thread_.swap(t);
+}
+
+
+SnapTask::~SnapTask()
+{
+   if (thread_.joinable())
+      thread_.join();
+}
+
+
+int
+SnapTask::WaitForExposureEnd()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   while (!exposureEnded_)
+      condition_.wait(lock);
+   return exposeResult_;
+}
+
+
+int
+SnapTask::WaitForReadout()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   while (!done_)
+      condition_.wait(lock);
+   return result_;
+}
+
+
+bool
+SnapTask::IsDone() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return done_;
+}
+
+
+void
+SnapTask::Run()
+{
+   int ret;
+   {
+      MMThreadGuard moduleGuard(moduleLock_);
+
+      ret = RunStep(expose_);
+      {
+         boost::mutex::scoped_lock lock(mutex_);
+         exposureEnded_ = true;
+         exposeResult_ = ret;
+         condition_.notify_all();
+      }
+
+      if (ret == DEVICE_OK)
+         ret = RunStep(readout_);
+   }
+
+   boost::mutex::scoped_lock lock(mutex_);
+   done_ = true;
+   result_ = ret;
+   condition_.notify_all();
+}
+
+} // namespace mm
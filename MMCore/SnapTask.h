@@ -0,0 +1,84 @@
+// DESCRIPTION:   Snaps an image on a separate thread, returning control to
+//                the caller at the end of the exposure
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/DeviceThreads.h"
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace mm
+{
+
+/**
+ * \brief Runs the exposure and the readout of a snapped image on a thread
+ * of its own.
+ *
+ * By the MM::Camera contract, SnapImage() returns when the exposure has
+ * ended, and GetImageBuffer() then waits for the readout. The caller can
+ * wait for the first step only, and do other work (closing the shutter,
+ * moving the stage) while the image is read out.
+ */
+class SnapTask /* final */
+{
+public:
+   /// A step of the snap, returning a device error code
+   typedef boost::function<int ()> Step;
+
+   /**
+    * Runs expose and then, if it succeeded, readout, holding moduleLock
+    * (if not null) throughout. Exceptions thrown by the steps are reported
+    * as DEVICE_ERR.
+    */
+   SnapTask(long id, MMThreadLock* moduleLock, Step expose, Step readout);
+   /// Waits for both steps to finish
+   ~SnapTask();
+
+   long GetId() const { return id_; }
+
+   /// Waits for the exposure to end; returns the error code of expose
+   int WaitForExposureEnd();
+   /**
+    * \brief Waits for the readout to finish.
+    *
+    * Returns the error code of the step that failed, or DEVICE_OK.
+    */
+   int WaitForReadout();
+   bool IsDone() const;
+
+private:
+   SnapTask(const SnapTask&);
+   SnapTask& operator=(const SnapTask&);
+
+   void Run();
+
+   const long id_;
+   MMThreadLock* moduleLock_;
+   Step expose_;
+   Step readout_;
+
+   boost::thread thread_;
+   mutable boost::mutex mutex_;
+   boost::condition_variable condition_;
+   // Guarded by mutex_
+   bool exposureEnded_;
+   bool done_;
+   int exposeResult_;
+   int result_;
+};
+
+} // namespace mm
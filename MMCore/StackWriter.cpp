@@ -0,0 +1,442 @@
+// DESCRIPTION:   Streams images from the circular buffer to a stack file
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "StackWriter.h"
+
+#include "CircularBuffer.h"
+#include "ErrorCodes.h"
+#include "FrameBuffer.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/bind.hpp>
+
+#include <cstring>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// Images are collected in buffers of this size before being written
+const size_t fileBufferSize = 8 << 20;
+
+// TIFF pages start on this boundary, so that the pixels of images whose size
+// is a multiple of it stay aligned
+const size_t tiffPageAlignment = 16;
+
+const boost::uint16_t tiffTypeShort = 3;
+const boost::uint16_t tiffTypeLong = 4;
+const boost::uint16_t tiffTypeLong8 = 16;
+
+bool
+HostIsLittleEndian()
+{
+   const boost::uint16_t test = 1;
+   return *reinterpret_cast<const unsigned char*>(&test) != 0;
+}
+
+size_t
+PadTo(size_t size, size_t alignment)
+{
+   return (size + alignment - 1) / alignment * alignment;
+}
+
+// BigTIFF directory entries, in the byte order of the host (the file is
+// marked accordingly, so that the pixels can be written unchanged)
+class TiffDirectory
+{
+public:
+   void Add(boost::uint16_t tag, boost::uint16_t type, boost::uint64_t count,
+         const void* value, size_t valueSize)
+   {
+      unsigned char entry[20] = { 0 };
+      std::memcpy(entry, &tag, 2);
+      std::memcpy(entry + 2, &type, 2);
+      std::memcpy(entry + 4, &count, 8);
+      std::memcpy(entry + 12, value, valueSize);
+      entries_.insert(entries_.end(), entry, entry + sizeof(entry));
+   }
+   void AddShort(boost::uint16_t tag, boost::uint16_t value)
+   { AddShorts(tag, value, 1); }
+   // Up to 4 equal values, which fit in the entry
+   void AddShorts(boost::uint16_t tag, boost::uint16_t value, unsigned count)
+   {
+      boost::uint16_t values[4] = { value, value, value, value };
+      Add(tag, tiffTypeShort, count, values, 2 * count);
+   }
+   void AddLong(boost::uint16_t tag, boost::uint32_t value)
+   { Add(tag, tiffTypeLong, 1, &value, 4); }
+   void AddLong8(boost::uint16_t tag, boost::uint64_t value)
+   { Add(tag, tiffTypeLong8, 1, &value, 8); }
+
+   size_t GetNumberOfEntries() const { return entries_.size() / 20; }
+   const std::vector<unsigned char>& GetEntries() const { return entries_; }
+
+private:
+   std::vector<unsigned char> entries_;
+};
+
+// Reorder BGRA pixels (as stored by the Core) to RGBA (as stored in TIFF)
+template <typename Component>
+void
+SwapRedAndBlue(const unsigned char* src, size_t numPixels, unsigned char* dest)
+{
+   const Component* in = reinterpret_cast<const Component*>(src);
+   Component* out = reinterpret_cast<Component*>(dest);
+   for (size_t i = 0; i < numPixels; ++i)
+   {
+      out[4 * i] = in[4 * i + 2];
+      out[4 * i + 1] = in[4 * i + 1];
+      out[4 * i + 2] = in[4 * i];
+      out[4 * i + 3] = in[4 * i + 3];
+   }
+}
+
+// Tag values are written in a single column; tabs and line breaks would
+// break the index
+std::string
+IndexSafe(std::string s)
+{
+   for (std::string::iterator it = s.begin(); it != s.end(); ++it)
+   {
+      if (*it == '\t' || *it == '\n' || *it == '\r')
+         *it = ' ';
+   }
+   return s;
+}
+
+} // anonymous namespace
+
+
+StackWriter::StackWriter(CircularBuffer& buffer, const std::string& path,
+      Format format, long maxFrames) :
+   buffer_(buffer),
+   path_(path),
+   format_(format),
+   maxFrames_(maxFrames),
+   cursor_(-1),
+   lastNextIfdOffset_(0),
+   running_(true),
+   finishRequested_(false),
+   abortRequested_(false),
+   frameCount_(0)
+{
+   file_.reset(new AlignedFileOutput(path, fileBufferSize, true));
+   const std::string indexPath = path + ".idx";
+   index_.open(indexPath.c_str(), std::ios::out | std::ios::trunc);
+   if (!index_)
+      throw CMMError("Cannot open file " + indexPath + " for writing",
+            MMERR_FileOpenFailed);
+   index_ << "# offset\tbytes\twidth\theight\tbytesPerPixel\tcomponents\t"
+      "tags (key=value)\n";
+
+   if (format_ == FormatBigTiff)
+      WriteTiffHeader();
+
+   cursor_ = buffer_.AddCursor(false, true);
+   boost::thread t(boost::bind(&StackWriter::Run, this));
+   thread_.swap(t);
+}
+
+
+StackWriter::~StackWriter()
+{
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      abortRequested_ = true;
+      condition_.notify_all();
+   }
+   if (thread_.joinable())
+      thread_.join();
+   try
+   {
+      CloseFiles();
+   }
+   catch (const CMMError&)
+   {
+   }
+}
+
+
+void
+StackWriter::Finish() throw (CMMError)
+{
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      finishRequested_ = true;
+      condition_.notify_all();
+   }
+   if (thread_.joinable())
+      thread_.join();
+
+   try
+   {
+      CloseFiles();
+   }
+   catch (const CMMError& e)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (errorText_.empty())
+         errorText_ = e.getMsg();
+   }
+
+   boost::mutex::scoped_lock lock(mutex_);
+   if (!errorText_.empty())
+      throw CMMError(errorText_);
+}
+
+
+bool
+StackWriter::IsRunning() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return running_;
+}
+
+
+long
+StackWriter::GetFrameCount() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return frameCount_;
+}
+
+
+void
+StackWriter::Run()
+{
+   try
+   {
+      for (;;)
+      {
+         {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (abortRequested_ ||
+                  (maxFrames_ > 0 && frameCount_ >= maxFrames_))
+               break;
+         }
+
+         // The image stays in the buffer until it has been written, and the
+         // buffer is not reallocated meanwhile
+         CircularBuffer::ReadLock readLock(buffer_.GetReadMutex());
+         const ImgBuffer* image = buffer_.PeekNextImageBuffer(cursor_, 0);
+         if (image)
+         {
+            WriteFrame(*image);
+            buffer_.AdvanceCursor(cursor_);
+            boost::mutex::scoped_lock lock(mutex_);
+            ++frameCount_;
+            continue;
+         }
+
+         // Nothing to write; when finishing, the buffer has been drained
+         readLock.unlock();
+         boost::mutex::scoped_lock lock(mutex_);
+         if (finishRequested_ || abortRequested_)
+            break;
+         condition_.timed_wait(lock, boost::posix_time::milliseconds(2));
+      }
+   }
+   catch (const CMMError& e)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      errorText_ = e.getMsg();
+   }
+
+   // Images must not be held for a writer that no longer reads them
+   try
+   {
+      buffer_.RemoveCursor(cursor_);
+   }
+   catch (const CMMError&)
+   {
+   }
+
+   boost::mutex::scoped_lock lock(mutex_);
+   running_ = false;
+}
+
+
+void
+StackWriter::WriteFrame(const ImgBuffer& image) throw (CMMError)
+{
+   Metadata md = image.GetMetadata();
+   unsigned nComponents = 1;
+   if (md.HasTag("PixelType"))
+   {
+      const std::string pixelType = md.GetSingleTag("PixelType").GetValue();
+      if (pixelType.compare(0, 3, "RGB") == 0)
+         nComponents = 4;
+   }
+   if (image.Depth() % nComponents != 0)
+      nComponents = 1;
+
+   const size_t pixelBytes =
+      static_cast<size_t>(image.Width()) * image.Height() * image.Depth();
+   boost::uint64_t pixelOffset;
+   size_t storedBytes = pixelBytes;
+   if (format_ == FormatBigTiff)
+   {
+      WriteTiffPage(image, nComponents);
+      pixelOffset = file_->GetSize() - PadTo(pixelBytes, tiffPageAlignment);
+   }
+   else if (format_ == FormatCompressedRaw)
+   {
+      pixelOffset = file_->GetSize();
+      codec_.Compress(image.GetPixels(), pixelBytes,
+            image.Depth() / nComponents, compressed_);
+      file_->Append(&compressed_[0], compressed_.size());
+      storedBytes = compressed_.size();
+   }
+   else
+   {
+      pixelOffset = file_->GetSize();
+      WritePixels(image, nComponents);
+   }
+   WriteIndexEntry(pixelOffset, storedBytes, image, nComponents, md);
+}
+
+
+void
+StackWriter::WriteTiffHeader() throw (CMMError)
+{
+   unsigned char header[16];
+   const char* byteOrder = HostIsLittleEndian() ? "II" : "MM";
+   const boost::uint16_t version = 43;
+   const boost::uint16_t offsetSize = 8;
+   const boost::uint16_t reserved = 0;
+   const boost::uint64_t firstIfd = sizeof(header);
+   std::memcpy(header, byteOrder, 2);
+   std::memcpy(header + 2, &version, 2);
+   std::memcpy(header + 4, &offsetSize, 2);
+   std::memcpy(header + 6, &reserved, 2);
+   std::memcpy(header + 8, &firstIfd, 8);
+   file_->Append(header, sizeof(header));
+   // A file without pages has no first directory
+   lastNextIfdOffset_ = 8;
+}
+
+
+void
+StackWriter::WriteTiffPage(const ImgBuffer& image, unsigned nComponents)
+   throw (CMMError)
+{
+   // The directory precedes the pixels, so that the offset of the next
+   // directory is known when writing it; the last page's link is set to 0
+   // when closing
+   const size_t componentBytes = image.Depth() / nComponents;
+   const size_t pixelBytes =
+      static_cast<size_t>(image.Width()) * image.Height() * image.Depth();
+   const bool rgb = (nComponents == 4);
+
+   TiffDirectory dir;
+   const size_t numEntries = rgb ? 11 : 10;
+   const size_t dirSize = PadTo(8 + 20 * numEntries + 8, tiffPageAlignment);
+   const boost::uint64_t dirOffset = file_->GetSize();
+   const boost::uint64_t pixelOffset = dirOffset + dirSize;
+   const boost::uint64_t nextDirOffset =
+      pixelOffset + PadTo(pixelBytes, tiffPageAlignment);
+
+   dir.AddLong(256, image.Width()); // ImageWidth
+   dir.AddLong(257, image.Height()); // ImageLength
+   dir.AddShorts(258, static_cast<boost::uint16_t>(8 * componentBytes),
+         nComponents); // BitsPerSample
+   dir.AddShort(259, 1); // Compression: none
+   dir.AddShort(262, rgb ? 2 : 1); // PhotometricInterpretation
+   dir.AddLong8(273, pixelOffset); // StripOffsets
+   dir.AddShort(277, static_cast<boost::uint16_t>(nComponents)); // SamplesPerPixel
+   dir.AddLong(278, image.Height()); // RowsPerStrip
+   dir.AddLong8(279, pixelBytes); // StripByteCounts
+   dir.AddShort(284, 1); // PlanarConfiguration: chunky
+   if (rgb)
+      dir.AddShort(338, 2); // ExtraSamples: unassociated alpha
+
+   std::vector<unsigned char> block(dirSize, 0);
+   const boost::uint64_t count = dir.GetNumberOfEntries();
+   std::memcpy(&block[0], &count, 8);
+   std::memcpy(&block[8], &dir.GetEntries()[0], dir.GetEntries().size());
+   std::memcpy(&block[8 + dir.GetEntries().size()], &nextDirOffset, 8);
+   file_->Append(&block[0], block.size());
+   lastNextIfdOffset_ = dirOffset + 8 + dir.GetEntries().size();
+
+   WritePixels(image, nComponents);
+   file_->AppendZeros(PadTo(pixelBytes, tiffPageAlignment) - pixelBytes);
+}
+
+
+void
+StackWriter::WritePixels(const ImgBuffer& image, unsigned nComponents)
+   throw (CMMError)
+{
+   const size_t rowBytes = static_cast<size_t>(image.Width()) * image.Depth();
+   if (format_ != FormatBigTiff || nComponents != 4)
+   {
+      file_->Append(image.GetPixels(), rowBytes * image.Height());
+      return;
+   }
+
+   rowBuffer_.resize(rowBytes);
+   for (unsigned y = 0; y < image.Height(); ++y)
+   {
+      const unsigned char* row = image.GetPixels() + y * rowBytes;
+      if (image.Depth() == 8)
+         SwapRedAndBlue<boost::uint16_t>(row, image.Width(), &rowBuffer_[0]);
+      else
+         SwapRedAndBlue<unsigned char>(row, image.Width(), &rowBuffer_[0]);
+      file_->Append(&rowBuffer_[0], rowBytes);
+   }
+}
+
+
+void
+StackWriter::WriteIndexEntry(boost::uint64_t offset, size_t bytes,
+      const ImgBuffer& image, unsigned nComponents, const Metadata& md)
+{
+   index_ << offset << '\t' << bytes << '\t' << image.Width() << '\t' << image.Height() << '\t' <<
+      image.Depth() << '\t' << nComponents;
+   const std::vector<std::string> keys = md.GetKeys();
+   for (std::vector<std::string>::const_iterator it = keys.begin(),
+         end = keys.end(); it != end; ++it)
+   {
+      index_ << '\t' << IndexSafe(*it) << '=' <<
+         IndexSafe(md.GetSingleTag(it->c_str()).GetValue());
+   }
+   index_ << '\n';
+}
+
+
+void
+StackWriter::CloseFiles() throw (CMMError)
+{
+   if (!file_)
+      return;
+
+   if (format_ == FormatBigTiff && lastNextIfdOffset_ != 0)
+   {
+      const boost::uint64_t zero = 0;
+      file_->Patch(lastNextIfdOffset_, &zero, sizeof(zero));
+   }
+   index_.close();
+   boost::scoped_ptr<AlignedFileOutput> file;
+   file.swap(file_);
+   file->Close();
+   if (index_.fail())
+      throw CMMError("Cannot write file " + path_ + ".idx");
+}
+
+} // namespace mm
@@ -0,0 +1,124 @@
+// DESCRIPTION:   Streams images from the circular buffer to a stack file
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "AlignedFileOutput.h"
+#include "Error.h"
+#include "FrameCodec.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+class CircularBuffer;
+class Metadata;
+
+namespace mm
+{
+
+class ImgBuffer;
+
+/**
+ * \brief Writes the images inserted into the circular buffer to a file, on
+ * its own thread.
+ *
+ * The writer reads the buffer through a cursor that owns the images, so
+ * images are not discarded before they are written (but are once written,
+ * whether or not they have been retrieved with GetNextImage()), and are
+ * written straight from the buffer without being copied out of the Core.
+ * Channel 0 of each image is written.
+ *
+ * Three formats are supported: a multi-page BigTIFF file, a raw file of
+ * the pixels of each image, one after the other, and a raw file of the
+ * images each compressed with FrameCodec. In all cases, an index file (the
+ * file name followed by ".idx") lists the offset, stored size and metadata
+ * of each image, one image per line, in tab-separated columns.
+ */
+class StackWriter /* final */
+{
+public:
+   enum Format
+   {
+      FormatBigTiff,
+      FormatRaw,
+      FormatCompressedRaw
+   };
+
+   /**
+    * Opens the files and starts writing the images inserted from now on.
+    * Writing ends after maxFrames images, unless maxFrames is 0 or less.
+    * Throws CMMError if the files cannot be created.
+    */
+   StackWriter(CircularBuffer& buffer, const std::string& path,
+         Format format, long maxFrames);
+   /// Stops writing without waiting for the remaining images
+   ~StackWriter();
+
+   /**
+    * \brief Writes the images remaining in the buffer, then closes the files.
+    *
+    * Throws CMMError if writing failed.
+    */
+   void Finish() throw (CMMError);
+
+   bool IsRunning() const;
+   long GetFrameCount() const;
+
+private:
+   StackWriter(const StackWriter&);
+   StackWriter& operator=(const StackWriter&);
+
+   void Run();
+   void WriteFrame(const ImgBuffer& image) throw (CMMError);
+   void WriteTiffHeader() throw (CMMError);
+   void WriteTiffPage(const ImgBuffer& image, unsigned nComponents)
+      throw (CMMError);
+   void WritePixels(const ImgBuffer& image, unsigned nComponents)
+      throw (CMMError);
+   void WriteIndexEntry(boost::uint64_t offset, size_t bytes,
+         const ImgBuffer& image, unsigned nComponents, const Metadata& md);
+   void CloseFiles() throw (CMMError);
+
+   CircularBuffer& buffer_;
+   const std::string path_;
+   const Format format_;
+   const long maxFrames_;
+   int cursor_;
+   boost::scoped_ptr<AlignedFileOutput> file_;
+   std::ofstream index_;
+   // Offset of the next-IFD field of the last TIFF page, or 0
+   boost::uint64_t lastNextIfdOffset_;
+   // Row being reordered from BGRA to RGBA
+   std::vector<unsigned char> rowBuffer_;
+   FrameCodec codec_;
+   std::vector<unsigned char> compressed_;
+
+   boost::thread thread_;
+   mutable boost::mutex mutex_;
+   boost::condition_variable condition_;
+   // Guarded by mutex_
+   bool running_;
+   bool finishRequested_;
+   bool abortRequested_;
+   long frameCount_;
+   std::string errorText_;
+};
+
+} // namespace mm
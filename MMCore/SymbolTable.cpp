@@ -0,0 +1,239 @@
+// DESCRIPTION:   Interned strings for device labels and property names
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SymbolTable.h"
+
+#include <boost/atomic.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstring>
+#include <vector>
+
+
+namespace mm
+{
+
+namespace
+{
+
+// A character range, so that C strings can be looked up without first
+// copying them into a std::string.
+struct CharRange
+{
+   CharRange(const char* b, const char* e) : begin(b), end(e) {}
+   const char* begin;
+   const char* end;
+};
+
+// Strings and CharRanges must hash identically, so hash both explicitly as
+// character ranges
+struct CharRangeHash
+{
+   std::size_t operator()(const CharRange& r) const
+   { return boost::hash_range(r.begin, r.end); }
+   std::size_t operator()(const std::string& s) const
+   { return boost::hash_range(s.data(), s.data() + s.size()); }
+};
+
+struct CharRangeEqual
+{
+   bool operator()(const CharRange& r, const std::string& s) const
+   {
+      const std::size_t length = r.end - r.begin;
+      return length == s.size() &&
+         std::memcmp(r.begin, s.data(), length) == 0;
+   }
+};
+
+// An interned string. Never destroyed, as lock-free readers may hold it.
+struct Entry
+{
+   Entry(const std::string& n, Symbol s) : name(n), symbol(s) {}
+   const std::string name;
+   const Symbol symbol;
+};
+
+// Open-addressing hash table whose slots, once filled, never change, so
+// that it can be searched without locking.
+struct Slots
+{
+   explicit Slots(std::size_t capacity) :
+      mask(capacity - 1),
+      entries(new boost::atomic<const Entry*>[capacity])
+   {
+      for (std::size_t i = 0; i < capacity; ++i)
+         entries[i].store(0, boost::memory_order_relaxed);
+   }
+
+   std::size_t Capacity() const { return mask + 1; }
+
+   // Only called with the table's mutex held
+   void Insert(const Entry* entry)
+   {
+      std::size_t i = CharRangeHash()(entry->name) & mask;
+      while (entries[i].load(boost::memory_order_relaxed))
+         i = (i + 1) & mask;
+      entries[i].store(entry, boost::memory_order_release);
+   }
+
+   const std::size_t mask;
+   boost::scoped_array< boost::atomic<const Entry*> > entries;
+};
+
+class Table
+{
+   // Serializes interning; lookups do not lock
+   boost::mutex mutex_;
+   boost::atomic<const Slots*> slots_;
+   std::vector<const Entry*> names_; // Indexed by symbol; guarded by mutex_
+
+public:
+   Table()
+   {
+      Slots* slots = new Slots(256);
+      const Entry* empty = new Entry(std::string(), NullSymbol);
+      slots->Insert(empty);
+      names_.push_back(empty);
+      slots_.store(slots, boost::memory_order_release);
+   }
+
+   bool Find(const CharRange& name, Symbol& symbol) const
+   {
+      const Slots* slots = slots_.load(boost::memory_order_acquire);
+      std::size_t i = CharRangeHash()(name) & slots->mask;
+      for (;;)
+      {
+         const Entry* entry = slots->entries[i].load(boost::memory_order_acquire);
+         if (!entry)
+            return false;
+         if (CharRangeEqual()(name, entry->name))
+         {
+            symbol = entry->symbol;
+            return true;
+         }
+         i = (i + 1) & slots->mask;
+      }
+   }
+
+   Symbol Intern(const CharRange& name)
+   {
+      Symbol symbol;
+      if (Find(name, symbol))
+         return symbol;
+
+      boost::mutex::scoped_lock lock(mutex_);
+      if (Find(name, symbol)) // Interned while we waited for the lock
+         return symbol;
+
+      symbol = static_cast<Symbol>(names_.size());
+      const Entry* entry = new Entry(std::string(name.begin, name.end), symbol);
+      names_.push_back(entry);
+
+      Slots* slots = const_cast<Slots*>(slots_.load(boost::memory_order_relaxed));
+      if (2 * names_.size() > slots->Capacity())
+      {
+         // Publish a larger copy. The old table is leaked, because readers
+         // may still be searching it; the tables' total size is bounded by
+         // twice the final size.
+         Slots* larger = new Slots(2 * slots->Capacity());
+         for (std::vector<const Entry*>::const_iterator it = names_.begin(),
+               end = names_.end(); it != end; ++it)
+            larger->Insert(*it);
+         slots_.store(larger, boost::memory_order_release);
+      }
+      else
+      {
+         slots->Insert(entry);
+      }
+      return symbol;
+   }
+
+   std::string Name(Symbol symbol)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (symbol >= names_.size())
+         return std::string();
+      return names_[symbol]->name;
+   }
+};
+
+Table&
+GetTable()
+{
+   // Never destroyed, so that it remains usable during static destruction
+   static Table* table = new Table();
+   return *table;
+}
+
+// Make sure the table is constructed before any threads are started
+struct TableInitializer
+{
+   TableInitializer() { GetTable(); }
+} tableInitializer;
+
+CharRange
+MakeRange(const std::string& s)
+{
+   return CharRange(s.data(), s.data() + s.size());
+}
+
+CharRange
+MakeRange(const char* s)
+{
+   if (!s)
+      return CharRange(0, 0);
+   return CharRange(s, s + std::strlen(s));
+}
+
+} // anonymous namespace
+
+
+Symbol
+SymbolTable::Intern(const std::string& name)
+{
+   return GetTable().Intern(MakeRange(name));
+}
+
+
+Symbol
+SymbolTable::Intern(const char* name)
+{
+   return GetTable().Intern(MakeRange(name));
+}
+
+
+bool
+SymbolTable::Find(const std::string& name, Symbol& symbol)
+{
+   return GetTable().Find(MakeRange(name), symbol);
+}
+
+
+bool
+SymbolTable::Find(const char* name, Symbol& symbol)
+{
+   return GetTable().Find(MakeRange(name), symbol);
+}
+
+
+std::string
+SymbolTable::Name(Symbol symbol)
+{
+   return GetTable().Name(symbol);
+}
+
+} // namespace mm
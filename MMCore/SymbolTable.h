@@ -0,0 +1,77 @@
+// DESCRIPTION:   Interned strings for device labels and property names
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <string>
+
+
+namespace mm
+{
+
+/**
+ * \brief Integer id of an interned string.
+ *
+ * Equal strings have equal symbols for the lifetime of the process, so that
+ * symbols can be compared and hashed in place of the strings. The empty
+ * string is always NullSymbol.
+ */
+typedef unsigned Symbol;
+
+const Symbol NullSymbol = 0;
+
+
+/**
+ * \brief The process-wide table of interned strings.
+ *
+ * Used for device labels and property names, which form a small set of
+ * strings that are looked up very frequently. Interned strings are never
+ * removed, so arbitrary (e.g. user-supplied) strings should be looked up
+ * with Find() rather than interned.
+ *
+ * All functions are thread-safe. Looking up a string that is already
+ * interned (with Find() or Intern()) does not take a lock.
+ */
+class SymbolTable /* final */
+{
+public:
+   /**
+    * \brief Get the symbol for a string, interning it if necessary.
+    */
+   ///@{
+   static Symbol Intern(const std::string& name);
+   static Symbol Intern(const char* name);
+   ///@}
+
+   /**
+    * \brief Get the symbol for a string only if it is already interned.
+    *
+    * \return false if the string has not been interned.
+    */
+   ///@{
+   static bool Find(const std::string& name, Symbol& symbol);
+   static bool Find(const char* name, Symbol& symbol);
+   ///@}
+
+   /**
+    * \brief Get the string for a symbol.
+    */
+   static std::string Name(Symbol symbol);
+
+private:
+   SymbolTable();
+};
+
+} // namespace mm
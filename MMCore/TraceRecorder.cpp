@@ -0,0 +1,241 @@
+// DESCRIPTION:   In-memory recording of Core activity as trace events
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+
+namespace mm
+{
+
+namespace
+{
+
+void
+WriteJSONString(std::ostream& out, const char* s)
+{
+   out << '"';
+   for (; *s; ++s)
+   {
+      const unsigned char ch = static_cast<unsigned char>(*s);
+      switch (ch)
+      {
+         case '"': out << "\\\""; break;
+         case '\\': out << "\\\\"; break;
+         case '\n': out << "\\n"; break;
+         case '\r': out << "\\r"; break;
+         case '\t': out << "\\t"; break;
+         default:
+            if (ch < 0x20)
+            {
+               char buf[8];
+               std::sprintf(buf, "\\u%04x", ch);
+               out << buf;
+            }
+            else
+            {
+               out << *s;
+            }
+      }
+   }
+   out << '"';
+}
+
+struct CompareFirst
+{
+   template <typename T>
+   bool operator()(const T& lhs, const T& rhs) const
+   { return lhs.first < rhs.first; }
+};
+
+} // anonymous namespace
+
+
+const size_t TraceRecorder::DefaultCapacity;
+const size_t TraceRecorder::MaxArgLength;
+
+TraceRecorder::TraceRecorder(size_t capacity) :
+   capacity_(std::max<size_t>(capacity, 1)),
+   enabled_(false),
+   next_(0)
+{
+}
+
+
+void
+TraceRecorder::SetEnabled(bool enable)
+{
+   if (enable)
+   {
+      boost::mutex::scoped_lock lock(allocationMutex_);
+      if (!slots_)
+      {
+         slots_.reset(new Slot[capacity_]);
+         for (size_t i = 0; i < capacity_; ++i)
+            slots_[i].sequence.store(0, boost::memory_order_relaxed);
+      }
+   }
+   // Publishes the slots to recording threads
+   enabled_.store(enable, boost::memory_order_release);
+}
+
+
+void
+TraceRecorder::RecordSpan(const char* category, const char* name,
+      const char* argName, const char* argValue,
+      boost::int64_t startUs, boost::int64_t durationUs)
+{
+   if (!IsEnabled())
+      return;
+
+   const boost::uint64_t index = next_.fetch_add(1, boost::memory_order_relaxed);
+   Slot& slot = slots_[index % capacity_];
+
+   // The sequence is cleared while the event is written, so that readers
+   // can detect a torn event (as with a seqlock)
+   slot.sequence.store(0, boost::memory_order_relaxed);
+   boost::atomic_thread_fence(boost::memory_order_release);
+
+   Event& event = slot.event;
+   event.category = category;
+   event.name = name;
+   event.argName = argValue && argValue[0] ? argName : 0;
+   std::strncpy(event.argValue, argValue ? argValue : "", MaxArgLength);
+   event.argValue[MaxArgLength] = '\0';
+   event.startUs = startUs;
+   event.durationUs = durationUs;
+   event.tid = logging::internal::GetTid();
+
+   slot.sequence.store(index + 1, boost::memory_order_release);
+}
+
+
+void
+TraceRecorder::Clear()
+{
+   boost::mutex::scoped_lock lock(allocationMutex_);
+   if (!slots_)
+      return;
+   for (size_t i = 0; i < capacity_; ++i)
+      slots_[i].sequence.store(0, boost::memory_order_relaxed);
+}
+
+
+size_t
+TraceRecorder::GetEventCount() const
+{
+   boost::mutex::scoped_lock lock(allocationMutex_);
+   if (!slots_)
+      return 0;
+   size_t count = 0;
+   for (size_t i = 0; i < capacity_; ++i)
+   {
+      if (slots_[i].sequence.load(boost::memory_order_relaxed) != 0)
+         ++count;
+   }
+   return count;
+}
+
+
+void
+TraceRecorder::WriteJSON(std::ostream& out) const
+{
+   std::vector< std::pair<boost::uint64_t, Event> > events;
+   {
+      boost::mutex::scoped_lock lock(allocationMutex_);
+      if (slots_)
+      {
+         events.reserve(capacity_);
+         for (size_t i = 0; i < capacity_; ++i)
+         {
+            const Slot& slot = slots_[i];
+            const boost::uint64_t sequence =
+               slot.sequence.load(boost::memory_order_acquire);
+            if (sequence == 0)
+               continue;
+            Event event = slot.event;
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            if (slot.sequence.load(boost::memory_order_relaxed) != sequence)
+               continue; // Overwritten while being copied
+            events.push_back(std::make_pair(sequence, event));
+         }
+      }
+   }
+   std::sort(events.begin(), events.end(), CompareFirst());
+
+   std::map<logging::internal::ThreadIdType, unsigned> threadNumbers;
+   std::vector<logging::internal::ThreadIdType> threads;
+
+   out << "{\"traceEvents\":[";
+   bool first = true;
+   for (size_t i = 0; i < events.size(); ++i)
+   {
+      const Event& event = events[i].second;
+
+      std::map<logging::internal::ThreadIdType, unsigned>::const_iterator
+         found = threadNumbers.find(event.tid);
+      unsigned threadNumber;
+      if (found != threadNumbers.end())
+      {
+         threadNumber = found->second;
+      }
+      else
+      {
+         threadNumber = static_cast<unsigned>(threads.size() + 1);
+         threadNumbers[event.tid] = threadNumber;
+         threads.push_back(event.tid);
+      }
+
+      out << (first ? "\n" : ",\n");
+      first = false;
+      out << "{\"name\":";
+      WriteJSONString(out, event.name);
+      out << ",\"cat\":";
+      WriteJSONString(out, event.category);
+      out << ",\"ph\":\"X\",\"ts\":" << event.startUs <<
+         ",\"dur\":" << event.durationUs <<
+         ",\"pid\":1,\"tid\":" << threadNumber;
+      if (event.argName)
+      {
+         out << ",\"args\":{";
+         WriteJSONString(out, event.argName);
+         out << ':';
+         WriteJSONString(out, event.argValue);
+         out << '}';
+      }
+      out << '}';
+   }
+
+   for (size_t i = 0; i < threads.size(); ++i)
+   {
+      std::ostringstream threadName;
+      threadName << "tid" << threads[i];
+      out << (first ? "\n" : ",\n");
+      first = false;
+      out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" <<
+         (i + 1) << ",\"args\":{\"name\":";
+      WriteJSONString(out, threadName.str().c_str());
+      out << "}}";
+   }
+   out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+} // namespace mm
@@ -0,0 +1,165 @@
+// DESCRIPTION:   In-memory recording of Core activity as trace events
+//
+// COPYRIGHT:     University of California, San Francisco, 2014
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Logging/Metadata.h"
+#include "MonotonicClock.h"
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+
+namespace mm
+{
+
+/**
+ * \brief Records timed spans of Core activity into a fixed-size ring.
+ *
+ * Recording is lock-free and may be done from any thread; when the ring is
+ * full, the oldest events are overwritten. The recorded events can be
+ * written in the Chrome trace event JSON format, which can be opened in
+ * chrome://tracing or the Perfetto UI.
+ *
+ * The category, name and argument name of events must be string literals (or
+ * otherwise outlive the recorder); the argument value is copied (truncated
+ * to MaxArgLength).
+ *
+ * The ring is allocated when recording is first enabled.
+ */
+class TraceRecorder /* final */
+{
+public:
+   static const size_t DefaultCapacity = 65536;
+   static const size_t MaxArgLength = 63;
+
+   explicit TraceRecorder(size_t capacity = DefaultCapacity);
+
+   void SetEnabled(bool enable);
+   bool IsEnabled() const { return enabled_.load(boost::memory_order_acquire); }
+
+   void RecordSpan(const char* category, const char* name,
+         const char* argName, const char* argValue,
+         boost::int64_t startUs, boost::int64_t durationUs);
+
+   /**
+    * \brief Discard all recorded events.
+    *
+    * Events being recorded concurrently may or may not be discarded.
+    */
+   void Clear();
+
+   /// Number of events currently held (at most the capacity)
+   size_t GetEventCount() const;
+
+   /**
+    * \brief Write the recorded events as a Chrome trace event JSON object.
+    *
+    * Threads are numbered in order of appearance and named after their OS
+    * thread id, as printed in the log.
+    */
+   void WriteJSON(std::ostream& out) const;
+
+private:
+   TraceRecorder(const TraceRecorder&);
+   TraceRecorder& operator=(const TraceRecorder&);
+
+   struct Event
+   {
+      const char* category;
+      const char* name;
+      const char* argName;
+      char argValue[MaxArgLength + 1];
+      boost::int64_t startUs;
+      boost::int64_t durationUs;
+      logging::internal::ThreadIdType tid;
+   };
+
+   struct Slot
+   {
+      // Index of the event plus one; 0 while empty or being written
+      boost::atomic<boost::uint64_t> sequence;
+      Event event;
+   };
+
+   const size_t capacity_;
+   mutable boost::mutex allocationMutex_;
+   boost::scoped_array<Slot> slots_; // Allocated before first enabled
+   boost::atomic<bool> enabled_;
+   boost::atomic<boost::uint64_t> next_;
+};
+
+
+/**
+ * \brief Records the time from construction to destruction as a trace span,
+ * if the recorder is enabled.
+ *
+ * The recorder may be null.
+ */
+class TraceScope /* final */
+{
+public:
+   TraceScope(TraceRecorder* trace, const char* category, const char* name) :
+      trace_(trace && trace->IsEnabled() ? trace : 0),
+      category_(category),
+      name_(name),
+      argName_(0),
+      startUs_(trace_ ? MonotonicClock::NowUs() : 0)
+   {
+      argValue_[0] = '\0';
+   }
+
+   ~TraceScope()
+   {
+      if (trace_)
+         trace_->RecordSpan(category_, name_, argName_, argValue_,
+               startUs_, MonotonicClock::NowUs() - startUs_);
+   }
+
+   /// Whether the span will be recorded; can be used to skip formatting
+   bool IsActive() const { return trace_ != 0; }
+
+   /// Set the (single) argument attached to the span
+   void SetArg(const char* name, const char* value)
+   {
+      if (!trace_)
+         return;
+      argName_ = name;
+      std::strncpy(argValue_, value ? value : "", TraceRecorder::MaxArgLength);
+      argValue_[TraceRecorder::MaxArgLength] = '\0';
+   }
+
+   void SetArg(const char* name, const std::string& value)
+   { SetArg(name, value.c_str()); }
+
+private:
+   TraceScope(const TraceScope&);
+   TraceScope& operator=(const TraceScope&);
+
+   TraceRecorder* const trace_;
+   const char* const category_;
+   const char* const name_;
+   const char* argName_;
+   char argValue_[TraceRecorder::MaxArgLength + 1];
+   const boost::int64_t startUs_;
+};
+
+} // namespace mm
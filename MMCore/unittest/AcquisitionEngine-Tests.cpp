@@ -0,0 +1,278 @@
+#include <gtest/gtest.h>
+
+#include "AcquisitionEngine.h"
+#include "AcquisitionPlan.h"
+#include "CoreUtils.h"
+#include "Error.h"
+#include "MMCore.h"
+#include "TestAdapters.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace mm;
+
+
+// These tests use the SequenceTester (and for multi-ROI, the DemoCamera)
+// adapter; see TestAdapters.h for how adapters are found.
+class AcquisitionEngineCoreTests : public ::testing::Test
+{
+protected:
+   CMMCore core_;
+   bool haveAdapter_;
+
+   virtual void SetUp()
+   {
+      test::SetAdapterSearchPaths(core_);
+      haveAdapter_ = test::HaveAdapter(core_, "SequenceTester");
+      if (!haveAdapter_)
+         return;
+
+      core_.loadDevice("Hub", "SequenceTester", "THub");
+      core_.loadDevice("Cam", "SequenceTester", "TCamera-0");
+      core_.loadDevice("Z", "SequenceTester", "TZStage-0");
+      core_.setParentLabel("Cam", "Hub");
+      core_.setParentLabel("Z", "Hub");
+      core_.initializeAllDevices();
+      core_.setCameraDevice("Cam");
+      core_.setFocusDevice("Z");
+      core_.enableDeviceCallTiming(true);
+   }
+
+   static AcquisitionPlan ThreeSlicePlan()
+   {
+      AcquisitionPlan plan;
+      std::vector<double> slices;
+      slices.push_back(1.0);
+      slices.push_back(2.0);
+      slices.push_back(3.0);
+      plan.setZSlices(slices, false);
+      return plan;
+   }
+
+   // Pops the images and checks that they are the slices in order
+   void ExpectSlices(long nSlices)
+   {
+      ASSERT_EQ(nSlices, core_.getRemainingImageCount());
+      for (long i = 0; i < nSlices; ++i)
+      {
+         Metadata md;
+         core_.popNextImageMD(md);
+         EXPECT_EQ(ToString(i), md.GetSingleTag("SliceIndex").GetValue());
+         EXPECT_EQ("0", md.GetSingleTag("FrameIndex").GetValue());
+      }
+   }
+};
+
+namespace
+{
+
+void WaitForPlan(CMMCore* core, bool* failed)
+{
+   try
+   {
+      core->waitForAcquisitionPlan();
+   }
+   catch (const CMMError&)
+   {
+      *failed = true;
+   }
+}
+
+} // anonymous namespace
+
+
+TEST(AcquisitionEngineTests, ChannelsChangeFastestByDefault)
+{
+   AcquisitionPlan plan;
+   plan.setChannelGroup("Channel");
+   plan.addChannel("DAPI", 10.0);
+   plan.addChannel("FITC", 20.0);
+   std::vector<double> slices;
+   slices.push_back(-1.0);
+   slices.push_back(0.0);
+   slices.push_back(1.0);
+   plan.setZSlices(slices, true);
+
+   std::vector<AcquisitionEvent> events =
+      AcquisitionEngine::CompileBlock(plan, 3, 0, 100.0);
+   ASSERT_EQ(6u, events.size());
+   for (size_t i = 0; i < events.size(); ++i)
+   {
+      EXPECT_EQ(3, events[i].frameIndex);
+      EXPECT_EQ(long(i / 2), events[i].sliceIndex);
+      EXPECT_EQ(long(i % 2), events[i].channelIndex);
+      EXPECT_TRUE(events[i].hasZ);
+      EXPECT_DOUBLE_EQ(99.0 + double(i / 2), events[i].z);
+      EXPECT_FALSE(events[i].hasXY);
+   }
+   EXPECT_EQ("FITC", events[1].channelPreset);
+   EXPECT_DOUBLE_EQ(20.0, events[1].exposureMs);
+
+   Metadata tags = events[5].GetTags();
+   EXPECT_EQ("2", tags.GetSingleTag("SliceIndex").GetValue());
+   EXPECT_EQ("FITC", tags.GetSingleTag("Channel").GetValue());
+}
+
+TEST(AcquisitionEngineTests, SlicesFirstAndPositions)
+{
+   AcquisitionPlan plan;
+   plan.addXYPosition(1.0, 2.0);
+   plan.addXYPosition(3.0, 4.0);
+   plan.setChannelGroup("Channel");
+   plan.addChannel("DAPI", 0.0);
+   plan.addChannel("FITC", 0.0);
+   std::vector<double> slices;
+   slices.push_back(5.0);
+   slices.push_back(6.0);
+   plan.setZSlices(slices, false);
+   plan.setSlicesFirst(true);
+   plan.setTimePoints(3, 1000.0);
+   EXPECT_EQ(3 * 2 * 2 * 2, plan.getNumberOfImages());
+
+   std::vector<AcquisitionEvent> events =
+      AcquisitionEngine::CompileBlock(plan, 0, 1, 100.0);
+   ASSERT_EQ(4u, events.size());
+   EXPECT_EQ(1, events[1].sliceIndex);
+   EXPECT_EQ(0, events[1].channelIndex);
+   EXPECT_EQ(1, events[2].channelIndex);
+   EXPECT_DOUBLE_EQ(6.0, events[1].z);
+   EXPECT_TRUE(events[0].hasXY);
+   EXPECT_DOUBLE_EQ(3.0, events[0].x);
+   EXPECT_DOUBLE_EQ(4.0, events[0].y);
+   EXPECT_FALSE(events[0].GetTags().HasTag("Exposure-ms"));
+}
+
+TEST(AcquisitionEngineTests, EmptyPlanHasOneImagePerTimePoint)
+{
+   AcquisitionPlan plan;
+   std::vector<AcquisitionEvent> events =
+      AcquisitionEngine::CompileBlock(plan, 0, 0, 0.0);
+   ASSERT_EQ(1u, events.size());
+   EXPECT_FALSE(events[0].hasZ);
+   EXPECT_TRUE(events[0].channelPreset.empty());
+   EXPECT_EQ("Default", events[0].GetTags().GetSingleTag("Channel").GetValue());
+
+   EXPECT_THROW(plan.setTimePoints(0, 0.0), CMMError);
+   EXPECT_THROW(plan.getChannelPreset(0), CMMError);
+   EXPECT_THROW(plan.getXPosition(-1), CMMError);
+}
+
+TEST_F(AcquisitionEngineCoreTests, SnapsWhenStageCannotSequence)
+{
+   if (!haveAdapter_)
+      return;
+   core_.startAcquisitionPlan(ThreeSlicePlan());
+   core_.waitForAcquisitionPlan();
+
+   ExpectSlices(3);
+   EXPECT_EQ(3, core_.getDeviceCallCount("Cam", "SnapImage"));
+   EXPECT_EQ(0, core_.getDeviceCallCount("Cam", "StartSequenceAcquisition"));
+   EXPECT_EQ(3, core_.getDeviceCallCount("Z", "SetPosition"));
+   EXPECT_DOUBLE_EQ(3.0, core_.getPosition("Z"));
+}
+
+TEST_F(AcquisitionEngineCoreTests, SnapsWhenStageSequenceIsTooShort)
+{
+   if (!haveAdapter_)
+      return;
+   core_.setProperty("Z", "TriggerSequenceMaxLength", "2");
+   core_.startAcquisitionPlan(ThreeSlicePlan());
+   core_.waitForAcquisitionPlan();
+
+   ExpectSlices(3);
+   EXPECT_EQ(3, core_.getDeviceCallCount("Cam", "SnapImage"));
+   EXPECT_EQ(0, core_.getDeviceCallCount("Cam", "StartSequenceAcquisition"));
+}
+
+TEST_F(AcquisitionEngineCoreTests, SequencesStage)
+{
+   if (!haveAdapter_)
+      return;
+   core_.setProperty("Z", "TriggerSourceDevice", "TCamera-0");
+   core_.setProperty("Z", "TriggerSourcePort", "ExposureStartEdge");
+   core_.setProperty("Z", "TriggerSequenceMaxLength", "10");
+   core_.startAcquisitionPlan(ThreeSlicePlan());
+   core_.waitForAcquisitionPlan();
+
+   ExpectSlices(3);
+   EXPECT_EQ(0, core_.getDeviceCallCount("Cam", "SnapImage"));
+   EXPECT_EQ(1, core_.getDeviceCallCount("Cam", "StartSequenceAcquisition"));
+   // Only the first slice is set directly
+   EXPECT_EQ(1, core_.getDeviceCallCount("Z", "SetPosition"));
+   EXPECT_FALSE(core_.isSequenceRunning("Cam"));
+}
+
+TEST_F(AcquisitionEngineCoreTests, RefusesChangesWhileRunning)
+{
+   if (!haveAdapter_)
+      return;
+   AcquisitionPlan plan;
+   plan.setTimePoints(100, 1000.0);
+   core_.startAcquisitionPlan(plan);
+
+   EXPECT_THROW(core_.setCameraDevice(""), CMMError);
+   EXPECT_THROW(core_.unloadDevice("Z"), CMMError);
+   EXPECT_THROW(core_.unloadAllDevices(), CMMError);
+   EXPECT_THROW(core_.loadSystemConfiguration("NoSuchFile.cfg"), CMMError);
+   EXPECT_THROW(core_.setCircularBufferMemoryFootprint(10), CMMError);
+   EXPECT_EQ("Cam", core_.getCameraDevice());
+   EXPECT_EQ(4u, core_.getLoadedDevices().size()); // Including Core
+
+   // Several threads may wait for the plan
+   bool failed[2] = { false, false };
+   boost::thread_group waiters;
+   waiters.create_thread(boost::bind(&WaitForPlan, &core_, &failed[0]));
+   waiters.create_thread(boost::bind(&WaitForPlan, &core_, &failed[1]));
+   core_.stopAcquisitionPlan();
+   waiters.join_all();
+   EXPECT_FALSE(failed[0]);
+   EXPECT_FALSE(failed[1]);
+   EXPECT_FALSE(core_.isAcquisitionPlanRunning());
+
+   core_.setCameraDevice("");
+   core_.unloadAllDevices();
+}
+
+TEST_F(AcquisitionEngineCoreTests, PacksSnappedMultiROIFrames)
+{
+   if (!haveAdapter_ || !test::HaveAdapter(core_, "DemoCamera"))
+      return;
+   core_.loadDevice("DCam", "DemoCamera", "DCam");
+   core_.initializeDevice("DCam");
+   core_.setProperty("DCam", "AllowMultiROI", "1");
+   core_.setCameraDevice("DCam");
+   std::vector<unsigned> xs, ys, widths, heights;
+   xs.push_back(0);
+   ys.push_back(0);
+   widths.push_back(10);
+   heights.push_back(10);
+   xs.push_back(90);
+   ys.push_back(90);
+   widths.push_back(10);
+   heights.push_back(10);
+   core_.setMultiROI(xs, ys, widths, heights);
+   core_.enableMultiROIPacking(true);
+
+   core_.startAcquisitionPlan(AcquisitionPlan());
+   core_.waitForAcquisitionPlan();
+
+   ASSERT_EQ(1, core_.getRemainingImageCount());
+   Metadata md;
+   core_.popNextImageMD(md);
+   EXPECT_EQ("10", md.GetSingleTag("Width").GetValue());
+   EXPECT_EQ("20", md.GetSingleTag("Height").GetValue());
+   EXPECT_TRUE(md.HasTag(MM::g_Keyword_Metadata_PackedROIs));
+   EXPECT_EQ("DCam", md.GetSingleTag(MM::g_Keyword_CoreCamera).GetValue());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return test::ExitStatus(RUN_ALL_TESTS());
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "AlignedFileOutput.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using mm::AlignedFileOutput;
+
+
+namespace
+{
+
+const char* const testPath = "AlignedFileOutput-Tests.out";
+
+std::vector<unsigned char> ReadFile(const char* path)
+{
+   std::ifstream in(path, std::ios::binary);
+   return std::vector<unsigned char>(std::istreambuf_iterator<char>(in),
+         std::istreambuf_iterator<char>());
+}
+
+} // anonymous namespace
+
+
+TEST(AlignedFileOutputTests, WritesDataSpanningSeveralBuffers)
+{
+   std::vector<unsigned char> expected;
+   {
+      // Buffer size is rounded up to the alignment
+      AlignedFileOutput out(testPath, 1, true);
+      for (unsigned i = 0; i < 3 * AlignedFileOutput::Alignment / 7 + 5; ++i)
+      {
+         unsigned char chunk[7];
+         for (unsigned j = 0; j < sizeof(chunk); ++j)
+            chunk[j] = static_cast<unsigned char>(i + j);
+         out.Append(chunk, sizeof(chunk));
+         expected.insert(expected.end(), chunk, chunk + sizeof(chunk));
+      }
+      out.AppendZeros(3);
+      expected.resize(expected.size() + 3, 0);
+      EXPECT_EQ(expected.size(), out.GetSize());
+      out.Close();
+   }
+   // The padding of the last unbuffered write is not part of the file
+   EXPECT_EQ(expected, ReadFile(testPath));
+   std::remove(testPath);
+}
+
+TEST(AlignedFileOutputTests, PatchesAreAppliedOnClose)
+{
+   {
+      AlignedFileOutput out(testPath, 4096, false);
+      std::vector<unsigned char> data(10000, 1);
+      out.Append(&data[0], data.size());
+      const unsigned char patch[2] = { 7, 8 };
+      out.Patch(4095, patch, sizeof(patch));
+      out.Patch(0, patch, 1);
+   }
+   std::vector<unsigned char> contents = ReadFile(testPath);
+   ASSERT_EQ(10000u, contents.size());
+   EXPECT_EQ(7, contents[0]);
+   EXPECT_EQ(1, contents[1]);
+   EXPECT_EQ(7, contents[4095]);
+   EXPECT_EQ(8, contents[4096]);
+   EXPECT_EQ(1, contents[9999]);
+   std::remove(testPath);
+}
+
+TEST(AlignedFileOutputTests, ThrowsIfFileCannotBeCreated)
+{
+   EXPECT_THROW(AlignedFileOutput("no-such-directory/file", 4096, false),
+         CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include "CameraBufferSet.h"
+#include "CircularBuffer.h"
+#include "MonotonicClock.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using mm::CameraBufferSet;
+
+
+namespace
+{
+
+class CameraBufferSetTests : public ::testing::Test
+{
+protected:
+   virtual void SetUp()
+   {
+      std::vector<std::string> cameras;
+      cameras.push_back("Left");
+      cameras.push_back("Right");
+      std::vector<unsigned> memoryMB(2, 1);
+      set_.Reset(cameras, memoryMB);
+
+      // Images of different sizes and pixel types
+      ASSERT_TRUE(set_.Find("Left")->Initialize(1, 64, 32, 1));
+      ASSERT_TRUE(set_.Find("Right")->Initialize(1, 16, 16, 2));
+   }
+
+   bool Insert(const std::string& camera, unsigned char value)
+   {
+      boost::shared_ptr<CircularBuffer> buffer = set_.Find(camera);
+      std::vector<unsigned char> pixels(buffer->Width() * buffer->Height() *
+            buffer->Depth(), value);
+      Metadata md;
+      md.PutImageTag("Camera", camera);
+      // Received times are recorded to 1/100 ms
+      boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+      return buffer->InsertImage(&pixels[0], buffer->Width(),
+            buffer->Height(), buffer->Depth(), &md);
+   }
+
+   CameraBufferSet set_;
+};
+
+void InsertMany(boost::shared_ptr<CircularBuffer> buffer, std::string camera,
+      int n)
+{
+   std::vector<unsigned char> pixels(buffer->Width() * buffer->Height() *
+         buffer->Depth());
+   for (int i = 0; i < n; ++i)
+   {
+      Metadata md;
+      md.PutImageTag("Camera", camera);
+      buffer->InsertImage(&pixels[0], buffer->Width(), buffer->Height(),
+            buffer->Depth(), &md);
+   }
+}
+
+} // anonymous namespace
+
+TEST(CameraBufferSetMemoryTests, DividesInProportionToImageSize)
+{
+   std::vector<size_t> frameBytes;
+   frameBytes.push_back(1000);
+   frameBytes.push_back(3000);
+   frameBytes.push_back(0);
+   std::vector<unsigned> memoryMB = CameraBufferSet::DivideMemory(frameBytes, 100);
+   ASSERT_EQ(3u, memoryMB.size());
+   EXPECT_EQ(25u, memoryMB[0]);
+   EXPECT_EQ(75u, memoryMB[1]);
+   EXPECT_EQ(1u, memoryMB[2]);
+}
+
+TEST_F(CameraBufferSetTests, KeepsBuffersPerCamera)
+{
+   std::vector<std::string> cameras = set_.GetCameras();
+   ASSERT_EQ(2u, cameras.size());
+   EXPECT_EQ("Left", cameras[0]);
+   EXPECT_EQ("Right", cameras[1]);
+   EXPECT_FALSE(set_.Find("Other"));
+
+   ASSERT_TRUE(Insert("Left", 1));
+   ASSERT_TRUE(Insert("Right", 2));
+   ASSERT_TRUE(Insert("Right", 3));
+   EXPECT_EQ(1ul, set_.Find("Left")->GetRemainingImageCount());
+   EXPECT_EQ(2ul, set_.Find("Right")->GetRemainingImageCount());
+   EXPECT_EQ(3ul, set_.GetRemainingImageCount());
+
+   set_.ClearImages();
+   EXPECT_EQ(0ul, set_.GetRemainingImageCount());
+
+   set_.Clear();
+   EXPECT_TRUE(set_.IsEmpty());
+   EXPECT_FALSE(set_.Find("Left"));
+}
+
+TEST_F(CameraBufferSetTests, PopsImagesInReceivedOrder)
+{
+   ASSERT_TRUE(Insert("Right", 1));
+   ASSERT_TRUE(Insert("Left", 2));
+   ASSERT_TRUE(Insert("Left", 3));
+   ASSERT_TRUE(Insert("Right", 4));
+
+   const char* expectedCameras[] = { "Right", "Left", "Left", "Right" };
+   const unsigned expectedWidths[] = { 16, 64, 64, 16 };
+   for (unsigned char i = 0; i < 4; ++i)
+   {
+      const mm::ImgBuffer* image = set_.PopEarliestImage(0);
+      ASSERT_TRUE(image != 0);
+      EXPECT_EQ(i + 1, image->GetPixels()[0]);
+      EXPECT_EQ(expectedWidths[i], image->Width());
+      EXPECT_EQ(expectedCameras[i],
+            image->GetMetadata().GetSingleTag("Camera").GetValue());
+   }
+   EXPECT_TRUE(set_.PopEarliestImage(0) == 0);
+}
+
+TEST_F(CameraBufferSetTests, TagsFramesOfConcurrentCamerasIndependently)
+{
+   const int n = 400;
+   const double startMs = mm::MonotonicClock::NowAsMMTime().getMsec();
+   boost::thread_group threads;
+   threads.create_thread(boost::bind(&InsertMany, set_.Find("Left"),
+            "Left", n));
+   threads.create_thread(boost::bind(&InsertMany, set_.Find("Right"),
+            "Right", n));
+   threads.join_all();
+   const double endMs = mm::MonotonicClock::NowAsMMTime().getMsec();
+
+   const char* cameras[] = { "Left", "Right" };
+   for (int c = 0; c < 2; ++c)
+   {
+      boost::shared_ptr<CircularBuffer> buffer = set_.Find(cameras[c]);
+      ASSERT_EQ((unsigned long)n, buffer->GetRemainingImageCount());
+      long firstNumber = 0;
+      double previousMs = startMs - 0.01;
+      for (int i = 0; i < n; ++i)
+      {
+         const mm::ImgBuffer* image = buffer->GetNextImageBuffer(0);
+         ASSERT_TRUE(image != 0);
+         const Metadata& md = image->GetMetadata();
+         const long number = std::atol(md.GetSingleTag(
+                  MM::g_Keyword_Metadata_ImageNumber).GetValue().c_str());
+         if (i == 0)
+            firstNumber = number;
+         EXPECT_EQ(firstNumber + i, number);
+         // Rounded to 1/100 ms
+         const double receivedMs = std::atof(md.GetSingleTag(
+                  MM::g_Keyword_Metadata_ReceivedTime).GetValue().c_str());
+         EXPECT_GE(receivedMs, previousMs);
+         EXPECT_LE(receivedMs, endMs + 0.01);
+         previousMs = receivedMs;
+      }
+   }
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "MMCore.h"
+
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+// 4 frames of 512x512 8-bit pixels fit in 1 MB
+const unsigned width = 512;
+const unsigned height = 512;
+
+class CircularBufferCursorTests : public ::testing::Test
+{
+protected:
+   CircularBufferCursorTests() :
+      buffer_(1),
+      pixels_(width * height)
+   {}
+
+   virtual void SetUp()
+   {
+      ASSERT_TRUE(buffer_.Initialize(1, width, height, 1));
+      ASSERT_EQ(4ul, buffer_.GetSize());
+   }
+
+   bool Insert(unsigned char value)
+   {
+      pixels_[0] = value;
+      return buffer_.InsertImage(&pixels_[0], width, height, 1, 0);
+   }
+
+   int Next(int cursor)
+   {
+      const mm::ImgBuffer* img = buffer_.GetNextImageBuffer(cursor, 0);
+      return img ? img->GetPixels()[0] : -1;
+   }
+
+   int Next()
+   {
+      const unsigned char* pixels = buffer_.GetNextImage();
+      return pixels ? pixels[0] : -1;
+   }
+
+   CircularBuffer buffer_;
+   std::vector<unsigned char> pixels_;
+};
+
+// Batches of images, first pixel of each set to its index
+class CircularBufferBatchTests : public CircularBufferCursorTests
+{
+protected:
+   unsigned InsertBatch(unsigned count)
+   {
+      std::vector<unsigned char> pixels(count * width * height);
+      std::vector<Metadata> mds(count);
+      for (unsigned i = 0; i < count; ++i)
+      {
+         pixels[i * width * height] = static_cast<unsigned char>(i);
+         mds[i].PutImageTag<std::string>("Camera", "Cam");
+      }
+      return buffer_.InsertImages(&pixels[0], width, height, 1, 1, mds);
+   }
+};
+
+} // anonymous namespace
+
+
+TEST_F(CircularBufferCursorTests, FullBufferRejectsImagesByDefault)
+{
+   EXPECT_FALSE(buffer_.GetOverwriteOldest());
+   for (unsigned char i = 0; i < 4; ++i)
+      ASSERT_TRUE(Insert(i));
+   EXPECT_FALSE(Insert(4));
+   EXPECT_TRUE(buffer_.Overflow());
+   EXPECT_EQ(0l, buffer_.GetOverwrittenCount());
+   EXPECT_EQ(0, Next());
+}
+
+TEST_F(CircularBufferCursorTests, OverwritingDiscardsOldestImages)
+{
+   buffer_.SetOverwriteOldest(true);
+   for (unsigned char i = 0; i < 10; ++i)
+      ASSERT_TRUE(Insert(i));
+   EXPECT_FALSE(buffer_.Overflow());
+   EXPECT_EQ(6l, buffer_.GetOverwrittenCount());
+   EXPECT_EQ(4ul, buffer_.GetRemainingImageCount());
+   for (int i = 6; i < 10; ++i)
+      EXPECT_EQ(i, Next());
+   EXPECT_EQ(-1, Next());
+
+   // The count restarts when the buffer is initialized
+   ASSERT_TRUE(buffer_.Initialize(1, width, height, 1));
+   EXPECT_EQ(0l, buffer_.GetOverwrittenCount());
+   EXPECT_TRUE(buffer_.GetOverwriteOldest());
+}
+
+TEST(CoreCircularBufferTests, OverwriteSettingSurvivesReallocation)
+{
+   CMMCore core;
+   EXPECT_FALSE(core.isCircularBufferOverwriteEnabled());
+   core.enableCircularBufferOverwrite(true);
+   EXPECT_TRUE(core.isCircularBufferOverwriteEnabled());
+   core.setCircularBufferMemoryFootprint(2);
+   EXPECT_TRUE(core.isCircularBufferOverwriteEnabled());
+   EXPECT_EQ(0l, core.getOverwrittenImageCount());
+   EXPECT_THROW(core.enableCircularBufferCompression(1, 1), CMMError);
+   core.enableCircularBufferOverwrite(false);
+   EXPECT_FALSE(core.isCircularBufferOverwriteEnabled());
+}
+
+TEST_F(CircularBufferCursorTests, EachCursorReadsAllImages)
+{
+   int first = buffer_.AddCursor(false);
+   int second = buffer_.AddCursor(false);
+   for (unsigned char i = 0; i < 3; ++i)
+      ASSERT_TRUE(Insert(i));
+
+   EXPECT_EQ(3ul, buffer_.GetRemainingImageCount(first));
+   for (int i = 0; i < 3; ++i)
+      EXPECT_EQ(i, Next(first));
+   EXPECT_EQ(-1, Next(first));
+   EXPECT_EQ(0ul, buffer_.GetRemainingImageCount(first));
+
+   EXPECT_EQ(0, Next(second));
+   for (int i = 0; i < 3; ++i)
+      EXPECT_EQ(i, Next());
+   EXPECT_EQ(1, Next(second));
+   EXPECT_EQ(1ul, buffer_.GetRemainingImageCount(second));
+   EXPECT_EQ(0l, buffer_.GetMissedImageCount(second));
+}
+
+TEST_F(CircularBufferCursorTests, NonLossyCursorHoldsUpInsertion)
+{
+   int cursor = buffer_.AddCursor(false);
+   for (unsigned char i = 0; i < 4; ++i)
+   {
+      ASSERT_TRUE(Insert(i));
+      EXPECT_EQ(i, Next());
+   }
+   EXPECT_EQ(0ul, buffer_.GetFreeSize());
+   EXPECT_FALSE(Insert(4));
+   EXPECT_TRUE(buffer_.Overflow());
+
+   EXPECT_EQ(0, Next(cursor));
+   EXPECT_TRUE(Insert(5));
+
+   buffer_.RemoveCursor(cursor);
+   EXPECT_EQ(4ul, buffer_.GetFreeSize() + buffer_.GetRemainingImageCount());
+   EXPECT_THROW(buffer_.GetNextImageBuffer(cursor, 0), CMMError);
+   EXPECT_THROW(buffer_.RemoveCursor(cursor), CMMError);
+}
+
+TEST_F(CircularBufferCursorTests, LossyCursorMissesImages)
+{
+   int cursor = buffer_.AddCursor(true);
+   for (unsigned char i = 0; i < 7; ++i)
+   {
+      ASSERT_TRUE(Insert(i));
+      EXPECT_EQ(i, Next());
+   }
+   EXPECT_FALSE(buffer_.Overflow());
+
+   // Only the last 4 images are still in the buffer
+   EXPECT_EQ(3l, buffer_.GetMissedImageCount(cursor));
+   EXPECT_EQ(4ul, buffer_.GetRemainingImageCount(cursor));
+   EXPECT_EQ(3, Next(cursor));
+}
+
+TEST_F(CircularBufferCursorTests, OverwritingDiscardsFromLaggingCursors)
+{
+   buffer_.SetOverwriteOldest(true);
+   int cursor = buffer_.AddCursor(false);
+   for (unsigned char i = 0; i < 6; ++i)
+   {
+      ASSERT_TRUE(Insert(i));
+      EXPECT_EQ(i, Next());
+   }
+   EXPECT_EQ(0l, buffer_.GetOverwrittenCount());
+   EXPECT_EQ(2l, buffer_.GetMissedImageCount(cursor));
+   EXPECT_EQ(2, Next(cursor));
+}
+
+TEST_F(CircularBufferCursorTests, ClearAndCopyKeepCursors)
+{
+   int cursor = buffer_.AddCursor(false);
+   ASSERT_TRUE(Insert(1));
+   buffer_.Clear();
+   EXPECT_EQ(0ul, buffer_.GetRemainingImageCount(cursor));
+   ASSERT_TRUE(Insert(2));
+   EXPECT_EQ(2, Next(cursor));
+
+   CircularBuffer other(1);
+   ASSERT_TRUE(other.Initialize(1, width, height, 1));
+   other.CopyCursors(buffer_);
+   EXPECT_EQ(0ul, other.GetRemainingImageCount(cursor));
+   EXPECT_NE(cursor, other.AddCursor(true));
+}
+
+TEST_F(CircularBufferBatchTests, InsertsImagesThatFit)
+{
+   ASSERT_TRUE(Insert(9));
+   EXPECT_EQ(3u, InsertBatch(5));
+   EXPECT_TRUE(buffer_.Overflow());
+   EXPECT_EQ(9, Next());
+   for (int i = 0; i < 3; ++i)
+   {
+      const mm::ImgBuffer* img = buffer_.GetNextImageBuffer(0);
+      ASSERT_TRUE(img != 0);
+      EXPECT_EQ(i, img->GetPixels()[0]);
+      Metadata md = img->GetMetadata();
+      EXPECT_EQ("Cam", md.GetSingleTag("Camera").GetValue());
+      EXPECT_TRUE(md.HasTag(MM::g_Keyword_Metadata_ImageNumber));
+   }
+
+   mm::CameraFrameStatistics stats = buffer_.GetCameraFrameStatistics("Cam");
+   EXPECT_EQ(3, stats.inserted);
+   EXPECT_EQ(2, stats.rejected);
+}
+
+TEST_F(CircularBufferBatchTests, BatchLargerThanBufferOverwrites)
+{
+   buffer_.SetOverwriteOldest(true);
+   EXPECT_EQ(10u, InsertBatch(10));
+   EXPECT_FALSE(buffer_.Overflow());
+   EXPECT_EQ(4ul, buffer_.GetRemainingImageCount());
+   for (int i = 6; i < 10; ++i)
+      EXPECT_EQ(i, Next());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
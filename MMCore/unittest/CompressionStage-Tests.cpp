@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "CompressionStage.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/thread.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using mm::CompressionStage;
+
+
+namespace
+{
+
+// 4 frames of 512x512 16-bit pixels fit in 2 MB
+const unsigned width = 512;
+const unsigned height = 512;
+
+class CompressionStageTests : public ::testing::Test
+{
+protected:
+   CompressionStageTests() :
+      buffer_(2),
+      pixels_(width * height * 2)
+   {}
+
+   virtual void SetUp()
+   {
+      ASSERT_TRUE(buffer_.Initialize(1, width, height, 2));
+      ASSERT_EQ(4ul, buffer_.GetSize());
+   }
+
+   bool Insert(unsigned char value)
+   {
+      // Mostly zero high bytes, as in dim fluorescence images
+      for (size_t i = 0; i < pixels_.size(); i += 2)
+      {
+         pixels_[i] = static_cast<unsigned char>(std::rand() % 8);
+         pixels_[i + 1] = 0;
+      }
+      pixels_[0] = value;
+      Metadata md;
+      md.PutImageTag<std::string>("PixelType", "GRAY16");
+      return buffer_.InsertImage(&pixels_[0], width, height, 2, &md);
+   }
+
+   void WaitForFreeSlots(unsigned long count)
+   {
+      for (int i = 0; i < 1000 && buffer_.GetFreeSize() < count; ++i)
+         boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+      ASSERT_EQ(count, buffer_.GetFreeSize());
+   }
+
+   CircularBuffer buffer_;
+   std::vector<unsigned char> pixels_;
+};
+
+} // anonymous namespace
+
+
+TEST_F(CompressionStageTests, ReleasesSlotsAndPopsInOrder)
+{
+   CompressionStage stage(buffer_, 3, 64 << 20);
+   std::vector<unsigned char> last;
+   // More images than the buffer holds uncompressed
+   for (unsigned char i = 0; i < 12; ++i)
+   {
+      ASSERT_TRUE(Insert(i));
+      WaitForFreeSlots(4);
+   }
+   last = pixels_;
+   EXPECT_EQ(12ul, stage.GetRemainingImageCount());
+   EXPECT_GT(stage.GetCompressionRatio(), 1.5);
+
+   for (unsigned char i = 0; i < 12; ++i)
+   {
+      Metadata md;
+      const unsigned char* pixels = stage.PopNextImage(0, md);
+      ASSERT_TRUE(pixels != 0);
+      EXPECT_EQ(i, pixels[0]);
+      EXPECT_TRUE(md.HasTag(MM::g_Keyword_Metadata_CompressedSize));
+      EXPECT_EQ("GRAY16", md.GetSingleTag("PixelType").GetValue());
+      if (i == 11)
+      {
+         EXPECT_EQ(0, std::memcmp(&last[0], pixels, last.size()));
+      }
+   }
+   Metadata md;
+   EXPECT_TRUE(stage.PopNextImage(0, md) == 0);
+   EXPECT_EQ(0ul, stage.GetRemainingImageCount());
+   EXPECT_EQ(0u, stage.GetCompressedBytes());
+}
+
+TEST_F(CompressionStageTests, MemoryLimitKeepsImagesInBuffer)
+{
+   // Room for a single compressed image
+   CompressionStage stage(buffer_, 1, 1);
+   ASSERT_TRUE(Insert(1));
+   WaitForFreeSlots(4);
+   ASSERT_TRUE(Insert(2));
+   ASSERT_TRUE(Insert(3));
+   boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+   EXPECT_EQ(2ul, buffer_.GetRemainingImageCount());
+   EXPECT_EQ(3ul, stage.GetRemainingImageCount());
+
+   Metadata md;
+   for (unsigned char i = 1; i <= 3; ++i)
+   {
+      const unsigned char* pixels = stage.PopNextImage(0, md);
+      ASSERT_TRUE(pixels != 0);
+      EXPECT_EQ(i, pixels[0]);
+   }
+}
+
+TEST_F(CompressionStageTests, ClearingTheBufferDiscardsCompressedImages)
+{
+   CompressionStage stage(buffer_, 2, 64 << 20);
+   ASSERT_TRUE(Insert(1));
+   ASSERT_TRUE(Insert(2));
+   WaitForFreeSlots(4);
+   buffer_.Clear();
+   EXPECT_EQ(0ul, stage.GetRemainingImageCount());
+
+   ASSERT_TRUE(Insert(3));
+   Metadata md;
+   const unsigned char* pixels = stage.PopNextImage(0, md);
+   ASSERT_TRUE(pixels != 0);
+   EXPECT_EQ(3, pixels[0]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include "ConfigFileCache.h"
+
+#include <string>
+
+using namespace mm;
+
+
+TEST(ConfigFileCacheTests, SkipsCommentsAndStripsCR)
+{
+   ParsedConfigFile commands = ConfigFileCache::Parse(
+         "# comment\r\n"
+         "\r\n"
+         "Device,Cam,DemoCamera,DCam\r\n");
+   ASSERT_EQ(1u, commands.size());
+   EXPECT_EQ(ConfigFileCommand::SingleLine, commands[0].kind);
+   EXPECT_EQ(3, commands[0].lineNumber);
+   EXPECT_EQ("Device,Cam,DemoCamera,DCam", commands[0].line);
+   ASSERT_EQ(4u, commands[0].tokens.size());
+   EXPECT_EQ("DCam", commands[0].tokens[3]);
+}
+
+TEST(ConfigFileCacheTests, LastPropertyWriteWins)
+{
+   ParsedConfigFile commands = ConfigFileCache::Parse(
+         "Property,Cam,Binning,1\n"
+         "Property,Cam,Mode,A\n"
+         "Property,Cam,Binning,2\n"
+         "Property,Stage,Speed\n");
+   ASSERT_EQ(1u, commands.size());
+   ASSERT_EQ(ConfigFileCommand::PropertyBatch, commands[0].kind);
+   const std::vector<ConfigFileCommand>& batch = commands[0].batch;
+   ASSERT_EQ(3u, batch.size());
+   EXPECT_EQ("Mode", batch[0].tokens[2]);
+   EXPECT_EQ("Binning", batch[1].tokens[2]);
+   EXPECT_EQ("2", batch[1].tokens[3]);
+   EXPECT_EQ(3, batch[1].lineNumber);
+   ASSERT_EQ(4u, batch[2].tokens.size());
+   EXPECT_EQ("", batch[2].tokens[3]);
+}
+
+TEST(ConfigFileCacheTests, CorePropertiesSplitBatches)
+{
+   ParsedConfigFile commands = ConfigFileCache::Parse(
+         "Property,Cam,Binning,1\n"
+         "Property,Core,Initialize,1\n"
+         "Property,Cam,Binning,2\n");
+   ASSERT_EQ(3u, commands.size());
+   EXPECT_EQ(ConfigFileCommand::PropertyBatch, commands[0].kind);
+   EXPECT_EQ(ConfigFileCommand::SingleLine, commands[1].kind);
+   EXPECT_EQ(ConfigFileCommand::PropertyBatch, commands[2].kind);
+   EXPECT_EQ("1", commands[0].batch[0].tokens[3]);
+   EXPECT_EQ("2", commands[2].batch[0].tokens[3]);
+}
+
+TEST(ConfigFileCacheTests, ReusesParseOfIdenticalContents)
+{
+   ConfigFileCache cache;
+   const std::string contents = "Property,Cam,Binning,1\n";
+   boost::shared_ptr<const ParsedConfigFile> first = cache.GetParsed(contents);
+   boost::shared_ptr<const ParsedConfigFile> second = cache.GetParsed(contents);
+   EXPECT_EQ(first, second);
+   boost::shared_ptr<const ParsedConfigFile> other =
+      cache.GetParsed("Property,Cam,Binning,2\n");
+   EXPECT_NE(first, other);
+}
+
+TEST(ConfigFileCacheTests, DistinguishesContentsOfEqualLength)
+{
+   ConfigFileCache cache;
+   const std::string a = "Property,Cam,Mode,AB\n";
+   const std::string b = "Property,Cam,Mode,BA\n";
+   boost::shared_ptr<const ParsedConfigFile> parsedA = cache.GetParsed(a);
+   boost::shared_ptr<const ParsedConfigFile> parsedB = cache.GetParsed(b);
+   ASSERT_NE(parsedA, parsedB);
+   EXPECT_EQ("AB", (*parsedA)[0].batch[0].tokens[3]);
+   EXPECT_EQ("BA", (*parsedB)[0].batch[0].tokens[3]);
+   EXPECT_EQ(parsedA, cache.GetParsed(a));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
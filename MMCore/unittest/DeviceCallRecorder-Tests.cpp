@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include "DeviceCallRecorder.h"
+#include "DeviceCallStatistics.h"
+#include "Error.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using mm::DeviceCallRecorder;
+using mm::RecordedDeviceCall;
+
+
+namespace
+{
+
+std::vector<std::string> Args(const char* a = 0, const char* b = 0)
+{
+   std::vector<std::string> args;
+   if (a)
+      args.push_back(a);
+   if (b)
+      args.push_back(b);
+   return args;
+}
+
+void RecordMany(DeviceCallRecorder* recorder, int n)
+{
+   for (int i = 0; i < n; ++i)
+      recorder->Record("Dev", "Busy", Args(), i, 1);
+}
+
+} // anonymous namespace
+
+TEST(DeviceCallRecorderTests, RoundTripsCallsThroughText)
+{
+   DeviceCallRecorder recorder;
+   recorder.Record("Cam", "SnapImage", Args(), 2000, 300);
+   recorder.Record("My\tDevice", "SetProperty",
+         Args("Line\nBreak", "C:\\path\r"), 1000, 5);
+
+   std::ostringstream os;
+   recorder.Write(os);
+   std::istringstream is(os.str());
+   std::vector<RecordedDeviceCall> calls = DeviceCallRecorder::Read(is);
+
+   ASSERT_EQ(2u, calls.size());
+   // Sorted by start time
+   EXPECT_EQ(1000, calls[0].startUs);
+   EXPECT_EQ(5, calls[0].durationUs);
+   EXPECT_EQ(1u, calls[0].thread);
+   EXPECT_EQ("My\tDevice", calls[0].device);
+   EXPECT_EQ("SetProperty", calls[0].method);
+   ASSERT_EQ(2u, calls[0].args.size());
+   EXPECT_EQ("Line\nBreak", calls[0].args[0]);
+   EXPECT_EQ("C:\\path\r", calls[0].args[1]);
+   EXPECT_EQ(2000, calls[1].startUs);
+   EXPECT_EQ("SnapImage", calls[1].method);
+   EXPECT_TRUE(calls[1].args.empty());
+}
+
+TEST(DeviceCallRecorderTests, RejectsInvalidInput)
+{
+   std::istringstream notRecording("SnapImage\n");
+   EXPECT_THROW(DeviceCallRecorder::Read(notRecording), CMMError);
+
+   std::ostringstream os;
+   DeviceCallRecorder().Write(os);
+   std::istringstream truncated(os.str() + "1000\t5\n");
+   EXPECT_THROW(DeviceCallRecorder::Read(truncated), CMMError);
+}
+
+TEST(DeviceCallRecorderTests, RecordsTimedCallsWithArguments)
+{
+   DeviceCallRecorder recorder;
+   mm::DeviceCallStatistics stats;
+   stats.SetTrace(0, "Stage");
+   stats.SetRecorder(&recorder);
+   {
+      mm::DeviceCallTimer timer(stats, mm::DeviceCallSetPosition);
+      EXPECT_FALSE(timer.IsRecording());
+   }
+   EXPECT_EQ(0u, recorder.GetCallCount());
+
+   recorder.SetEnabled(true);
+   {
+      mm::DeviceCallTimer timer(stats, mm::DeviceCallModuleLockWait);
+      EXPECT_FALSE(timer.IsRecording());
+   }
+   {
+      mm::DeviceCallTimer timer(stats, mm::DeviceCallSetPosition,
+            "SetPositionUm");
+      EXPECT_TRUE(timer.IsRecording());
+      timer.AddArg(0.1);
+      timer.AddArg(-3L);
+   }
+
+   std::vector<RecordedDeviceCall> calls = recorder.GetCalls();
+   ASSERT_EQ(1u, calls.size());
+   EXPECT_EQ("Stage", calls[0].device);
+   EXPECT_EQ("SetPositionUm", calls[0].method);
+   ASSERT_EQ(2u, calls[0].args.size());
+   double value;
+   std::istringstream(calls[0].args[0]) >> value;
+   EXPECT_EQ(0.1, value);
+   EXPECT_EQ("-3", calls[0].args[1]);
+   // Statistics themselves remain disabled
+   EXPECT_EQ(0, stats.GetTiming(mm::DeviceCallSetPosition).count);
+}
+
+TEST(DeviceCallRecorderTests, NumbersThreads)
+{
+   DeviceCallRecorder recorder;
+   boost::thread_group threads;
+   for (int i = 0; i < 3; ++i)
+      threads.create_thread(boost::bind(&RecordMany, &recorder, 100));
+   threads.join_all();
+
+   std::vector<RecordedDeviceCall> calls = recorder.GetCalls();
+   ASSERT_EQ(300u, calls.size());
+   std::vector<int> perThread(4);
+   for (size_t i = 0; i < calls.size(); ++i)
+   {
+      ASSERT_GE(calls[i].thread, 1u);
+      ASSERT_LE(calls[i].thread, 3u);
+      ++perThread[calls[i].thread];
+   }
+   EXPECT_EQ(100, perThread[1]);
+   EXPECT_EQ(100, perThread[2]);
+   EXPECT_EQ(100, perThread[3]);
+
+   recorder.Clear();
+   EXPECT_EQ(0u, recorder.GetCallCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include "DeviceCallRecorder.h"
+#include "MMCore.h"
+#include "MonotonicClock.h"
+#include "TestAdapters.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using mm::MonotonicClock;
+
+
+// These tests use the DemoCamera adapter (and the Utilities adapter, as an
+// example of real devices); see TestAdapters.h for how adapters are found.
+class DeviceCallReplayerTests : public ::testing::Test
+{
+protected:
+   CMMCore core_;
+   bool haveAdapter_;
+   std::ostringstream recording_;
+   const char* filename_;
+
+   DeviceCallReplayerTests() : filename_("DeviceCallReplayer-Tests.txt") {}
+
+   virtual void SetUp()
+   {
+      mm::test::SetAdapterSearchPaths(core_);
+      haveAdapter_ = mm::test::HaveAdapter(core_, "DemoCamera");
+
+      mm::DeviceCallRecorder().Write(recording_);
+   }
+
+   virtual void TearDown()
+   {
+      std::remove(filename_);
+   }
+
+   void AddCall(long startMs, long durationMs, unsigned thread,
+         const std::string& device, const std::string& method,
+         const std::string& arg = "")
+   {
+      recording_ << startMs * 1000 << '\t' << durationMs * 1000 << '\t' <<
+         thread << '\t' << device << '\t' << method;
+      if (!arg.empty())
+         recording_ << '\t' << arg;
+      recording_ << '\n';
+   }
+
+   // Returns the elapsed time in milliseconds
+   double Replay(bool withRecordedTiming, long expectedCount,
+         bool allowRealDevices = false)
+   {
+      {
+         std::ofstream os(filename_);
+         os << recording_.str();
+      }
+      const boost::int64_t startUs = MonotonicClock::NowUs();
+      EXPECT_EQ(expectedCount, core_.replayDeviceCalls(filename_,
+               withRecordedTiming, allowRealDevices));
+      return (MonotonicClock::NowUs() - startUs) / 1000.0;
+   }
+};
+
+
+TEST_F(DeviceCallReplayerTests, IssuesCallsToLoadedDevices)
+{
+   if (!haveAdapter_)
+      return;
+   core_.loadDevice("Stage", "DemoCamera", "DStage");
+   core_.initializeAllDevices();
+
+   AddCall(0, 1, 1, "Stage", "SetPositionUm", "12.5");
+   AddCall(5, 1, 1, "Stage", "NoSuchMethod");
+   AddCall(10, 1, 1, "NoSuchDevice", "Busy");
+   Replay(false, 1);
+   EXPECT_DOUBLE_EQ(12.5, core_.getPosition("Stage"));
+}
+
+TEST_F(DeviceCallReplayerTests, ReplaysThreadsConcurrently)
+{
+   if (!haveAdapter_)
+      return;
+   // Both devices share the module lock, which must not be held while the
+   // recorded durations elapse
+   core_.loadDevice("Cam", "DemoCamera", "DCam");
+   core_.loadDevice("Stage", "DemoCamera", "DStage");
+   core_.initializeAllDevices();
+
+   AddCall(0, 300, 1, "Cam", "Busy");
+   AddCall(0, 300, 2, "Stage", "Busy");
+   AddCall(300, 300, 1, "Cam", "Busy");
+   AddCall(300, 300, 2, "Stage", "Busy");
+   double elapsedMs = Replay(true, 4);
+   EXPECT_GE(elapsedMs, 590.0);
+   EXPECT_LT(elapsedMs, 1000.0);
+}
+
+TEST_F(DeviceCallReplayerTests, KeepsRecordedStartOffsets)
+{
+   if (!haveAdapter_)
+      return;
+   core_.loadDevice("Cam", "DemoCamera", "DCam");
+   core_.initializeAllDevices();
+
+   AddCall(100, 1, 1, "Cam", "Busy");
+   AddCall(400, 1, 2, "Cam", "Busy");
+   double elapsedMs = Replay(true, 2);
+   EXPECT_GE(elapsedMs, 290.0);
+   EXPECT_LT(elapsedMs, 600.0);
+
+   elapsedMs = Replay(false, 2);
+   EXPECT_LT(elapsedMs, 200.0);
+}
+
+TEST_F(DeviceCallReplayerTests, RefusesRealDevicesUnlessAllowed)
+{
+   if (!haveAdapter_ || !mm::test::HaveAdapter(core_, "Utilities"))
+      return;
+   core_.loadDevice("Stage", "DemoCamera", "DStage");
+   core_.loadDevice("Shutter", "Utilities", "Multi Shutter");
+   core_.initializeAllDevices();
+
+   AddCall(0, 1, 1, "Stage", "SetPositionUm", "7");
+   AddCall(1, 1, 1, "Shutter", "Busy");
+   {
+      std::ofstream os(filename_);
+      os << recording_.str();
+   }
+   EXPECT_THROW(core_.replayDeviceCalls(filename_, false), CMMError);
+   // Nothing was issued
+   EXPECT_DOUBLE_EQ(0.0, core_.getPosition("Stage"));
+
+   Replay(false, 2, true);
+   EXPECT_DOUBLE_EQ(7.0, core_.getPosition("Stage"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return mm::test::ExitStatus(RUN_ALL_TESTS());
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include "DeviceCallStatistics.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+
+using mm::DeviceCallStatistics;
+using mm::DeviceCallTimer;
+using mm::DeviceCallTiming;
+
+
+namespace
+{
+
+void RecordMany(DeviceCallStatistics* stats, int n)
+{
+   for (int i = 0; i < n; ++i)
+      stats->Record(mm::DeviceCallBusy, i % 10);
+}
+
+} // anonymous namespace
+
+TEST(DeviceCallStatisticsTests, NamesRoundTrip)
+{
+   for (int i = 0; i < mm::DeviceCallCount; ++i)
+   {
+      mm::DeviceCall call = static_cast<mm::DeviceCall>(i);
+      mm::DeviceCall found;
+      ASSERT_TRUE(mm::FindDeviceCall(mm::GetDeviceCallName(call), found));
+      EXPECT_EQ(call, found);
+   }
+   mm::DeviceCall found;
+   EXPECT_FALSE(mm::FindDeviceCall("NoSuchCall", found));
+}
+
+TEST(DeviceCallStatisticsTests, RecordsLatencyInLog2Bins)
+{
+   DeviceCallStatistics stats;
+   stats.Record(mm::DeviceCallSetProperty, 0);
+   stats.Record(mm::DeviceCallSetProperty, 1);
+   stats.Record(mm::DeviceCallSetProperty, 3);
+   stats.Record(mm::DeviceCallSetProperty, 1000);
+   stats.Record(mm::DeviceCallSetProperty, -5); // Counted as 0
+   stats.Record(mm::DeviceCallSetProperty, 1000000000); // Last bin
+
+   DeviceCallTiming timing = stats.GetTiming(mm::DeviceCallSetProperty);
+   EXPECT_EQ(6, timing.count);
+   EXPECT_DOUBLE_EQ(1000001.004, timing.totalMs);
+   EXPECT_DOUBLE_EQ(1000000.0, timing.maxMs);
+   ASSERT_EQ(DeviceCallTiming::HistogramBins, timing.histogram.size());
+   EXPECT_EQ(2, timing.histogram[0]);
+   EXPECT_EQ(1, timing.histogram[1]);
+   EXPECT_EQ(1, timing.histogram[2]);
+   EXPECT_EQ(1, timing.histogram[10]); // [512, 1024) us
+   EXPECT_EQ(1, timing.histogram[DeviceCallTiming::HistogramBins - 1]);
+
+   EXPECT_DOUBLE_EQ(0.002, timing.GetPercentileUpperBoundMs(0.5));
+   EXPECT_DOUBLE_EQ(1000000.0, timing.GetPercentileUpperBoundMs(1.0));
+
+   EXPECT_EQ(0, stats.GetTiming(mm::DeviceCallGetProperty).count);
+
+   stats.Reset();
+   EXPECT_EQ(0, stats.GetTiming(mm::DeviceCallSetProperty).count);
+   EXPECT_EQ(0.0, stats.GetTiming(mm::DeviceCallSetProperty).maxMs);
+}
+
+TEST(DeviceCallStatisticsTests, TimerRecordsOnlyWhenEnabled)
+{
+   DeviceCallStatistics stats;
+   {
+      DeviceCallTimer timer(stats, mm::DeviceCallSnapImage);
+   }
+   EXPECT_EQ(0, stats.GetTiming(mm::DeviceCallSnapImage).count);
+
+   stats.SetEnabled(true);
+   {
+      DeviceCallTimer timer(stats, mm::DeviceCallSnapImage);
+      boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+      timer.Stop();
+      boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   }
+   DeviceCallTiming timing = stats.GetTiming(mm::DeviceCallSnapImage);
+   EXPECT_EQ(1, timing.count);
+   EXPECT_GE(timing.maxMs, 4.0);
+   EXPECT_LT(timing.maxMs, 50.0);
+}
+
+TEST(DeviceCallStatisticsTests, RecordsFromManyThreads)
+{
+   DeviceCallStatistics stats;
+   boost::thread_group threads;
+   for (int i = 0; i < 4; ++i)
+      threads.create_thread(boost::bind(&RecordMany, &stats, 10000));
+   threads.join_all();
+
+   DeviceCallTiming timing = stats.GetTiming(mm::DeviceCallBusy);
+   EXPECT_EQ(40000, timing.count);
+   EXPECT_DOUBLE_EQ(4 * 1000 * 45 / 1000.0, timing.totalMs);
+   EXPECT_DOUBLE_EQ(0.009, timing.maxMs);
+   long histogramTotal = 0;
+   for (size_t i = 0; i < timing.histogram.size(); ++i)
+      histogramTotal += timing.histogram[i];
+   EXPECT_EQ(40000, histogramTotal);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
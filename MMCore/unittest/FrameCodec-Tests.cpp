@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include "FrameCodec.h"
+
+#include <boost/cstdint.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using mm::FrameCodec;
+
+
+namespace
+{
+
+std::vector<unsigned char> RoundTrip(const std::vector<unsigned char>& data,
+      unsigned elementSize, size_t* compressedSize = 0)
+{
+   FrameCodec codec;
+   std::vector<unsigned char> compressed;
+   codec.Compress(data.empty() ? 0 : &data[0], data.size(), elementSize,
+         compressed);
+   EXPECT_LE(compressed.size(), FrameCodec::GetMaxCompressedSize(data.size()));
+   if (compressedSize)
+      *compressedSize = compressed.size();
+
+   // Decompressing does not depend on the instance that compressed
+   FrameCodec other;
+   std::vector<unsigned char> result(data.size() + 1, 0xcd);
+   other.Decompress(&compressed[0], compressed.size(), &result[0],
+         data.size());
+   EXPECT_EQ(0xcd, result.back());
+   result.pop_back();
+   return result;
+}
+
+// 16-bit image with a few bright spots on a dim, noisy background
+std::vector<unsigned char> SparseImage(unsigned width, unsigned height)
+{
+   std::vector<boost::uint16_t> pixels(width * height);
+   std::srand(42);
+   for (size_t i = 0; i < pixels.size(); ++i)
+      pixels[i] = static_cast<boost::uint16_t>(100 + std::rand() % 4);
+   for (unsigned spot = 0; spot < 20; ++spot)
+   {
+      const size_t center = std::rand() % pixels.size();
+      for (size_t i = center; i < center + 8 && i < pixels.size(); ++i)
+         pixels[i] = static_cast<boost::uint16_t>(3000 + std::rand() % 1000);
+   }
+   std::vector<unsigned char> bytes(pixels.size() * 2);
+   std::memcpy(&bytes[0], &pixels[0], bytes.size());
+   return bytes;
+}
+
+} // anonymous namespace
+
+
+TEST(FrameCodecTests, SparseImagesCompress)
+{
+   std::vector<unsigned char> image = SparseImage(256, 256);
+   size_t compressedSize;
+   EXPECT_EQ(image, RoundTrip(image, 2, &compressedSize));
+   EXPECT_LT(compressedSize, image.size() / 2);
+}
+
+TEST(FrameCodecTests, RoundTripsAnySizeAndElementSize)
+{
+   std::srand(1);
+   for (size_t size = 0; size < 300; size += 7)
+   {
+      std::vector<unsigned char> data(size);
+      for (size_t i = 0; i < size; ++i)
+         data[i] = static_cast<unsigned char>(i % 5 == 0 ? std::rand() : i / 16);
+      for (unsigned elementSize = 1; elementSize <= 4; ++elementSize)
+         EXPECT_EQ(data, RoundTrip(data, elementSize));
+   }
+}
+
+TEST(FrameCodecTests, RoundTripsLongRunsAndNoise)
+{
+   std::vector<unsigned char> data(200000, 0);
+   std::srand(7);
+   for (size_t i = 100000; i < data.size(); ++i)
+      data[i] = static_cast<unsigned char>(std::rand());
+   size_t compressedSize;
+   EXPECT_EQ(data, RoundTrip(data, 1, &compressedSize));
+   EXPECT_LT(compressedSize, 110000u);
+
+   // Incompressible data is stored
+   std::vector<unsigned char> noise(data.begin() + 100000, data.end());
+   EXPECT_EQ(noise, RoundTrip(noise, 2, &compressedSize));
+   EXPECT_EQ(noise.size() + 2, compressedSize);
+}
+
+TEST(FrameCodecTests, CorruptDataThrows)
+{
+   std::vector<unsigned char> image = SparseImage(64, 64);
+   FrameCodec codec;
+   std::vector<unsigned char> compressed;
+   codec.Compress(&image[0], image.size(), 2, compressed);
+   std::vector<unsigned char> result(image.size());
+
+   EXPECT_THROW(codec.Decompress(&compressed[0], compressed.size() / 2,
+            &result[0], result.size()), CMMError);
+   EXPECT_THROW(codec.Decompress(&compressed[0], compressed.size(),
+            &result[0], result.size() - 1), CMMError);
+   compressed[0] = 99;
+   EXPECT_THROW(codec.Decompress(&compressed[0], compressed.size(),
+            &result[0], result.size()), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
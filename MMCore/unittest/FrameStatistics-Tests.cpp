@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include "FrameStatistics.h"
+
+using namespace mm;
+
+
+namespace
+{
+
+FrameArrival Arrival(double hostTimeMs)
+{
+   FrameArrival arrival;
+   arrival.hostTimeMs = hostTimeMs;
+   return arrival;
+}
+
+FrameArrival Arrival(double hostTimeMs, long frameNumber, double cameraTimeMs)
+{
+   FrameArrival arrival = Arrival(hostTimeMs);
+   arrival.hasCameraFrameNumber = true;
+   arrival.cameraFrameNumber = frameNumber;
+   arrival.hasCameraTime = true;
+   arrival.cameraTimeMs = cameraTimeMs;
+   return arrival;
+}
+
+} // anonymous namespace
+
+
+TEST(FrameStatisticsTests, ImageNumbersArePerCamera)
+{
+   FrameStatistics stats;
+   size_t a = stats.GetCameraIndex("A");
+   size_t b = stats.GetCameraIndex("B");
+   EXPECT_NE(a, b);
+   EXPECT_EQ(a, stats.GetCameraIndex("A"));
+   EXPECT_EQ(0, stats.NextImageNumber(a));
+   EXPECT_EQ(1, stats.NextImageNumber(a));
+   EXPECT_EQ(0, stats.NextImageNumber(b));
+   stats.Reset();
+   EXPECT_EQ(0, stats.NextImageNumber(stats.GetCameraIndex("A")));
+}
+
+TEST(FrameStatisticsTests, CountsFrameCounterGaps)
+{
+   FrameStatistics stats;
+   size_t cam = stats.GetCameraIndex("Cam");
+   stats.RecordInserted(cam, Arrival(0.0, 10, 0.0));
+   stats.RecordInserted(cam, Arrival(10.0, 11, 10.0));
+   stats.RecordInserted(cam, Arrival(40.0, 14, 40.0));
+   // Restarted counter is not a gap
+   stats.RecordInserted(cam, Arrival(50.0, 0, 50.0));
+   stats.RecordRejected(cam);
+
+   CameraFrameStatistics result = stats.GetStatistics("Cam");
+   EXPECT_EQ(4, result.inserted);
+   EXPECT_EQ(1, result.rejected);
+   EXPECT_EQ(2, result.dropped);
+   // Camera timestamps account for the gap, so nothing is late
+   EXPECT_EQ(0, result.late);
+   EXPECT_EQ(3, result.jitterHistogram[0]);
+}
+
+TEST(FrameStatisticsTests, DetectsLateFramesFromHostTimes)
+{
+   FrameStatistics stats;
+   size_t cam = stats.GetCameraIndex("Cam");
+   stats.RecordInserted(cam, Arrival(0.0));
+   stats.RecordInserted(cam, Arrival(10.0));
+   stats.RecordInserted(cam, Arrival(20.0));
+   stats.RecordInserted(cam, Arrival(50.0));
+   stats.RecordInserted(cam, Arrival(60.003));
+
+   CameraFrameStatistics result = stats.GetStatistics("Cam");
+   EXPECT_EQ(1, result.late);
+   ASSERT_EQ(CameraFrameStatistics::JitterHistogramBins,
+         result.jitterHistogram.size());
+   EXPECT_EQ(1, result.jitterHistogram[0]);
+   // 3 us deviation
+   EXPECT_EQ(1, result.jitterHistogram[2]);
+   // 20 ms deviation
+   EXPECT_EQ(1, result.jitterHistogram[15]);
+}
+
+TEST(FrameStatisticsTests, UnknownCameraHasNoStatistics)
+{
+   FrameStatistics stats;
+   CameraFrameStatistics result = stats.GetStatistics("None");
+   EXPECT_EQ(0, result.inserted);
+   EXPECT_TRUE(stats.GetCameras().empty());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "Error.h"
+#include "ImageTransposer.h"
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace mm;
+
+
+namespace
+{
+
+// 3x2 image:
+//  1 2 3
+//  4 5 6
+template <typename Pixel>
+std::vector<Pixel> SmallImage()
+{
+   std::vector<Pixel> image;
+   for (int i = 1; i <= 6; ++i)
+      image.push_back(static_cast<Pixel>(i));
+   return image;
+}
+
+template <typename Pixel>
+std::vector<Pixel> Transform(const ImageTransposer& transposer,
+      const std::vector<Pixel>& image, unsigned width, unsigned height)
+{
+   std::vector<Pixel> result(image.size());
+   transposer.Transform(reinterpret_cast<const unsigned char*>(&image[0]),
+         width, height, sizeof(Pixel),
+         reinterpret_cast<unsigned char*>(&result[0]));
+   return result;
+}
+
+} // anonymous namespace
+
+
+TEST(ImageTransposerTests, Mirror)
+{
+   std::vector<boost::uint8_t> image = SmallImage<boost::uint8_t>();
+
+   std::vector<boost::uint8_t> x =
+      Transform(ImageTransposer(false, true, false), image, 3, 2);
+   const boost::uint8_t expectedX[] = { 3, 2, 1, 6, 5, 4 };
+   EXPECT_TRUE(std::equal(x.begin(), x.end(), expectedX));
+
+   std::vector<boost::uint8_t> y =
+      Transform(ImageTransposer(false, false, true), image, 3, 2);
+   const boost::uint8_t expectedY[] = { 4, 5, 6, 1, 2, 3 };
+   EXPECT_TRUE(std::equal(y.begin(), y.end(), expectedY));
+}
+
+TEST(ImageTransposerTests, SwapThenMirror)
+{
+   unsigned newWidth, newHeight;
+   ImageTransposer(true, false, false).GetTransformedSize(3, 2,
+         newWidth, newHeight);
+   EXPECT_EQ(2u, newWidth);
+   EXPECT_EQ(3u, newHeight);
+
+   std::vector<boost::uint16_t> image = SmallImage<boost::uint16_t>();
+   std::vector<boost::uint16_t> swapped =
+      Transform(ImageTransposer(true, false, false), image, 3, 2);
+   const boost::uint16_t expectedSwap[] = { 1, 4, 2, 5, 3, 6 };
+   EXPECT_TRUE(std::equal(swapped.begin(), swapped.end(), expectedSwap));
+
+   std::vector<boost::uint32_t> image32 = SmallImage<boost::uint32_t>();
+   std::vector<boost::uint32_t> all =
+      Transform(ImageTransposer(true, true, true), image32, 3, 2);
+   const boost::uint32_t expectedAll[] = { 6, 3, 5, 2, 4, 1 };
+   EXPECT_TRUE(std::equal(all.begin(), all.end(), expectedAll));
+}
+
+TEST(ImageTransposerTests, LargeTransposeSpansTiles)
+{
+   const unsigned width = 70, height = 45;
+   std::vector<boost::uint64_t> image(width * height);
+   for (size_t i = 0; i < image.size(); ++i)
+      image[i] = i;
+   std::vector<boost::uint64_t> result =
+      Transform(ImageTransposer(true, false, true), image, width, height);
+   // Transposed image is height wide; then mirrored top-bottom
+   for (unsigned y = 0; y < height; ++y)
+   {
+      for (unsigned x = 0; x < width; ++x)
+      {
+         ASSERT_EQ(image[y * width + x],
+               result[(width - 1 - x) * height + y]);
+      }
+   }
+}
+
+TEST(ImageTransposerTests, UnsupportedPixelSize)
+{
+   std::vector<unsigned char> image(6), result(6);
+   EXPECT_THROW(ImageTransposer(true, false, false).Transform(&image[0],
+            1, 2, 3, &result[0]), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
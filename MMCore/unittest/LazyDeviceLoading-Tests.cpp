@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+#include "TestAdapters.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// These tests use the DemoCamera adapter; see TestAdapters.h for how adapters
+// are found.
+class LazyDeviceLoadingTests : public ::testing::Test
+{
+protected:
+   CMMCore core_;
+   bool haveAdapter_;
+
+   virtual void SetUp()
+   {
+      mm::test::SetAdapterSearchPaths(core_);
+      haveAdapter_ = mm::test::HaveAdapter(core_, "DemoCamera");
+      core_.enableLazyDeviceLoading(true);
+   }
+};
+
+namespace
+{
+
+void GetExposure(CMMCore* core, std::string* result)
+{
+   try
+   {
+      *result = core->getProperty("Cam", "Exposure");
+   }
+   catch (const CMMError&)
+   {
+   }
+}
+
+void GetName(CMMCore* core, const char* label, std::string* result)
+{
+   try
+   {
+      *result = core->getProperty(label, MM::g_Keyword_Name);
+   }
+   catch (const CMMError&)
+   {
+   }
+}
+
+} // anonymous namespace
+
+
+TEST_F(LazyDeviceLoadingTests, ListingDoesNotLoadDevices)
+{
+   if (!haveAdapter_)
+      return;
+   core_.loadDevice("Cam", "DemoCamera", "DCam");
+   core_.loadDevice("Stage", "DemoCamera", "DStage");
+   core_.initializeAllDevices();
+
+   EXPECT_EQ(3u, core_.getLoadedDevices().size()); // Including Core
+   std::vector<std::string> cameras =
+      core_.getLoadedDevicesOfType(MM::CameraDevice);
+   ASSERT_EQ(1u, cameras.size());
+   EXPECT_EQ("Cam", cameras[0]);
+   std::vector<std::string> allowed =
+      core_.getAllowedPropertyValues("Core", "Camera");
+   EXPECT_TRUE(std::find(allowed.begin(), allowed.end(), "Cam") != allowed.end());
+   core_.getSystemState();
+   core_.waitForSystem();
+
+   EXPECT_TRUE(core_.isDeviceDeferred("Cam"));
+   EXPECT_TRUE(core_.isDeviceDeferred("Stage"));
+}
+
+TEST_F(LazyDeviceLoadingTests, AccessLoadsDevice)
+{
+   if (!haveAdapter_)
+      return;
+   core_.loadDevice("Cam", "DemoCamera", "DCam");
+   core_.loadDevice("Stage", "DemoCamera", "DStage");
+   core_.initializeAllDevices();
+
+   core_.setProperty("Cam", "Exposure", "25");
+   EXPECT_FALSE(core_.isDeviceDeferred("Cam"));
+   EXPECT_TRUE(core_.isDeviceDeferred("Stage"));
+   EXPECT_EQ(25.0, core_.getExposure("Cam"));
+}
+
+TEST_F(LazyDeviceLoadingTests, ConcurrentAccessLoadsDeviceOnce)
+{
+   if (!haveAdapter_)
+      return;
+   core_.loadDevice("Cam", "DemoCamera", "DCam");
+   core_.initializeAllDevices();
+
+   const int nThreads = 8;
+   std::vector<std::string> results(nThreads);
+   boost::thread_group threads;
+   for (int i = 0; i < nThreads; ++i)
+      threads.create_thread(boost::bind(&GetExposure, &core_, &results[i]));
+   threads.join_all();
+
+   EXPECT_FALSE(core_.isDeviceDeferred("Cam"));
+   for (int i = 0; i < nThreads; ++i)
+      EXPECT_FALSE(results[i].empty());
+   EXPECT_EQ(2u, core_.getLoadedDevices().size());
+}
+
+TEST_F(LazyDeviceLoadingTests, FailedSetupLeavesDeviceDeferred)
+{
+   if (!haveAdapter_)
+      return;
+   const char* filename = "LazyDeviceLoading-Tests.cfg";
+   {
+      std::ofstream cfg(filename);
+      cfg << "Device,Cam,DemoCamera,DCam\n";
+      cfg << "Property,Cam,NoSuchProperty,1\n";
+      cfg << "Property,Core,Initialize,1\n";
+   }
+   core_.loadSystemConfiguration(filename);
+   std::remove(filename);
+   ASSERT_TRUE(core_.isDeviceDeferred("Cam"));
+
+   EXPECT_THROW(core_.getProperty("Cam", "Exposure"), CMMError);
+   EXPECT_TRUE(core_.isDeviceDeferred("Cam"));
+   // The recorded settings are kept, so the next access fails the same way
+   EXPECT_THROW(core_.getProperty("Cam", "Exposure"), CMMError);
+   EXPECT_TRUE(core_.isDeviceDeferred("Cam"));
+
+   core_.unloadDevice("Cam");
+   EXPECT_EQ(1u, core_.getLoadedDevices().size());
+}
+
+TEST_F(LazyDeviceLoadingTests, HubPeripheralsBindConcurrently)
+{
+   if (!mm::test::HaveAdapter(core_, "SequenceTester"))
+      return;
+   const char* filename = "LazyDeviceLoading-Tests.cfg";
+   {
+      std::ofstream cfg(filename);
+      cfg << "Device,Hub,SequenceTester,THub\n";
+      cfg << "Device,Cam,SequenceTester,TCamera-0\n";
+      cfg << "Device,Z,SequenceTester,TZStage-0\n";
+      cfg << "Device,Switcher,SequenceTester,TSwitcher-0\n";
+      cfg << "Parent,Cam,Hub\n";
+      cfg << "Parent,Z,Hub\n";
+      cfg << "Parent,Switcher,Hub\n";
+      cfg << "Property,Core,Initialize,1\n";
+   }
+   core_.loadSystemConfiguration(filename);
+   std::remove(filename);
+   ASSERT_TRUE(core_.isDeviceDeferred("Hub"));
+
+   // Each peripheral looks up its hub (binding it) from Initialize(), while
+   // holding the module lock that the other bindings wait for
+   const char* labels[] = { "Cam", "Z", "Switcher" };
+   std::string results[3];
+   boost::thread threads[3];
+   for (int i = 0; i < 3; ++i)
+      threads[i] = boost::thread(boost::bind(&GetName, &core_, labels[i],
+               &results[i]));
+   for (int i = 0; i < 3; ++i)
+      ASSERT_TRUE(threads[i].timed_join(boost::posix_time::seconds(10)));
+
+   EXPECT_EQ("TCamera-0", results[0]);
+   EXPECT_EQ("TZStage-0", results[1]);
+   EXPECT_EQ("TSwitcher-0", results[2]);
+   EXPECT_FALSE(core_.isDeviceDeferred("Hub"));
+   std::vector<std::string> peripherals = core_.getLoadedPeripheralDevices("Hub");
+   EXPECT_EQ(3u, peripherals.size());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return mm::test::ExitStatus(RUN_ALL_TESTS());
+}
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include "MonotonicClock.h"
+#include "../MMDevice/MMDevice.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <cstdlib>
+
+using mm::MonotonicClock;
+
+
+TEST(MonotonicClockTests, NeverGoesBackwards)
+{
+   boost::int64_t previous = MonotonicClock::NowUs();
+   for (int i = 0; i < 100000; ++i)
+   {
+      boost::int64_t now = MonotonicClock::NowUs();
+      ASSERT_GE(now, previous);
+      previous = now;
+   }
+}
+
+TEST(MonotonicClockTests, LocalTimeMatchesWallClock)
+{
+   boost::posix_time::time_duration diff =
+      MonotonicClock::NowAsLocalTime() -
+      boost::posix_time::microsec_clock::local_time();
+   EXPECT_LT(std::abs(diff.total_milliseconds()), 1000);
+}
+
+TEST(MonotonicClockTests, MMTimeAdvancesWithClock)
+{
+   MM::MMTime t0 = MonotonicClock::NowAsMMTime();
+   boost::int64_t us0 = MonotonicClock::NowUs();
+   EXPECT_GT(t0.getMsec(), 0.0);
+
+   boost::int64_t us1;
+   do
+   {
+      us1 = MonotonicClock::NowUs();
+   } while (us1 - us0 < 2000);
+   MM::MMTime t1 = MonotonicClock::NowAsMMTime();
+   EXPECT_GE((t1 - t0).getMsec(), 2.0);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
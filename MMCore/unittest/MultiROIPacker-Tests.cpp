@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "Error.h"
+#include "MultiROIPacker.h"
+
+#include <vector>
+
+using namespace mm;
+
+
+namespace
+{
+
+// Frame whose pixel values encode their coordinates
+std::vector<unsigned char> CoordinateFrame(unsigned width, unsigned height)
+{
+   std::vector<unsigned char> frame(width * height);
+   for (unsigned y = 0; y < height; ++y)
+      for (unsigned x = 0; x < width; ++x)
+         frame[y * width + x] = static_cast<unsigned char>(16 * y + x);
+   return frame;
+}
+
+} // anonymous namespace
+
+
+TEST(MultiROIPackerTests, EqualWidthROIsAreStacked)
+{
+   std::vector<MultiROIPacker::ROI> rois;
+   rois.push_back(MultiROIPacker::ROI(10, 20, 2, 2));
+   rois.push_back(MultiROIPacker::ROI(13, 23, 2, 1));
+   MultiROIPacker packer(rois);
+
+   EXPECT_EQ(5u, packer.GetFrameWidth());
+   EXPECT_EQ(4u, packer.GetFrameHeight());
+   EXPECT_EQ(2u, packer.GetPackedWidth());
+   EXPECT_EQ(3u, packer.GetPackedHeight());
+   EXPECT_EQ("10,20,2,2;13,23,2,1", packer.GetROITable());
+
+   std::vector<unsigned char> frame = CoordinateFrame(5, 4);
+   std::vector<unsigned char> packed(6, 0xff);
+   packer.Pack(&frame[0], 1, &packed[0]);
+   EXPECT_EQ(0x00, packed[0]);
+   EXPECT_EQ(0x01, packed[1]);
+   EXPECT_EQ(0x10, packed[2]);
+   EXPECT_EQ(0x11, packed[3]);
+   EXPECT_EQ(0x33, packed[4]);
+   EXPECT_EQ(0x34, packed[5]);
+}
+
+TEST(MultiROIPackerTests, UnequalWidthsPadLastRow)
+{
+   std::vector<MultiROIPacker::ROI> rois;
+   rois.push_back(MultiROIPacker::ROI(0, 0, 3, 1));
+   rois.push_back(MultiROIPacker::ROI(1, 2, 1, 2));
+   MultiROIPacker packer(rois);
+
+   EXPECT_EQ(3u, packer.GetPackedWidth());
+   EXPECT_EQ(2u, packer.GetPackedHeight());
+
+   // 16-bit pixels
+   std::vector<unsigned short> frame(3 * 4);
+   for (size_t i = 0; i < frame.size(); ++i)
+      frame[i] = static_cast<unsigned short>(1000 + i);
+   std::vector<unsigned short> packed(6, 0xffff);
+   MultiROIPacker::Copier copier(packer,
+         reinterpret_cast<const unsigned char*>(&frame[0]), 2);
+   copier.CopyPixels(0, reinterpret_cast<unsigned char*>(&packed[0]));
+   EXPECT_EQ(1000, packed[0]);
+   EXPECT_EQ(1002, packed[2]);
+   EXPECT_EQ(1007, packed[3]);
+   EXPECT_EQ(1010, packed[4]);
+   EXPECT_EQ(0, packed[5]);
+}
+
+TEST(MultiROIPackerTests, RejectsEmptyROIs)
+{
+   std::vector<MultiROIPacker::ROI> rois;
+   EXPECT_THROW((MultiROIPacker(rois)), CMMError);
+   rois.push_back(MultiROIPacker::ROI(0, 0, 0, 1));
+   EXPECT_THROW((MultiROIPacker(rois)), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
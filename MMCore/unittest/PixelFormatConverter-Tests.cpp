@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include "Error.h"
+#include "PixelFormatConverter.h"
+
+#include <boost/cstdint.hpp>
+
+#include <vector>
+
+using namespace mm;
+
+
+namespace
+{
+
+std::vector<boost::uint16_t> Convert(MM::SourcePixelFormat format,
+      unsigned width, unsigned height, unsigned rowPitch,
+      const std::vector<unsigned char>& src)
+{
+   PixelFormatConverter converter(format, width, height, rowPitch, 2, 1);
+   std::vector<boost::uint16_t> dest(width * height);
+   converter.Convert(&src[0], reinterpret_cast<unsigned char*>(&dest[0]));
+   return dest;
+}
+
+} // anonymous namespace
+
+
+TEST(PixelFormatConverterTests, UnpacksPairs)
+{
+   std::vector<unsigned char> src;
+   src.push_back(0xab);
+   src.push_back(0x21);
+   src.push_back(0xcd);
+
+   std::vector<boost::uint16_t> dest =
+      Convert(MM::SourceMono12Packed, 2, 1, 0, src);
+   EXPECT_EQ(0xab1, dest[0]);
+   EXPECT_EQ(0xcd2, dest[1]);
+
+   dest = Convert(MM::SourceMono10Packed, 2, 1, 0, src);
+   EXPECT_EQ(0x2ad, dest[0]);
+   EXPECT_EQ(0x336, dest[1]);
+
+   dest = Convert(MM::SourceMono12p, 2, 1, 0, src);
+   EXPECT_EQ(0x1ab, dest[0]);
+   EXPECT_EQ(0xcd2, dest[1]);
+}
+
+TEST(PixelFormatConverterTests, WholeRowsMatchPairwiseUnpacking)
+{
+   // Odd width with row padding, so that every code path is exercised
+   const unsigned width = 11, height = 3, rowPitch = 20;
+   std::vector<unsigned char> src(rowPitch * height);
+   for (size_t i = 0; i < src.size(); ++i)
+      src[i] = static_cast<unsigned char>(i * 37 + 11);
+
+   std::vector<boost::uint16_t> dest =
+      Convert(MM::SourceMono12p, width, height, rowPitch, src);
+   for (unsigned y = 0; y < height; ++y)
+   {
+      for (unsigned x = 0; x < width; ++x)
+      {
+         const unsigned char* pair = &src[y * rowPitch + 3 * (x / 2)];
+         boost::uint16_t expected = (x % 2) ?
+            ((pair[1] >> 4) | (pair[2] << 4)) :
+            (pair[0] | ((pair[1] & 0x0f) << 8));
+         EXPECT_EQ(expected, dest[y * width + x]) << x << ", " << y;
+      }
+   }
+}
+
+TEST(PixelFormatConverterTests, SwapsBigEndianAndRemovesPadding)
+{
+   std::vector<unsigned char> src;
+   const unsigned char rows[] = { 0x12, 0x34, 0x56, 0x78, 0xee,
+                                  0x9a, 0xbc, 0xde, 0xf0, 0xee };
+   src.assign(rows, rows + sizeof(rows));
+
+   std::vector<boost::uint16_t> dest =
+      Convert(MM::SourceMono16BigEndian, 2, 2, 5, src);
+   EXPECT_EQ(0x1234, dest[0]);
+   EXPECT_EQ(0x5678, dest[1]);
+   EXPECT_EQ(0x9abc, dest[2]);
+   EXPECT_EQ(0xdef0, dest[3]);
+
+   PixelFormatConverter native(MM::SourceNative, 2, 2, 5, 2, 1);
+   EXPECT_FALSE(native.IsIdentity());
+   std::vector<unsigned char> plain(8);
+   native.Convert(&src[0], &plain[0]);
+   EXPECT_EQ(0x9a, plain[4]);
+   EXPECT_EQ(0xf0, plain[7]);
+}
+
+TEST(PixelFormatConverterTests, RejectsInvalidLayouts)
+{
+   EXPECT_TRUE(PixelFormatConverter(MM::SourceNative, 4, 4, 0, 4, 4)
+         .IsIdentity());
+   EXPECT_THROW(PixelFormatConverter(MM::SourceNative, 4, 4, 15, 4, 4),
+         CMMError);
+   EXPECT_THROW(PixelFormatConverter(MM::SourceMono12p, 4, 4, 0, 1, 1),
+         CMMError);
+   EXPECT_THROW(PixelFormatConverter(MM::SourceMono12Packed, 5, 1, 7, 2, 1),
+         CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include "PixelStatistics.h"
+
+#include "../MMDevice/ImageMetadata.h"
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/cstdint.hpp>
+
+#include <vector>
+
+using namespace mm;
+
+
+namespace
+{
+
+const unsigned char* Bytes(const std::vector<boost::uint16_t>& pixels)
+{
+   return reinterpret_cast<const unsigned char*>(&pixels[0]);
+}
+
+} // anonymous namespace
+
+
+TEST(PixelStatisticsTests, ReducesWithoutHistogram)
+{
+   std::vector<boost::uint16_t> pixels;
+   pixels.push_back(2);
+   pixels.push_back(4);
+   pixels.push_back(4);
+   pixels.push_back(4);
+   pixels.push_back(5);
+   pixels.push_back(5);
+   pixels.push_back(7);
+   pixels.push_back(9);
+
+   PixelStatistics stats(0, 16);
+   stats.Reset(2);
+   stats.Accumulate(Bytes(pixels), pixels.size());
+   stats.Finish();
+   EXPECT_EQ(8u, stats.GetCount());
+   EXPECT_EQ(2u, stats.GetMin());
+   EXPECT_EQ(9u, stats.GetMax());
+   EXPECT_DOUBLE_EQ(5.0, stats.GetMean());
+   EXPECT_DOUBLE_EQ(2.0, stats.GetStdDev());
+   EXPECT_TRUE(stats.GetHistogram().empty());
+}
+
+TEST(PixelStatisticsTests, HistogramCoversBitDepth)
+{
+   // 12-bit pixels in 4 bins of 1024 values
+   std::vector<boost::uint16_t> pixels;
+   pixels.push_back(0);
+   pixels.push_back(1023);
+   pixels.push_back(1024);
+   pixels.push_back(4095);
+   pixels.push_back(5000);
+
+   PixelStatistics stats(4, 12);
+   stats.Reset(2);
+   stats.Accumulate(Bytes(pixels), pixels.size());
+   stats.Finish();
+   EXPECT_EQ(0u, stats.GetMin());
+   EXPECT_EQ(5000u, stats.GetMax());
+   ASSERT_EQ(4u, stats.GetHistogram().size());
+   EXPECT_EQ(2u, stats.GetHistogram()[0]);
+   EXPECT_EQ(1u, stats.GetHistogram()[1]);
+   EXPECT_EQ(0u, stats.GetHistogram()[2]);
+   // Includes the pixel beyond the bit depth
+   EXPECT_EQ(2u, stats.GetHistogram()[3]);
+}
+
+TEST(PixelStatisticsTests, CopyMatchesAccumulate)
+{
+   // Spans several copy and reduction chunks
+   std::vector<unsigned char> pixels(200000);
+   for (size_t i = 0; i < pixels.size(); ++i)
+      pixels[i] = static_cast<unsigned char>((i * 7919) % 251);
+   std::vector<unsigned char> copy(pixels.size());
+
+   for (unsigned bins = 0; bins < 2; ++bins)
+   {
+      PixelStatistics copied(bins * 16, 8);
+      copied.Reset(1);
+      copied.CopyAndAccumulate(&pixels[0], &copy[0], pixels.size());
+      copied.Finish();
+      EXPECT_TRUE(copy == pixels);
+
+      PixelStatistics direct(bins * 16, 8);
+      direct.Reset(1);
+      direct.Accumulate(&pixels[0], pixels.size());
+      direct.Finish();
+
+      EXPECT_EQ(0u, copied.GetMin());
+      EXPECT_EQ(250u, copied.GetMax());
+      EXPECT_EQ(direct.GetMean(), copied.GetMean());
+      EXPECT_EQ(direct.GetStdDev(), copied.GetStdDev());
+      EXPECT_TRUE(direct.GetHistogram() == copied.GetHistogram());
+   }
+}
+
+TEST(PixelStatisticsTests, PutsTags)
+{
+   std::vector<unsigned char> pixels(4, 10);
+   PixelStatistics stats(2, 8);
+   stats.Reset(1);
+   stats.Accumulate(&pixels[0], pixels.size());
+   stats.Finish();
+
+   Metadata md;
+   stats.PutTags(md);
+   EXPECT_EQ("10", md.GetSingleTag(MM::g_Keyword_Metadata_PixelMin).GetValue());
+   EXPECT_EQ("10", md.GetSingleTag(MM::g_Keyword_Metadata_PixelMax).GetValue());
+   EXPECT_EQ("4,0",
+         md.GetSingleTag(MM::g_Keyword_Metadata_PixelHistogram).GetValue());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "Configuration.h"
+#include "PresetMatcher.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace mm;
+
+
+namespace
+{
+
+std::vector<std::string> Values(const char* first, const char* second)
+{
+   std::vector<std::string> values;
+   values.push_back(first);
+   values.push_back(second);
+   return values;
+}
+
+} // anonymous namespace
+
+
+TEST(PresetMatcherTests, CollectsPropertiesInPresetOrder)
+{
+   std::map<std::string, Configuration> presets;
+   presets["A"].addSetting(PropertySetting("Dev", "P1", "1"));
+   presets["A"].addSetting(PropertySetting("Dev", "P2", "x"));
+   presets["B"].addSetting(PropertySetting("Dev", "P2", "y"));
+
+   PresetMatcher matcher(presets);
+   ASSERT_EQ(2u, matcher.GetProperties().size());
+   EXPECT_EQ("P1", matcher.GetProperties()[0].second);
+   EXPECT_EQ("P2", matcher.GetProperties()[1].second);
+}
+
+TEST(PresetMatcherTests, MatchesFirstPresetInNameOrder)
+{
+   std::map<std::string, Configuration> presets;
+   presets["A"].addSetting(PropertySetting("Dev", "P1", "1"));
+   presets["A"].addSetting(PropertySetting("Dev", "P2", "x"));
+   presets["B"].addSetting(PropertySetting("Dev", "P2", "y"));
+   // Does not constrain P1, so also matches whatever A matches for P1
+   presets["C"].addSetting(PropertySetting("Dev", "P2", "x"));
+
+   PresetMatcher matcher(presets);
+   EXPECT_EQ("A", matcher.Match(Values("1", "x")));
+   EXPECT_EQ("B", matcher.Match(Values("1", "y")));
+   EXPECT_EQ("C", matcher.Match(Values("2", "x")));
+   EXPECT_EQ("", matcher.Match(Values("2", "z")));
+   // Repeated query is answered from the cache
+   EXPECT_EQ("", matcher.Match(Values("2", "z")));
+   EXPECT_EQ("A", matcher.Match(Values("1", "x")));
+}
+
+TEST(PresetMatcherTests, EmptyPresetMatchesAnything)
+{
+   std::map<std::string, Configuration> presets;
+   presets["Empty"];
+   presets["Full"].addSetting(PropertySetting("Dev", "P1", "1"));
+
+   PresetMatcher matcher(presets);
+   std::vector<std::string> values(1, "5");
+   EXPECT_EQ("Empty", matcher.Match(values));
+}
+
+TEST(PresetMatcherTests, NoPresets)
+{
+   PresetMatcher matcher((std::map<std::string, Configuration>()));
+   EXPECT_TRUE(matcher.GetProperties().empty());
+   EXPECT_EQ("", matcher.Match(std::vector<std::string>()));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+
+#include "Error.h"
+#include "PreviewBuffer.h"
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace mm;
+
+
+namespace
+{
+
+// Insert images of alternating sizes whose pixels all equal the frame
+// number, modulo 256
+void InsertFrames(PreviewBuffer* preview, int nFrames)
+{
+   std::vector<unsigned char> pixels;
+   Metadata md;
+   for (int i = 0; i < nFrames; ++i)
+   {
+      const unsigned width = (i % 2) ? 64 : 16;
+      pixels.assign(width * width, static_cast<unsigned char>(i));
+      md.PutImageTag("Frame", i);
+      preview->Insert(&pixels[0], width, width, 1, 1, md, static_cast<double>(i));
+   }
+}
+
+} // anonymous namespace
+
+
+TEST(PreviewBufferTests, KeepsOneImagePerInterval)
+{
+   PreviewBuffer preview;
+   preview.SetIntervalMs(30.0);
+   PreviewImage image;
+   EXPECT_FALSE(preview.GetLastImage(image));
+
+   std::vector<unsigned char> pixels(4);
+   Metadata md;
+   for (int i = 0; i < 10; ++i)
+   {
+      md.PutImageTag("Frame", i);
+      pixels[0] = static_cast<unsigned char>(i);
+      preview.Insert(&pixels[0], 2, 2, 1, 1, md, 10.0 * i);
+   }
+
+   ASSERT_TRUE(preview.GetLastImage(image));
+   // Frames at 0, 30, 60 and 90 ms
+   EXPECT_EQ(9, image.pixels[0]);
+   EXPECT_EQ("9", image.md.GetSingleTag("Frame").GetValue());
+   EXPECT_EQ(2u, image.width);
+   EXPECT_EQ(2u, image.height);
+
+   // A new acquisition restarts the clock
+   pixels[0] = 42;
+   preview.Insert(&pixels[0], 2, 2, 1, 1, md, 5.0);
+   ASSERT_TRUE(preview.GetLastImage(image));
+   EXPECT_EQ(42, image.pixels[0]);
+}
+
+TEST(PreviewBufferTests, BinsMonochromePixels)
+{
+   // 5x3 pixels binned by 2; the last column and row are dropped
+   const boost::uint16_t pixels[] = {
+      1, 3, 10, 20, 99,
+      5, 7, 30, 41, 99,
+      99, 99, 99, 99, 99,
+   };
+   PreviewBuffer preview;
+   preview.SetBinning(2);
+   preview.Insert(reinterpret_cast<const unsigned char*>(pixels), 5, 3, 2, 1,
+         Metadata(), 0.0);
+
+   PreviewImage image;
+   ASSERT_TRUE(preview.GetLastImage(image));
+   EXPECT_EQ(2u, image.width);
+   EXPECT_EQ(1u, image.height);
+   EXPECT_EQ(2u, image.byteDepth);
+   ASSERT_EQ(4u, image.pixels.size());
+   const boost::uint16_t* binned =
+      reinterpret_cast<const boost::uint16_t*>(&image.pixels[0]);
+   EXPECT_EQ(4, binned[0]);
+   // 25.25 rounds to 25
+   EXPECT_EQ(25, binned[1]);
+   EXPECT_EQ("2", image.md.GetSingleTag("Width").GetValue());
+}
+
+TEST(PreviewBufferTests, BinsRGBComponentsSeparately)
+{
+   std::vector<unsigned char> pixels(2 * 2 * 4);
+   for (unsigned i = 0; i < 4; ++i)
+   {
+      pixels[4 * i] = 10;
+      pixels[4 * i + 1] = static_cast<unsigned char>(20 * i);
+      pixels[4 * i + 2] = 255;
+   }
+   PreviewBuffer preview;
+   preview.SetBinning(2);
+   preview.Insert(&pixels[0], 2, 2, 4, 4, Metadata(), 0.0);
+
+   PreviewImage image;
+   ASSERT_TRUE(preview.GetLastImage(image));
+   EXPECT_EQ(1u, image.width);
+   EXPECT_EQ(4u, image.nComponents);
+   ASSERT_EQ(4u, image.pixels.size());
+   EXPECT_EQ(10, image.pixels[0]);
+   EXPECT_EQ(30, image.pixels[1]);
+   EXPECT_EQ(255, image.pixels[2]);
+   EXPECT_EQ(0, image.pixels[3]);
+}
+
+TEST(PreviewBufferTests, CopiesConsistentImagesDuringInsertion)
+{
+   PreviewBuffer preview;
+   boost::thread inserter(boost::bind(&InsertFrames, &preview, 20000));
+
+   PreviewImage image;
+   int nRead = 0;
+   bool consistent = true;
+   while (!inserter.timed_join(boost::posix_time::milliseconds(0)))
+   {
+      if (!preview.GetLastImage(image))
+         continue;
+      ++nRead;
+      const int frame =
+         std::atoi(image.md.GetSingleTag("Frame").GetValue().c_str());
+      const unsigned width = (frame % 2) ? 64 : 16;
+      const unsigned char value = static_cast<unsigned char>(frame);
+      if (image.width != width || image.height != width ||
+            image.pixels.size() != width * width ||
+            std::count(image.pixels.begin(), image.pixels.end(), value) !=
+            static_cast<long>(image.pixels.size()))
+      {
+         consistent = false;
+         break;
+      }
+   }
+   inserter.join();
+
+   EXPECT_TRUE(consistent);
+   EXPECT_GT(nRead, 0);
+   ASSERT_TRUE(preview.GetLastImage(image));
+   EXPECT_EQ("19999", image.md.GetSingleTag("Frame").GetValue());
+}
+
+TEST(PreviewBufferTests, RejectsInvalidBinning)
+{
+   PreviewBuffer preview;
+   EXPECT_THROW(preview.SetBinning(0), CMMError);
+   EXPECT_THROW(preview.SetBinning(PreviewBuffer::MaxBinning + 1), CMMError);
+   EXPECT_EQ(1u, preview.GetBinning());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include "SnapTask.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <stdexcept>
+
+using mm::SnapTask;
+
+
+namespace
+{
+
+int Succeed() { return DEVICE_OK; }
+int Fail() { return DEVICE_NOT_CONNECTED; }
+int Throw() { throw std::runtime_error("test"); }
+
+// A step that does not return until opened
+class Gate
+{
+public:
+   Gate() : open_(false), ran_(false) {}
+
+   int Pass()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      ran_ = true;
+      while (!open_)
+         condition_.wait(lock);
+      return DEVICE_OK;
+   }
+
+   void Open()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      open_ = true;
+      condition_.notify_all();
+   }
+
+   bool Ran()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      return ran_;
+   }
+
+private:
+   boost::mutex mutex_;
+   boost::condition_variable condition_;
+   bool open_;
+   bool ran_;
+};
+
+} // anonymous namespace
+
+TEST(SnapTaskTests, ReturnsAtExposureEndBeforeReadout)
+{
+   Gate readout;
+   SnapTask task(7, 0, &Succeed, boost::bind(&Gate::Pass, &readout));
+   EXPECT_EQ(7, task.GetId());
+   EXPECT_EQ(DEVICE_OK, task.WaitForExposureEnd());
+   EXPECT_FALSE(task.IsDone());
+
+   readout.Open();
+   EXPECT_EQ(DEVICE_OK, task.WaitForReadout());
+   EXPECT_TRUE(task.IsDone());
+   EXPECT_TRUE(readout.Ran());
+}
+
+TEST(SnapTaskTests, FailedExposureSkipsReadout)
+{
+   Gate readout;
+   readout.Open();
+   SnapTask task(1, 0, &Fail, boost::bind(&Gate::Pass, &readout));
+   EXPECT_EQ(DEVICE_NOT_CONNECTED, task.WaitForExposureEnd());
+   EXPECT_EQ(DEVICE_NOT_CONNECTED, task.WaitForReadout());
+   EXPECT_FALSE(readout.Ran());
+}
+
+TEST(SnapTaskTests, ReportsExceptionsAsErrors)
+{
+   SnapTask task(1, 0, &Succeed, &Throw);
+   EXPECT_EQ(DEVICE_OK, task.WaitForExposureEnd());
+   EXPECT_EQ(DEVICE_ERR, task.WaitForReadout());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
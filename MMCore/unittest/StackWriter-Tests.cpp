@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "FrameCodec.h"
+#include "StackWriter.h"
+
+#include "../MMDevice/DeviceUtils.h"
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/cstdint.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using mm::StackWriter;
+
+
+namespace
+{
+
+const unsigned width = 5;
+const unsigned height = 3;
+
+std::vector<unsigned char> ReadFile(const std::string& path)
+{
+   std::ifstream in(path.c_str(), std::ios::binary);
+   return std::vector<unsigned char>(std::istreambuf_iterator<char>(in),
+         std::istreambuf_iterator<char>());
+}
+
+std::vector<std::string> ReadLines(const std::string& path)
+{
+   std::ifstream in(path.c_str());
+   std::vector<std::string> lines;
+   std::string line;
+   while (std::getline(in, line))
+      lines.push_back(line);
+   return lines;
+}
+
+template <typename T>
+T Read(const std::vector<unsigned char>& file, boost::uint64_t offset)
+{
+   T value;
+   std::memcpy(&value, &file[static_cast<size_t>(offset)], sizeof(T));
+   return value;
+}
+
+class StackWriterTests : public ::testing::Test
+{
+protected:
+   StackWriterTests() :
+      path_("StackWriter-Tests.out"),
+      buffer_(1),
+      pixels_(width * height * 2)
+   {}
+
+   virtual void SetUp()
+   {
+      ASSERT_TRUE(buffer_.Initialize(1, width, height, 2));
+   }
+
+   virtual void TearDown()
+   {
+      std::remove(path_.c_str());
+      std::remove((path_ + ".idx").c_str());
+   }
+
+   void Insert(unsigned char value)
+   {
+      ASSERT_TRUE(TryInsert(value));
+   }
+
+   bool TryInsert(unsigned char value)
+   {
+      for (size_t i = 0; i < pixels_.size(); ++i)
+         pixels_[i] = static_cast<unsigned char>(value + i);
+      Metadata md;
+      md.PutImageTag<std::string>("Label", "a\tb");
+      return buffer_.InsertImage(&pixels_[0], width, height, 2, &md);
+   }
+
+   std::string path_;
+   CircularBuffer buffer_;
+   std::vector<unsigned char> pixels_;
+};
+
+} // anonymous namespace
+
+
+TEST_F(StackWriterTests, WritesBigTiffPages)
+{
+   {
+      StackWriter writer(buffer_, path_, StackWriter::FormatBigTiff, 0);
+      Insert(10);
+      Insert(20);
+      writer.Finish();
+      EXPECT_EQ(2, writer.GetFrameCount());
+      EXPECT_FALSE(writer.IsRunning());
+   }
+
+   std::vector<unsigned char> file = ReadFile(path_);
+   ASSERT_GE(file.size(), 16u);
+   EXPECT_EQ(43, Read<boost::uint16_t>(file, 2));
+   EXPECT_EQ(8, Read<boost::uint16_t>(file, 4));
+
+   boost::uint64_t ifd = Read<boost::uint64_t>(file, 8);
+   for (unsigned char page = 0; page < 2; ++page)
+   {
+      ASSERT_NE(0u, ifd);
+      ASSERT_LT(ifd, file.size());
+      boost::uint64_t numEntries = Read<boost::uint64_t>(file, ifd);
+      boost::uint64_t stripOffset = 0, stripBytes = 0;
+      for (boost::uint64_t i = 0; i < numEntries; ++i)
+      {
+         const boost::uint64_t entry = ifd + 8 + 20 * i;
+         const boost::uint16_t tag = Read<boost::uint16_t>(file, entry);
+         if (tag == 256)
+            EXPECT_EQ(width, Read<boost::uint32_t>(file, entry + 12));
+         else if (tag == 258)
+            EXPECT_EQ(16, Read<boost::uint16_t>(file, entry + 12));
+         else if (tag == 273)
+            stripOffset = Read<boost::uint64_t>(file, entry + 12);
+         else if (tag == 279)
+            stripBytes = Read<boost::uint64_t>(file, entry + 12);
+      }
+      ASSERT_EQ(width * height * 2, stripBytes);
+      ASSERT_LE(stripOffset + stripBytes, file.size());
+      EXPECT_EQ(10 * (page + 1), file[static_cast<size_t>(stripOffset)]);
+      EXPECT_EQ(10 * (page + 1) + 29,
+            file[static_cast<size_t>(stripOffset + stripBytes - 1)]);
+      ifd = Read<boost::uint64_t>(file, ifd + 8 + 20 * numEntries);
+   }
+   EXPECT_EQ(0u, ifd);
+}
+
+TEST_F(StackWriterTests, WritesRawFramesAndIndex)
+{
+   {
+      StackWriter writer(buffer_, path_, StackWriter::FormatRaw, 2);
+      Insert(1);
+      Insert(2);
+      Insert(3);
+      writer.Finish();
+      EXPECT_EQ(2, writer.GetFrameCount());
+   }
+
+   std::vector<unsigned char> file = ReadFile(path_);
+   ASSERT_EQ(2 * width * height * 2, file.size());
+   EXPECT_EQ(1, file[0]);
+   EXPECT_EQ(2, file[width * height * 2]);
+
+   std::vector<std::string> lines = ReadLines(path_ + ".idx");
+   ASSERT_EQ(3u, lines.size());
+   EXPECT_EQ('#', lines[0][0]);
+   EXPECT_EQ(0u, lines[1].find("0\t30\t5\t3\t2\t1\t"));
+   EXPECT_EQ(0u, lines[2].find("30\t30\t5\t3\t2\t1\t"));
+   EXPECT_NE(std::string::npos, lines[1].find("\tLabel=a b"));
+
+   // The third image was not read by the writer
+   EXPECT_EQ(3ul, buffer_.GetRemainingImageCount());
+}
+
+TEST_F(StackWriterTests, WrittenImagesMakeRoomWithoutBeingPopped)
+{
+   const long size = static_cast<long>(buffer_.GetSize());
+   const long count = 2 * size + 3;
+   {
+      StackWriter writer(buffer_, path_, StackWriter::FormatRaw, count);
+      for (long i = 0; i < count; ++i)
+      {
+         // The writer may fall behind, but it always catches up
+         int attempts = 0;
+         while (!TryInsert(static_cast<unsigned char>(i)) && ++attempts < 5000)
+            CDeviceUtils::SleepMs(1);
+         ASSERT_LT(attempts, 5000) << "at image " << i;
+      }
+      writer.Finish();
+      EXPECT_EQ(count, writer.GetFrameCount());
+   }
+
+   std::vector<unsigned char> file = ReadFile(path_);
+   ASSERT_EQ(static_cast<size_t>(count) * width * height * 2, file.size());
+   EXPECT_EQ(static_cast<unsigned char>(count - 1),
+         file[(count - 1) * width * height * 2]);
+
+   // Images that were not popped in time are skipped
+   EXPECT_GE(size, static_cast<long>(buffer_.GetRemainingImageCount()));
+   EXPECT_EQ(static_cast<unsigned char>(count - size),
+         buffer_.GetNextImage()[0]);
+}
+
+TEST_F(StackWriterTests, WritesCompressedFrames)
+{
+   {
+      StackWriter writer(buffer_, path_, StackWriter::FormatCompressedRaw, 0);
+      Insert(7);
+      writer.Finish();
+      EXPECT_EQ(1, writer.GetFrameCount());
+   }
+
+   std::vector<unsigned char> file = ReadFile(path_);
+   std::vector<std::string> lines = ReadLines(path_ + ".idx");
+   ASSERT_EQ(2u, lines.size());
+   std::ostringstream expectedEntry;
+   expectedEntry << "0\t" << file.size() << "\t5\t3\t2\t1\t";
+   EXPECT_EQ(0u, lines[1].find(expectedEntry.str()));
+
+   std::vector<unsigned char> image(width * height * 2);
+   mm::FrameCodec codec;
+   codec.Decompress(&file[0], file.size(), &image[0], image.size());
+   EXPECT_EQ(pixels_, image);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
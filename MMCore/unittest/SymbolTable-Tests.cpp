@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "Configuration.h"
+#include "SymbolTable.h"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace mm;
+
+
+namespace
+{
+
+// Interns names shared by all threads, while the table grows
+void InternMany(int count, std::vector<Symbol>* symbols, bool* consistent)
+{
+   symbols->resize(count);
+   *consistent = true;
+   for (int i = 0; i < count; ++i)
+   {
+      const std::string name = "SymbolTableTests-Concurrent-" +
+         boost::lexical_cast<std::string>(i);
+      (*symbols)[i] = SymbolTable::Intern(name);
+      Symbol found;
+      if (!SymbolTable::Find(name.c_str(), found) || found != (*symbols)[i] ||
+            SymbolTable::Name(found) != name)
+         *consistent = false;
+   }
+}
+
+} // anonymous namespace
+
+
+TEST(SymbolTableTests, EqualStringsHaveEqualSymbols)
+{
+   Symbol a = SymbolTable::Intern("SymbolTableTests-A");
+   Symbol b = SymbolTable::Intern(std::string("SymbolTableTests-B"));
+   EXPECT_NE(a, b);
+   EXPECT_EQ(a, SymbolTable::Intern(std::string("SymbolTableTests-A")));
+   EXPECT_EQ(b, SymbolTable::Intern("SymbolTableTests-B"));
+   EXPECT_EQ("SymbolTableTests-A", SymbolTable::Name(a));
+   EXPECT_EQ(NullSymbol, SymbolTable::Intern(""));
+   EXPECT_EQ(NullSymbol, SymbolTable::Intern(static_cast<const char*>(0)));
+}
+
+TEST(SymbolTableTests, FindDoesNotIntern)
+{
+   Symbol symbol;
+   EXPECT_FALSE(SymbolTable::Find("SymbolTableTests-Unseen", symbol));
+   EXPECT_FALSE(SymbolTable::Find("SymbolTableTests-Unseen", symbol));
+   Symbol interned = SymbolTable::Intern("SymbolTableTests-Seen");
+   ASSERT_TRUE(SymbolTable::Find(std::string("SymbolTableTests-Seen"), symbol));
+   EXPECT_EQ(interned, symbol);
+}
+
+TEST(SymbolTableTests, ConfigurationLookupBySymbols)
+{
+   Configuration config;
+   config.addSetting(PropertySetting("Dev", "Prop", "1"));
+   config.addSetting(PropertySetting("Dev", "Other", "2"));
+   config.addSetting(PropertySetting("Dev", "Prop", "3"));
+   ASSERT_EQ(2u, config.size());
+   EXPECT_EQ("3", config.getSetting("Dev", "Prop").getPropertyValue());
+   EXPECT_EQ("Dev-Prop", config.getSetting(0).getKey());
+   EXPECT_TRUE(config.isPropertyIncluded("Dev", "Other"));
+   EXPECT_FALSE(config.isPropertyIncluded("Dev", "SymbolTableTests-Unknown"));
+   EXPECT_TRUE(config.isSettingIncluded(PropertySetting("Dev", "Other", "2")));
+   EXPECT_FALSE(config.isSettingIncluded(PropertySetting("Dev", "Other", "1")));
+   EXPECT_THROW(config.getSetting("SymbolTableTests-NoDev", "Prop"), CMMError);
+
+   config.deleteSetting("Dev", "Prop");
+   ASSERT_EQ(1u, config.size());
+   EXPECT_EQ("2", config.getSetting("Dev", "Other").getPropertyValue());
+   EXPECT_FALSE(config.isPropertyIncluded("Dev", "Prop"));
+}
+
+TEST(SymbolTableTests, ConcurrentInterningAgrees)
+{
+   const int nThreads = 4;
+   const int count = 2000; // Enough to grow the table several times
+   std::vector< std::vector<Symbol> > symbols(nThreads);
+   bool consistent[nThreads];
+   boost::thread_group threads;
+   for (int t = 0; t < nThreads; ++t)
+      threads.create_thread(boost::bind(&InternMany, count, &symbols[t],
+               &consistent[t]));
+   threads.join_all();
+
+   for (int t = 0; t < nThreads; ++t)
+   {
+      EXPECT_TRUE(consistent[t]);
+      EXPECT_TRUE(symbols[t] == symbols[0]);
+   }
+   for (int i = 1; i < count; ++i)
+      EXPECT_NE(symbols[0][i - 1], symbols[0][i]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
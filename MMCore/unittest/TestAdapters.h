@@ -0,0 +1,99 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Lookup of the device adapters used by the Core tests.
+//
+// Adapters are searched for in the working directory and in the directories
+// listed in MM_TEST_ADAPTER_PATH (separated as in PATH), which the Makefile
+// points at the build directories of the adapters. A test that cannot find
+// an adapter it needs is reported as skipped, and the test program then
+// exits with the status that the Automake test driver reports as SKIP.
+namespace mm
+{
+namespace test
+{
+
+// Exit status for tests that were skipped (Automake convention)
+const int SKIPPED_EXIT_STATUS = 77;
+
+inline int& SkippedTestCount()
+{
+   static int count = 0;
+   return count;
+}
+
+inline std::vector<std::string> AdapterSearchPaths()
+{
+#ifdef _WIN32
+   const char separator = ';';
+#else
+   const char separator = ':';
+#endif
+   std::vector<std::string> paths;
+   paths.push_back(".");
+   if (const char* pathList = std::getenv("MM_TEST_ADAPTER_PATH"))
+   {
+      std::string remaining(pathList);
+      for (;;)
+      {
+         std::string::size_type end = remaining.find(separator);
+         std::string path = remaining.substr(0, end);
+         if (!path.empty())
+            paths.push_back(path);
+         if (end == std::string::npos)
+            break;
+         remaining.erase(0, end + 1);
+      }
+   }
+   return paths;
+}
+
+inline void SetAdapterSearchPaths(CMMCore& core)
+{
+   core.setDeviceAdapterSearchPaths(AdapterSearchPaths());
+}
+
+// Returns whether the adapter can be found; if not, the current test is
+// marked as skipped. Call after SetAdapterSearchPaths().
+inline bool HaveAdapter(CMMCore& core, const std::string& name)
+{
+   std::vector<std::string> adapters = core.getDeviceAdapterNames();
+   if (std::find(adapters.begin(), adapters.end(), name) != adapters.end())
+      return true;
+
+   const ::testing::TestInfo* info =
+      ::testing::UnitTest::GetInstance()->current_test_info();
+   std::cout << "[  SKIPPED ] ";
+   if (info)
+      std::cout << info->test_case_name() << '.' << info->name() << ": ";
+   std::cout << name << " adapter not found (set MM_TEST_ADAPTER_PATH)" <<
+      std::endl;
+   ::testing::Test::RecordProperty("skipped", name + " adapter not found");
+   ++SkippedTestCount();
+   return false;
+}
+
+// Exit status for main(), given the result of RUN_ALL_TESTS()
+inline int ExitStatus(int testResult)
+{
+   if (testResult == 0 && SkippedTestCount() > 0)
+   {
+      std::cout << SkippedTestCount() <<
+         " test(s) skipped for lack of device adapters" << std::endl;
+      return SKIPPED_EXIT_STATUS;
+   }
+   return testResult;
+}
+
+} // namespace test
+} // namespace mm
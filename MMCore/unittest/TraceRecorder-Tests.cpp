@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "DeviceCallStatistics.h"
+#include "TraceRecorder.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <sstream>
+#include <string>
+
+using mm::TraceRecorder;
+using mm::TraceScope;
+
+
+namespace
+{
+
+std::string ToJSON(const TraceRecorder& trace)
+{
+   std::ostringstream os;
+   trace.WriteJSON(os);
+   return os.str();
+}
+
+size_t CountOccurrences(const std::string& s, const std::string& what)
+{
+   size_t count = 0;
+   for (size_t pos = s.find(what); pos != std::string::npos;
+         pos = s.find(what, pos + what.size()))
+      ++count;
+   return count;
+}
+
+void RecordMany(TraceRecorder* trace, int n)
+{
+   for (int i = 0; i < n; ++i)
+   {
+      TraceScope scope(trace, "test", "Worker");
+   }
+}
+
+} // anonymous namespace
+
+TEST(TraceRecorderTests, RecordsNothingWhenDisabled)
+{
+   TraceRecorder trace;
+   {
+      TraceScope scope(&trace, "test", "Span");
+      EXPECT_FALSE(scope.IsActive());
+   }
+   {
+      TraceScope scope(0, "test", "Span");
+      EXPECT_FALSE(scope.IsActive());
+   }
+   EXPECT_EQ(0u, trace.GetEventCount());
+   EXPECT_EQ("{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n", ToJSON(trace));
+}
+
+TEST(TraceRecorderTests, WritesSpansAsChromeTraceEvents)
+{
+   TraceRecorder trace;
+   trace.SetEnabled(true);
+   trace.RecordSpan("device", "SnapImage", "device", "Cam\"1\"", 1000, 250);
+   trace.RecordSpan("frame", "popNextImage", "ignored", "", 2000, 5);
+
+   std::string json = ToJSON(trace);
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"SnapImage\",\"cat\":\"device\",\"ph\":\"X\","
+            "\"ts\":1000,\"dur\":250,\"pid\":1,\"tid\":1,"
+            "\"args\":{\"device\":\"Cam\\\"1\\\"\"}}"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"popNextImage\",\"cat\":\"frame\",\"ph\":\"X\","
+            "\"ts\":2000,\"dur\":5,\"pid\":1,\"tid\":1}"));
+   EXPECT_NE(std::string::npos, json.find(
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"));
+   EXPECT_LT(json.find("SnapImage"), json.find("popNextImage"));
+
+   trace.Clear();
+   EXPECT_EQ(0u, trace.GetEventCount());
+}
+
+TEST(TraceRecorderTests, OverwritesOldestEvents)
+{
+   TraceRecorder trace(4);
+   trace.SetEnabled(true);
+   const char* names[] = { "A", "B", "C", "D", "E", "F" };
+   for (int i = 0; i < 6; ++i)
+      trace.RecordSpan("test", names[i], 0, 0, i, 1);
+
+   EXPECT_EQ(4u, trace.GetEventCount());
+   std::string json = ToJSON(trace);
+   EXPECT_EQ(std::string::npos, json.find("\"name\":\"A\""));
+   EXPECT_EQ(std::string::npos, json.find("\"name\":\"B\""));
+   EXPECT_NE(std::string::npos, json.find("\"name\":\"C\""));
+   EXPECT_LT(json.find("\"name\":\"E\""), json.find("\"name\":\"F\""));
+}
+
+TEST(TraceRecorderTests, TracesDeviceCalls)
+{
+   TraceRecorder trace;
+   trace.SetEnabled(true);
+   mm::DeviceCallStatistics stats;
+   stats.SetTrace(&trace, "Stage");
+   {
+      mm::DeviceCallTimer timer(stats, mm::DeviceCallSetPosition);
+   }
+
+   // Statistics themselves remain disabled
+   EXPECT_EQ(0, stats.GetTiming(mm::DeviceCallSetPosition).count);
+   std::string json = ToJSON(trace);
+   EXPECT_NE(std::string::npos, json.find(
+            "\"name\":\"SetPosition\",\"cat\":\"device\""));
+   EXPECT_NE(std::string::npos, json.find("\"args\":{\"device\":\"Stage\"}"));
+}
+
+TEST(TraceRecorderTests, RecordsFromManyThreads)
+{
+   TraceRecorder trace;
+   trace.SetEnabled(true);
+   boost::thread_group threads;
+   for (int i = 0; i < 4; ++i)
+      threads.create_thread(boost::bind(&RecordMany, &trace, 1000));
+   threads.join_all();
+
+   EXPECT_EQ(4000u, trace.GetEventCount());
+   std::string json = ToJSON(trace);
+   EXPECT_EQ(4000u, CountOccurrences(json, "\"name\":\"Worker\""));
+   EXPECT_EQ(4u, CountOccurrences(json, "\"name\":\"thread_name\""));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -283,6 +283,10 @@
 %apply int &OUTPUT { int &y };
 %apply int &OUTPUT { int &xSize };
 %apply int &OUTPUT { int &ySize };
+%apply unsigned int &OUTPUT { unsigned int &width };
+%apply unsigned int &OUTPUT { unsigned int &height };
+%apply unsigned int &OUTPUT { unsigned int &bytesPerPixel };
+%apply unsigned int &OUTPUT { unsigned int &nComponents };
 
 
 // Java typemap
@@ -506,6 +510,54 @@
    }
 }
 
+// Preview images (see CMMCore::enablePreviewStream()) have their own
+// dimensions, which are those of the copy just returned to this thread (a
+// newer preview image may have arrived meanwhile); monochrome pixels map as
+// above, RGB32 to byte[] and RGB64 to short[]
+%typemap(out) void* getLastPreviewImage, void* getLastPreviewImageMD
+{
+   unsigned width, height, bytesPerPixel, nComponents;
+   (arg1)->getRetrievedPreviewImageFormat(width, height, bytesPerPixel,
+         nComponents);
+   long lSize = width * height;
+
+   if (bytesPerPixel == 1 || bytesPerPixel == 4)
+   {
+      long length = lSize * bytesPerPixel;
+      jbyteArray data = JCALL1(NewByteArray, jenv, length);
+      if (data == 0)
+      {
+         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+         if (excep)
+            jenv->ThrowNew(excep, "The system ran out of memory!");
+         $result = 0;
+         return $result;
+      }
+      JCALL4(SetByteArrayRegion, jenv, data, 0, length, (jbyte*)result);
+      $result = data;
+   }
+   else if (bytesPerPixel == 2 || bytesPerPixel == 8)
+   {
+      long length = lSize * bytesPerPixel / 2;
+      jshortArray data = JCALL1(NewShortArray, jenv, length);
+      if (data == 0)
+      {
+         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+         if (excep)
+            jenv->ThrowNew(excep, "The system ran out of memory!");
+         $result = 0;
+         return $result;
+      }
+      JCALL4(SetShortArrayRegion, jenv, data, 0, length, (jshort*)result);
+      $result = data;
+   }
+   else
+   {
+      // don't know how to map
+      $result = 0;
+   }
+}
+
 // Java typemap
 // change default SWIG mapping of void* return values
 // to return CObject containing array of pixel values
@@ -789,6 +841,16 @@
       return popNextTaggedImage(0);
    }
 
+   public TaggedImage popNextTaggedImageForCursor(int cursor, int cameraChannelIndex) throws java.lang.Exception {
+      Metadata md = new Metadata();
+      Object pixels = popNextImageMDForCursor(cursor, cameraChannelIndex, md);
+      return createTaggedImage(pixels, md, cameraChannelIndex);
+   }
+
+   public TaggedImage popNextTaggedImageForCursor(int cursor) throws java.lang.Exception {
+      return popNextTaggedImageForCursor(cursor, 0);
+   }
+
    // convenience functions follow
    
    /*
@@ -884,11 +946,82 @@
 %{
 #include "../MMDevice/MMDeviceConstants.h"
 #include "../MMCore/Configuration.h"
+#include "../MMCore/AcquisitionPlan.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMCore/MMEventCallback.h"
 #include "../MMCore/MMCore.h"
 %}
 
+// Images of per-camera buffers (see CMMCore::enablePerCameraBuffers()) can
+// differ in size from the current camera's, so their size and pixel type
+// are taken from their metadata
+%{
+static jobject ImageFromMetadata(JNIEnv* jenv, const void* pixels,
+      const Metadata& md)
+{
+   long lSize;
+   std::string pixelType;
+   try
+   {
+      lSize = atol(md.GetSingleTag("Width").GetValue().c_str()) *
+         atol(md.GetSingleTag("Height").GetValue().c_str());
+      pixelType = md.GetSingleTag("PixelType").GetValue();
+   }
+   catch (const MetadataKeyError&)
+   {
+      return 0;
+   }
+
+   jarray data = 0;
+   if (pixelType == "GRAY8" || pixelType == "RGB32")
+   {
+      long length = (pixelType == "GRAY8") ? lSize : lSize * 4;
+      jbyteArray bytes = JCALL1(NewByteArray, jenv, length);
+      if (bytes)
+         JCALL4(SetByteArrayRegion, jenv, bytes, 0, length, (const jbyte*)pixels);
+      data = bytes;
+   }
+   else if (pixelType == "GRAY16" || pixelType == "RGB64")
+   {
+      long length = (pixelType == "GRAY16") ? lSize : lSize * 4;
+      jshortArray shorts = JCALL1(NewShortArray, jenv, length);
+      if (shorts)
+         JCALL4(SetShortArrayRegion, jenv, shorts, 0, length, (const jshort*)pixels);
+      data = shorts;
+   }
+   else if (pixelType == "GRAY32")
+   {
+      jfloatArray floats = JCALL1(NewFloatArray, jenv, lSize);
+      if (floats)
+         JCALL4(SetFloatArrayRegion, jenv, floats, 0, lSize, (const jfloat*)pixels);
+      data = floats;
+   }
+   else
+   {
+      // don't know how to map
+      return 0;
+   }
+
+   if (data == 0)
+   {
+      jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+      if (excep)
+         jenv->ThrowNew(excep, "The system ran out of memory!");
+   }
+   return data;
+}
+%}
+
+%typemap(out) void* popNextMergedImageMD
+{
+   $result = ImageFromMetadata(jenv, result, *arg2);
+}
+
+%typemap(out) void* popNextImageMDForCamera
+{
+   $result = ImageFromMetadata(jenv, result, *arg3);
+}
+
 
 // instantiate STL mappings
 
@@ -1059,6 +1192,7 @@ namespace std {
 
 %include "../MMDevice/MMDeviceConstants.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/AcquisitionPlan.h"
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
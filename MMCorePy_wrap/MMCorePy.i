@@ -97,6 +97,38 @@ import_array();
 }
 
 
+// Preview images (see CMMCore::enablePreviewStream()) have their own
+// dimensions, which are those of the copy just returned to this thread; RGB
+// pixels map to a third dimension of 4 components
+%typemap(out) void* getLastPreviewImage, void* getLastPreviewImageMD
+{
+   unsigned width, height, bytesPerPixel, nComponents;
+   (arg1)->getRetrievedPreviewImageFormat(width, height, bytesPerPixel,
+         nComponents);
+   npy_intp dims[3];
+   dims[0] = height;
+   dims[1] = width;
+   dims[2] = nComponents;
+   int nd = (dims[2] > 1) ? 3 : 2;
+   int componentBytes = (dims[2] > 0) ? bytesPerPixel / dims[2] : 0;
+
+   if (componentBytes == 1 || componentBytes == 2 || componentBytes == 4)
+   {
+      PyObject * numpyArray = PyArray_SimpleNew(nd, dims,
+            componentBytes == 1 ? NPY_UINT8 :
+            (componentBytes == 2 ? NPY_UINT16 : NPY_UINT32));
+      memcpy(PyArray_DATA((PyArrayObject *) numpyArray), result,
+            dims[0] * dims[1] * bytesPerPixel);
+      $result = numpyArray;
+   }
+   else
+   {
+      // don't know how to map
+      $result = 0;
+   }
+}
+
+
 %typemap(out) unsigned int*
 {
    //Here we assume we are getting RGBA (32 bits).
@@ -150,11 +182,61 @@ import_array();
 #include "../MMDevice/MMDeviceConstants.h"
 #include "../MMCore/Error.h"
 #include "../MMCore/Configuration.h"
+#include "../MMCore/AcquisitionPlan.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMCore/MMEventCallback.h"
 #include "../MMCore/MMCore.h"
 %}
 
+// Images of per-camera buffers (see CMMCore::enablePerCameraBuffers()) can
+// differ in size from the current camera's, so their size and pixel type
+// are taken from their metadata
+%{
+static PyObject* ImageFromMetadata(const void* pixels, const Metadata& md)
+{
+   npy_intp dims[2];
+   std::string pixelType;
+   try
+   {
+      dims[0] = atol(md.GetSingleTag("Height").GetValue().c_str());
+      dims[1] = atol(md.GetSingleTag("Width").GetValue().c_str());
+      pixelType = md.GetSingleTag("PixelType").GetValue();
+   }
+   catch (const MetadataKeyError&)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Image metadata lacks its size");
+      return 0;
+   }
+
+   int typenum;
+   int bytesPerPixel;
+   if (pixelType == "GRAY8") { typenum = NPY_UINT8; bytesPerPixel = 1; }
+   else if (pixelType == "GRAY16") { typenum = NPY_UINT16; bytesPerPixel = 2; }
+   else if (pixelType == "GRAY32" || pixelType == "RGB32") { typenum = NPY_UINT32; bytesPerPixel = 4; }
+   else if (pixelType == "RGB64") { typenum = NPY_UINT64; bytesPerPixel = 8; }
+   else
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Unknown pixel type");
+      return 0;
+   }
+
+   PyObject * numpyArray = PyArray_SimpleNew(2, dims, typenum);
+   memcpy(PyArray_DATA((PyArrayObject *) numpyArray), pixels,
+         dims[0] * dims[1] * bytesPerPixel);
+   return numpyArray;
+}
+%}
+
+%typemap(out) void* popNextMergedImageMD
+{
+   $result = ImageFromMetadata(result, *arg2);
+}
+
+%typemap(out) void* popNextImageMDForCamera
+{
+   $result = ImageFromMetadata(result, *arg3);
+}
+
 // Extend exception objects to return the exception object message in python.
 // __str__ method gets printed in the traceback, so it should contain the core error message string.
 
@@ -208,12 +290,17 @@ namespace std {
 %apply int &OUTPUT { int &y };
 %apply int &OUTPUT { int &xSize };
 %apply int &OUTPUT { int &ySize };
+%apply unsigned int &OUTPUT { unsigned int &width };
+%apply unsigned int &OUTPUT { unsigned int &height };
+%apply unsigned int &OUTPUT { unsigned int &bytesPerPixel };
+%apply unsigned int &OUTPUT { unsigned int &nComponents };
 
 
 
 %include "../MMDevice/MMDeviceConstants.h"
 %include "../MMCore/Error.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/AcquisitionPlan.h"
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
@@ -1293,7 +1293,13 @@ public:
    virtual unsigned GetImageBytesPerPixel() const = 0;
    virtual int SnapImage() = 0;
 
-   CCameraBase() : busy_(false), stopWhenCBOverflows_(false), thd_(0)
+   CCameraBase() :
+      busy_(false),
+      stopWhenCBOverflows_(false),
+      overlappedInsert_(false),
+      tagsChanged_(true),
+      thd_(0),
+      insertThd_(0)
    {
       // create and initialize common transpose properties
       std::vector<std::string> allowedValues;
@@ -1309,6 +1315,7 @@ public:
       SetAllowedValues(MM::g_Keyword_Transpose_Correction, allowedValues);
 
       thd_ = new BaseSequenceThread(this);
+      insertThd_ = new BaseInsertThread(this);
    }
 
    virtual ~CCameraBase()
@@ -1318,6 +1325,7 @@ public:
          thd_->wait();
       }
       delete thd_;
+      delete insertThd_;
    }
 
    virtual bool Busy() {return busy_;}
@@ -1403,8 +1411,13 @@ public:
     */
    virtual void GetTags(char* serializedMetadata)
    {
-      std::string data = metadata_.Serialize();
-      data.copy(serializedMetadata, data.size(), 0);
+      // The tags are only serialized again after they have changed
+      if (tagsChanged_)
+      {
+         serializedTags_ = metadata_.Serialize();
+         tagsChanged_ = false;
+      }
+      serializedTags_.copy(serializedMetadata, serializedTags_.size(), 0);
    }
 
    // temporary debug methods
@@ -1461,12 +1474,14 @@ public:
    virtual void AddTag(const char* key, const char* deviceLabel, const char* value)
    {
       metadata_.PutTag(key, deviceLabel, value);
+      tagsChanged_ = true;
    }
 
 
    virtual void RemoveTag(const char* key)
    {
       metadata_.RemoveTag(key);
+      tagsChanged_ = true;
    }
 
    virtual bool SupportsMultiROI()
@@ -1522,6 +1537,13 @@ protected:
       {
          return ret;
       }
+      if (overlappedInsert_)
+      {
+         // Hand the frame over to the insert thread and return, so that the
+         // next exposure can start while this frame is being inserted
+         return insertThd_->Submit(GetImageBuffer(), GetImageWidth(),
+               GetImageHeight(), GetImageBytesPerPixel());
+      }
       ret = InsertImage();
       if (ret != DEVICE_OK)
       {
@@ -1532,24 +1554,62 @@ protected:
 
    virtual int InsertImage()
    {
-      char label[MM::MaxStrLength];
-      this->GetLabel(label);
-      Metadata md;
-      md.put("Camera", label);
-      int ret = GetCoreCallback()->InsertImage(this, GetImageBuffer(), GetImageWidth(),
-         GetImageHeight(), GetImageBytesPerPixel(),
-         md.Serialize().c_str());
+      return InsertSequenceImage(GetImageBuffer(), GetImageWidth(),
+            GetImageHeight(), GetImageBytesPerPixel());
+   }
+
+   /**
+    * Inserts an image into the Core's buffer, with the camera label as
+    * metadata. Unless the camera was told to stop on overflow, the buffer is
+    * cleared and the insertion retried if the buffer is full.
+    */
+   int InsertSequenceImage(const unsigned char* pixels, unsigned width,
+         unsigned height, unsigned byteDepth)
+   {
+      // The metadata does not change, so it is serialized only once
+      if (serializedImageMetadata_.empty())
+      {
+         char label[MM::MaxStrLength];
+         this->GetLabel(label);
+         Metadata md;
+         md.put("Camera", label);
+         serializedImageMetadata_ = md.Serialize();
+      }
+
+      int ret = GetCoreCallback()->InsertImage(this, pixels, width, height,
+            byteDepth, serializedImageMetadata_.c_str());
       if (!stopWhenCBOverflows_ && ret == DEVICE_BUFFER_OVERFLOW)
       {
          // do not stop on overflow - just reset the buffer
          GetCoreCallback()->ClearImageBuffer(this);
-         return GetCoreCallback()->InsertImage(this, GetImageBuffer(), GetImageWidth(),
-            GetImageHeight(), GetImageBytesPerPixel(),
-            md.Serialize().c_str());
+         return GetCoreCallback()->InsertImage(this, pixels, width, height,
+               byteDepth, serializedImageMetadata_.c_str());
       } else
          return ret;
    }
 
+   /**
+    * Enables or disables overlapped capture and insertion in the default
+    * sequence acquisition.
+    *
+    * When enabled, the default ThreadRun() copies each snapped image into
+    * one of two buffers and lets a second thread insert it into the Core's
+    * buffer, so that the next SnapImage() can start right away. This
+    * benefits cameras whose SnapImage() waits for the exposure. Images are
+    * inserted with InsertSequenceImage(); InsertImage() is not called.
+    *
+    * Cannot be changed while a sequence acquisition is running.
+    */
+   int SetOverlappedSequenceInsert(bool enable)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      overlappedInsert_ = enable;
+      return DEVICE_OK;
+   }
+
+   bool IsOverlappedSequenceInsert() const {return overlappedInsert_;}
+
    virtual double GetIntervalMs() {return thd_->GetIntervalMs();}
    virtual long GetImageCounter() {return thd_->GetImageCounter();}
    virtual long GetNumberOfImages() {return thd_->GetNumberOfImages();}
@@ -1664,6 +1724,9 @@ protected:
       virtual int svc(void) throw()
       {
          int ret=DEVICE_ERR;
+         const bool overlapped = camera_->overlappedInsert_;
+         if (overlapped)
+            camera_->insertThd_->Start();
          try 
          {
             do
@@ -1676,6 +1739,13 @@ protected:
          }catch(...){
             camera_->LogMessage(g_Msg_EXCEPTION_IN_THREAD, false);
          }
+         if (overlapped)
+         {
+            // Insert the images still pending before reporting completion
+            int insertRet = camera_->insertThd_->Finish();
+            if (ret == DEVICE_OK)
+               ret = insertRet;
+         }
          stop_=true;
          UpdateActualDuration();
          camera_->OnThreadExiting();
@@ -1696,15 +1766,158 @@ protected:
    };
    //////////////////////////////////////////////////////////////////////////
 
+   // Nested class inserting images in parallel with the sequence thread
+   // (see SetOverlappedSequenceInsert())
+   ////////////////////////////////////////////////////////////////////////////
+   class BaseInsertThread : public MMDeviceThreadBase
+   {
+      enum { numFrames = 2 };
+   public:
+      BaseInsertThread(CCameraBase* pCam)
+         :camera_(pCam)
+         ,freeFrames_(numFrames)
+         ,queuedFrames_(0)
+         ,nextFill_(0)
+         ,nextInsert_(0)
+         ,queued_(0)
+         ,ret_(DEVICE_OK)
+      {};
+
+      ~BaseInsertThread() {}
+
+      void Start()
+      {
+         nextFill_ = 0;
+         nextInsert_ = 0;
+         queued_ = 0;
+         ret_ = DEVICE_OK;
+         activate();
+      }
+
+      /**
+       * Copies an image and queues it for insertion. Blocks while all
+       * frame buffers are waiting for insertion. Returns the error of a
+       * previous insertion, if any.
+       */
+      int Submit(const unsigned char* pixels, unsigned width,
+            unsigned height, unsigned byteDepth)
+      {
+         freeFrames_.Wait();
+         int ret = GetResult();
+         if (ret != DEVICE_OK)
+         {
+            freeFrames_.Post();
+            return ret;
+         }
+
+         Frame& frame = frames_[nextFill_];
+         nextFill_ = (nextFill_ + 1) % numFrames;
+         frame.pixels.assign(pixels, pixels + width * height * byteDepth);
+         frame.width = width;
+         frame.height = height;
+         frame.byteDepth = byteDepth;
+
+         {
+            MMThreadGuard g(lock_);
+            ++queued_;
+         }
+         queuedFrames_.Post();
+         return DEVICE_OK;
+      }
+
+      /**
+       * Inserts the queued images, ends the thread and returns the first
+       * insertion error.
+       */
+      int Finish()
+      {
+         // Wake up the thread without queueing a frame
+         queuedFrames_.Post();
+         wait();
+         return GetResult();
+      }
+
+   private:
+      struct Frame
+      {
+         std::vector<unsigned char> pixels;
+         unsigned width;
+         unsigned height;
+         unsigned byteDepth;
+      };
+
+      int GetResult()
+      {
+         MMThreadGuard g(lock_);
+         return ret_;
+      }
+
+      virtual int svc(void) throw()
+      {
+         for (;;)
+         {
+            queuedFrames_.Wait();
+            {
+               MMThreadGuard g(lock_);
+               if (queued_ == 0)
+                  break; // Finish() was called
+               --queued_;
+            }
+
+            Frame& frame = frames_[nextInsert_];
+            nextInsert_ = (nextInsert_ + 1) % numFrames;
+            // After an error, keep discarding frames until Finish()
+            if (GetResult() == DEVICE_OK)
+            {
+               int ret = DEVICE_ERR;
+               try
+               {
+                  ret = camera_->InsertSequenceImage(&frame.pixels[0],
+                        frame.width, frame.height, frame.byteDepth);
+               }
+               catch (...)
+               {
+                  camera_->LogMessage(g_Msg_EXCEPTION_IN_THREAD, false);
+               }
+               if (ret != DEVICE_OK)
+               {
+                  MMThreadGuard g(lock_);
+                  ret_ = ret;
+               }
+            }
+            freeFrames_.Post();
+         }
+         return GetResult();
+      }
+
+   private:
+      CCameraBase* camera_;
+      Frame frames_[numFrames];
+      MMThreadSemaphore freeFrames_;
+      MMThreadSemaphore queuedFrames_;
+      int nextFill_;
+      int nextInsert_;
+      long queued_;
+      int ret_;
+      MMThreadLock lock_;
+   };
+   //////////////////////////////////////////////////////////////////////////
+
 
 private:
 
    bool busy_;
    bool stopWhenCBOverflows_;
+   bool overlappedInsert_;
    Metadata metadata_;
+   bool tagsChanged_;
+   std::string serializedTags_;
+   std::string serializedImageMetadata_;
 
    BaseSequenceThread * thd_;
    friend class BaseSequenceThread;
+   BaseInsertThread * insertThd_;
+   friend class BaseInsertThread;
 };
 
 
@@ -27,6 +27,8 @@
    #include <pthread.h>
 #endif
 
+#include <limits.h>
+
 /**
  * Base class for threads in MM devices
  */
@@ -183,3 +185,75 @@ private:
 
    MMThreadLock* lock_;
 };
+
+/**
+ * Counting semaphore.
+ */
+class MMThreadSemaphore
+{
+public:
+   explicit MMThreadSemaphore(long initialCount = 0)
+   {
+#ifdef WIN32
+      sem_ = CreateSemaphore(NULL, initialCount, LONG_MAX, NULL);
+#else
+      count_ = initialCount;
+      pthread_mutex_init(&mutex_, NULL);
+      pthread_cond_init(&cond_, NULL);
+#endif
+   }
+
+   ~MMThreadSemaphore()
+   {
+#ifdef WIN32
+      CloseHandle(sem_);
+#else
+      pthread_cond_destroy(&cond_);
+      pthread_mutex_destroy(&mutex_);
+#endif
+   }
+
+   /**
+    * Decrement the count, waiting for it to become positive if necessary.
+    */
+   void Wait()
+   {
+#ifdef WIN32
+      WaitForSingleObject(sem_, INFINITE);
+#else
+      pthread_mutex_lock(&mutex_);
+      while (count_ == 0)
+         pthread_cond_wait(&cond_, &mutex_);
+      --count_;
+      pthread_mutex_unlock(&mutex_);
+#endif
+   }
+
+   /**
+    * Increment the count, waking up a waiting thread.
+    */
+   void Post()
+   {
+#ifdef WIN32
+      ReleaseSemaphore(sem_, 1, NULL);
+#else
+      pthread_mutex_lock(&mutex_);
+      ++count_;
+      pthread_cond_signal(&cond_);
+      pthread_mutex_unlock(&mutex_);
+#endif
+   }
+
+private:
+   // Forbid copying
+   MMThreadSemaphore(const MMThreadSemaphore&);
+   MMThreadSemaphore& operator=(const MMThreadSemaphore&);
+
+#ifdef WIN32
+   HANDLE sem_;
+#else
+   long count_;
+   pthread_mutex_t mutex_;
+   pthread_cond_t cond_;
+#endif
+};
@@ -27,7 +27,7 @@
 // Header version
 // If any of the class definitions changes, the interface version
 // must be incremented
-#define DEVICE_INTERFACE_VERSION 67
+#define DEVICE_INTERFACE_VERSION 69
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -1292,6 +1292,30 @@ namespace MM {
       virtual int InsertImage(const Device* caller, const ImgBuffer& buf) = 0;
       virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess = true) = 0;
       virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* md = 0, const bool doProcess = true) = 0;
+      /**
+       * Insert an image with padded rows or pixels that need conversion.
+       * The pixels are unpadded and converted while being copied into the
+       * sequence buffer, saving the camera a pass over the image.
+       * rowPitch is the number of bytes from one row to the next (0 for
+       * unpadded rows); each row starts on a byte boundary. byteDepth and
+       * nComponents describe the resulting pixels, which must be 2 and 1
+       * for formats other than SourceNative.
+       */
+      virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned rowPitch, SourcePixelFormat format, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess = true) = 0;
+      /**
+       * Insert several consecutive frames at once, for cameras that
+       * retrieve frames in bulk. buf holds numFrames frames one after the
+       * other, without padding. serializedMetadata applies to all frames;
+       * frameMetadata, if not null, points to numFrames serialized metadata
+       * (each of which may be null or empty) whose tags are added to those
+       * of each frame. The sequence buffer is locked and its slots
+       * reserved once for the whole batch. If the buffer fills up, the
+       * frames that fit are inserted and DEVICE_BUFFER_OVERFLOW is
+       * returned. If numInserted is not null, it receives the number of
+       * leading frames that were inserted, so that the caller can retry
+       * from the first rejected frame.
+       */
+      virtual int InsertImages(const Device* caller, const unsigned char* buf, unsigned numFrames, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const char* const* frameMetadata, unsigned* numInserted, const bool doProcess = true) = 0;
       /// \deprecated Use the other forms instead.
       virtual int InsertImage(const Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess = true) = 0;
       virtual void ClearImageBuffer(const Device* caller) = 0;
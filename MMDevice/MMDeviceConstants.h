@@ -138,6 +138,9 @@ namespace MM {
    const char* const g_Keyword_Transpose_MirrorX = "TransposeMirrorX";
    const char* const g_Keyword_Transpose_MirrorY = "TransposeMirrorY";
    const char* const g_Keyword_Transpose_Correction = "TransposeCorrection";
+   // Read-only "1" on cameras that apply the Transpose properties to their
+   // images themselves; otherwise the Core applies them
+   const char* const g_Keyword_Transpose_InCamera = "TransposeInCamera";
    const char* const g_Keyword_Closed_Position = "ClosedPosition";
    const char* const g_Keyword_HubID = "HubID";
 
@@ -149,6 +152,26 @@ namespace MM {
    const char* const g_Keyword_Metadata_StartTime   = "StartTime-ms";
    const char* const g_Keyword_Metadata_ROI_X       = "ROI-X-start";
    const char* const g_Keyword_Metadata_ROI_Y       = "ROI-Y-start";
+   // Optional tags set by cameras that report a hardware frame counter and
+   // timestamp; used by the Core to detect dropped frames
+   const char* const g_Keyword_Metadata_CameraFrameNumber = "CameraFrameNumber";
+   const char* const g_Keyword_Metadata_CameraTimeStamp   = "CameraTimeStamp-ms";
+   // Set by the Core: time at which the frame was received from the camera
+   const char* const g_Keyword_Metadata_ReceivedTime      = "ReceivedTime-ms";
+   // Set by the Core when the ROIs of a multi-ROI frame are packed into one
+   // image: "x,y,width,height" of each ROI in packing order, separated by ";"
+   const char* const g_Keyword_Metadata_PackedROIs        = "PackedROIs";
+   // Set by the Core on inserted images when pixel statistics are enabled;
+   // the histogram is a comma-separated list of counts in bins that evenly
+   // divide the range from 0 to 2^(camera bit depth)
+   const char* const g_Keyword_Metadata_PixelMin          = "PixelMin";
+   const char* const g_Keyword_Metadata_PixelMax          = "PixelMax";
+   const char* const g_Keyword_Metadata_PixelMean         = "PixelMean";
+   const char* const g_Keyword_Metadata_PixelStdDev       = "PixelStdDev";
+   const char* const g_Keyword_Metadata_PixelHistogram    = "PixelHistogram";
+   // Set by the Core on images popped from a compressed buffer: bytes of
+   // all channels of the image, compressed
+   const char* const g_Keyword_Metadata_CompressedSize    = "CompressedSize";
 
    // configuration file format constants
    const char* const g_FieldDelimiters = ",";
@@ -247,6 +270,17 @@ namespace MM {
       FocusDirectionAwayFromSample,
    };
 
+   // Layout of the pixels passed to Core::InsertImage() together with a row
+   // pitch. Except for SourceNative, the formats are monochrome and are
+   // converted to 16-bit pixels in host byte order.
+   enum SourcePixelFormat {
+      SourceNative,          // Pixels as stored by the Core
+      SourceMono10Packed,    // 2 pixels in 3 bytes (GigE Vision Mono10Packed)
+      SourceMono12Packed,    // 2 pixels in 3 bytes (GigE Vision Mono12Packed)
+      SourceMono12p,         // LSB-first 12-bit stream (GenICam Mono12p)
+      SourceMono16BigEndian
+   };
+
    //////////////////////////////////////////////////////////////////////////////
    // Notification constants
    //
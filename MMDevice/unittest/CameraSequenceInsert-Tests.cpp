@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include "DeviceBase.h"
+#include "DeviceThreads.h"
+#include "DeviceUtils.h"
+#include "MMDevice.h"
+
+#include <vector>
+
+
+namespace
+{
+
+const unsigned imageWidth = 4;
+const unsigned imageHeight = 2;
+
+// Minimal core callback that records the images inserted by a camera
+class ImageRecordingCore : public MM::Core
+{
+public:
+   ImageRecordingCore() :
+      insertDelayMs_(0),
+      failAfter_(-1)
+   {}
+
+   void SetInsertDelayMs(double delayMs) { insertDelayMs_ = delayMs; }
+   void SetFailAfter(int count) { failAfter_ = count; }
+   std::vector<unsigned char> GetInsertedFirstBytes()
+   {
+      MMThreadGuard g(lock_);
+      return inserted_;
+   }
+
+   virtual int InsertImage(const MM::Device*, const unsigned char* buf,
+         unsigned, unsigned, unsigned, const char*, const bool)
+   {
+      CDeviceUtils::SleepMs(static_cast<long>(insertDelayMs_));
+      MMThreadGuard g(lock_);
+      if (failAfter_ >= 0 && static_cast<int>(inserted_.size()) >= failAfter_)
+         return DEVICE_ERR;
+      inserted_.push_back(buf[0]);
+      return DEVICE_OK;
+   }
+
+   virtual int LogMessage(const MM::Device*, const char*, bool) const { return DEVICE_OK; }
+   virtual MM::Device* GetDevice(const MM::Device*, const char*) { return 0; }
+   virtual int GetDeviceProperty(const char*, const char*, char*) { return DEVICE_ERR; }
+   virtual int SetDeviceProperty(const char*, const char*, const char*) { return DEVICE_ERR; }
+   virtual void GetLoadedDeviceOfType(const MM::Device*, MM::DeviceType, char* name, const unsigned int) { name[0] = 0; }
+   virtual int SetSerialProperties(const char*, const char*, const char*, const char*, const char*, const char*, const char*) { return DEVICE_ERR; }
+   virtual int SetSerialCommand(const MM::Device*, const char*, const char*, const char*) { return DEVICE_ERR; }
+   virtual int GetSerialAnswer(const MM::Device*, const char*, unsigned long, char*, const char*) { return DEVICE_ERR; }
+   virtual int WriteToSerial(const MM::Device*, const char*, const unsigned char*, unsigned long) { return DEVICE_ERR; }
+   virtual int ReadFromSerial(const MM::Device*, const char*, unsigned char*, unsigned long, unsigned long&) { return DEVICE_ERR; }
+   virtual int PurgeSerial(const MM::Device*, const char*) { return DEVICE_ERR; }
+   virtual MM::PortType GetSerialPortType(const char*) const { return MM::InvalidPort; }
+   virtual int OnPropertiesChanged(const MM::Device*) { return DEVICE_OK; }
+   virtual int OnPropertyChanged(const MM::Device*, const char*, const char*) { return DEVICE_OK; }
+   virtual int OnStagePositionChanged(const MM::Device*, double) { return DEVICE_OK; }
+   virtual int OnXYStagePositionChanged(const MM::Device*, double, double) { return DEVICE_OK; }
+   virtual int OnExposureChanged(const MM::Device*, double) { return DEVICE_OK; }
+   virtual int OnSLMExposureChanged(const MM::Device*, double) { return DEVICE_OK; }
+   virtual int OnMagnifierChanged(const MM::Device*) { return DEVICE_OK; }
+   virtual unsigned long GetClockTicksUs(const MM::Device*) { return 0; }
+   virtual MM::MMTime GetCurrentMMTime() { return MM::MMTime(); }
+   virtual int AcqFinished(const MM::Device*, int) { return DEVICE_OK; }
+   virtual int PrepareForAcq(const MM::Device*) { return DEVICE_OK; }
+   virtual int InsertImage(const MM::Device*, const ImgBuffer&) { return DEVICE_ERR; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, unsigned, const char*, const bool) { return DEVICE_ERR; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, const Metadata*, const bool) { return DEVICE_ERR; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, MM::SourcePixelFormat, unsigned, unsigned, const char*, const bool) { return DEVICE_ERR; }
+   virtual int InsertImages(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, unsigned, unsigned, const char*, const char* const*, unsigned*, const bool) { return DEVICE_ERR; }
+   virtual void ClearImageBuffer(const MM::Device*) {}
+   virtual bool InitializeImageBuffer(unsigned, unsigned, unsigned int, unsigned int, unsigned int) { return true; }
+   virtual int InsertMultiChannel(const MM::Device*, const unsigned char*, unsigned, unsigned, unsigned, unsigned, Metadata*) { return DEVICE_ERR; }
+   virtual const char* GetImage() { return 0; }
+   virtual int GetImageDimensions(int&, int&, int&) { return DEVICE_ERR; }
+   virtual int GetFocusPosition(double&) { return DEVICE_ERR; }
+   virtual int SetFocusPosition(double) { return DEVICE_ERR; }
+   virtual int MoveFocus(double) { return DEVICE_ERR; }
+   virtual int SetXYPosition(double, double) { return DEVICE_ERR; }
+   virtual int GetXYPosition(double&, double&) { return DEVICE_ERR; }
+   virtual int MoveXYStage(double, double) { return DEVICE_ERR; }
+   virtual int SetExposure(double) { return DEVICE_ERR; }
+   virtual int GetExposure(double&) { return DEVICE_ERR; }
+   virtual int SetConfig(const char*, const char*) { return DEVICE_ERR; }
+   virtual int GetCurrentConfig(const char*, int, char*) { return DEVICE_ERR; }
+   virtual int GetChannelConfig(char*, const unsigned int) { return DEVICE_ERR; }
+   virtual MM::ImageProcessor* GetImageProcessor(const MM::Device*) { return 0; }
+   virtual MM::AutoFocus* GetAutoFocus(const MM::Device*) { return 0; }
+   virtual MM::Hub* GetParentHub(const MM::Device*) const { return 0; }
+   virtual MM::State* GetStateDevice(const MM::Device*, const char*) { return 0; }
+   virtual MM::SignalIO* GetSignalIODevice(const MM::Device*, const char*) { return 0; }
+   virtual void NextPostedError(int&, char*, int, int&) {}
+   virtual void PostError(const int, const char*) {}
+   virtual void ClearPostedErrors() {}
+
+private:
+   double insertDelayMs_;
+   int failAfter_;
+   std::vector<unsigned char> inserted_;
+   MMThreadLock lock_;
+};
+
+
+// Camera whose images are filled with the number of the snap
+class CountingCamera : public CCameraBase<CountingCamera>
+{
+public:
+   CountingCamera() :
+      snapCount_(0),
+      pixels_(imageWidth * imageHeight)
+   {}
+
+   virtual int Initialize() { return DEVICE_OK; }
+   virtual int Shutdown() { return DEVICE_OK; }
+   virtual void GetName(char* name) const
+   { CDeviceUtils::CopyLimitedString(name, "CountingCamera"); }
+
+   virtual int SnapImage()
+   {
+      std::fill(pixels_.begin(), pixels_.end(),
+            static_cast<unsigned char>(snapCount_++));
+      return DEVICE_OK;
+   }
+   virtual const unsigned char* GetImageBuffer() { return &pixels_[0]; }
+   virtual long GetImageBufferSize() const { return static_cast<long>(pixels_.size()); }
+   virtual unsigned GetImageWidth() const { return imageWidth; }
+   virtual unsigned GetImageHeight() const { return imageHeight; }
+   virtual unsigned GetImageBytesPerPixel() const { return 1; }
+   virtual unsigned GetBitDepth() const { return 8; }
+   virtual int GetBinning() const { return 1; }
+   virtual int SetBinning(int) { return DEVICE_OK; }
+   virtual void SetExposure(double) {}
+   virtual double GetExposure() const { return 0.0; }
+   virtual int SetROI(unsigned, unsigned, unsigned, unsigned) { return DEVICE_OK; }
+   virtual int GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize)
+   { x = y = 0; xSize = imageWidth; ySize = imageHeight; return DEVICE_OK; }
+   virtual int ClearROI() { return DEVICE_OK; }
+   virtual int IsExposureSequenceable(bool& seq) const { seq = false; return DEVICE_OK; }
+
+   using CCameraBase<CountingCamera>::SetOverlappedSequenceInsert;
+   using CCameraBase<CountingCamera>::IsOverlappedSequenceInsert;
+
+   int Run(long numImages)
+   {
+      int ret = StartSequenceAcquisition(numImages, 0.0, true);
+      if (ret != DEVICE_OK)
+         return ret;
+      while (IsCapturing())
+         CDeviceUtils::SleepMs(1);
+      return StopSequenceAcquisition();
+   }
+
+private:
+   int snapCount_;
+   std::vector<unsigned char> pixels_;
+};
+
+} // anonymous namespace
+
+
+TEST(CameraSequenceInsertTests, DirectInsertInsertsAllFrames)
+{
+   ImageRecordingCore core;
+   CountingCamera camera;
+   camera.SetCallback(&core);
+   ASSERT_EQ(DEVICE_OK, camera.Run(10));
+
+   std::vector<unsigned char> inserted = core.GetInsertedFirstBytes();
+   ASSERT_EQ(10u, inserted.size());
+   for (unsigned i = 0; i < inserted.size(); ++i)
+      EXPECT_EQ(i, inserted[i]);
+}
+
+TEST(CameraSequenceInsertTests, OverlappedInsertKeepsFramesInOrder)
+{
+   ImageRecordingCore core;
+   core.SetInsertDelayMs(2); // Slower than snapping, so Submit() blocks
+   CountingCamera camera;
+   camera.SetCallback(&core);
+   ASSERT_EQ(DEVICE_OK, camera.SetOverlappedSequenceInsert(true));
+   ASSERT_EQ(DEVICE_OK, camera.Run(20));
+
+   std::vector<unsigned char> inserted = core.GetInsertedFirstBytes();
+   ASSERT_EQ(20u, inserted.size());
+   for (unsigned i = 0; i < inserted.size(); ++i)
+      EXPECT_EQ(i, inserted[i]);
+
+   // The insert thread can be restarted for another sequence
+   ASSERT_EQ(DEVICE_OK, camera.Run(5));
+   inserted = core.GetInsertedFirstBytes();
+   ASSERT_EQ(25u, inserted.size());
+   EXPECT_EQ(24, inserted[24]);
+}
+
+TEST(CameraSequenceInsertTests, OverlappedInsertStopsOnInsertionError)
+{
+   ImageRecordingCore core;
+   core.SetFailAfter(3);
+   CountingCamera camera;
+   camera.SetCallback(&core);
+   ASSERT_EQ(DEVICE_OK, camera.SetOverlappedSequenceInsert(true));
+   ASSERT_EQ(DEVICE_OK, camera.Run(100));
+
+   // The sequence ends shortly after the error instead of running on
+   std::vector<unsigned char> inserted = core.GetInsertedFirstBytes();
+   EXPECT_EQ(3u, inserted.size());
+}
+
+TEST(CameraSequenceInsertTests, OverlappedInsertCannotChangeWhileCapturing)
+{
+   ImageRecordingCore core;
+   core.SetInsertDelayMs(1);
+   CountingCamera camera;
+   camera.SetCallback(&core);
+   ASSERT_EQ(DEVICE_OK, camera.StartSequenceAcquisition(1000, 0.0, true));
+   EXPECT_EQ(DEVICE_CAMERA_BUSY_ACQUIRING, camera.SetOverlappedSequenceInsert(true));
+   camera.StopSequenceAcquisition();
+   EXPECT_FALSE(camera.IsOverlappedSequenceInsert());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
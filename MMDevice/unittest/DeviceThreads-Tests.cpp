@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include "DeviceThreads.h"
+#include "DeviceUtils.h"
+
+
+namespace
+{
+
+// Waits on a semaphore a given number of times
+class Waiter : public MMDeviceThreadBase
+{
+public:
+   Waiter(MMThreadSemaphore& sem, int count) :
+      sem_(sem),
+      count_(count),
+      done_(0)
+   {}
+
+   int GetDone()
+   {
+      MMThreadGuard g(lock_);
+      return done_;
+   }
+
+private:
+   virtual int svc()
+   {
+      for (int i = 0; i < count_; ++i)
+      {
+         sem_.Wait();
+         MMThreadGuard g(lock_);
+         ++done_;
+      }
+      return 0;
+   }
+
+   MMThreadSemaphore& sem_;
+   int count_;
+   int done_;
+   MMThreadLock lock_;
+};
+
+} // anonymous namespace
+
+
+TEST(MMThreadSemaphoreTests, InitialCountAllowsWaits)
+{
+   MMThreadSemaphore sem(3);
+   Waiter waiter(sem, 3);
+   waiter.activate();
+   waiter.wait();
+   EXPECT_EQ(3, waiter.GetDone());
+}
+
+TEST(MMThreadSemaphoreTests, WaitBlocksUntilPost)
+{
+   MMThreadSemaphore sem;
+   Waiter waiter(sem, 2);
+   waiter.activate();
+
+   CDeviceUtils::SleepMs(20);
+   EXPECT_EQ(0, waiter.GetDone());
+   sem.Post();
+   for (int i = 0; i < 1000 && waiter.GetDone() < 1; ++i)
+      CDeviceUtils::SleepMs(1);
+   EXPECT_EQ(1, waiter.GetDone());
+
+   CDeviceUtils::SleepMs(20);
+   EXPECT_EQ(1, waiter.GetDone());
+   sem.Post();
+   waiter.wait();
+   EXPECT_EQ(2, waiter.GetDone());
+}
+
+TEST(MMThreadSemaphoreTests, PostsAreCounted)
+{
+   MMThreadSemaphore sem;
+   for (int i = 0; i < 100; ++i)
+      sem.Post();
+   Waiter waiter(sem, 100);
+   waiter.activate();
+   waiter.wait();
+   EXPECT_EQ(100, waiter.GetDone());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}